@@ -0,0 +1,172 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <QSemaphore>
+
+#include "SpscQueue.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// frames handed over per benchmark iteration, so that starting the producer thread does not show in the result
+	const int FRAME_COUNT = 10000;
+
+	struct Frame
+	{
+		int64_t number = 0;
+		uint8_t payload[64];
+	};
+
+	// stands in for the decoding or the rendering, a busy wait so that the thread stays awake like a real stage would
+	void simulateWork(int64_t microseconds)
+	{
+		if (microseconds <= 0)
+			return;
+
+		auto endTime = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+
+		while (std::chrono::steady_clock::now() < endTime) {}
+	}
+
+	// the handshake the pipeline threads used before the queues: one shared slot, and a semaphore for each direction
+	class SemaphoreSlot
+	{
+
+	public:
+
+		SemaphoreSlot()
+		{
+			frameReadSemaphore.release(1);
+		}
+
+		bool waitForFreeSlot(int timeout)
+		{
+			return frameReadSemaphore.tryAcquire(1, timeout);
+		}
+
+		Frame& back()
+		{
+			return frame;
+		}
+
+		void push()
+		{
+			frameAvailableSemaphore.release(1);
+		}
+
+		bool waitForItem(int timeout)
+		{
+			return frameAvailableSemaphore.tryAcquire(1, timeout);
+		}
+
+		Frame& front()
+		{
+			return frame;
+		}
+
+		void pop()
+		{
+			frameReadSemaphore.release(1);
+		}
+
+	private:
+
+		Frame frame;
+		QSemaphore frameReadSemaphore;
+		QSemaphore frameAvailableSemaphore;
+	};
+
+	// the same loops as the pipeline threads, with the same 100 ms timeouts
+	template <typename Queue>
+	void transferFrames(benchmark::State& state, Queue& queue)
+	{
+		int64_t producerWork = state.range(1);
+		int64_t consumerWork = state.range(2);
+
+		for (auto _ : state)
+		{
+			std::thread producer([&]()
+			{
+				for (int64_t i = 0; i < FRAME_COUNT; ++i)
+				{
+					simulateWork(producerWork);
+
+					while (!queue.waitForFreeSlot(100)) {}
+
+					Frame& frame = queue.back();
+					frame.number = i;
+					frame.payload[0] = (uint8_t)i;
+					queue.push();
+				}
+			});
+
+			int64_t checksum = 0;
+
+			for (int64_t i = 0; i < FRAME_COUNT; ++i)
+			{
+				while (!queue.waitForItem(100)) {}
+
+				checksum += queue.front().number;
+				queue.pop();
+
+				simulateWork(consumerWork);
+			}
+
+			producer.join();
+			benchmark::DoNotOptimize(checksum);
+		}
+
+		state.SetItemsProcessed(state.iterations() * FRAME_COUNT);
+	}
+
+	void semaphoreSlot(benchmark::State& state)
+	{
+		SemaphoreSlot slot;
+		transferFrames(state, slot);
+	}
+
+	void spscQueue(benchmark::State& state)
+	{
+		SpscQueue<Frame> queue;
+		queue.initialize((int)state.range(0));
+		transferFrames(state, queue);
+	}
+
+	// depth, producer work and consumer work in microseconds
+	// no work shows the cost of the handover itself, even work keeps both sides sleeping and waking, uneven work keeps one side waiting
+	void addArguments(benchmark::internal::Benchmark* benchmark, int depth)
+	{
+		benchmark->ArgNames({ "depth", "producer_us", "consumer_us" });
+		benchmark->Args({ depth, 0, 0 });
+		benchmark->Args({ depth, 20, 20 });
+		benchmark->Args({ depth, 5, 20 });
+		benchmark->Args({ depth, 20, 5 });
+		benchmark->UseRealTime();
+		benchmark->Unit(benchmark::kMillisecond);
+	}
+
+	// there is always exactly one slot
+	void setSemaphoreSlotArguments(benchmark::internal::Benchmark* benchmark)
+	{
+		addArguments(benchmark, 1);
+	}
+
+	// 2 and 3 are the default video and encoder depths
+	void setSpscQueueArguments(benchmark::internal::Benchmark* benchmark)
+	{
+		for (int depth : { 1, 2, 3, 8 })
+			addArguments(benchmark, depth);
+	}
+}
+
+BENCHMARK(semaphoreSlot)->Apply(setSemaphoreSlotArguments);
+BENCHMARK(spscQueue)->Apply(setSpscQueueArguments);
+
+BENCHMARK_MAIN();
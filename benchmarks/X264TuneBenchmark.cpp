@@ -0,0 +1,220 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+extern "C"
+{
+#include <stdint.h>
+#include "x264.h"
+}
+
+namespace
+{
+	// the default window size and encoder settings
+	const int FRAME_WIDTH = 1280;
+	const int FRAME_HEIGHT = 720;
+	const int FRAME_RATE = 30;
+	const int FRAME_COUNT = 240;
+	const char* PRESET = "veryfast";
+	const char* PROFILE = "high";
+	const float CONSTANT_RATE_FACTOR = 23.0f;
+
+	// the picture pans over a larger texture by two pixels right and down per frame (one in chroma), so that there is real motion to search
+	const int PAN_X = 2;
+	const int PAN_Y = 2;
+
+	// smooth shapes like a map with some grain like a video, fixed so that every run encodes the same frames
+	class SyntheticClip
+	{
+
+	public:
+
+		SyntheticClip()
+		{
+			uint32_t seed = 12345;
+
+			for (int plane = 0; plane < 3; ++plane)
+			{
+				int divisor = (plane == 0) ? 1 : 2;
+				planeWidths[plane] = (FRAME_WIDTH + PAN_X * FRAME_COUNT) / divisor;
+				planeHeights[plane] = (FRAME_HEIGHT + PAN_Y * FRAME_COUNT) / divisor;
+				planes[plane].resize((size_t)planeWidths[plane] * planeHeights[plane]);
+
+				for (int y = 0; y < planeHeights[plane]; ++y)
+				{
+					for (int x = 0; x < planeWidths[plane]; ++x)
+					{
+						double fx = (double)x * divisor;
+						double fy = (double)y * divisor;
+						double value = 128.0;
+
+						if (plane == 0)
+						{
+							seed = seed * 1664525 + 1013904223;
+							double grain = (int)(seed >> 28) - 8;
+
+							value += 60.0 * sin(fx / 37.0) + 40.0 * sin(fy / 23.0 + fx / 91.0) + grain;
+						}
+						else
+							value += 30.0 * sin((plane == 1 ? fx : fy) / 150.0);
+
+						planes[plane][(size_t)y * planeWidths[plane] + x] = (uint8_t)std::min(std::max(value, 16.0), 235.0);
+					}
+				}
+			}
+		}
+
+		// x264 copies the picture in, so the planes can point straight into the texture
+		void setPicture(x264_picture_t& picture, int frameIndex) const
+		{
+			picture.img.i_csp = X264_CSP_I420;
+			picture.img.i_plane = 3;
+			picture.i_pts = frameIndex;
+
+			for (int plane = 0; plane < 3; ++plane)
+			{
+				int divisor = (plane == 0) ? 1 : 2;
+				size_t offset = (size_t)(frameIndex * PAN_Y / divisor) * planeWidths[plane] + frameIndex * PAN_X / divisor;
+
+				picture.img.plane[plane] = const_cast<uint8_t*>(planes[plane].data()) + offset;
+				picture.img.i_stride[plane] = planeWidths[plane];
+			}
+		}
+
+	private:
+
+		std::vector<uint8_t> planes[3];
+		int planeWidths[3];
+		int planeHeights[3];
+	};
+
+	// the same parameters as X264Backend without the encode cache or fragments
+	x264_t* openEncoder(const char* tune)
+	{
+		x264_param_t param;
+
+		if (x264_param_default_preset(&param, PRESET, (tune[0] != '\0') ? tune : nullptr) < 0)
+			return nullptr;
+
+		param.i_width = FRAME_WIDTH;
+		param.i_height = FRAME_HEIGHT;
+		param.i_fps_num = FRAME_RATE;
+		param.i_fps_den = 1;
+		param.i_timebase_num = 1;
+		param.i_timebase_den = FRAME_RATE;
+		param.i_csp = X264_CSP_I420;
+		param.rc.i_rc_method = X264_RC_CRF;
+		param.rc.f_rf_constant = CONSTANT_RATE_FACTOR;
+		param.i_log_level = X264_LOG_NONE;
+
+		// costs the same with both tunes, like encoder/enableQualityMetrics
+		param.analyse.b_psnr = 1;
+		param.analyse.b_ssim = 1;
+
+		x264_param_apply_fastfirstpass(&param);
+
+		if (x264_param_apply_profile(&param, PROFILE) < 0)
+			return nullptr;
+
+		param.b_annexb = 0;
+		param.b_repeat_headers = 0;
+
+		return x264_encoder_open(&param);
+	}
+
+	struct EncodeStatistics
+	{
+		int64_t frameCount = 0;
+		int64_t byteCount = 0;
+		double psnrSum = 0.0;
+		double ssimSum = 0.0;
+
+		void add(int frameSize, const x264_picture_t& encodedPicture)
+		{
+			frameCount++;
+			byteCount += frameSize;
+			psnrSum += encodedPicture.prop.f_psnr_avg;
+			ssimSum += encodedPicture.prop.f_ssim;
+		}
+	};
+
+	// the whole clip per iteration, including the frames the lookahead still holds at the end
+	void encodeClip(benchmark::State& state, const char* tune)
+	{
+		static const SyntheticClip clip;
+		EncodeStatistics statistics;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			x264_t* encoder = openEncoder(tune);
+			state.ResumeTiming();
+
+			if (encoder == nullptr)
+			{
+				state.SkipWithError("Could not open encoder");
+				return;
+			}
+
+			x264_picture_t inputPicture;
+			x264_picture_t encodedPicture;
+			x264_nal_t* nal;
+			int nalCount;
+			bool isFailed = false;
+
+			for (int i = 0; i < FRAME_COUNT && !isFailed; ++i)
+			{
+				x264_picture_init(&inputPicture);
+				clip.setPicture(inputPicture, i);
+
+				int frameSize = x264_encoder_encode(encoder, &nal, &nalCount, &inputPicture, &encodedPicture);
+
+				if (frameSize > 0)
+					statistics.add(frameSize, encodedPicture);
+
+				isFailed = (frameSize < 0);
+			}
+
+			while (!isFailed && x264_encoder_delayed_frames(encoder) > 0)
+			{
+				int frameSize = x264_encoder_encode(encoder, &nal, &nalCount, nullptr, &encodedPicture);
+
+				if (frameSize > 0)
+					statistics.add(frameSize, encodedPicture);
+
+				isFailed = (frameSize < 0);
+			}
+
+			state.PauseTiming();
+			x264_encoder_close(encoder);
+			state.ResumeTiming();
+
+			if (isFailed)
+			{
+				state.SkipWithError("Could not encode frame");
+				return;
+			}
+		}
+
+		if (statistics.frameCount == 0)
+			return;
+
+		double clipDuration = (double)FRAME_COUNT / FRAME_RATE;
+
+		state.counters["frames"] = benchmark::Counter((double)statistics.frameCount, benchmark::Counter::kIsRate);
+		state.counters["psnr_db"] = statistics.psnrSum / statistics.frameCount;
+		state.counters["ssim"] = statistics.ssimSum / statistics.frameCount;
+		state.counters["kbit_per_s"] = statistics.byteCount * 8.0 / 1000.0 / clipDuration / state.iterations();
+	}
+}
+
+BENCHMARK_CAPTURE(encodeClip, zerolatency, "zerolatency")->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(encodeClip, default, "")->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
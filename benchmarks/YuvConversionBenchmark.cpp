@@ -0,0 +1,124 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+#include "FrameData.h"
+#include "YuvConverter.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const int FRAME_WIDTH = 3840;
+	const int FRAME_HEIGHT = 2160;
+
+	// a fixed 4K frame, with gradients so that no two neighbouring pixels are alike
+	class ConversionFixture : public benchmark::Fixture
+	{
+
+	public:
+
+		void SetUp(const benchmark::State&)
+		{
+			pixels.resize((size_t)FRAME_WIDTH * FRAME_HEIGHT * 4);
+
+			for (int y = 0; y < FRAME_HEIGHT; ++y)
+			{
+				for (int x = 0; x < FRAME_WIDTH; ++x)
+				{
+					uint8_t* pixel = &pixels[((size_t)y * FRAME_WIDTH + x) * 4];
+
+					pixel[0] = (uint8_t)(x * 255 / FRAME_WIDTH);
+					pixel[1] = (uint8_t)(y * 255 / FRAME_HEIGHT);
+					pixel[2] = (uint8_t)((x + y) & 0xff);
+					pixel[3] = 255;
+				}
+			}
+
+			frameData = FrameData();
+			frameData.data = pixels.data();
+			frameData.width = FRAME_WIDTH;
+			frameData.height = FRAME_HEIGHT;
+			frameData.rowLength = (size_t)FRAME_WIDTH * 4;
+			frameData.dataLength = pixels.size();
+
+			// allocated the same way as the pictures of the encoder
+			picture = av_frame_alloc();
+			picture->format = AV_PIX_FMT_YUV420P;
+			picture->width = FRAME_WIDTH;
+			picture->height = FRAME_HEIGHT;
+			av_frame_get_buffer(picture, 0);
+		}
+
+		void TearDown(const benchmark::State&)
+		{
+			av_frame_free(&picture);
+			pixels.clear();
+		}
+
+	protected:
+
+		std::vector<uint8_t> pixels;
+		FrameData frameData;
+		AVFrame* picture = nullptr;
+	};
+
+	void setConversionCounters(benchmark::State& state)
+	{
+		state.SetItemsProcessed(state.iterations());
+		state.SetBytesProcessed(state.iterations() * (int64_t)FRAME_WIDTH * FRAME_HEIGHT * 4);
+	}
+}
+
+// the same context as the encoder uses with encoder/useSwscale, on one thread
+BENCHMARK_DEFINE_F(ConversionFixture, swscale)(benchmark::State& state)
+{
+	SwsContext* swsContext = sws_getContext(FRAME_WIDTH, FRAME_HEIGHT, AV_PIX_FMT_RGBA, FRAME_WIDTH, FRAME_HEIGHT, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+	if (swsContext == nullptr)
+	{
+		state.SkipWithError("Could not get sws context");
+		return;
+	}
+
+	int rowLength = (int)frameData.rowLength;
+
+	for (auto _ : state)
+	{
+		sws_scale(swsContext, &frameData.data, &rowLength, 0, frameData.height, picture->data, picture->linesize);
+		benchmark::ClobberMemory();
+	}
+
+	sws_freeContext(swsContext);
+	setConversionCounters(state);
+}
+
+// the band count is the thread count, the calling thread converts one band itself
+BENCHMARK_DEFINE_F(ConversionFixture, yuvConverter)(benchmark::State& state)
+{
+	YuvConverter yuvConverter;
+	yuvConverter.initialize((int)state.range(0));
+
+	for (auto _ : state)
+	{
+		yuvConverter.convert(frameData, picture);
+		benchmark::ClobberMemory();
+	}
+
+	setConversionCounters(state);
+}
+
+BENCHMARK_REGISTER_F(ConversionFixture, swscale)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_REGISTER_F(ConversionFixture, yuvConverter)->ArgName("bands")->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
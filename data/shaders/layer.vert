@@ -0,0 +1,12 @@
+#version 120
+
+attribute vec2 vertexPosition;
+attribute vec2 vertexTextureCoordinate;
+
+varying vec2 textureCoordinate;
+
+void main()
+{
+	gl_Position = vec4(vertexPosition, 0.0, 1.0);
+	textureCoordinate = vertexTextureCoordinate;
+}
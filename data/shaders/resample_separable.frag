@@ -0,0 +1,34 @@
+#version 330
+
+// one pass of the separable version of rescale_bicubic.frag
+// the output covers the same area as the input, only the size along the direction changes
+
+uniform sampler2D textureSampler;
+uniform sampler2D weightSampler;
+uniform vec2 textureSize;
+uniform vec2 direction;
+uniform float phaseCount;
+
+in vec2 textureCoordinate;
+
+out vec4 color;
+
+void main()
+{
+	// position along the direction in input texels, texel centers are at whole numbers
+	// shifted by one texel from the usual convention, to follow the snapping of rescale_bicubic.frag (and of the software compositor)
+	float position = dot(textureCoordinate * textureSize, direction) + 0.5f;
+	float base = floor(position);
+	float phase = position - base;
+
+	// normalized weights of the taps -1, 0, 1 and 2 for this phase
+	vec4 weights = texture(weightSampler, vec2((phase * phaseCount + 0.5f) / phaseCount, 0.5f));
+
+	vec2 texelStep = direction / textureSize;
+	vec2 baseCoordinate = mix(textureCoordinate, (vec2(base, base) + 0.5f) / textureSize, direction);
+
+	color = weights.x * texture(textureSampler, baseCoordinate - texelStep) +
+		weights.y * texture(textureSampler, baseCoordinate) +
+		weights.z * texture(textureSampler, baseCoordinate + texelStep) +
+		weights.w * texture(textureSampler, baseCoordinate + 2.0f * texelStep);
+}
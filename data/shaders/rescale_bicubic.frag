@@ -10,12 +10,16 @@ in vec2 textureCoordinate;
 
 out vec3 color;
 
-// select one
+// select one (can be overridden with the rescale shader defines setting)
 // triangle, bell, bspline, catmullrom, lanczos
+#ifndef INTERPOLATION_FUNCTION
 #define INTERPOLATION_FUNCTION lanczos
+#endif
 
 // can be tuned (1.0f - 3.0f)
+#ifndef LANCZOS_SIZE
 #define LANCZOS_SIZE 2.0f
+#endif
 
 // don't touch
 #define PI 3.14159265f
@@ -0,0 +1,493 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMap>
+#include <QSettings>
+#include <QTextStream>
+#include <QThread>
+
+#include "BatchScheduler.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const int PROGRESS_INTERVAL = 1000;
+
+	// a job never gets fewer cores than this (unless the whole limit is smaller), and no more than the encoder can make use of
+	const int MINIMUM_ENCODE_CORES = 4;
+	const int MINIMUM_STABILIZE_CORES = 2;
+	const int MAXIMUM_JOB_CORES = 16;
+
+	// Qt, FFmpeg, OpenCV and the OpenGL driver, before any frame buffers
+	const double BASE_JOB_MEMORY = 150.0;
+
+	// the reference and lookahead frames x264 keeps in addition to one frame per thread
+	const int ENCODER_EXTRA_FRAME_COUNT = 16;
+
+	// the lookahead of the slower presets when the zerolatency tune is not used
+	const int ENCODER_LOOKAHEAD_FRAME_COUNT = 60;
+
+	// the lines of the child processes are made of key=value pairs after the line type
+	QMap<QString, QString> parseOutputLine(const QString& line)
+	{
+		QMap<QString, QString> values;
+		QStringList parts = line.split(' ', QString::SkipEmptyParts);
+
+		for (int i = 1; i < parts.size(); ++i)
+			values[parts[i].section('=', 0, 0)] = parts[i].section('=', 1);
+
+		return values;
+	}
+}
+
+BatchScheduler::~BatchScheduler()
+{
+	for (BatchJob& batchJob : batchJobs)
+	{
+		if (batchJob.process != nullptr && batchJob.process->state() != QProcess::NotRunning)
+		{
+			batchJob.process->kill();
+			batchJob.process->waitForFinished();
+		}
+	}
+}
+
+const char* BatchScheduler::getStateName(JobState state)
+{
+	switch (state)
+	{
+		case JobState::Queued: return "queued";
+		case JobState::Running: return "running";
+		case JobState::Succeeded: return "ok";
+		case JobState::Failed: return "failed";
+		case JobState::Skipped: return "skipped";
+		default: return "unknown";
+	}
+}
+
+int BatchScheduler::run(const QString& jobListFilePath, const QStringList& arguments)
+{
+	if (!parseArguments(arguments))
+	{
+		HeadlessRunner::printUsage();
+		return ExitUsageError;
+	}
+
+	if (!readJobList(jobListFilePath))
+		return ExitUsageError;
+
+	qDebug("Running %d batch jobs with %d cores and %.0f MB of memory", (int)batchJobs.size(), coreLimit, memoryLimit);
+
+	fprintf(stdout, "batch-start jobs=%d cores=%d memory_mb=%.0f\n", (int)batchJobs.size(), coreLimit, memoryLimit);
+	fflush(stdout);
+
+	batchTimer.start();
+
+	connect(&progressTimer, &QTimer::timeout, this, &BatchScheduler::printProgress);
+	progressTimer.start(PROGRESS_INTERVAL);
+
+	startJobs();
+
+	bool isRunning = std::any_of(batchJobs.begin(), batchJobs.end(), [](const BatchJob& batchJob) { return batchJob.state == JobState::Running; });
+
+	if (isRunning)
+		eventLoop.exec();
+
+	progressTimer.stop();
+	printProgress();
+
+	return printResult();
+}
+
+bool BatchScheduler::parseArguments(const QStringList& arguments)
+{
+	coreLimit = QThread::idealThreadCount();
+	memoryLimit = 0.0;
+
+	for (const QString& argument : arguments)
+	{
+		QString name = argument.section('=', 0, 0);
+		QString value = argument.section('=', 1);
+		bool isValid = false;
+
+		if (name == "--cores")
+			coreLimit = value.toInt(&isValid);
+		else if (name == "--memory")
+			memoryLimit = value.toDouble(&isValid);
+
+		if (!isValid)
+		{
+			fprintf(stderr, "Invalid option: %s\n", qPrintable(argument));
+			return false;
+		}
+	}
+
+	coreLimit = std::max(1, coreLimit);
+	memoryLimit = std::max(0.0, memoryLimit);
+
+	return true;
+}
+
+bool BatchScheduler::readJobList(const QString& jobListFilePath)
+{
+	QFile file(jobListFilePath);
+
+	if (!file.open(QFile::ReadOnly | QFile::Text))
+	{
+		fprintf(stdout, "error job=batch message=\"Could not open job list %s\"\n", qPrintable(jobListFilePath));
+		fflush(stdout);
+		return false;
+	}
+
+	// one job per line: the job type without the dashes and the settings file, relative to the job list
+	QDir jobListDirectory = QFileInfo(jobListFilePath).absoluteDir();
+	QTextStream stream(&file);
+	int lineNumber = 0;
+
+	while (!stream.atEnd())
+	{
+		QString line = stream.readLine().trimmed();
+		lineNumber++;
+
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+
+		BatchJob batchJob;
+		batchJob.job = HeadlessRunner::parseJob(QString("--%1").arg(line.section(' ', 0, 0)));
+		batchJob.iniFilePath = jobListDirectory.absoluteFilePath(line.section(' ', 1).trimmed());
+
+		if (batchJob.job == HeadlessJob::None || batchJob.job == HeadlessJob::Batch || !QFile::exists(batchJob.iniFilePath))
+		{
+			fprintf(stdout, "error job=batch message=\"Invalid job on line %d of %s\"\n", lineNumber, qPrintable(jobListFilePath));
+			fflush(stdout);
+			return false;
+		}
+
+		estimateMemory(batchJob);
+		batchJobs.push_back(std::move(batchJob));
+	}
+
+	if (batchJobs.empty())
+	{
+		fprintf(stdout, "error job=batch message=\"No jobs in %s\"\n", qPrintable(jobListFilePath));
+		fflush(stdout);
+		return false;
+	}
+
+	return true;
+}
+
+void BatchScheduler::estimateMemory(BatchJob& batchJob)
+{
+	Settings settings;
+	QSettings iniFileSettings(batchJob.iniFilePath, QSettings::IniFormat);
+	settings.readFromQSettings(&iniFileSettings);
+
+	batchJob.memoryEstimate = BASE_JOB_MEMORY;
+
+	if (batchJob.job != HeadlessJob::Encode)
+		return;
+
+	// a rough upper bound, the decoded frames are assumed to be about the size of the output
+	double frameSize = settings.window.width * settings.window.height * 4.0 / 1000000.0;
+	int decodedFrameCount = settings.video.frameQueueDepth + settings.stabilizer.frameQueueDepth + std::max(1, settings.video.decoderThreadCount);
+	int renderedFrameCount = settings.encoder.frameQueueDepth + 2;
+	int encodedFrameCount = std::max(MAXIMUM_JOB_CORES, settings.encoder.threadCount) + ENCODER_EXTRA_FRAME_COUNT;
+
+	if (!settings.encoder.tune.contains("zerolatency"))
+		encodedFrameCount += ENCODER_LOOKAHEAD_FRAME_COUNT;
+
+	batchJob.memoryEstimate += frameSize * (decodedFrameCount + renderedFrameCount);
+	batchJob.memoryEstimate += frameSize * 0.375 * encodedFrameCount; // YUV 4:2:0
+	batchJob.memoryEstimate += std::max(1, settings.encoder.writeBufferSize) * std::max(1, settings.encoder.writeBufferCount);
+
+	// the map is kept as an image and as a texture
+	QSize mapSize = QImageReader(settings.map.imageFilePath).size();
+
+	if (mapSize.isValid())
+		batchJob.memoryEstimate += mapSize.width() * mapSize.height() * 4.0 * 2.0 / 1000000.0;
+}
+
+void BatchScheduler::assignThreads(BatchJob& batchJob, int coreCount)
+{
+	batchJob.coreCount = coreCount;
+	batchJob.decoderThreadCount = 0;
+	batchJob.encoderThreadCount = 0;
+	batchJob.stabilizerThreadCount = 0;
+
+	if (batchJob.job == HeadlessJob::Encode)
+	{
+		// one core is left for the renderer and the stabilizer stage
+		batchJob.decoderThreadCount = std::max(1, coreCount / 4);
+		batchJob.encoderThreadCount = std::max(1, coreCount - batchJob.decoderThreadCount - 1);
+		batchJob.stabilizerThreadCount = 1;
+	}
+	else if (batchJob.job == HeadlessJob::Stabilize)
+	{
+		batchJob.decoderThreadCount = std::max(1, coreCount / 2);
+		batchJob.stabilizerThreadCount = std::max(1, coreCount - batchJob.decoderThreadCount);
+	}
+}
+
+bool BatchScheduler::getIsReady(size_t index) const
+{
+	// the earlier jobs of the same settings file have to succeed first, so that a stabilize, pass two, encode chain runs in order
+	for (size_t i = 0; i < index; ++i)
+	{
+		if (batchJobs[i].iniFilePath == batchJobs[index].iniFilePath && batchJobs[i].state != JobState::Succeeded)
+			return false;
+	}
+
+	return true;
+}
+
+void BatchScheduler::startJobs()
+{
+	for (size_t i = 0; i < batchJobs.size(); ++i)
+	{
+		BatchJob& batchJob = batchJobs[i];
+
+		if (batchJob.state != JobState::Queued)
+			continue;
+
+		// the chain of a failed job is not continued
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (batchJobs[j].iniFilePath == batchJob.iniFilePath && (batchJobs[j].state == JobState::Failed || batchJobs[j].state == JobState::Skipped))
+			{
+				batchJob.state = JobState::Skipped;
+
+				fprintf(stdout, "job-result index=%d job=%s status=skipped\n", (int)i + 1, HeadlessRunner::getJobName(batchJob.job));
+				fflush(stdout);
+
+				break;
+			}
+		}
+	}
+
+	std::vector<size_t> readyIndices;
+
+	for (size_t i = 0; i < batchJobs.size(); ++i)
+	{
+		if (batchJobs[i].state == JobState::Queued && getIsReady(i))
+			readyIndices.push_back(i);
+	}
+
+	for (size_t i = 0; i < readyIndices.size(); ++i)
+	{
+		BatchJob& batchJob = batchJobs[readyIndices[i]];
+
+		// a job that failed to start finishes right away and starts the others itself
+		if (batchJob.state != JobState::Queued)
+			continue;
+
+		int freeCoreCount = coreLimit - usedCoreCount;
+		int remainingJobCount = (int)(readyIndices.size() - i);
+		int minimumCoreCount = (batchJob.job == HeadlessJob::Encode) ? MINIMUM_ENCODE_CORES : (batchJob.job == HeadlessJob::Stabilize) ? MINIMUM_STABILIZE_CORES : 1;
+		minimumCoreCount = std::min(minimumCoreCount, coreLimit);
+
+		// the free cores are shared evenly between the jobs that could start now
+		int coreCount = std::max(minimumCoreCount, std::min(freeCoreCount / remainingJobCount, MAXIMUM_JOB_CORES));
+
+		bool isIdle = (usedCoreCount == 0);
+		bool hasCores = (coreCount <= freeCoreCount);
+		bool hasMemory = (memoryLimit <= 0.0 || usedMemory + batchJob.memoryEstimate <= memoryLimit);
+
+		// one job always runs, even if it alone is over the limits
+		if (!isIdle && (!hasCores || !hasMemory))
+			continue;
+
+		if (isIdle && !hasMemory)
+			qWarning("Batch job %d needs about %.0f MB, more than the memory limit", (int)readyIndices[i] + 1, batchJob.memoryEstimate);
+
+		startJob(readyIndices[i], std::min(coreCount, coreLimit));
+	}
+}
+
+void BatchScheduler::startJob(size_t index, int coreCount)
+{
+	BatchJob& batchJob = batchJobs[index];
+
+	assignThreads(batchJob, coreCount);
+
+	QStringList arguments;
+	arguments << QString("--%1").arg(HeadlessRunner::getJobName(batchJob.job)) << batchJob.iniFilePath;
+
+	if (batchJob.decoderThreadCount > 0)
+		arguments << QString("--decoder-threads=%1").arg(batchJob.decoderThreadCount);
+
+	if (batchJob.encoderThreadCount > 0)
+		arguments << QString("--encoder-threads=%1").arg(batchJob.encoderThreadCount);
+
+	if (batchJob.stabilizerThreadCount > 0)
+		arguments << QString("--stabilizer-threads=%1").arg(batchJob.stabilizerThreadCount);
+
+	// every job logs next to its settings file, the shared log would be truncated by each of them
+	QFileInfo iniFileInfo(batchJob.iniFilePath);
+	arguments << QString("--log-file=%1").arg(iniFileInfo.absoluteDir().absoluteFilePath(QString("%1-%2.log").arg(iniFileInfo.completeBaseName(), HeadlessRunner::getJobName(batchJob.job))));
+
+	batchJob.process.reset(new QProcess());
+	batchJob.process->setStandardErrorFile(QProcess::nullDevice());
+
+	connect(batchJob.process.get(), &QProcess::readyReadStandardOutput, this, [this, index]() { readJobOutput(index); });
+	connect(batchJob.process.get(), static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this, [this, index](int exitCode, QProcess::ExitStatus exitStatus) { jobFinished(index, (exitStatus == QProcess::NormalExit) ? exitCode : ExitProcessingError); });
+	connect(batchJob.process.get(), &QProcess::errorOccurred, this, [this, index](QProcess::ProcessError error) { if (error == QProcess::FailedToStart) jobFinished(index, ExitInitializationError); });
+
+	batchJob.state = JobState::Running;
+	batchJob.runTimer.start();
+	usedCoreCount += batchJob.coreCount;
+	usedMemory += batchJob.memoryEstimate;
+
+	fprintf(stdout, "job-start index=%d job=%s ini=%s cores=%d decoder_threads=%d encoder_threads=%d stabilizer_threads=%d memory_mb=%.0f\n",
+		(int)index + 1,
+		HeadlessRunner::getJobName(batchJob.job),
+		qPrintable(QDir::toNativeSeparators(batchJob.iniFilePath)),
+		batchJob.coreCount,
+		batchJob.decoderThreadCount,
+		batchJob.encoderThreadCount,
+		batchJob.stabilizerThreadCount,
+		batchJob.memoryEstimate);
+
+	fflush(stdout);
+
+	batchJob.process->start(QCoreApplication::applicationFilePath(), arguments);
+}
+
+void BatchScheduler::readJobOutput(size_t index)
+{
+	BatchJob& batchJob = batchJobs[index];
+
+	batchJob.outputBuffer.append(batchJob.process->readAllStandardOutput());
+
+	int lineEnd = 0;
+
+	while ((lineEnd = batchJob.outputBuffer.indexOf('\n')) >= 0)
+	{
+		QString line = QString::fromUtf8(batchJob.outputBuffer.left(lineEnd)).trimmed();
+		batchJob.outputBuffer.remove(0, lineEnd + 1);
+
+		if (line.startsWith("progress "))
+		{
+			QMap<QString, QString> values = parseOutputLine(line);
+			batchJob.processedFrameCount = values.value("frame").toInt();
+			batchJob.framesPerSecond = values.value("fps").toDouble();
+		}
+		else if (line.startsWith("result "))
+			batchJob.processedFrameCount = parseOutputLine(line).value("frames").toInt();
+		else if (line.startsWith("error "))
+			qWarning("Batch job %d: %s", (int)index + 1, qPrintable(line));
+	}
+}
+
+void BatchScheduler::jobFinished(size_t index, int exitCode)
+{
+	BatchJob& batchJob = batchJobs[index];
+
+	// a process that failed to start can report both an error and finishing
+	if (batchJob.state != JobState::Running)
+		return;
+
+	readJobOutput(index);
+
+	batchJob.state = (exitCode == ExitSuccess) ? JobState::Succeeded : JobState::Failed;
+	batchJob.exitCode = exitCode;
+	batchJob.framesPerSecond = 0.0;
+	usedCoreCount -= batchJob.coreCount;
+	usedMemory -= batchJob.memoryEstimate;
+
+	double elapsedSeconds = batchJob.runTimer.elapsed() / 1000.0;
+
+	fprintf(stdout, "job-result index=%d job=%s status=%s exit=%d frames=%d elapsed=%.3f fps=%.2f\n",
+		(int)index + 1,
+		HeadlessRunner::getJobName(batchJob.job),
+		getStateName(batchJob.state),
+		exitCode,
+		batchJob.processedFrameCount,
+		elapsedSeconds,
+		(elapsedSeconds > 0.0) ? batchJob.processedFrameCount / elapsedSeconds : 0.0);
+
+	fflush(stdout);
+
+	startJobs();
+
+	bool isRunning = std::any_of(batchJobs.begin(), batchJobs.end(), [](const BatchJob& job) { return job.state == JobState::Running; });
+
+	if (!isRunning)
+		eventLoop.quit();
+}
+
+void BatchScheduler::printProgress()
+{
+	int stateCounts[5] = { 0, 0, 0, 0, 0 };
+	int totalFrameCount = 0;
+	double currentFramesPerSecond = 0.0;
+
+	for (const BatchJob& batchJob : batchJobs)
+	{
+		stateCounts[(int)batchJob.state]++;
+		totalFrameCount += batchJob.processedFrameCount;
+
+		if (batchJob.state == JobState::Running)
+			currentFramesPerSecond += batchJob.framesPerSecond;
+	}
+
+	double elapsedSeconds = batchTimer.elapsed() / 1000.0;
+
+	fprintf(stdout, "batch elapsed=%.3f queued=%d running=%d succeeded=%d failed=%d skipped=%d cores=%d/%d memory_mb=%.0f/%.0f frames=%d fps=%.2f current_fps=%.2f\n",
+		elapsedSeconds,
+		stateCounts[(int)JobState::Queued],
+		stateCounts[(int)JobState::Running],
+		stateCounts[(int)JobState::Succeeded],
+		stateCounts[(int)JobState::Failed],
+		stateCounts[(int)JobState::Skipped],
+		usedCoreCount,
+		coreLimit,
+		usedMemory,
+		memoryLimit,
+		totalFrameCount,
+		(elapsedSeconds > 0.0) ? totalFrameCount / elapsedSeconds : 0.0,
+		currentFramesPerSecond);
+
+	fflush(stdout);
+}
+
+int BatchScheduler::printResult()
+{
+	int succeededCount = 0;
+	int totalFrameCount = 0;
+
+	for (const BatchJob& batchJob : batchJobs)
+	{
+		if (batchJob.state == JobState::Succeeded)
+			succeededCount++;
+
+		totalFrameCount += batchJob.processedFrameCount;
+	}
+
+	double elapsedSeconds = batchTimer.elapsed() / 1000.0;
+	bool isSuccess = (succeededCount == (int)batchJobs.size());
+
+	fprintf(stdout, "batch-result status=%s jobs=%d succeeded=%d frames=%d elapsed=%.3f fps=%.2f\n",
+		isSuccess ? "ok" : "failed",
+		(int)batchJobs.size(),
+		succeededCount,
+		totalFrameCount,
+		elapsedSeconds,
+		(elapsedSeconds > 0.0) ? totalFrameCount / elapsedSeconds : 0.0);
+
+	fflush(stdout);
+
+	qDebug("Batch finished: %d of %d jobs succeeded in %.1f s", succeededCount, (int)batchJobs.size(), elapsedSeconds);
+
+	return isSuccess ? ExitSuccess : ExitProcessingError;
+}
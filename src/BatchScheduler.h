@@ -0,0 +1,84 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include "HeadlessRunner.h"
+
+namespace OrientView
+{
+	// Run the jobs of a job list as command line child processes, as many at a time as the core and memory limits allow.
+	class BatchScheduler : public QObject
+	{
+		Q_OBJECT
+
+	public:
+
+		~BatchScheduler();
+
+		int run(const QString& jobListFilePath, const QStringList& arguments);
+
+	private:
+
+		enum class JobState { Queued, Running, Succeeded, Failed, Skipped };
+
+		struct BatchJob
+		{
+			HeadlessJob job = HeadlessJob::None;
+			QString iniFilePath;
+			JobState state = JobState::Queued;
+
+			int coreCount = 0;
+			int decoderThreadCount = 0;
+			int encoderThreadCount = 0;
+			int stabilizerThreadCount = 0;
+			double memoryEstimate = 0.0; // megabytes
+
+			std::unique_ptr<QProcess> process;
+			QByteArray outputBuffer;
+			QElapsedTimer runTimer;
+			int exitCode = 0;
+			int processedFrameCount = 0;
+			double framesPerSecond = 0.0;
+		};
+
+		static const char* getStateName(JobState state);
+
+		bool parseArguments(const QStringList& arguments);
+		bool readJobList(const QString& jobListFilePath);
+		void estimateMemory(BatchJob& batchJob);
+		void assignThreads(BatchJob& batchJob, int coreCount);
+
+		bool getIsReady(size_t index) const;
+		void startJobs();
+		void startJob(size_t index, int coreCount);
+		void readJobOutput(size_t index);
+		void jobFinished(size_t index, int exitCode);
+
+		void printProgress();
+		int printResult();
+
+		std::vector<BatchJob> batchJobs;
+
+		int coreLimit = 0;
+		double memoryLimit = 0.0; // megabytes, zero means no limit
+		int usedCoreCount = 0;
+		double usedMemory = 0.0;
+
+		QElapsedTimer batchTimer;
+		QTimer progressTimer;
+		QEventLoop eventLoop;
+	};
+}
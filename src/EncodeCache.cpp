@@ -0,0 +1,470 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainterPath>
+#include <QSettings>
+#include <QStringList>
+#include <QTemporaryFile>
+
+extern "C"
+{
+#include <stdint.h>
+#include "x264.h"
+}
+
+#include "EncodeCache.h"
+#include "RouteManager.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const quint32 CACHE_FILE_MAGIC = 0x4f564543; // "OVEC"
+	const quint32 CACHE_FILE_VERSION = 1;
+
+	// these either don't change the output at all, or their effect is hashed frame by frame through the route state
+	const char* EXCLUDED_SETTINGS[] =
+	{
+		"route/controlTimeOffset",
+		"route/runnerTimeOffset",
+		"splits/type",
+		"splits/splitTimes",
+		"video/enableVerboseLogging",
+		"video/frameQueueDepth",
+		"video/decoderThreadCount",
+		"window/fullscreen",
+		"window/hideCursor",
+		"renderer/softwareThreadCount",
+		"renderer/enableGpuTimers",
+		"stabilizer/frameQueueDepth",
+		"stabilizer/threadCount",
+		"encoder/outputVideoFilePath",
+		"encoder/frameQueueDepth",
+		"encoder/threadCount",
+		"inputHandler/",
+		"trace/"
+	};
+
+	bool isExcludedSetting(const QString& key)
+	{
+		for (const char* excludedSetting : EXCLUDED_SETTINGS)
+		{
+			QString excludedKey = QString(excludedSetting);
+
+			if (excludedKey.endsWith('/') ? key.startsWith(excludedKey) : key == excludedKey)
+				return true;
+		}
+
+		return false;
+	}
+}
+
+bool EncodeCache::initialize(Settings* settings)
+{
+	outputFilePath = settings->encoder.outputVideoFilePath;
+	cacheFilePath = outputFilePath + ".cache";
+	previousOutputFilePath = outputFilePath + ".previous";
+	gopLength = settings->encoder.cacheGopLength;
+
+	if (gopLength < 1)
+	{
+		qWarning("Could not use encode cache GOP length %d", gopLength);
+		return false;
+	}
+
+	settingsHash = calculateSettingsHash(settings);
+
+	if (settingsHash.isEmpty())
+		return false;
+
+	// left over from an interrupted encode
+	QFile::remove(previousOutputFilePath);
+
+	if (readCacheFile() && QFile::exists(outputFilePath))
+	{
+		if (QFile::rename(outputFilePath, previousOutputFilePath))
+			hasPreviousOutput = openPreviousOutput();
+		else
+			qWarning("Could not move the previous output aside");
+	}
+
+	// the cache file describes the output that is about to be overwritten
+	QFile::remove(cacheFilePath);
+
+	qDebug("Encode cache: GOP length %d, %s", gopLength, hasPreviousOutput ? "reusing the previous output" : "encoding everything");
+
+	return true;
+}
+
+EncodeCache::~EncodeCache()
+{
+	if (previousFormatContext != nullptr)
+		avformat_close_input(&previousFormatContext);
+}
+
+bool EncodeCache::getIsReused(int64_t frameIndex, const RouteManager* routeManager, double frameDuration)
+{
+	// GOPs are decided in pairs, x264 alternates the IDR picture id and skipping an even number of IDRs keeps the neighbouring ids different
+	int64_t pairIndex = frameIndex / (2 * gopLength);
+
+	if (pairIndex != currentPairIndex)
+	{
+		currentPairIndex = pairIndex;
+		isCurrentPairReused = checkGopPair(pairIndex, routeManager, frameDuration);
+	}
+
+	bool isReused = isCurrentPairReused && frameIndex < (int64_t)previousFrameTimes.size();
+
+	if (isReused)
+	{
+		reusedFrameCount++;
+
+		if (frameIndex % gopLength == 0)
+			reusedGopCount++;
+	}
+
+	return isReused;
+}
+
+void EncodeCache::recordFrame(int64_t frameIndex, double frameTime, RouteManager* routeManager)
+{
+	if (frameIndex % gopLength == 0)
+	{
+		gopHash.reset();
+		gopHash.addData(settingsHash);
+	}
+
+	frameTimes.push_back(frameTime);
+
+	gopHash.addData((const char*)&frameTime, sizeof(frameTime));
+	addRouteState(gopHash, *routeManager);
+
+	if ((frameIndex + 1) % gopLength == 0)
+		gopHashes.push_back(gopHash.result());
+}
+
+bool EncodeCache::readPreviousFrame(int64_t frameIndex, QByteArray& data, bool& isKeyframe)
+{
+	if (previousFormatContext == nullptr)
+		return false;
+
+	AVPacket packet;
+	av_init_packet(&packet);
+	packet.data = nullptr;
+	packet.size = 0;
+
+	// the previous output has no B-frames, so the packets come in the frame order
+	while (av_read_frame(previousFormatContext, &packet) >= 0)
+	{
+		if (packet.stream_index == previousStreamIndex)
+		{
+			int64_t packetIndex = previousPacketIndex++;
+
+			if (packetIndex == frameIndex)
+			{
+				data = QByteArray((const char*)packet.data, packet.size);
+				isKeyframe = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+				av_packet_unref(&packet);
+
+				return true;
+			}
+
+			if (packetIndex > frameIndex)
+			{
+				av_packet_unref(&packet);
+				break;
+			}
+		}
+
+		av_packet_unref(&packet);
+	}
+
+	qWarning("Could not read frame %lld from the previous output", (long long)frameIndex);
+	return false;
+}
+
+void EncodeCache::close(bool isComplete)
+{
+	if (previousFormatContext != nullptr)
+		avformat_close_input(&previousFormatContext);
+
+	QFile::remove(previousOutputFilePath);
+
+	// an interrupted encode leaves no cache file behind, so the next encode can't trust the partial output
+	if (!isComplete)
+		return;
+
+	if (frameTimes.size() % gopLength != 0)
+		gopHashes.push_back(gopHash.result());
+
+	writeCacheFile();
+
+	qDebug("Encode cache: reused %lld of %lld GOPs (%.1f %% of the frames)", (long long)reusedGopCount, (long long)getGopCount(), getReusedFraction() * 100.0);
+}
+
+int EncodeCache::getGopLength() const
+{
+	return gopLength;
+}
+
+double EncodeCache::getReusedFraction() const
+{
+	if (frameTimes.empty())
+		return 0.0;
+
+	return (double)reusedFrameCount / frameTimes.size();
+}
+
+int64_t EncodeCache::getReusedGopCount() const
+{
+	return reusedGopCount;
+}
+
+int64_t EncodeCache::getGopCount() const
+{
+	return ((int64_t)frameTimes.size() + gopLength - 1) / gopLength;
+}
+
+QByteArray EncodeCache::calculateSettingsHash(Settings* settings)
+{
+	QTemporaryFile temporaryFile;
+
+	if (!temporaryFile.open())
+	{
+		qWarning("Could not create a temporary file for the encode cache");
+		return QByteArray();
+	}
+
+	temporaryFile.close();
+
+	{
+		QSettings temporarySettings(temporaryFile.fileName(), QSettings::IniFormat);
+		settings->writeToQSettings(&temporarySettings);
+		temporarySettings.sync();
+	}
+
+	QFile file(temporaryFile.fileName());
+
+	if (!file.open(QFile::ReadOnly | QFile::Text))
+	{
+		qWarning("Could not read the temporary file of the encode cache");
+		return QByteArray();
+	}
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(QByteArray::number(CACHE_FILE_VERSION));
+	hash.addData(QByteArray::number(X264_BUILD));
+
+	QString group;
+
+	while (!file.atEnd())
+	{
+		QString line = QString::fromUtf8(file.readLine()).trimmed();
+
+		if (line.startsWith('[') && line.endsWith(']'))
+			group = line.mid(1, line.length() - 2);
+		else if (isExcludedSetting(group + "/" + line.section('=', 0, 0)))
+			continue;
+
+		hash.addData(line.toUtf8());
+	}
+
+	// the input files are identified by their size and modification time instead of reading them through
+	QStringList inputFilePaths;
+	inputFilePaths << settings->video.inputVideoFilePath << settings->map.imageFilePath << settings->route.quickRouteJpegFilePath << settings->stabilizer.inputDataFilePath;
+
+	for (const QString& inputFilePath : inputFilePaths)
+	{
+		QFileInfo fileInfo(inputFilePath);
+
+		if (fileInfo.exists())
+		{
+			hash.addData(QByteArray::number(fileInfo.size()));
+			hash.addData(QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()));
+		}
+	}
+
+	return hash.result();
+}
+
+bool EncodeCache::checkGopPair(int64_t pairIndex, const RouteManager* routeManager, double frameDuration)
+{
+	if (!hasPreviousOutput)
+		return false;
+
+	int64_t previousFrameCount = (int64_t)previousFrameTimes.size();
+	int64_t firstFrameIndex = pairIndex * 2 * gopLength;
+	int64_t lastFrameIndex = std::min(firstFrameIndex + 2 * gopLength, previousFrameCount);
+
+	if (firstFrameIndex >= previousFrameCount)
+		return false;
+
+	// step a copy of the route through the frame times of the previous encode, the result is what the renderer would draw for these frames
+	RouteManager simulatedRouteManager = *routeManager;
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+
+	for (int64_t i = firstFrameIndex; i < lastFrameIndex; ++i)
+	{
+		if (i % gopLength == 0)
+		{
+			hash.reset();
+			hash.addData(settingsHash);
+		}
+
+		double frameTime = previousFrameTimes[i];
+		simulatedRouteManager.update(frameTime, frameDuration);
+
+		hash.addData((const char*)&frameTime, sizeof(frameTime));
+		addRouteState(hash, simulatedRouteManager);
+
+		if ((i + 1) % gopLength == 0 || i + 1 == lastFrameIndex)
+		{
+			size_t gopIndex = (size_t)(i / gopLength);
+
+			if (gopIndex >= previousGopHashes.size() || hash.result() != previousGopHashes[gopIndex])
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool EncodeCache::readCacheFile()
+{
+	QFile file(cacheFilePath);
+
+	if (!file.open(QFile::ReadOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic = 0;
+	quint32 version = 0;
+	QByteArray previousSettingsHash;
+	qint32 previousGopLength = 0;
+	quint64 frameCount = 0;
+	quint64 gopCount = 0;
+
+	stream >> magic >> version >> previousSettingsHash >> previousGopLength;
+
+	if (magic != CACHE_FILE_MAGIC || version != CACHE_FILE_VERSION || previousGopLength != gopLength || previousSettingsHash != settingsHash)
+	{
+		qDebug("Encode cache: the settings or the input files have changed");
+		return false;
+	}
+
+	stream >> frameCount;
+	previousFrameTimes.resize((size_t)frameCount);
+
+	for (double& frameTime : previousFrameTimes)
+		stream >> frameTime;
+
+	stream >> gopCount;
+	previousGopHashes.resize((size_t)gopCount);
+
+	for (QByteArray& previousGopHash : previousGopHashes)
+		stream >> previousGopHash;
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		qWarning("Could not read encode cache file");
+		previousFrameTimes.clear();
+		previousGopHashes.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool EncodeCache::writeCacheFile()
+{
+	QFile file(cacheFilePath);
+
+	if (!file.open(QFile::WriteOnly | QFile::Truncate))
+	{
+		qWarning("Could not open encode cache file");
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	stream << CACHE_FILE_MAGIC << CACHE_FILE_VERSION << settingsHash << (qint32)gopLength;
+	stream << (quint64)frameTimes.size();
+
+	for (double frameTime : frameTimes)
+		stream << frameTime;
+
+	stream << (quint64)gopHashes.size();
+
+	for (const QByteArray& hash : gopHashes)
+		stream << hash;
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		qWarning("Could not write encode cache file");
+		file.remove();
+		return false;
+	}
+
+	return true;
+}
+
+bool EncodeCache::openPreviousOutput()
+{
+	if (avformat_open_input(&previousFormatContext, previousOutputFilePath.toUtf8().constData(), nullptr, nullptr) < 0)
+	{
+		qWarning("Could not open the previous output");
+		return false;
+	}
+
+	if (avformat_find_stream_info(previousFormatContext, nullptr) < 0)
+	{
+		qWarning("Could not find stream information of the previous output");
+		avformat_close_input(&previousFormatContext);
+		return false;
+	}
+
+	previousStreamIndex = av_find_best_stream(previousFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+	// a file that was replaced or cut after the encode doesn't match the cache anymore, fragmented files don't tell their frame count up front
+	int64_t previousFrameCount = (previousStreamIndex >= 0) ? previousFormatContext->streams[previousStreamIndex]->nb_frames : -1;
+
+	if (previousStreamIndex < 0 || (previousFrameCount != 0 && previousFrameCount != (int64_t)previousFrameTimes.size()))
+	{
+		qWarning("Could not match the previous output with the encode cache");
+		avformat_close_input(&previousFormatContext);
+		return false;
+	}
+
+	return true;
+}
+
+void EncodeCache::addRouteState(QCryptographicHash& hash, RouteManager& routeManager)
+{
+	Route& route = routeManager.getDefaultRoute();
+
+	double view[6] = { routeManager.getX(), routeManager.getY(), routeManager.getAngle(), routeManager.getScale(), route.runnerPosition.x(), route.runnerPosition.y() };
+	hash.addData((const char*)view, sizeof(view));
+
+	for (const QPointF& controlPosition : route.controlPositions)
+	{
+		double position[2] = { controlPosition.x(), controlPosition.y() };
+		hash.addData((const char*)position, sizeof(position));
+	}
+
+	for (int i = 0; i < route.tailPath.elementCount(); ++i)
+	{
+		QPainterPath::Element element = route.tailPath.elementAt(i);
+		double values[3] = { element.x, element.y, (double)element.type };
+		hash.addData((const char*)values, sizeof(values));
+	}
+}
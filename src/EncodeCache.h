@@ -0,0 +1,77 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QString>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+}
+
+namespace OrientView
+{
+	class Settings;
+	class RouteManager;
+
+	// Remember a hash of everything that went into each GOP of an encode, so that the next encode can copy the unchanged GOPs from the previous output instead of rendering and encoding them again.
+	class EncodeCache
+	{
+
+	public:
+
+		bool initialize(Settings* settings);
+		~EncodeCache();
+
+		bool getIsReused(int64_t frameIndex, const RouteManager* routeManager, double frameDuration);
+		void recordFrame(int64_t frameIndex, double frameTime, RouteManager* routeManager);
+		bool readPreviousFrame(int64_t frameIndex, QByteArray& data, bool& isKeyframe);
+		void close(bool isComplete);
+
+		int getGopLength() const;
+		double getReusedFraction() const;
+		int64_t getReusedGopCount() const;
+		int64_t getGopCount() const;
+
+	private:
+
+		QByteArray calculateSettingsHash(Settings* settings);
+		bool checkGopPair(int64_t pairIndex, const RouteManager* routeManager, double frameDuration);
+		bool readCacheFile();
+		bool writeCacheFile();
+		bool openPreviousOutput();
+
+		static void addRouteState(QCryptographicHash& hash, RouteManager& routeManager);
+
+		QString outputFilePath;
+		QString cacheFilePath;
+		QString previousOutputFilePath;
+		int gopLength = 0;
+		QByteArray settingsHash;
+
+		// loaded from the cache file of the previous encode
+		std::vector<double> previousFrameTimes;
+		std::vector<QByteArray> previousGopHashes;
+		bool hasPreviousOutput = false;
+
+		// recorded during this encode
+		std::vector<double> frameTimes;
+		std::vector<QByteArray> gopHashes;
+		QCryptographicHash gopHash { QCryptographicHash::Sha1 };
+
+		int64_t currentPairIndex = -1;
+		bool isCurrentPairReused = false;
+		int64_t reusedGopCount = 0;
+		int64_t reusedFrameCount = 0;
+
+		AVFormatContext* previousFormatContext = nullptr;
+		int previousStreamIndex = -1;
+		int64_t previousPacketIndex = 0;
+	};
+}
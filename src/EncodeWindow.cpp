@@ -11,6 +11,7 @@
 #include "VideoDecoder.h"
 #include "VideoEncoderThread.h"
 #include "Settings.h"
+#include "OffscreenContext.h"
 
 using namespace OrientView;
 
@@ -21,17 +22,10 @@ EncodeWindow::EncodeWindow(QWidget *parent) : QDialog(parent), ui(new Ui::Encode
 
 EncodeWindow::~EncodeWindow()
 {
-	if (context != nullptr)
+	if (offscreenContext != nullptr)
 	{
-		delete context;
-		context = nullptr;
-	}
-
-	if (surface != nullptr)
-	{
-		surface->destroy();
-		delete surface;
-		surface = nullptr;
+		delete offscreenContext;
+		offscreenContext = nullptr;
 	}
 
 	if (ui != nullptr)
@@ -50,32 +44,13 @@ bool EncodeWindow::initialize(VideoDecoder* videoDecoder, VideoEncoderThread* vi
 	setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
 	resize(10, 10);
 
-	QSurfaceFormat surfaceFormat;
-	surfaceFormat.setSamples(settings->window.multisamples);
-
-	surface = new QOffscreenSurface();
-	surface->setFormat(surfaceFormat);
-	surface->create();
-
-	if (!surface->isValid())
-	{
-		qWarning("Could not create offscreen surface");
-		return false;
-	}
-
-	context = new QOpenGLContext();
-	context->setFormat(surfaceFormat);
-
-	if (!context->create())
+	// the software compositor does not need OpenGL at all
+	if (settings->renderer.backend == RenderBackend::OpenGL)
 	{
-		qWarning("Could not create OpenGL context");
-		return false;
-	}
+		offscreenContext = new OffscreenContext();
 
-	if (!context->makeCurrent(surface))
-	{
-		qWarning("Could not make context current");
-		return false;
+		if (!offscreenContext->initialize(settings))
+			return false;
 	}
 
 	totalFrameCount = videoDecoder->getTotalFrameCount();
@@ -95,14 +70,9 @@ bool EncodeWindow::initialize(VideoDecoder* videoDecoder, VideoEncoderThread* vi
 	return true;
 }
 
-QOffscreenSurface* EncodeWindow::getSurface() const
-{
-	return surface;
-}
-
-QOpenGLContext* EncodeWindow::getContext() const
+OffscreenContext* EncodeWindow::getOffscreenContext() const
 {
-	return context;
+	return offscreenContext;
 }
 
 bool EncodeWindow::getIsInitialized() const
@@ -5,8 +5,6 @@
 
 #include <QDialog>
 #include <QTime>
-#include <QOffscreenSurface>
-#include <QOpenGLContext>
 
 namespace Ui
 {
@@ -18,6 +16,7 @@ namespace OrientView
 	class VideoDecoder;
 	class VideoEncoderThread;
 	class Settings;
+	class OffscreenContext;
 
 	// Display the progress of the encoding process.
 	class EncodeWindow : public QDialog
@@ -31,8 +30,7 @@ namespace OrientView
 
 		bool initialize(VideoDecoder* videoDecoder, VideoEncoderThread* videoEncoderThread, Settings* settings);
 
-		QOffscreenSurface* getSurface() const;
-		QOpenGLContext* getContext() const;
+		OffscreenContext* getOffscreenContext() const;
 		bool getIsInitialized() const;
 
 	signals:
@@ -61,8 +59,7 @@ namespace OrientView
 		QTime pauseTime;
 		int totalPauseTime = 0;
 
-		QOffscreenSurface* surface = nullptr;
-		QOpenGLContext* context = nullptr;
+		OffscreenContext* offscreenContext = nullptr;
 
 		bool isInitialized = false;
 		bool isRunning = true;
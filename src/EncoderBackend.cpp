@@ -0,0 +1,51 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <QtGlobal>
+
+#include "EncoderBackend.h"
+#include "X264Backend.h"
+#include "LibavBackend.h"
+#include "Y4mBackend.h"
+
+using namespace OrientView;
+
+EncoderBackend* EncoderBackend::create(const QString& name)
+{
+	if (name == "x264")
+		return new X264Backend();
+
+	if (name == "libav")
+		return new LibavBackend();
+
+	if (name == "y4m")
+		return new Y4mBackend();
+
+	qWarning("Could not find encoder backend \"%s\", the choices are x264, libav and y4m", qPrintable(name));
+	return nullptr;
+}
+
+// the defaults are for the backends without audio or without the encode cache
+bool EncoderBackend::initializeAudio(AVStream*)
+{
+	return false;
+}
+
+bool EncoderBackend::writeCopiedFrame(const uint8_t*, size_t, int64_t, bool)
+{
+	return false;
+}
+
+bool EncoderBackend::writeAudioPacket(AVPacket*, int64_t)
+{
+	return false;
+}
+
+double EncoderBackend::getWriteStallDuration() const
+{
+	return 0.0;
+}
+
+void EncoderBackend::logStatistics()
+{
+}
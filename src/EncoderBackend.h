@@ -0,0 +1,47 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+
+#include <QString>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+#include "libavutil/frame.h"
+}
+
+namespace OrientView
+{
+	class VideoDecoder;
+	class Settings;
+
+	// The part of the encoder that turns the converted YUV 4:2:0 pictures into an output. VideoEncoder does the conversion and the threading, and picks one of these by the encoder/backend setting.
+	class EncoderBackend
+	{
+
+	public:
+
+		static EncoderBackend* create(const QString& name);
+		virtual ~EncoderBackend() {}
+
+		// cacheGopLength is zero unless the encode cache copies GOPs into the output, only a backend that supports writeCopiedFrame() is given one
+		virtual bool initialize(VideoDecoder* videoDecoder, Settings* settings, int cacheGopLength) = 0;
+		virtual bool initializeAudio(AVStream* audioStream);
+		virtual bool writeHeaders() = 0;
+
+		// the picture may be referenced after the call, so it has to be made writable before it is converted to again
+		// returns the number of bytes that came out, which can belong to earlier pictures, or -1
+		virtual int encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe) = 0;
+		virtual int flush() = 0;
+
+		virtual bool writeCopiedFrame(const uint8_t* data, size_t size, int64_t pts, bool isKeyframe);
+		virtual bool writeAudioPacket(AVPacket* packet, int64_t timestamp); // timestamp in the time base of the source stream, zero at the first video frame
+		virtual bool close(int64_t frameCount) = 0; // false if the output could not be finished or written completely
+
+		virtual double getWriteStallDuration() const;
+		virtual void logStatistics();
+	};
+}
@@ -0,0 +1,238 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+#include "FileWriterThread.h"
+#include "PipelineTracer.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const size_t BUFFER_ALIGNMENT = 4096;
+}
+
+bool FileWriterThread::initialize(const QString& fileName, int bufferSize, int bufferCount)
+{
+	this->bufferSize = (int64_t)std::max(1, bufferSize);
+
+	file.setFileName(fileName);
+
+	// the buffers here are large enough, another layer of buffering would only copy the data once more
+	// readable too, l-smash reads back what it has written when it moves the index to the front of the file
+	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Unbuffered))
+	{
+		qWarning("Could not open output file %s", qPrintable(fileName));
+		return false;
+	}
+
+	bufferQueue.initialize(bufferCount);
+
+	for (int i = 0; i < bufferQueue.getCapacity(); ++i)
+	{
+		WriteBuffer& writeBuffer = bufferQueue.getSlot(i);
+		writeBuffer.data = (uint8_t*)qMallocAligned((size_t)this->bufferSize, BUFFER_ALIGNMENT);
+
+		if (writeBuffer.data == nullptr)
+		{
+			qWarning("Could not allocate write buffer");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+FileWriterThread::~FileWriterThread()
+{
+	for (int i = 0; i < bufferQueue.getCapacity(); ++i)
+	{
+		WriteBuffer& writeBuffer = bufferQueue.getSlot(i);
+
+		if (writeBuffer.data != nullptr)
+		{
+			qFreeAligned(writeBuffer.data);
+			writeBuffer.data = nullptr;
+		}
+	}
+}
+
+bool FileWriterThread::write(const uint8_t* data, int64_t size)
+{
+	while (size > 0 && !isFailed)
+	{
+		if (!hasCurrentBuffer)
+		{
+			if (!bufferQueue.waitForFreeSlot(0))
+			{
+				// every buffer is still waiting for the file system
+				QElapsedTimer stallTimer;
+				stallTimer.start();
+
+				while (!bufferQueue.waitForFreeSlot(100) && !isFailed) {}
+
+				stallCount++;
+				stallDuration += stallTimer.nsecsElapsed() / 1000000.0;
+
+				if (isFailed)
+					break;
+			}
+
+			WriteBuffer& writeBuffer = bufferQueue.back();
+			writeBuffer.size = 0;
+			writeBuffer.filePosition = position;
+			hasCurrentBuffer = true;
+		}
+
+		WriteBuffer& writeBuffer = bufferQueue.back();
+		int64_t copySize = std::min(size, bufferSize - writeBuffer.size);
+
+		memcpy(writeBuffer.data + writeBuffer.size, data, (size_t)copySize);
+
+		writeBuffer.size += copySize;
+		data += copySize;
+		size -= copySize;
+		position += copySize;
+		fileSize = std::max(fileSize, position);
+
+		if (writeBuffer.size == bufferSize)
+			submitBuffer();
+	}
+
+	return !isFailed;
+}
+
+int64_t FileWriterThread::seek(int64_t offset, int whence)
+{
+	// the data before the seek goes out as a buffer of its own, the buffers remember where they belong
+	submitBuffer();
+
+	if (whence == SEEK_SET)
+		position = offset;
+	else if (whence == SEEK_CUR)
+		position += offset;
+	else if (whence == SEEK_END)
+		position = fileSize + offset;
+	else
+		return -1;
+
+	return position;
+}
+
+int FileWriterThread::read(uint8_t* data, int size)
+{
+	// rare, so simply let the writer catch up and then read the file directly
+	submitBuffer();
+	waitUntilWritten();
+
+	if (isFailed || !file.seek(position))
+		return -1;
+
+	qint64 readSize = file.read((char*)data, size);
+
+	if (readSize > 0)
+		position += readSize;
+
+	return (int)readSize;
+}
+
+bool FileWriterThread::close()
+{
+	submitBuffer();
+
+	requestInterruption();
+	wait();
+
+	file.close();
+
+	return !isFailed;
+}
+
+bool FileWriterThread::getIsFailed() const
+{
+	return isFailed;
+}
+
+double FileWriterThread::getStallDuration() const
+{
+	return stallDuration;
+}
+
+void FileWriterThread::logStatistics()
+{
+	qDebug("File writer: %.1f MB in %lld buffers of %.1f MB, %.1f ms writing, the producer stalled %d times for %.1f ms",
+		writtenByteCount / 1000000.0,
+		(long long)writtenBufferCount.load(),
+		bufferSize / 1000000.0,
+		writeDuration,
+		stallCount,
+		stallDuration);
+}
+
+void FileWriterThread::run()
+{
+	PipelineTracer::setThreadName("Writer");
+
+	QElapsedTimer writeTimer;
+
+	while (true)
+	{
+		if (bufferQueue.waitForItem(100))
+		{
+			WriteBuffer& writeBuffer = bufferQueue.front();
+
+			if (!isFailed)
+			{
+				TraceScope traceScope("write");
+				writeTimer.restart();
+
+				if (file.pos() != writeBuffer.filePosition && !file.seek(writeBuffer.filePosition))
+				{
+					qWarning("Could not seek in output file");
+					isFailed = true;
+				}
+				else if (file.write((const char*)writeBuffer.data, writeBuffer.size) != writeBuffer.size)
+				{
+					qWarning("Could not write to output file");
+					isFailed = true;
+				}
+				else
+					writtenByteCount += writeBuffer.size;
+
+				writeDuration += writeTimer.nsecsElapsed() / 1000000.0;
+			}
+
+			bufferQueue.pop();
+			writtenBufferCount++;
+		}
+		else if (isInterruptionRequested())
+			break;
+	}
+}
+
+void FileWriterThread::submitBuffer()
+{
+	if (!hasCurrentBuffer)
+		return;
+
+	hasCurrentBuffer = false;
+
+	// an empty buffer stays in its slot and is taken again by the next write
+	if (bufferQueue.back().size == 0)
+		return;
+
+	bufferQueue.push();
+	submittedBufferCount++;
+}
+
+void FileWriterThread::waitUntilWritten()
+{
+	while (writtenBufferCount.load() < submittedBufferCount && !isFailed)
+		QThread::msleep(1);
+}
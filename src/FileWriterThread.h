@@ -0,0 +1,71 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <QThread>
+#include <QFile>
+#include <QString>
+
+#include "SpscQueue.h"
+
+namespace OrientView
+{
+	// Write a file on a thread through a few large page aligned buffers, so that the writer only copies to memory and doesn't wait for the file system.
+	class FileWriterThread : public QThread
+	{
+		Q_OBJECT
+
+	public:
+
+		bool initialize(const QString& fileName, int bufferSize, int bufferCount);
+		~FileWriterThread();
+
+		// Producer side, all from one thread at a time.
+		bool write(const uint8_t* data, int64_t size);
+		int64_t seek(int64_t offset, int whence);
+		int read(uint8_t* data, int size);
+		bool close();
+
+		bool getIsFailed() const;
+		double getStallDuration() const;
+		void logStatistics();
+
+	protected:
+
+		void run();
+
+	private:
+
+		struct WriteBuffer
+		{
+			uint8_t* data = nullptr;
+			int64_t size = 0;
+			int64_t filePosition = 0;
+		};
+
+		void submitBuffer();
+		void waitUntilWritten();
+
+		QFile file;
+		SpscQueue<WriteBuffer> bufferQueue;
+		int64_t bufferSize = 0;
+
+		// producer side
+		bool hasCurrentBuffer = false;
+		int64_t position = 0;
+		int64_t fileSize = 0;
+		int64_t submittedBufferCount = 0;
+		int stallCount = 0;
+		double stallDuration = 0.0; // milliseconds
+
+		// writer side
+		std::atomic<int64_t> writtenBufferCount{ 0 };
+		std::atomic<bool> isFailed{ false };
+		int64_t writtenByteCount = 0;
+		double writeDuration = 0.0; // milliseconds
+	};
+}
@@ -17,6 +17,13 @@ namespace OrientView
 		int height = 0;					// Height in pixels
 		int64_t duration = 0;			// Duration in microseconds
 		int64_t timeStamp = 0;			// Time stamp given by FFmpeg (no unit)
+		int64_t presentationTime = 0;	// Time stamp in microseconds, scaled like the duration
+		double time = 0.0;				// Position in the video in seconds, not scaled
 		int64_t cumulativeNumber = 0;	// Total number of frames produced (doesn't reset on seek)
+		double stabilizerX = 0.0;		// Stabilizing offset relative to the frame width
+		double stabilizerY = 0.0;		// Stabilizing offset relative to the frame height
+		double stabilizerAngle = 0.0;	// Stabilizing rotation in degrees
+		bool isReused = false;			// Copied from the previous output instead of rendered and encoded
+		bool isEndOfStream = false;		// Sent through the queues after the last frame, carries no picture
 	};
 }
@@ -0,0 +1,99 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include "FrameStabilizerThread.h"
+#include "VideoDecoderThread.h"
+#include "VideoStabilizer.h"
+#include "Settings.h"
+#include "PipelineTracer.h"
+
+using namespace OrientView;
+
+void FrameStabilizerThread::initialize(VideoDecoderThread* videoDecoderThread, VideoStabilizer* videoStabilizer, Settings* settings)
+{
+	this->videoDecoderThread = videoDecoderThread;
+	this->videoStabilizer = videoStabilizer;
+
+	frameQueue.initialize(settings->stabilizer.frameQueueDepth);
+}
+
+void FrameStabilizerThread::run()
+{
+	FrameData frameDataGrayscale;
+	int previousGeneration = 0;
+
+	PipelineTracer::setThreadName("Stabilizer");
+
+	while (!isInterruptionRequested())
+	{
+		if (!frameQueue.waitForFreeSlot(100))
+			continue;
+
+		StabilizedFrame& stabilizedFrame = frameQueue.back();
+
+		if (!videoDecoderThread->tryGetNextFrame(stabilizedFrame.frameData, frameDataGrayscale, 100, &stabilizedFrame.generation))
+			continue;
+
+		if (stabilizedFrame.frameData.isEndOfStream)
+		{
+			videoDecoderThread->signalFrameRead();
+			frameQueue.push();
+			continue;
+		}
+
+		// the first frame after a seek is not tracked against the last one before it, which may still have been in the queue when the seek was requested
+		if (stabilizedFrame.generation != previousGeneration)
+		{
+			videoStabilizer->reset();
+			previousGeneration = stabilizedFrame.generation;
+		}
+
+		{
+			TraceScope traceScope("stabilize");
+			videoStabilizer->processFrame(frameDataGrayscale);
+		}
+
+		stabilizedFrame.frameData.stabilizerX = videoStabilizer->getX();
+		stabilizedFrame.frameData.stabilizerY = videoStabilizer->getY();
+		stabilizedFrame.frameData.stabilizerAngle = videoStabilizer->getAngle();
+
+		// only the grayscale picture has been used here, the color picture stays valid until the renderer has read the frame
+		videoDecoderThread->signalFrameRead();
+		frameQueue.push();
+	}
+}
+
+bool FrameStabilizerThread::tryGetNextFrame(FrameData& frameData, int timeout)
+{
+	if (!frameQueue.waitForItem(timeout))
+		return false;
+
+	int currentGeneration = videoDecoderThread->getSeekGeneration();
+
+	// stabilized before the latest seek
+	while (frameQueue.front().generation != currentGeneration)
+	{
+		discardedFrameCount++;
+		frameQueue.pop();
+
+		if (!frameQueue.waitForItem(0))
+			return false;
+	}
+
+	frameData = frameQueue.front().frameData;
+
+	return true;
+}
+
+void FrameStabilizerThread::signalFrameRead()
+{
+	frameQueue.pop();
+}
+
+void FrameStabilizerThread::logStatistics()
+{
+	frameQueue.logStatistics("Stabilized frame");
+
+	if (discardedFrameCount > 0)
+		qDebug("Stabilizer: %d frames discarded after seeks", discardedFrameCount);
+}
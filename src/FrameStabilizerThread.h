@@ -0,0 +1,51 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QThread>
+
+#include "FrameData.h"
+#include "SpscQueue.h"
+
+namespace OrientView
+{
+	class VideoDecoderThread;
+	class VideoStabilizer;
+	class Settings;
+
+	// Run the real-time video stabilizer on a thread between the decoder and the renderer, the transformation is passed on with each frame.
+	class FrameStabilizerThread : public QThread
+	{
+		Q_OBJECT
+
+	public:
+
+		void initialize(VideoDecoderThread* videoDecoderThread, VideoStabilizer* videoStabilizer, Settings* settings);
+
+		bool tryGetNextFrame(FrameData& frameData, int timeout);
+		void signalFrameRead();
+
+		void logStatistics();
+
+	protected:
+
+		void run();
+
+	private:
+
+		struct StabilizedFrame
+		{
+			FrameData frameData;
+			int generation = 0;
+		};
+
+		VideoDecoderThread* videoDecoderThread = nullptr;
+		VideoStabilizer* videoStabilizer = nullptr;
+
+		// the frames point to the decoder pictures, which are not reused before they have been read from here too
+		SpscQueue<StabilizedFrame> frameQueue;
+
+		int discardedFrameCount = 0;
+	};
+}
@@ -0,0 +1,530 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+
+#include "HeadlessRunner.h"
+#include "Settings.h"
+#include "OffscreenContext.h"
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+#include "EncodeCache.h"
+#include "QuickRouteReader.h"
+#include "MapImageReader.h"
+#include "VideoStabilizer.h"
+#include "InputHandler.h"
+#include "SplitsManager.h"
+#include "RouteManager.h"
+#include "Renderer.h"
+#include "VideoDecoderThread.h"
+#include "FrameStabilizerThread.h"
+#include "RenderOffScreenThread.h"
+#include "VideoEncoderThread.h"
+#include "VideoStabilizerThread.h"
+#include "PipelineTracer.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// progress lines are printed at most this often, the last frame is always printed
+	const qint64 PROGRESS_INTERVAL = 1000;
+
+	// the errors are printed on one line, so the message cannot contain quotes or line breaks
+	QString getPrintableMessage(const char* message)
+	{
+		QString result(message);
+		result.replace('"', '\'');
+		result.replace('\n', ' ');
+
+		return result;
+	}
+}
+
+HeadlessRunner::~HeadlessRunner()
+{
+	shutdown();
+}
+
+HeadlessJob HeadlessRunner::parseJob(const QString& argument)
+{
+	if (argument == "--stabilize")
+		return HeadlessJob::Stabilize;
+	else if (argument == "--stabilize-pass-two")
+		return HeadlessJob::StabilizePassTwo;
+	else if (argument == "--encode")
+		return HeadlessJob::Encode;
+	else if (argument == "--batch")
+		return HeadlessJob::Batch;
+	else
+		return HeadlessJob::None;
+}
+
+const char* HeadlessRunner::getJobName(HeadlessJob job)
+{
+	switch (job)
+	{
+		case HeadlessJob::Stabilize: return "stabilize";
+		case HeadlessJob::StabilizePassTwo: return "stabilize-pass-two";
+		case HeadlessJob::Encode: return "encode";
+		case HeadlessJob::Batch: return "batch";
+		default: return "none";
+	}
+}
+
+bool HeadlessRunner::parseOptions(const QStringList& arguments, HeadlessOptions& options)
+{
+	for (const QString& argument : arguments)
+	{
+		QString name = argument.section('=', 0, 0);
+		QString value = argument.section('=', 1);
+		bool isValid = true;
+
+		if (name == "--decoder-threads")
+			options.decoderThreadCount = value.toInt(&isValid);
+		else if (name == "--encoder-threads")
+			options.encoderThreadCount = value.toInt(&isValid);
+		else if (name == "--stabilizer-threads")
+			options.stabilizerThreadCount = value.toInt(&isValid);
+		else if (name == "--log-file" && !value.isEmpty())
+			options.logFilePath = QFileInfo(value).absoluteFilePath();
+		else
+			isValid = false;
+
+		if (!isValid)
+		{
+			fprintf(stderr, "Invalid option: %s\n", qPrintable(argument));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void HeadlessRunner::printUsage()
+{
+	fprintf(stderr, "Usage: orientview [settings.ini]\n");
+	fprintf(stderr, "       orientview --stabilize settings.ini\n");
+	fprintf(stderr, "       orientview --stabilize-pass-two settings.ini\n");
+	fprintf(stderr, "       orientview --encode settings.ini\n");
+	fprintf(stderr, "       orientview --batch jobs.txt [--cores=N] [--memory=MB]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Options of the single jobs: --decoder-threads=N --encoder-threads=N --stabilizer-threads=N --log-file=path\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Exit codes: 0 success, 1 usage error, 2 initialization error, 3 processing error\n");
+}
+
+int HeadlessRunner::run(HeadlessJob job, const QString& iniFilePath, const HeadlessOptions& options)
+{
+	if (job == HeadlessJob::None || job == HeadlessJob::Batch)
+	{
+		printUsage();
+		return ExitUsageError;
+	}
+
+	jobName = getJobName(job);
+
+	if (!QFile::exists(iniFilePath))
+	{
+		fprintf(stdout, "error job=%s message=\"Could not find settings file %s\"\n", jobName, qPrintable(iniFilePath));
+		fflush(stdout);
+		return ExitUsageError;
+	}
+
+	qDebug("Running %s from the command line with %s", jobName, qPrintable(iniFilePath));
+
+	settings = new Settings();
+	QSettings iniFileSettings(iniFilePath, QSettings::IniFormat);
+	settings->readFromQSettings(&iniFileSettings);
+
+	// a hand written settings file can name its files relative to itself, wherever the command is run from
+	settings->resolveFilePaths(QFileInfo(iniFilePath).absolutePath());
+
+	if (options.decoderThreadCount >= 0)
+		settings->video.decoderThreadCount = options.decoderThreadCount;
+
+	if (options.encoderThreadCount >= 0)
+		settings->encoder.threadCount = options.encoderThreadCount;
+
+	if (options.stabilizerThreadCount >= 0)
+		settings->stabilizer.threadCount = options.stabilizerThreadCount;
+
+	// the status lines must not get mixed into a video stream
+	statusOutput = (job == HeadlessJob::Encode && settings->encoder.outputVideoFilePath == "-" && settings->encoder.backend != "x264") ? stderr : stdout;
+
+	runTimer.start();
+	lastProgressTime = 0;
+	processedFrameCount = 0;
+	processedVideoTime = 0.0;
+	totalOutputSize = 0.0;
+
+	int exitCode = ExitSuccess;
+
+	try
+	{
+		switch (job)
+		{
+			case HeadlessJob::Stabilize: exitCode = runStabilize(); break;
+			case HeadlessJob::StabilizePassTwo: exitCode = runStabilizePassTwo(); break;
+			case HeadlessJob::Encode: exitCode = runEncode(); break;
+			default: break;
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		qWarning("%s", ex.what());
+
+		fprintf(statusOutput, "error job=%s message=\"%s\"\n", jobName, qPrintable(getPrintableMessage(ex.what())));
+		fflush(statusOutput);
+
+		exitCode = ExitInitializationError;
+	}
+
+	shutdown();
+
+	return exitCode;
+}
+
+int HeadlessRunner::runStabilize()
+{
+	videoDecoder = new VideoDecoder();
+	videoStabilizer = new VideoStabilizer();
+	videoStabilizerThread = new VideoStabilizerThread();
+
+	if (!videoDecoder->initialize(settings))
+		throw std::runtime_error("Could not initialize video decoder");
+
+	if (!videoStabilizerThread->initialize(videoDecoder, videoStabilizer, settings))
+		throw std::runtime_error("Could not initialize video stabilizer thread");
+
+	if (!videoStabilizer->initialize(settings, true))
+		throw std::runtime_error("Could not initialize video stabilizer");
+
+	totalFrameCount = videoDecoder->getTotalFrameCount();
+
+	QEventLoop eventLoop;
+	connect(videoStabilizerThread, &VideoStabilizerThread::frameProcessed, this, &HeadlessRunner::frameStabilized);
+	connect(videoStabilizerThread, &VideoStabilizerThread::processingFinished, &eventLoop, &QEventLoop::quit);
+
+	PipelineTracer::start(settings);
+	videoStabilizerThread->start();
+	eventLoop.exec();
+	videoStabilizerThread->wait();
+
+	// the queued progress signals are delivered before the finishing signal, so the counts are complete here
+	printProgress(processedFrameCount, processedVideoTime, true);
+
+	bool isFinished = videoDecoder->getIsFinished();
+	printResult(isFinished ? "ok" : "failed");
+
+	return isFinished ? ExitSuccess : ExitProcessingError;
+}
+
+int HeadlessRunner::runStabilizePassTwo()
+{
+	QFile fileIn(settings->stabilizer.passTwoInputFilePath);
+	QFile fileOut(settings->stabilizer.passTwoOutputFilePath);
+
+	if (!fileIn.open(QFile::ReadOnly | QFile::Text))
+		throw std::runtime_error("Could not open input file");
+
+	if (!fileOut.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		throw std::runtime_error("Could not open output file");
+
+	VideoStabilizer::convertCumulativeFramePositionsToNormalized(fileIn, fileOut, settings->stabilizer.smoothingRadius);
+
+	fileIn.close();
+	fileOut.close();
+
+	printResult("ok");
+
+	return ExitSuccess;
+}
+
+int HeadlessRunner::runEncode()
+{
+	// unlike the GUI, nobody is there to answer whether to continue without the video, the map or the route
+	videoDecoder = new VideoDecoder();
+
+	if (!videoDecoder->initialize(settings))
+		throw std::runtime_error("Could not initialize video decoder");
+
+	mapImageReader = new MapImageReader();
+
+	if (!mapImageReader->initialize(settings))
+		throw std::runtime_error("Could not initialize map image reader");
+
+	quickRouteReader = new QuickRouteReader();
+
+	if (!quickRouteReader->initialize(mapImageReader, settings))
+		throw std::runtime_error("Could not initialize QuickRoute reader");
+
+	videoEncoder = new VideoEncoder();
+	renderer = new Renderer();
+	videoStabilizer = new VideoStabilizer();
+	inputHandler = new InputHandler();
+	splitsManager = new SplitsManager();
+	routeManager = new RouteManager();
+	videoDecoderThread = new VideoDecoderThread();
+	frameStabilizerThread = new FrameStabilizerThread();
+	renderOffScreenThread = new RenderOffScreenThread();
+	videoEncoderThread = new VideoEncoderThread();
+
+	// the software compositor does not need OpenGL at all
+	if (settings->renderer.backend == RenderBackend::OpenGL)
+	{
+		offscreenContext = new OffscreenContext();
+
+		if (!offscreenContext->initialize(settings))
+			throw std::runtime_error("Could not initialize offscreen context");
+	}
+
+	if (!videoEncoder->initialize(videoDecoder, settings))
+		throw std::runtime_error("Could not initialize video encoder");
+
+	if (!renderer->initialize(videoDecoder, mapImageReader, inputHandler, routeManager, settings, true))
+		throw std::runtime_error("Could not initialize renderer");
+
+	if (!videoStabilizer->initialize(settings, false))
+		throw std::runtime_error("Could not initialize video stabilizer");
+
+	splitsManager->initialize(settings);
+
+	if (!routeManager->initialize(quickRouteReader, splitsManager, renderer, settings))
+		throw std::runtime_error("Could not initialize route manager");
+
+	routeManager->warmUp(settings->video.startTimeOffset, videoDecoder->getFrameDuration());
+
+	videoDecoderThread->initialize(videoDecoder, settings);
+	frameStabilizerThread->initialize(videoDecoderThread, videoStabilizer, settings);
+	renderOffScreenThread->initialize(offscreenContext, videoDecoder, videoDecoderThread, frameStabilizerThread, videoStabilizer, routeManager, renderer, videoEncoder, settings);
+	videoEncoderThread->initialize(videoDecoder, videoEncoder, renderOffScreenThread);
+
+	totalFrameCount = videoDecoder->getTotalFrameCount();
+
+	QEventLoop eventLoop;
+	connect(videoEncoderThread, &VideoEncoderThread::frameProcessed, this, &HeadlessRunner::frameEncoded);
+	connect(videoEncoderThread, &VideoEncoderThread::encodingFinished, &eventLoop, &QEventLoop::quit);
+
+	if (offscreenContext != nullptr)
+	{
+		offscreenContext->doneCurrent();
+		offscreenContext->moveToThread(renderOffScreenThread);
+	}
+
+	PipelineTracer::start(settings);
+
+	videoDecoderThread->start();
+	frameStabilizerThread->start();
+	renderOffScreenThread->start();
+	videoEncoderThread->start();
+
+	eventLoop.exec();
+	videoEncoderThread->wait();
+
+	// the frames flushed from the encoder at the end never went through frameEncoded, a stream keeps the count of what went through it
+	if (settings->encoder.outputVideoFilePath != "-")
+		totalOutputSize = QFileInfo(settings->encoder.outputVideoFilePath).size() / 1000000.0;
+
+	printProgress(processedFrameCount, processedVideoTime, true);
+
+	EncodeCache* encodeCache = videoEncoder->getEncodeCache();
+
+	if (encodeCache != nullptr)
+	{
+		fprintf(statusOutput, "cache job=%s reused_gops=%lld total_gops=%lld reused_fraction=%.3f\n",
+			jobName,
+			(long long)encodeCache->getReusedGopCount(),
+			(long long)encodeCache->getGopCount(),
+			encodeCache->getReusedFraction());
+	}
+
+	// kept apart from the encode time, a slow disk shows up here and not as a slow encoder
+	fprintf(statusOutput, "output job=%s write_stall_ms=%.1f\n", jobName, videoEncoder->getWriteStallDuration());
+
+	// a truncated output fails the job just like a video that was not read to the end
+	bool isFinished = videoEncoderThread->getIsStreamComplete() && videoEncoderThread->getIsOutputWritten();
+	printResult(isFinished ? "ok" : "failed");
+
+	return isFinished ? ExitSuccess : ExitProcessingError;
+}
+
+void HeadlessRunner::frameStabilized(int frameNumber, double currentTime)
+{
+	processedFrameCount++;
+	processedVideoTime = currentTime;
+
+	printProgress(frameNumber, currentTime, false);
+}
+
+void HeadlessRunner::frameEncoded(int frameNumber, int frameSize, double currentTime)
+{
+	processedFrameCount++;
+	processedVideoTime = currentTime;
+	totalOutputSize += frameSize / 1000000.0;
+
+	printProgress(frameNumber, currentTime, false);
+}
+
+void HeadlessRunner::printProgress(int frameNumber, double currentTime, bool isFinal)
+{
+	qint64 elapsedTime = runTimer.elapsed();
+
+	if (!isFinal && elapsedTime - lastProgressTime < PROGRESS_INTERVAL)
+		return;
+
+	lastProgressTime = elapsedTime;
+
+	double elapsedSeconds = elapsedTime / 1000.0;
+	double framesPerSecond = (elapsedSeconds > 0.0) ? processedFrameCount / elapsedSeconds : 0.0;
+	double percent = (totalFrameCount > 0) ? 100.0 * frameNumber / totalFrameCount : 0.0;
+
+	fprintf(statusOutput, "progress job=%s frame=%d total=%lld percent=%.2f video_time=%.3f elapsed=%.3f fps=%.2f size_mb=%.2f\n",
+		jobName,
+		frameNumber,
+		(long long)totalFrameCount,
+		percent,
+		currentTime,
+		elapsedSeconds,
+		framesPerSecond,
+		totalOutputSize);
+
+	fflush(statusOutput);
+}
+
+void HeadlessRunner::printResult(const char* status)
+{
+	double elapsedSeconds = runTimer.elapsed() / 1000.0;
+	double framesPerSecond = (elapsedSeconds > 0.0) ? processedFrameCount / elapsedSeconds : 0.0;
+
+	fprintf(statusOutput, "result job=%s status=%s frames=%d elapsed=%.3f fps=%.2f size_mb=%.2f\n",
+		jobName,
+		status,
+		processedFrameCount,
+		elapsedSeconds,
+		framesPerSecond,
+		totalOutputSize);
+
+	fflush(statusOutput);
+}
+
+void HeadlessRunner::shutdown()
+{
+	if (videoStabilizerThread != nullptr)
+	{
+		videoStabilizerThread->requestInterruption();
+		videoStabilizerThread->wait();
+		delete videoStabilizerThread;
+		videoStabilizerThread = nullptr;
+	}
+
+	if (videoEncoderThread != nullptr)
+	{
+		videoEncoderThread->requestInterruption();
+		videoEncoderThread->wait();
+		delete videoEncoderThread;
+		videoEncoderThread = nullptr;
+	}
+
+	if (renderOffScreenThread != nullptr)
+	{
+		renderOffScreenThread->requestInterruption();
+		renderOffScreenThread->wait();
+		delete renderOffScreenThread;
+		renderOffScreenThread = nullptr;
+	}
+
+	if (frameStabilizerThread != nullptr)
+	{
+		frameStabilizerThread->requestInterruption();
+		frameStabilizerThread->wait();
+		delete frameStabilizerThread;
+		frameStabilizerThread = nullptr;
+	}
+
+	if (videoDecoderThread != nullptr)
+	{
+		videoDecoderThread->requestInterruption();
+		videoDecoderThread->wait();
+		delete videoDecoderThread;
+		videoDecoderThread = nullptr;
+	}
+
+	PipelineTracer::finish();
+
+	// the renderer releases its OpenGL resources when it is deleted
+	if (offscreenContext != nullptr)
+		offscreenContext->makeCurrent();
+
+	if (routeManager != nullptr)
+	{
+		delete routeManager;
+		routeManager = nullptr;
+	}
+
+	if (splitsManager != nullptr)
+	{
+		delete splitsManager;
+		splitsManager = nullptr;
+	}
+
+	if (inputHandler != nullptr)
+	{
+		delete inputHandler;
+		inputHandler = nullptr;
+	}
+
+	if (videoStabilizer != nullptr)
+	{
+		delete videoStabilizer;
+		videoStabilizer = nullptr;
+	}
+
+	if (renderer != nullptr)
+	{
+		delete renderer;
+		renderer = nullptr;
+	}
+
+	if (videoEncoder != nullptr)
+	{
+		delete videoEncoder;
+		videoEncoder = nullptr;
+	}
+
+	if (offscreenContext != nullptr)
+	{
+		delete offscreenContext;
+		offscreenContext = nullptr;
+	}
+
+	if (mapImageReader != nullptr)
+	{
+		delete mapImageReader;
+		mapImageReader = nullptr;
+	}
+
+	if (quickRouteReader != nullptr)
+	{
+		delete quickRouteReader;
+		quickRouteReader = nullptr;
+	}
+
+	if (videoDecoder != nullptr)
+	{
+		delete videoDecoder;
+		videoDecoder = nullptr;
+	}
+
+	if (settings != nullptr)
+	{
+		delete settings;
+		settings = nullptr;
+	}
+}
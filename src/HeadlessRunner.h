@@ -0,0 +1,104 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+
+namespace OrientView
+{
+	class Settings;
+	class OffscreenContext;
+	class VideoDecoder;
+	class VideoEncoder;
+	class QuickRouteReader;
+	class MapImageReader;
+	class VideoStabilizer;
+	class InputHandler;
+	class SplitsManager;
+	class RouteManager;
+	class Renderer;
+	class VideoDecoderThread;
+	class FrameStabilizerThread;
+	class RenderOffScreenThread;
+	class VideoEncoderThread;
+	class VideoStabilizerThread;
+
+	enum class HeadlessJob { None, Stabilize, StabilizePassTwo, Encode, Batch };
+
+	// The exit codes of the command line mode.
+	enum HeadlessExitCode { ExitSuccess = 0, ExitUsageError = 1, ExitInitializationError = 2, ExitProcessingError = 3 };
+
+	// Overrides given on the command line after the settings file, the batch scheduler uses these to hand out the thread budgets.
+	struct HeadlessOptions
+	{
+		int decoderThreadCount = -1; // negative keeps the value of the settings file
+		int encoderThreadCount = -1;
+		int stabilizerThreadCount = -1;
+		QString logFilePath = "orientview.log";
+	};
+
+	// Run the stabilizer passes or the encoder from the command line without any widgets, and print the progress to the standard output.
+	class HeadlessRunner : public QObject
+	{
+		Q_OBJECT
+
+	public:
+
+		~HeadlessRunner();
+
+		static HeadlessJob parseJob(const QString& argument);
+		static const char* getJobName(HeadlessJob job);
+		static bool parseOptions(const QStringList& arguments, HeadlessOptions& options);
+		static void printUsage();
+
+		int run(HeadlessJob job, const QString& iniFilePath, const HeadlessOptions& options);
+
+	private slots:
+
+		void frameStabilized(int frameNumber, double currentTime);
+		void frameEncoded(int frameNumber, int frameSize, double currentTime);
+
+	private:
+
+		int runStabilize();
+		int runStabilizePassTwo();
+		int runEncode();
+
+		void printProgress(int frameNumber, double currentTime, bool isFinal);
+		void printResult(const char* status);
+		void shutdown();
+
+		Settings* settings = nullptr;
+		OffscreenContext* offscreenContext = nullptr;
+		VideoDecoder* videoDecoder = nullptr;
+		VideoEncoder* videoEncoder = nullptr;
+		QuickRouteReader* quickRouteReader = nullptr;
+		MapImageReader* mapImageReader = nullptr;
+		VideoStabilizer* videoStabilizer = nullptr;
+		InputHandler* inputHandler = nullptr;
+		SplitsManager* splitsManager = nullptr;
+		RouteManager* routeManager = nullptr;
+		Renderer* renderer = nullptr;
+		VideoDecoderThread* videoDecoderThread = nullptr;
+		FrameStabilizerThread* frameStabilizerThread = nullptr;
+		RenderOffScreenThread* renderOffScreenThread = nullptr;
+		VideoEncoderThread* videoEncoderThread = nullptr;
+		VideoStabilizerThread* videoStabilizerThread = nullptr;
+
+		const char* jobName = "";
+		FILE* statusOutput = stdout; // the standard error when the encoder streams to the standard output
+		QElapsedTimer runTimer;
+		qint64 lastProgressTime = 0;
+		int64_t totalFrameCount = 0;
+		int processedFrameCount = 0;
+		double processedVideoTime = 0.0;
+		double totalOutputSize = 0.0; // megabytes
+	};
+}
@@ -194,22 +194,29 @@ void InputHandler::handleInput(double frameTime)
 		routeManager->requestFullUpdate();
 	}
 
+	if (videoWindow->keyIsDown(Qt::Key_Control) && videoWindow->keyIsDown(Qt::Key_5))
+		renderOnScreenThread->setPlaybackRate(1.0);
+
+	if (videoWindow->keyIsDownOnce(Qt::Key_Z))
+		renderOnScreenThread->setPlaybackRate(renderOnScreenThread->getPlaybackRate() / 2.0);
+
+	if (videoWindow->keyIsDownOnce(Qt::Key_X))
+		renderOnScreenThread->setPlaybackRate(renderOnScreenThread->getPlaybackRate() * 2.0);
+
 	if (scrollMode == ScrollMode::None)
 	{
 		if (keyIsDownWithRepeat(Qt::Key_Left, seekBackwardRepeatHandler))
 		{
-			videoDecoder->seekRelative(-seekAmount);
-			videoDecoderThread->signalFrameRead();
+			videoDecoderThread->requestSeek(-seekAmount);
+			renderOnScreenThread->resetPlaybackClock();
 			renderOnScreenThread->advanceOneFrame();
-			videoStabilizer->reset();
 		}
 
 		if (keyIsDownWithRepeat(Qt::Key_Right, seekForwardRepeatHandler))
 		{
-			videoDecoder->seekRelative(seekAmount);
-			videoDecoderThread->signalFrameRead();
+			videoDecoderThread->requestSeek(seekAmount);
+			renderOnScreenThread->resetPlaybackClock();
 			renderOnScreenThread->advanceOneFrame();
-			videoStabilizer->reset();
 		}
 	}
 
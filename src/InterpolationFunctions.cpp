@@ -0,0 +1,175 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+
+#include "InterpolationFunctions.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// argument range of the functions is -X_RANGE - X_RANGE (same as in rescale_bicubic.frag)
+	const double X_RANGE = 2.0;
+	const double PI = 3.14159265358979323846;
+
+	double sinc(double x)
+	{
+		return sin(PI * x) / (PI * x);
+	}
+}
+
+InterpolationFunction InterpolationFunctions::fromName(const QString& name, InterpolationFunction defaultFunction)
+{
+	QString lowerName = name.toLower();
+
+	if (lowerName == "triangle")
+		return InterpolationFunction::Triangle;
+	else if (lowerName == "bell")
+		return InterpolationFunction::Bell;
+	else if (lowerName == "bspline")
+		return InterpolationFunction::BSpline;
+	else if (lowerName == "catmullrom")
+		return InterpolationFunction::CatmullRom;
+	else if (lowerName == "lanczos")
+		return InterpolationFunction::Lanczos;
+	else
+		return defaultFunction;
+}
+
+void InterpolationFunctions::fromShaderDefines(const QMap<QString, QString>& defines, InterpolationFunction& function, double& lanczosSize)
+{
+	// same defines and defaults as in rescale_bicubic.frag
+	function = fromName(defines.value("INTERPOLATION_FUNCTION"), InterpolationFunction::Lanczos);
+	lanczosSize = QString(defines.value("LANCZOS_SIZE", "2.0")).remove('f').toDouble();
+
+	if (lanczosSize <= 0.0)
+		lanczosSize = 2.0;
+}
+
+double InterpolationFunctions::evaluate(InterpolationFunction function, double x, double lanczosSize)
+{
+	switch (function)
+	{
+		case InterpolationFunction::Triangle:
+		{
+			x = x / X_RANGE;
+
+			if (x <= 0.0)
+				return (x + 1.0);
+			else
+				return (1.0 - x);
+		}
+
+		case InterpolationFunction::Bell:
+		{
+			x = (x / X_RANGE) * 1.5;
+
+			if (x >= -1.5 && x <= -0.5)
+				return 0.5 * pow(x + 1.5, 2.0);
+			else if (x > -0.5 && x <= 0.5)
+				return 3.0 / 4.0 - (x * x);
+			else if (x > 0.5 && x <= 1.5)
+				return 0.5 * pow(x - 1.5, 2.0);
+			else
+				return 0.0;
+		}
+
+		case InterpolationFunction::BSpline:
+		{
+			x = (fabs(x) / X_RANGE) * 2.0;
+
+			if (x >= 0.0 && x <= 1.0)
+				return (2.0 / 3.0) + 0.5 * (x * x * x) - (x * x);
+			else if (x > 1.0 && x <= 2.0)
+				return (1.0 / 6.0) * pow(2.0 - x, 3.0);
+			else
+				return 0.0;
+		}
+
+		case InterpolationFunction::CatmullRom:
+		{
+			const double B = 0.0;
+			const double C = 0.5;
+
+			x = (fabs(x) / X_RANGE) * 2.0;
+
+			if (x < 1.0)
+				return ((12 - 9 * B - 6 * C) * (x * x * x) + (-18 + 12 * B + 6 * C) * (x * x) + (6 - 2 * B)) / 6.0;
+			else if (x >= 1.0 && x <= 2.0)
+				return ((-B - 6 * C) * (x * x * x) + (6 * B + 30 * C) * (x * x) + (-12 * B - 48 * C) * x + 8 * B + 24 * C) / 6.0;
+			else
+				return 0.0;
+		}
+
+		case InterpolationFunction::Lanczos:
+		{
+			x = (fabs(x) / X_RANGE) * lanczosSize;
+
+			if (x == 0.0)
+				return 1.0;
+			else
+				return sinc(x) * sinc(x / lanczosSize);
+		}
+
+		default: return 0.0;
+	}
+}
+
+std::vector<float> InterpolationFunctions::calculateWeightTable(InterpolationFunction function, int phaseCount, double lanczosSize)
+{
+	std::vector<float> weights(phaseCount * 4);
+
+	for (int i = 0; i < phaseCount; ++i)
+	{
+		double alpha = (double)i / phaseCount;
+		double tapWeights[4];
+		double sum = 0.0;
+
+		for (int tap = -1; tap <= 2; ++tap)
+		{
+			tapWeights[tap + 1] = evaluate(function, (double)tap - alpha, lanczosSize);
+			sum += tapWeights[tap + 1];
+		}
+
+		for (int tap = 0; tap < 4; ++tap)
+			weights[i * 4 + tap] = (float)(tapWeights[tap] / sum);
+	}
+
+	return weights;
+}
+
+double InterpolationFunctions::calculateWeightTableError(InterpolationFunction function, int phaseCount, double lanczosSize)
+{
+	std::vector<float> weights = calculateWeightTable(function, phaseCount, lanczosSize);
+	const int stepsPerPhase = 16;
+	double maximumError = 0.0;
+
+	for (int i = 0; i < phaseCount * stepsPerPhase; ++i)
+	{
+		double alpha = (double)i / (phaseCount * stepsPerPhase);
+		double tapWeights[4];
+		double sum = 0.0;
+
+		for (int tap = -1; tap <= 2; ++tap)
+		{
+			tapWeights[tap + 1] = evaluate(function, (double)tap - alpha, lanczosSize);
+			sum += tapWeights[tap + 1];
+		}
+
+		// same as linear texture filtering, the last phase is clamped
+		double position = alpha * phaseCount;
+		int index1 = std::min((int)position, phaseCount - 1);
+		int index2 = std::min(index1 + 1, phaseCount - 1);
+		double fraction = position - index1;
+
+		for (int tap = 0; tap < 4; ++tap)
+		{
+			double tableWeight = weights[index1 * 4 + tap] * (1.0 - fraction) + weights[index2 * 4 + tap] * fraction;
+			maximumError = std::max(maximumError, fabs(tableWeight - tapWeights[tap] / sum));
+		}
+	}
+
+	return maximumError;
+}
@@ -0,0 +1,31 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <vector>
+
+#include <QMap>
+#include <QString>
+
+namespace OrientView
+{
+	enum InterpolationFunction { Triangle, Bell, BSpline, CatmullRom, Lanczos };
+
+	// Evaluate the 4-tap interpolation functions of the bicubic rescale shader on the CPU.
+	class InterpolationFunctions
+	{
+
+	public:
+
+		static InterpolationFunction fromName(const QString& name, InterpolationFunction defaultFunction);
+		static void fromShaderDefines(const QMap<QString, QString>& defines, InterpolationFunction& function, double& lanczosSize);
+		static double evaluate(InterpolationFunction function, double x, double lanczosSize = 2.0);
+
+		// Normalized weights for taps -1, 0, 1 and 2 at phaseCount evenly spaced fractional positions.
+		static std::vector<float> calculateWeightTable(InterpolationFunction function, int phaseCount, double lanczosSize = 2.0);
+
+		// Largest difference between linearly interpolated table weights and the exact normalized weights.
+		static double calculateWeightTableError(InterpolationFunction function, int phaseCount, double lanczosSize = 2.0);
+	};
+}
@@ -0,0 +1,184 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+
+#include "LatencyHistogram.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// values below this are counted exactly, above it every power of two is split into half as many buckets
+	const int LINEAR_BUCKET_COUNT = 128;
+	const int BUCKETS_PER_MAGNITUDE = LINEAR_BUCKET_COUNT / 2;
+	const int MAXIMUM_MAGNITUDE = 31;
+	const int BUCKET_COUNT = LINEAR_BUCKET_COUNT + MAXIMUM_MAGNITUDE * BUCKETS_PER_MAGNITUDE;
+
+	// about 38 hours in microseconds
+	const int64_t MAXIMUM_VALUE = ((int64_t)LINEAR_BUCKET_COUNT << MAXIMUM_MAGNITUDE) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	bucketCounts.resize(BUCKET_COUNT, 0);
+}
+
+void LatencyHistogram::record(double duration)
+{
+	int64_t value = (int64_t)(duration * 1000.0 + 0.5);
+	value = std::max((int64_t)0, std::min(value, MAXIMUM_VALUE));
+
+	bucketCounts[getBucketIndex(value)]++;
+
+	if (count == 0)
+	{
+		minimumValue = value;
+		maximumValue = value;
+	}
+	else
+	{
+		minimumValue = std::min(minimumValue, value);
+		maximumValue = std::max(maximumValue, value);
+	}
+
+	count++;
+	totalValue += value;
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other)
+{
+	if (other.count == 0)
+		return;
+
+	for (int i = 0; i < BUCKET_COUNT; ++i)
+		bucketCounts[i] += other.bucketCounts[i];
+
+	minimumValue = (count == 0) ? other.minimumValue : std::min(minimumValue, other.minimumValue);
+	maximumValue = (count == 0) ? other.maximumValue : std::max(maximumValue, other.maximumValue);
+	count += other.count;
+	totalValue += other.totalValue;
+}
+
+void LatencyHistogram::reset()
+{
+	std::fill(bucketCounts.begin(), bucketCounts.end(), 0);
+	count = 0;
+	minimumValue = 0;
+	maximumValue = 0;
+	totalValue = 0.0;
+}
+
+int64_t LatencyHistogram::getCount() const
+{
+	return count;
+}
+
+double LatencyHistogram::getMinimum() const
+{
+	return minimumValue / 1000.0;
+}
+
+double LatencyHistogram::getMaximum() const
+{
+	return maximumValue / 1000.0;
+}
+
+double LatencyHistogram::getMean() const
+{
+	return (count > 0) ? totalValue / count / 1000.0 : 0.0;
+}
+
+double LatencyHistogram::getPercentile(double percentile) const
+{
+	return getPercentiles(std::vector<double> { percentile }).at(0);
+}
+
+std::vector<double> LatencyHistogram::getPercentiles(const std::vector<double>& percentiles) const
+{
+	std::vector<double> results(percentiles.size(), 0.0);
+
+	if (count == 0)
+		return results;
+
+	// the percentiles are given in ascending order, so all of them are found with one pass over the buckets
+	size_t resultIndex = 0;
+	int64_t cumulativeCount = 0;
+
+	for (int i = 0; i < BUCKET_COUNT && resultIndex < percentiles.size(); ++i)
+	{
+		cumulativeCount += bucketCounts[i];
+
+		while (resultIndex < percentiles.size())
+		{
+			int64_t targetCount = std::max((int64_t)1, (int64_t)std::ceil(percentiles[resultIndex] / 100.0 * count));
+
+			if (cumulativeCount < targetCount)
+				break;
+
+			int64_t value = std::max(minimumValue, std::min(getBucketMidpoint(i), maximumValue));
+			results[resultIndex++] = value / 1000.0;
+		}
+	}
+
+	while (resultIndex < percentiles.size())
+		results[resultIndex++] = maximumValue / 1000.0;
+
+	return results;
+}
+
+QString LatencyHistogram::getSummary() const
+{
+	if (count == 0)
+		return QString("no samples");
+
+	std::vector<double> values = getPercentiles(std::vector<double> { 50.0, 95.0, 99.0 });
+
+	return QString("p50 %1 ms, p95 %2 ms, p99 %3 ms, max %4 ms, mean %5 ms (%6 samples)")
+		.arg(QString::number(values[0], 'f', 2))
+		.arg(QString::number(values[1], 'f', 2))
+		.arg(QString::number(values[2], 'f', 2))
+		.arg(QString::number(getMaximum(), 'f', 2))
+		.arg(QString::number(getMean(), 'f', 2))
+		.arg(count);
+}
+
+QString LatencyHistogram::getStageName(LatencyStage stage)
+{
+	switch (stage)
+	{
+		case FrameLatency: return "frame";
+		case DecodeLatency: return "decode";
+		case StabilizeLatency: return "stabilize";
+		case RenderLatency: return "render";
+		case EncodeLatency: return "encode";
+		default: return "unknown";
+	}
+}
+
+int LatencyHistogram::getBucketIndex(int64_t value)
+{
+	if (value < LINEAR_BUCKET_COUNT)
+		return (int)value;
+
+	int magnitude = 1;
+
+	while ((value >> magnitude) >= LINEAR_BUCKET_COUNT)
+		magnitude++;
+
+	int subBucket = (int)(value >> magnitude) - BUCKETS_PER_MAGNITUDE;
+
+	return LINEAR_BUCKET_COUNT + (magnitude - 1) * BUCKETS_PER_MAGNITUDE + subBucket;
+}
+
+int64_t LatencyHistogram::getBucketMidpoint(int index)
+{
+	if (index < LINEAR_BUCKET_COUNT)
+		return index;
+
+	int magnitude = (index - LINEAR_BUCKET_COUNT) / BUCKETS_PER_MAGNITUDE + 1;
+	int64_t subBucket = (index - LINEAR_BUCKET_COUNT) % BUCKETS_PER_MAGNITUDE + BUCKETS_PER_MAGNITUDE;
+
+	return (subBucket << magnitude) + ((int64_t)1 << (magnitude - 1));
+}
@@ -0,0 +1,49 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <QString>
+
+namespace OrientView
+{
+	enum LatencyStage { FrameLatency, DecodeLatency, StabilizeLatency, RenderLatency, EncodeLatency, LatencyStageCount };
+
+	// Count durations in logarithmic buckets with about 1.6 % precision, so that percentiles can be read without keeping the samples.
+	class LatencyHistogram
+	{
+
+	public:
+
+		LatencyHistogram();
+
+		void record(double duration);
+		void add(const LatencyHistogram& other);
+		void reset();
+
+		int64_t getCount() const;
+		double getMinimum() const;
+		double getMaximum() const;
+		double getMean() const;
+		double getPercentile(double percentile) const;
+		std::vector<double> getPercentiles(const std::vector<double>& percentiles) const;
+
+		QString getSummary() const;
+
+		static QString getStageName(LatencyStage stage);
+
+	private:
+
+		static int getBucketIndex(int64_t value);
+		static int64_t getBucketMidpoint(int index);
+
+		std::vector<int64_t> bucketCounts;
+		int64_t count = 0;
+		int64_t minimumValue = 0; // microseconds
+		int64_t maximumValue = 0; // microseconds
+		double totalValue = 0.0; // microseconds
+	};
+}
@@ -0,0 +1,306 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <QByteArray>
+#include <QtGlobal>
+
+extern "C"
+{
+#include "libavutil/opt.h"
+}
+
+#include "LibavBackend.h"
+#include "VideoDecoder.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+LibavBackend::~LibavBackend()
+{
+	if (formatContext != nullptr)
+	{
+		if (!(formatContext->oformat->flags & AVFMT_NOFILE))
+			avio_closep(&formatContext->pb);
+
+		avformat_free_context(formatContext);
+		formatContext = nullptr;
+	}
+
+	if (codecContext != nullptr)
+		avcodec_free_context(&codecContext);
+
+	if (packet != nullptr)
+		av_packet_free(&packet);
+}
+
+// the encode cache is never used with this backend
+bool LibavBackend::initialize(VideoDecoder* videoDecoder, Settings* settings, int)
+{
+	codecName = settings->encoder.codec;
+	fragmentDuration = settings->encoder.fragmentDuration;
+
+	const AVCodec* codec = avcodec_find_encoder_by_name(qPrintable(codecName));
+
+	if (codec == nullptr || codec->type != AVMEDIA_TYPE_VIDEO)
+	{
+		qWarning("Could not find video encoder %s", qPrintable(codecName));
+		return false;
+	}
+
+	// a pipe has no file name to guess the container from
+	QString outputFilePath = settings->encoder.outputVideoFilePath;
+	QByteArray url = (outputFilePath == "-") ? QByteArray("pipe:1") : outputFilePath.toUtf8();
+	QByteArray formatName = settings->encoder.outputFormat.toUtf8();
+
+	if (formatName.isEmpty() && outputFilePath == "-")
+		formatName = "matroska";
+
+	if (avformat_alloc_output_context2(&formatContext, nullptr, formatName.isEmpty() ? nullptr : formatName.constData(), url.constData()) < 0 || formatContext == nullptr)
+	{
+		qWarning("Could not find an output format for %s", qPrintable(outputFilePath));
+		return false;
+	}
+
+	codecContext = avcodec_alloc_context3(codec);
+
+	if (codecContext == nullptr)
+	{
+		qWarning("Could not allocate encoder context");
+		return false;
+	}
+
+	// the converter writes BT.601 limited range, the same as swscale
+	codecContext->width = settings->window.width;
+	codecContext->height = settings->window.height;
+	codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+	codecContext->time_base = AVRational { (int)videoDecoder->getFrameRateDen(), (int)videoDecoder->getFrameRateNum() };
+	codecContext->framerate = AVRational { (int)videoDecoder->getFrameRateNum(), (int)videoDecoder->getFrameRateDen() };
+	codecContext->color_range = AVCOL_RANGE_MPEG;
+	codecContext->colorspace = AVCOL_SPC_SMPTE170M;
+	codecContext->chroma_sample_location = AVCHROMA_LOC_CENTER;
+
+	if (settings->encoder.threadCount > 0)
+		codecContext->thread_count = settings->encoder.threadCount;
+
+	if (formatContext->oformat->flags & AVFMT_GLOBALHEADER)
+		codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	AVDictionary* codecOptions = nullptr;
+
+	// the x264 style preset names are passed on only to the encoders that take a preset name
+	const AVOption* presetOption = (codec->priv_class != nullptr) ? av_opt_find((void*)&codec->priv_class, "preset", nullptr, 0, AV_OPT_SEARCH_FAKE_OBJ) : nullptr;
+
+	if (presetOption != nullptr && presetOption->type == AV_OPT_TYPE_STRING)
+		av_dict_set(&codecOptions, "preset", qPrintable(settings->encoder.preset), 0);
+
+	av_dict_set_int(&codecOptions, "crf", settings->encoder.constantRateFactor, 0);
+
+	// comma separated, for example "x265-params=log-level=none:tune=grain", these override the ones above
+	if (!settings->encoder.codecOptions.isEmpty() && av_dict_parse_string(&codecOptions, qPrintable(settings->encoder.codecOptions), "=", ",", 0) < 0)
+		qWarning("Could not parse encoder options \"%s\"", qPrintable(settings->encoder.codecOptions));
+
+	int openResult = avcodec_open2(codecContext, codec, &codecOptions);
+
+	AVDictionaryEntry* unusedOption = nullptr;
+
+	while ((unusedOption = av_dict_get(codecOptions, "", unusedOption, AV_DICT_IGNORE_SUFFIX)) != nullptr)
+		qWarning("Encoder %s has no option %s", qPrintable(codecName), unusedOption->key);
+
+	av_dict_free(&codecOptions);
+
+	if (openResult < 0)
+	{
+		qWarning("Could not open video encoder %s", qPrintable(codecName));
+		return false;
+	}
+
+	videoStream = avformat_new_stream(formatContext, nullptr);
+
+	if (videoStream == nullptr || avcodec_parameters_from_context(videoStream->codecpar, codecContext) < 0)
+	{
+		qWarning("Could not add video stream");
+		return false;
+	}
+
+	videoStream->time_base = codecContext->time_base;
+
+	if (!(formatContext->oformat->flags & AVFMT_NOFILE) && avio_open(&formatContext->pb, url.constData(), AVIO_FLAG_WRITE) < 0)
+	{
+		qWarning("Could not open output file %s", qPrintable(outputFilePath));
+		return false;
+	}
+
+	packet = av_packet_alloc();
+
+	if (packet == nullptr)
+	{
+		qWarning("Could not allocate packet");
+		return false;
+	}
+
+	return true;
+}
+
+// the packets are copied as they are, so any format the container takes goes
+bool LibavBackend::initializeAudio(AVStream* sourceAudioStream)
+{
+	AVCodecParameters* codecParameters = sourceAudioStream->codecpar;
+
+	if (avformat_query_codec(formatContext->oformat, codecParameters->codec_id, FF_COMPLIANCE_NORMAL) == 0)
+	{
+		qWarning("Could not pass through %s audio, the %s format doesn't support it", avcodec_get_name(codecParameters->codec_id), formatContext->oformat->name);
+		return false;
+	}
+
+	audioStream = avformat_new_stream(formatContext, nullptr);
+
+	if (audioStream == nullptr || avcodec_parameters_copy(audioStream->codecpar, codecParameters) < 0)
+	{
+		qWarning("Could not add audio stream");
+		return false;
+	}
+
+	audioStream->codecpar->codec_tag = 0;
+	audioStream->time_base = sourceAudioStream->time_base;
+	audioTimeBase = sourceAudioStream->time_base;
+
+	return true;
+}
+
+bool LibavBackend::writeHeaders()
+{
+	AVDictionary* formatOptions = nullptr;
+
+	// the same kind of fragmented file as the x264 backend writes, only the MP4 and MOV muxers know these
+	if (fragmentDuration > 0.0)
+	{
+		av_dict_set(&formatOptions, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+		av_dict_set_int(&formatOptions, "frag_duration", (int64_t)(fragmentDuration * 1000000.0), 0);
+	}
+
+	int result = avformat_write_header(formatContext, &formatOptions);
+	av_dict_free(&formatOptions);
+
+	if (result < 0)
+	{
+		qWarning("Could not write output header");
+		return false;
+	}
+
+	isHeaderWritten = true;
+
+	return true;
+}
+
+int LibavBackend::encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe)
+{
+	picture->pts = pts;
+	picture->pict_type = forceKeyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+
+	// the encoder takes a reference to the frame instead of copying it
+	if (avcodec_send_frame(codecContext, picture) < 0)
+	{
+		qWarning("Could not encode frame");
+		return -1;
+	}
+
+	return writeEncodedPackets();
+}
+
+int LibavBackend::flush()
+{
+	if (avcodec_send_frame(codecContext, nullptr) < 0)
+	{
+		qWarning("Could not flush encoder");
+		return -1;
+	}
+
+	return writeEncodedPackets();
+}
+
+bool LibavBackend::writeAudioPacket(AVPacket* sourcePacket, int64_t timestamp)
+{
+	AVPacket* audioPacket = av_packet_clone(sourcePacket);
+
+	if (audioPacket == nullptr)
+		return false;
+
+	audioPacket->pts = timestamp;
+	audioPacket->dts = timestamp;
+	audioPacket->pos = -1;
+	audioPacket->stream_index = audioStream->index;
+	av_packet_rescale_ts(audioPacket, audioTimeBase, audioStream->time_base);
+
+	int result = av_interleaved_write_frame(formatContext, audioPacket);
+	av_packet_free(&audioPacket);
+
+	return (result >= 0);
+}
+
+bool LibavBackend::close(int64_t)
+{
+	bool isSuccessful = true;
+
+	if (isHeaderWritten && av_write_trailer(formatContext) < 0)
+	{
+		qWarning("Could not write output trailer");
+		isSuccessful = false;
+	}
+
+	isHeaderWritten = false;
+
+	// the data still buffered goes out here, so a full disk may only show up now
+	if (!(formatContext->oformat->flags & AVFMT_NOFILE) && formatContext->pb != nullptr)
+	{
+		bool hasWriteError = (formatContext->pb->error < 0);
+
+		if (avio_closep(&formatContext->pb) < 0 || hasWriteError)
+		{
+			qWarning("Could not write output file");
+			isSuccessful = false;
+		}
+	}
+
+	return isSuccessful;
+}
+
+void LibavBackend::logStatistics()
+{
+	qDebug("Encoder: %s into %s, %lld frames, %.1f MB", qPrintable(codecName), formatContext->oformat->name, (long long)encodedFrameCount, encodedByteCount / 1000000.0);
+}
+
+// returns the size of the packets that came out, the encoder may still hold some frames back
+int LibavBackend::writeEncodedPackets()
+{
+	int totalSize = 0;
+
+	while (true)
+	{
+		int result = avcodec_receive_packet(codecContext, packet);
+
+		if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+			break;
+
+		if (result < 0)
+		{
+			qWarning("Could not receive encoded packet");
+			return -1;
+		}
+
+		av_packet_rescale_ts(packet, codecContext->time_base, videoStream->time_base);
+		packet->stream_index = videoStream->index;
+
+		totalSize += packet->size;
+		encodedByteCount += packet->size;
+		encodedFrameCount++;
+
+		// the muxer takes over the packet and leaves it blank
+		if (av_interleaved_write_frame(formatContext, packet) < 0)
+		{
+			qWarning("Could not write encoded packet");
+			return -1;
+		}
+	}
+
+	return totalSize;
+}
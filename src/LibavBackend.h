@@ -0,0 +1,55 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QString>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+#include "EncoderBackend.h"
+
+namespace OrientView
+{
+	// Encode with any libavcodec encoder (for example HEVC or AV1) into any libavformat container, a "-" output streams to the standard output.
+	class LibavBackend : public EncoderBackend
+	{
+
+	public:
+
+		~LibavBackend();
+
+		bool initialize(VideoDecoder* videoDecoder, Settings* settings, int cacheGopLength);
+		bool initializeAudio(AVStream* sourceAudioStream);
+		bool writeHeaders();
+
+		int encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe);
+		int flush();
+
+		bool writeAudioPacket(AVPacket* packet, int64_t timestamp);
+		bool close(int64_t frameCount);
+
+		void logStatistics();
+
+	private:
+
+		int writeEncodedPackets();
+
+		AVFormatContext* formatContext = nullptr;
+		AVCodecContext* codecContext = nullptr;
+		AVStream* videoStream = nullptr;
+		AVStream* audioStream = nullptr;
+		AVRational audioTimeBase = { 1, 1 }; // of the source stream
+		AVPacket* packet = nullptr;
+		bool isHeaderWritten = false;
+		double fragmentDuration = 0.0;
+
+		QString codecName;
+		int64_t encodedFrameCount = 0;
+		int64_t encodedByteCount = 0;
+	};
+}
@@ -1,14 +1,19 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <memory>
 #include <typeinfo>
 
 #include <QApplication>
 #include <QDir>
+#include <QFileInfo>
 #include <QFontDatabase>
 
+#include "BatchScheduler.h"
 #include "FileHandler.h"
+#include "HeadlessRunner.h"
 #include "MainWindow.h"
+#include "OffscreenContext.h"
 #include "SimpleLogger.h"
 
 namespace
@@ -23,8 +28,33 @@ namespace
 
 int main(int argc, char *argv[])
 {
+	int exitCode = 0;
+
 	try
 	{
+		// orientview --encode job.ini runs the job without any windows
+		bool isHeadless = (argc >= 2 && QString(argv[1]).startsWith("--"));
+		OrientView::HeadlessJob headlessJob = isHeadless ? OrientView::HeadlessRunner::parseJob(QString(argv[1])) : OrientView::HeadlessJob::None;
+
+		if (isHeadless && (headlessJob == OrientView::HeadlessJob::None || argc < 3))
+		{
+			OrientView::HeadlessRunner::printUsage();
+			return OrientView::ExitUsageError;
+		}
+
+		QStringList headlessArguments;
+		OrientView::HeadlessOptions headlessOptions;
+
+		for (int i = 3; i < argc; ++i)
+			headlessArguments << QString(argv[i]);
+
+		// the batch scheduler reads its own options
+		if (isHeadless && headlessJob != OrientView::HeadlessJob::Batch && !OrientView::HeadlessRunner::parseOptions(headlessArguments, headlessOptions))
+		{
+			OrientView::HeadlessRunner::printUsage();
+			return OrientView::ExitUsageError;
+		}
+
 		QCoreApplication::setOrganizationDomain("orientview.com");
 		
 #ifdef Q_OS_WIN32
@@ -35,11 +65,22 @@ int main(int argc, char *argv[])
 		QCoreApplication::setOrganizationName("orientview");
 		QCoreApplication::setApplicationName("orientview");
 #endif
-		QApplication app(argc, argv);
+		// without any display server, fall back to surfaceless EGL so that offscreen rendering still works
+		if (OrientView::OffscreenContext::shouldUseHeadlessPlatform())
+			OrientView::OffscreenContext::selectHeadlessPlatform();
 
-		QDir::setCurrent(QCoreApplication::applicationDirPath());
+		// the command line mode draws nothing on the screen, so it does not need the widgets
+		std::unique_ptr<QGuiApplication> app(isHeadless ? new QGuiApplication(argc, argv) : new QApplication(argc, argv));
 
-		logger.initialize("orientview.log");
+		// relative to where the command was run (the job list in batch mode)
+		QString headlessIniFilePath = isHeadless ? QFileInfo(QString(argv[2])).absoluteFilePath() : QString();
+
+		// the command line mode stays in the directory it was run from, so that the log file and the relative paths end up where the user expects
+		if (!isHeadless)
+			QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+		logger.initialize(headlessOptions.logFilePath);
+		logger.setUseStandardError(isHeadless);
 		qInstallMessageHandler(messageHandler);
 
 		const QString fontPath = getDataFilePath("fonts/dejavu-sans-bold.ttf");
@@ -47,6 +88,18 @@ int main(int argc, char *argv[])
 		if (QFontDatabase::addApplicationFont(fontPath) == -1)
 			qWarning("Could not load font");
 
+		if (isHeadless && headlessJob == OrientView::HeadlessJob::Batch)
+		{
+			OrientView::BatchScheduler batchScheduler;
+			return batchScheduler.run(headlessIniFilePath, headlessArguments);
+		}
+
+		if (isHeadless)
+		{
+			OrientView::HeadlessRunner headlessRunner;
+			return headlessRunner.run(headlessJob, headlessIniFilePath, headlessOptions);
+		}
+
 		OrientView::MainWindow mainWindow;
 
 		logger.setMainWindow(&mainWindow);
@@ -57,7 +110,7 @@ int main(int argc, char *argv[])
 			mainWindow.readSettingsFromLocal();
 
 		mainWindow.show();
-		app.exec();
+		exitCode = app->exec();
 
 		mainWindow.writeSettingsToLocal();
 	}
@@ -65,4 +118,6 @@ int main(int argc, char *argv[])
 	{
 		qFatal("Exception (%s): %s", typeid(ex).name(), ex.what());
 	}
+
+	return exitCode;
 }
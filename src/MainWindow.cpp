@@ -14,6 +14,7 @@
 #include "Settings.h"
 #include "VideoWindow.h"
 #include "EncodeWindow.h"
+#include "OffscreenContext.h"
 #include "StabilizeWindow.h"
 #include "VideoDecoder.h"
 #include "VideoEncoder.h"
@@ -25,10 +26,12 @@
 #include "RouteManager.h"
 #include "Renderer.h"
 #include "VideoDecoderThread.h"
+#include "FrameStabilizerThread.h"
 #include "RenderOnScreenThread.h"
 #include "RenderOffScreenThread.h"
 #include "VideoEncoderThread.h"
 #include "VideoStabilizerThread.h"
+#include "PipelineTracer.h"
 
 using namespace OrientView;
 
@@ -203,6 +206,7 @@ void MainWindow::on_actionPlayVideo_triggered()
 		splitsManager = new SplitsManager();
 		routeManager = new RouteManager();
 		videoDecoderThread = new VideoDecoderThread();
+		frameStabilizerThread = new FrameStabilizerThread();
 		renderOnScreenThread = new RenderOnScreenThread();
 
 		videoWindow->show();
@@ -210,7 +214,7 @@ void MainWindow::on_actionPlayVideo_triggered()
 		if (!videoWindow->initialize(settings))
 			throw std::runtime_error("Could not initialize video window");
 
-		if (!renderer->initialize(videoDecoder, mapImageReader, videoStabilizer, inputHandler, routeManager, settings, false))
+		if (!renderer->initialize(videoDecoder, mapImageReader, inputHandler, routeManager, settings, false))
 			throw std::runtime_error("Could not initialize renderer");
 
 		if (!videoStabilizer->initialize(settings, false))
@@ -222,8 +226,11 @@ void MainWindow::on_actionPlayVideo_triggered()
 		if (!routeManager->initialize(quickRouteReader, splitsManager, renderer, settings))
 			throw std::runtime_error("Could not initialize route manager");
 
-		videoDecoderThread->initialize(videoDecoder);
-		renderOnScreenThread->initialize(this, videoWindow, videoDecoder, videoDecoderThread, videoStabilizer, routeManager, renderer, inputHandler);
+		routeManager->warmUp(settings->video.startTimeOffset, videoDecoder->getFrameDuration());
+
+		videoDecoderThread->initialize(videoDecoder, settings);
+		frameStabilizerThread->initialize(videoDecoderThread, videoStabilizer, settings);
+		renderOnScreenThread->initialize(this, videoWindow, videoDecoder, videoDecoderThread, frameStabilizerThread, videoStabilizer, routeManager, renderer, inputHandler, settings);
 
 		connect(videoWindow, &VideoWindow::closing, this, &MainWindow::playVideoFinished);
 		connect(videoWindow, &VideoWindow::resizing, renderOnScreenThread, &RenderOnScreenThread::windowResized);
@@ -231,7 +238,10 @@ void MainWindow::on_actionPlayVideo_triggered()
 		videoWindow->getContext()->doneCurrent();
 		videoWindow->getContext()->moveToThread(renderOnScreenThread);
 
+		PipelineTracer::start(settings);
+
 		videoDecoderThread->start();
+		frameStabilizerThread->start();
 		renderOnScreenThread->start();
 
 		this->hide();
@@ -259,6 +269,14 @@ void MainWindow::playVideoFinished()
 		renderOnScreenThread = nullptr;
 	}
 
+	if (frameStabilizerThread != nullptr)
+	{
+		frameStabilizerThread->requestInterruption();
+		frameStabilizerThread->wait();
+		delete frameStabilizerThread;
+		frameStabilizerThread = nullptr;
+	}
+
 	if (videoDecoderThread != nullptr)
 	{
 		videoDecoderThread->requestInterruption();
@@ -267,6 +285,8 @@ void MainWindow::playVideoFinished()
 		videoDecoderThread = nullptr;
 	}
 
+	PipelineTracer::finish();
+
 	if (videoWindow != nullptr && videoWindow->getIsInitialized())
 		videoWindow->getContext()->makeCurrent(videoWindow);
 
@@ -380,6 +400,7 @@ void MainWindow::on_actionEncodeVideo_triggered()
 		splitsManager = new SplitsManager();
 		routeManager = new RouteManager();
 		videoDecoderThread = new VideoDecoderThread();
+		frameStabilizerThread = new FrameStabilizerThread();
 		renderOffScreenThread = new RenderOffScreenThread();
 		videoEncoderThread = new VideoEncoderThread();
 
@@ -389,7 +410,7 @@ void MainWindow::on_actionEncodeVideo_triggered()
 		if (!videoEncoder->initialize(videoDecoder, settings))
 			throw std::runtime_error("Could not initialize video encoder");
 
-		if (!renderer->initialize(videoDecoder, mapImageReader, videoStabilizer, inputHandler, routeManager, settings, true))
+		if (!renderer->initialize(videoDecoder, mapImageReader, inputHandler, routeManager, settings, true))
 			throw std::runtime_error("Could not initialize renderer");
 
 		if (!videoStabilizer->initialize(settings, false))
@@ -400,8 +421,11 @@ void MainWindow::on_actionEncodeVideo_triggered()
 		if (!routeManager->initialize(quickRouteReader, splitsManager, renderer, settings))
 			throw std::runtime_error("Could not initialize route manager");
 
-		videoDecoderThread->initialize(videoDecoder);
-		renderOffScreenThread->initialize(this, encodeWindow, videoDecoder, videoDecoderThread, videoStabilizer, routeManager, renderer, videoEncoder);
+		routeManager->warmUp(settings->video.startTimeOffset, videoDecoder->getFrameDuration());
+
+		videoDecoderThread->initialize(videoDecoder, settings);
+		frameStabilizerThread->initialize(videoDecoderThread, videoStabilizer, settings);
+		renderOffScreenThread->initialize(encodeWindow->getOffscreenContext(), videoDecoder, videoDecoderThread, frameStabilizerThread, videoStabilizer, routeManager, renderer, videoEncoder, settings);
 		videoEncoderThread->initialize(videoDecoder, videoEncoder, renderOffScreenThread);
 
 		connect(encodeWindow, &EncodeWindow::closing, this, &MainWindow::encodeVideoFinished);
@@ -411,10 +435,16 @@ void MainWindow::on_actionEncodeVideo_triggered()
 		encodeWindow->setModal(true);
 		encodeWindow->show();
 
-		encodeWindow->getContext()->doneCurrent();
-		encodeWindow->getContext()->moveToThread(renderOffScreenThread);
+		if (encodeWindow->getOffscreenContext() != nullptr)
+		{
+			encodeWindow->getOffscreenContext()->doneCurrent();
+			encodeWindow->getOffscreenContext()->moveToThread(renderOffScreenThread);
+		}
+
+		PipelineTracer::start(settings);
 
 		videoDecoderThread->start();
+		frameStabilizerThread->start();
 		renderOffScreenThread->start();
 		videoEncoderThread->start();
 	}
@@ -449,6 +479,14 @@ void MainWindow::encodeVideoFinished()
 		renderOffScreenThread = nullptr;
 	}
 
+	if (frameStabilizerThread != nullptr)
+	{
+		frameStabilizerThread->requestInterruption();
+		frameStabilizerThread->wait();
+		delete frameStabilizerThread;
+		frameStabilizerThread = nullptr;
+	}
+
 	if (videoDecoderThread != nullptr)
 	{
 		videoDecoderThread->requestInterruption();
@@ -457,8 +495,10 @@ void MainWindow::encodeVideoFinished()
 		videoDecoderThread = nullptr;
 	}
 
-	if (encodeWindow != nullptr && encodeWindow->getIsInitialized())
-		encodeWindow->getContext()->makeCurrent(encodeWindow->getSurface());
+	PipelineTracer::finish();
+
+	if (encodeWindow != nullptr && encodeWindow->getIsInitialized() && encodeWindow->getOffscreenContext() != nullptr)
+		encodeWindow->getOffscreenContext()->makeCurrent();
 
 	if (routeManager != nullptr)
 	{
@@ -736,6 +776,7 @@ void MainWindow::on_pushButtonVideoStabilizerPassOneRun_clicked()
 		stabilizeWindow->setModal(true);
 		stabilizeWindow->show();
 
+		PipelineTracer::start(settings);
 		videoStabilizerThread->start();
 	}
 	catch (const std::exception& ex)
@@ -761,6 +802,8 @@ void MainWindow::stabilizeVideoFinished()
 		videoStabilizerThread = nullptr;
 	}
 
+	PipelineTracer::finish();
+
 	if (videoStabilizer != nullptr)
 	{
 		delete videoStabilizer;
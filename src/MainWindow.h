@@ -27,6 +27,7 @@ namespace OrientView
 	class RouteManager;
 	class Renderer;
 	class VideoDecoderThread;
+	class FrameStabilizerThread;
 	class RenderOnScreenThread;
 	class RenderOffScreenThread;
 	class VideoEncoderThread;
@@ -100,6 +101,7 @@ namespace OrientView
 		RouteManager* routeManager = nullptr;
 		Renderer* renderer = nullptr;
 		VideoDecoderThread* videoDecoderThread = nullptr;
+		FrameStabilizerThread* frameStabilizerThread = nullptr;
 		RenderOnScreenThread* renderOnScreenThread = nullptr;
 		RenderOffScreenThread* renderOffScreenThread = nullptr;
 		VideoEncoderThread* videoEncoderThread = nullptr;
@@ -12,9 +12,10 @@ extern "C"
 }
 
 #include "Mp4File.h"
+#include "FileWriterThread.h"
 
 #define H264_NALU_LENGTH_SIZE 4
-#define LOG_IF_ERR(cond, ...) if(cond) { qWarning(__VA_ARGS__); }
+#define FAIL_IF_ERR(cond, ...) if(cond) { qWarning(__VA_ARGS__); isSuccessful = false; }
 #define RETURN_IF_ERR(cond, ...) if(cond) { qWarning(__VA_ARGS__); return false; }
 
 namespace OrientView
@@ -35,12 +36,113 @@ namespace OrientView
 		int frameNumber;
 		int64_t initDelta;
 		lsmash_file_parameters_t fileParameters;
+		uint64_t fragmentLength; // media timescale units, zero for a regular file
+		uint64_t fragmentStartDts;
+		bool hasFragment;
+		lsmash_audio_summary_t* audioSummary;
+		uint32_t audioTrack; // zero without audio
+		uint32_t audioSampleEntry;
+		uint32_t audioTimescale;
+		uint32_t audioFrameLength;
+		int64_t audioFirstDts; // audio timescale units on the output timeline, -1 before the first sample
+		int64_t audioLastDts;
 	};
+
+	// the audio starts where its first sample falls on the output timeline, the gap before it is an empty edit
+	bool setAudioTimeline(Mp4Handle* mp4Handle, uint64_t duration)
+	{
+		if (mp4Handle->audioFirstDts > 0)
+		{
+			lsmash_edit_t emptyEdit;
+			emptyEdit.duration = (uint64_t)mp4Handle->audioFirstDts * mp4Handle->movieTimescale / mp4Handle->audioTimescale;
+			emptyEdit.start_time = ISOM_EDIT_MODE_EMPTY;
+			emptyEdit.rate = ISOM_EDIT_MODE_NORMAL;
+			RETURN_IF_ERR(lsmash_create_explicit_timeline_map(mp4Handle->root, mp4Handle->audioTrack, emptyEdit), "Failed to set timeline map for audio");
+		}
+
+		lsmash_edit_t edit;
+		edit.duration = duration;
+		edit.start_time = 0;
+		edit.rate = ISOM_EDIT_MODE_NORMAL;
+		RETURN_IF_ERR(lsmash_create_explicit_timeline_map(mp4Handle->root, mp4Handle->audioTrack, edit), "Failed to set timeline map for audio");
+
+		return true;
+	}
+
+	// l-smash writes through these, so the file system is only touched on the writer thread
+	int writeCallback(void* opaque, uint8_t* data, int size)
+	{
+		return ((FileWriterThread*)opaque)->write(data, size) ? size : -1;
+	}
+
+	int readCallback(void* opaque, uint8_t* data, int size)
+	{
+		return ((FileWriterThread*)opaque)->read(data, size);
+	}
+
+	int64_t seekCallback(void* opaque, int64_t offset, int whence)
+	{
+		return ((FileWriterThread*)opaque)->seek(offset, whence);
+	}
+
+	// l-smash doesn't always pass on the errors of the callbacks, a failed write stays failed and stops the encoding at the next sample
+	bool getIsWriteFailed(Mp4Handle* mp4Handle)
+	{
+		return ((FileWriterThread*)mp4Handle->fileParameters.opaque)->getIsFailed();
+	}
+
+	// a new fragment starts at the first keyframe after the fragment length, the samples of the previous one are written out and released
+	bool appendSample(Mp4Handle* mp4Handle, lsmash_sample_t* sample)
+	{
+		if (mp4Handle->fragmentLength > 0 && (sample->prop.ra_flags & ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC))
+		{
+			if (!mp4Handle->hasFragment)
+			{
+				// the initial movie is written with the first fragment, so the edit list can't wait for the end
+				lsmash_edit_t edit;
+				edit.duration = ISOM_EDIT_DURATION_IMPLICIT;
+				edit.start_time = mp4Handle->firstCts;
+				edit.rate = ISOM_EDIT_MODE_NORMAL;
+				RETURN_IF_ERR(lsmash_create_explicit_timeline_map(mp4Handle->root, mp4Handle->track, edit), "Failed to set timeline map for video");
+
+				if (mp4Handle->audioTrack)
+				{
+					RETURN_IF_ERR(!setAudioTimeline(mp4Handle, ISOM_EDIT_DURATION_IMPLICIT), "Failed to set the audio timeline of a fragmented file");
+					RETURN_IF_ERR(lsmash_flush_pooled_samples(mp4Handle->root, mp4Handle->audioTrack, mp4Handle->audioFrameLength), "Failed to flush the audio samples of the initial movie");
+				}
+
+				RETURN_IF_ERR(lsmash_create_fragment_movie(mp4Handle->root), "Failed to create the first movie fragment");
+
+				mp4Handle->hasFragment = true;
+				mp4Handle->fragmentStartDts = sample->dts;
+			}
+			else if (sample->dts - mp4Handle->fragmentStartDts >= mp4Handle->fragmentLength)
+			{
+				RETURN_IF_ERR(lsmash_flush_pooled_samples(mp4Handle->root, mp4Handle->track, mp4Handle->timeIncrement), "Failed to flush the samples of a movie fragment");
+
+				if (mp4Handle->audioTrack)
+				{
+					RETURN_IF_ERR(lsmash_flush_pooled_samples(mp4Handle->root, mp4Handle->audioTrack, mp4Handle->audioFrameLength), "Failed to flush the audio samples of a movie fragment");
+				}
+
+				RETURN_IF_ERR(lsmash_create_fragment_movie(mp4Handle->root), "Failed to create a movie fragment");
+
+				mp4Handle->fragmentStartDts = sample->dts;
+			}
+		}
+
+		RETURN_IF_ERR(lsmash_append_sample(mp4Handle->root, mp4Handle->track, sample), "Failed to append a video frame");
+		RETURN_IF_ERR(getIsWriteFailed(mp4Handle), "Failed to write the output file");
+
+		mp4Handle->frameNumber++;
+
+		return true;
+	}
 }
 
 using namespace OrientView;
 
-bool Mp4File::open(const QString& fileName)
+bool Mp4File::open(const QString& fileName, int writeBufferSize, int writeBufferCount)
 {
 	mp4Handle = (Mp4Handle*)calloc(1, sizeof(Mp4Handle));
 	RETURN_IF_ERR(!mp4Handle, "Failed to allocate memory for muxer information");
@@ -48,7 +150,21 @@ bool Mp4File::open(const QString& fileName)
 	mp4Handle->root = lsmash_create_root();
 	RETURN_IF_ERR(!mp4Handle->root, "Failed to create root");
 
-	RETURN_IF_ERR(lsmash_open_file(fileName.toUtf8().constData(), 0, &mp4Handle->fileParameters) < 0, "Failed to open an output file");
+	fileWriterThread = new FileWriterThread();
+	RETURN_IF_ERR(!fileWriterThread->initialize(fileName, writeBufferSize, writeBufferCount), "Failed to open an output file");
+	fileWriterThread->start();
+
+	// the same as lsmash_open_file() would set up for writing, but on top of the writer thread instead of a FILE
+	lsmash_file_parameters_t* fileParameters = &mp4Handle->fileParameters;
+	fileParameters->mode = (lsmash_file_mode)(LSMASH_FILE_MODE_WRITE | LSMASH_FILE_MODE_BOX | LSMASH_FILE_MODE_INITIALIZATION | LSMASH_FILE_MODE_MEDIA);
+	fileParameters->opaque = fileWriterThread;
+	fileParameters->write = writeCallback;
+	fileParameters->read = readCallback;
+	fileParameters->seek = seekCallback;
+	fileParameters->max_chunk_duration = 0.5;
+	fileParameters->max_async_tolerance = 2.0;
+	fileParameters->max_chunk_size = 4 * 1024 * 1024;
+	fileParameters->max_read_size = 4 * 1024 * 1024;
 
 	mp4Handle->summary = (lsmash_video_summary_t*)lsmash_create_summary(LSMASH_SUMMARY_TYPE_VIDEO);
 	RETURN_IF_ERR(!mp4Handle->summary, "Failed to allocate memory for summary information of video");
@@ -58,7 +174,7 @@ bool Mp4File::open(const QString& fileName)
 	return true;
 }
 
-bool Mp4File::setParameters(x264_param_t* param)
+bool Mp4File::setParameters(x264_param_t* param, double fragmentDuration)
 {
 	uint64_t mediaTimescale = (uint64_t)param->i_timebase_den;
 	mp4Handle->timeIncrement = (uint64_t)param->i_timebase_num;
@@ -71,6 +187,10 @@ bool Mp4File::setParameters(x264_param_t* param)
 	fileParameters->brands = brands;
 	fileParameters->brand_count = 3;
 	fileParameters->minor_version = 0;
+
+	if (fragmentDuration > 0.0)
+		fileParameters->mode = (lsmash_file_mode)(fileParameters->mode | LSMASH_FILE_MODE_FRAGMENTED);
+
 	RETURN_IF_ERR(!lsmash_set_file(mp4Handle->root, fileParameters), "Failed to add an output file into a ROOT");
 
 	lsmash_movie_parameters_t movieParameters;
@@ -106,6 +226,65 @@ bool Mp4File::setParameters(x264_param_t* param)
 	mp4Handle->videoTimescale = lsmash_get_media_timescale(mp4Handle->root, mp4Handle->track);
 	RETURN_IF_ERR(!mp4Handle->videoTimescale, "Media timescale for video is broken");
 
+	mp4Handle->fragmentLength = (fragmentDuration > 0.0) ? (uint64_t)(fragmentDuration * mp4Handle->videoTimescale) : 0;
+
+	return true;
+}
+
+// AAC only, the decoder specific info is the AudioSpecificConfig of the source stream
+bool Mp4File::addAudioTrack(int sampleRate, int channelCount, int frameLength, const uint8_t* decoderSpecificInfo, size_t decoderSpecificInfoSize)
+{
+	mp4Handle->audioTrack = lsmash_create_track(mp4Handle->root, ISOM_MEDIA_HANDLER_TYPE_AUDIO_TRACK);
+	RETURN_IF_ERR(!mp4Handle->audioTrack, "Failed to create an audio track");
+
+	lsmash_track_parameters_t trackParameters;
+	lsmash_initialize_track_parameters(&trackParameters);
+	trackParameters.mode = (lsmash_track_mode)(ISOM_TRACK_ENABLED | ISOM_TRACK_IN_MOVIE | ISOM_TRACK_IN_PREVIEW);
+	RETURN_IF_ERR(lsmash_set_track_parameters(mp4Handle->root, mp4Handle->audioTrack, &trackParameters), "Failed to set track parameters for audio");
+
+	lsmash_media_parameters_t mediaParameters;
+	lsmash_initialize_media_parameters(&mediaParameters);
+	mediaParameters.timescale = (uint32_t)sampleRate;
+	mediaParameters.media_handler_name = (char*)"OrientView";
+	RETURN_IF_ERR(lsmash_set_media_parameters(mp4Handle->root, mp4Handle->audioTrack, &mediaParameters), "Failed to set media parameters for audio");
+
+	mp4Handle->audioTimescale = lsmash_get_media_timescale(mp4Handle->root, mp4Handle->audioTrack);
+	RETURN_IF_ERR(!mp4Handle->audioTimescale, "Media timescale for audio is broken");
+
+	mp4Handle->audioSummary = (lsmash_audio_summary_t*)lsmash_create_summary(LSMASH_SUMMARY_TYPE_AUDIO);
+	RETURN_IF_ERR(!mp4Handle->audioSummary, "Failed to allocate memory for summary information of audio");
+
+	mp4Handle->audioSummary->sample_type = ISOM_CODEC_TYPE_MP4A_AUDIO;
+	mp4Handle->audioSummary->aot = MP4A_AUDIO_OBJECT_TYPE_AAC_LC;
+	mp4Handle->audioSummary->frequency = (uint32_t)sampleRate;
+	mp4Handle->audioSummary->channels = (uint32_t)channelCount;
+	mp4Handle->audioSummary->sample_size = 16;
+	mp4Handle->audioSummary->samples_in_frame = (uint32_t)frameLength;
+	mp4Handle->audioSummary->sbr_mode = MP4A_AAC_SBR_NOT_SPECIFIED;
+
+	lsmash_codec_specific_t* cs = lsmash_create_codec_specific_data(LSMASH_CODEC_SPECIFIC_DATA_TYPE_MP4SYS_DECODER_CONFIG, LSMASH_CODEC_SPECIFIC_FORMAT_STRUCTURED);
+	RETURN_IF_ERR(!cs, "Failed to allocate AAC specific info");
+
+	lsmash_mp4sys_decoder_parameters_t* param = (lsmash_mp4sys_decoder_parameters_t*)cs->data.structured;
+	param->objectTypeIndication = MP4SYS_OBJECT_TYPE_Audio_ISO_14496_3;
+	param->streamType = MP4SYS_STREAM_TYPE_AudioStream;
+
+	if (lsmash_set_mp4sys_decoder_specific_info(param, (uint8_t*)decoderSpecificInfo, (uint32_t)decoderSpecificInfoSize) || lsmash_add_codec_specific_data((lsmash_summary_t*)mp4Handle->audioSummary, cs))
+	{
+		lsmash_destroy_codec_specific_data(cs);
+		qWarning("Failed to add AAC specific info");
+		return false;
+	}
+
+	lsmash_destroy_codec_specific_data(cs);
+
+	mp4Handle->audioSampleEntry = lsmash_add_sample_entry(mp4Handle->root, mp4Handle->audioTrack, mp4Handle->audioSummary);
+	RETURN_IF_ERR(!mp4Handle->audioSampleEntry, "Failed to add sample entry for audio");
+
+	mp4Handle->audioFrameLength = (uint32_t)frameLength;
+	mp4Handle->audioFirstDts = -1;
+	mp4Handle->audioLastDts = -1;
+
 	return true;
 }
 
@@ -169,42 +348,119 @@ bool Mp4File::writeFrame(uint8_t* payload, size_t size, x264_picture_t* picture)
 	p_sample->index = mp4Handle->sampleEntry;
 	p_sample->prop.ra_flags = picture->b_keyframe ? ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC : ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE;
 
-	RETURN_IF_ERR(lsmash_append_sample(mp4Handle->root, mp4Handle->track, p_sample), "Failed to append a video frame");
+	return appendSample(mp4Handle, p_sample);
+}
+
+// a sample read back from an earlier file of the same settings, it already has its SEI if it was the first one
+bool Mp4File::writeCopiedFrame(const uint8_t* data, size_t size, int64_t pts, bool isKeyframe)
+{
+	if (!mp4Handle->frameNumber)
+	{
+		mp4Handle->startOffset = pts * -1;
+		mp4Handle->firstCts = mp4Handle->startOffset * mp4Handle->timeIncrement;
+	}
+
+	if (mp4Handle->seiBuffer)
+	{
+		free(mp4Handle->seiBuffer);
+		mp4Handle->seiBuffer = nullptr;
+		mp4Handle->seiSize = 0;
+	}
+
+	lsmash_sample_t* p_sample = lsmash_create_sample((uint32_t)size);
+	RETURN_IF_ERR(!p_sample, "Failed to create a video sample data");
+
+	memcpy(p_sample->data, data, size);
 
-	mp4Handle->frameNumber++;
+	// no B-frames, so the decoding order is the presentation order
+	p_sample->dts = (pts + mp4Handle->startOffset) * mp4Handle->timeIncrement;
+	p_sample->cts = p_sample->dts;
+	p_sample->index = mp4Handle->sampleEntry;
+	p_sample->prop.ra_flags = isKeyframe ? ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC : ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE;
+
+	return appendSample(mp4Handle, p_sample);
+}
+
+// the packet goes in as it was in the source file, only its timestamp is moved onto the output timeline
+bool Mp4File::writeAudioSample(const uint8_t* data, size_t size, int64_t dts)
+{
+	RETURN_IF_ERR(!mp4Handle->audioTrack, "No audio track to write to");
+
+	if (dts <= mp4Handle->audioLastDts)
+		return true;
+
+	// a fragmented file got its audio edit list with the first fragment, so the samples after it keep their own place
+	if (mp4Handle->audioFirstDts < 0)
+		mp4Handle->audioFirstDts = mp4Handle->hasFragment ? 0 : dts;
+
+	lsmash_sample_t* p_sample = lsmash_create_sample((uint32_t)size);
+	RETURN_IF_ERR(!p_sample, "Failed to create an audio sample data");
+
+	memcpy(p_sample->data, data, size);
+
+	p_sample->dts = (uint64_t)(dts - mp4Handle->audioFirstDts);
+	p_sample->cts = p_sample->dts;
+	p_sample->index = mp4Handle->audioSampleEntry;
+	p_sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
+
+	mp4Handle->audioLastDts = dts;
+
+	RETURN_IF_ERR(lsmash_append_sample(mp4Handle->root, mp4Handle->audioTrack, p_sample), "Failed to append an audio frame");
+	RETURN_IF_ERR(getIsWriteFailed(mp4Handle), "Failed to write the output file");
 
 	return true;
 }
 
-void Mp4File::close(int64_t lastPts)
+// returns false if anything went wrong while finishing the file or if any of it could not be written
+bool Mp4File::close(int64_t lastPts)
 {
+	bool isSuccessful = true;
+
 	if (mp4Handle != nullptr)
 	{
 		if (mp4Handle->root)
 		{
 			if (mp4Handle->track)
 			{
-				LOG_IF_ERR(lsmash_flush_pooled_samples(mp4Handle->root, mp4Handle->track, mp4Handle->timeIncrement), "Failed to flush the rest of samples");
+				FAIL_IF_ERR(lsmash_flush_pooled_samples(mp4Handle->root, mp4Handle->track, mp4Handle->timeIncrement), "Failed to flush the rest of samples");
+			}
+
+			if (mp4Handle->audioTrack)
+			{
+				FAIL_IF_ERR(lsmash_flush_pooled_samples(mp4Handle->root, mp4Handle->audioTrack, mp4Handle->audioFrameLength), "Failed to flush the rest of audio samples");
+
+				if (!mp4Handle->hasFragment && mp4Handle->audioFirstDts >= 0)
+				{
+					uint64_t audioDuration = (uint64_t)(mp4Handle->audioLastDts - mp4Handle->audioFirstDts + mp4Handle->audioFrameLength);
+					FAIL_IF_ERR(!setAudioTimeline(mp4Handle, audioDuration * mp4Handle->movieTimescale / mp4Handle->audioTimescale), "Failed to finish the audio timeline");
+				}
+			}
 
+			// a fragmented file got its edit list with the first fragment
+			if (mp4Handle->track && !mp4Handle->hasFragment)
+			{
 				double actualDuration = 0;
 
 				if (mp4Handle->movieTimescale != 0 && mp4Handle->videoTimescale != 0)
 					actualDuration = ((double)(lastPts * mp4Handle->timeIncrement) / mp4Handle->videoTimescale) * mp4Handle->movieTimescale;
 				else
+				{
 					qWarning("Timescale is broken");
+					isSuccessful = false;
+				}
 
 				lsmash_edit_t edit;
 				edit.duration = actualDuration;
 				edit.start_time = mp4Handle->firstCts;
 				edit.rate = ISOM_EDIT_MODE_NORMAL;
-				LOG_IF_ERR(lsmash_create_explicit_timeline_map(mp4Handle->root, mp4Handle->track, edit), "Failed to set timeline map for video");
+				FAIL_IF_ERR(lsmash_create_explicit_timeline_map(mp4Handle->root, mp4Handle->track, edit), "Failed to set timeline map for video");
 			}
 
-			LOG_IF_ERR(lsmash_finish_movie(mp4Handle->root, nullptr), "Failed to finish movie");
+			FAIL_IF_ERR(lsmash_finish_movie(mp4Handle->root, nullptr), "Failed to finish movie");
 		}
 
 		lsmash_cleanup_summary((lsmash_summary_t*)mp4Handle->summary);
-		lsmash_close_file(&mp4Handle->fileParameters);
+		lsmash_cleanup_summary((lsmash_summary_t*)mp4Handle->audioSummary);
 		lsmash_destroy_root(mp4Handle->root);
 
 		free(mp4Handle->seiBuffer);
@@ -212,4 +468,29 @@ void Mp4File::close(int64_t lastPts)
 
 		mp4Handle = nullptr;
 	}
+
+	if (fileWriterThread != nullptr && fileWriterThread->isRunning())
+	{
+		FAIL_IF_ERR(!fileWriterThread->close(), "Failed to write the output file");
+		fileWriterThread->logStatistics();
+	}
+
+	return isSuccessful;
+}
+
+Mp4File::~Mp4File()
+{
+	if (fileWriterThread != nullptr)
+	{
+		if (fileWriterThread->isRunning())
+			fileWriterThread->close();
+
+		delete fileWriterThread;
+		fileWriterThread = nullptr;
+	}
+}
+
+double Mp4File::getWriteStallDuration() const
+{
+	return (fileWriterThread != nullptr) ? fileWriterThread->getStallDuration() : 0.0;
 }
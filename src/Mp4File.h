@@ -3,26 +3,37 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include <QString>
 
 namespace OrientView
 {
 	struct Mp4Handle;
+	class FileWriterThread;
 
-	// Encapsulate the l-smash library for writing out video files in MP4 format.
+	// Encapsulate the l-smash library for writing out video files in MP4 format, either as a regular file or as a fragmented file that stays playable while it's being written.
 	class Mp4File
 	{
 
 	public:
 
-		bool open(const QString& fileName);
-		bool setParameters(x264_param_t* param);
+		bool open(const QString& fileName, int writeBufferSize, int writeBufferCount);
+		~Mp4File();
+
+		bool setParameters(x264_param_t* param, double fragmentDuration);
+		bool addAudioTrack(int sampleRate, int channelCount, int frameLength, const uint8_t* decoderSpecificInfo, size_t decoderSpecificInfoSize);
 		bool writeHeaders(x264_nal_t* nal);
 		bool writeFrame(uint8_t* payload, size_t size, x264_picture_t* picture);
-		void close(int64_t lastPts);
+		bool writeCopiedFrame(const uint8_t* data, size_t size, int64_t pts, bool isKeyframe);
+		bool writeAudioSample(const uint8_t* data, size_t size, int64_t dts);
+		bool close(int64_t lastPts);
+
+		double getWriteStallDuration() const;
 
 	private:
 
 		Mp4Handle* mp4Handle = nullptr;
+		FileWriterThread* fileWriterThread = nullptr;
 	};
 }
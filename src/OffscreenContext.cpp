@@ -0,0 +1,136 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <QGuiApplication>
+#include <QOpenGLFunctions>
+#include <QThread>
+
+#include "OffscreenContext.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+bool OffscreenContext::isHeadless = false;
+
+OffscreenContext::~OffscreenContext()
+{
+	if (context != nullptr)
+	{
+		delete context;
+		context = nullptr;
+	}
+
+	if (surface != nullptr)
+	{
+		surface->destroy();
+		delete surface;
+		surface = nullptr;
+	}
+}
+
+bool OffscreenContext::initialize(Settings* settings)
+{
+	qDebug("Initializing offscreen context");
+
+	QSurfaceFormat surfaceFormat;
+
+	// all drawing goes to multisampled framebuffer objects, so the surface itself only needs samples when a window system provides them
+	// surfaceless EGL displays usually have no multisampled pbuffer configs at all
+	surfaceFormat.setSamples(isHeadless ? 0 : settings->window.multisamples);
+
+	surface = new QOffscreenSurface();
+	surface->setFormat(surfaceFormat);
+	surface->create();
+
+	if (!surface->isValid())
+	{
+		qWarning("Could not create offscreen surface");
+		return false;
+	}
+
+	context = new QOpenGLContext();
+	context->setFormat(surfaceFormat);
+
+	if (!context->create())
+	{
+		qWarning("Could not create OpenGL context");
+		return false;
+	}
+
+	if (!context->makeCurrent(surface))
+	{
+		qWarning("Could not make context current");
+		return false;
+	}
+
+	qDebug("Offscreen context: %s %s (platform: %s)", (const char*)context->functions()->glGetString(GL_VENDOR), (const char*)context->functions()->glGetString(GL_RENDERER), qPrintable(QGuiApplication::platformName()));
+
+	return true;
+}
+
+bool OffscreenContext::makeCurrent()
+{
+	return context->makeCurrent(surface);
+}
+
+void OffscreenContext::doneCurrent()
+{
+	context->doneCurrent();
+}
+
+void OffscreenContext::moveToThread(QThread* thread)
+{
+	context->moveToThread(thread);
+}
+
+QOffscreenSurface* OffscreenContext::getSurface() const
+{
+	return surface;
+}
+
+QOpenGLContext* OffscreenContext::getContext() const
+{
+	return context;
+}
+
+bool OffscreenContext::shouldUseHeadlessPlatform()
+{
+#ifdef Q_OS_LINUX
+	if (!qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		return false;
+
+	return qEnvironmentVariableIsEmpty("DISPLAY") && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY");
+#else
+	return false;
+#endif
+}
+
+void OffscreenContext::selectHeadlessPlatform()
+{
+	// must be called before the application object is created
+	// eglfs with the plain device integration uses EGL_DEFAULT_DISPLAY and pbuffers for offscreen surfaces
+	// with Mesa, EGL_PLATFORM=surfaceless makes the default display work without X, Wayland or DRM master (hardware or llvmpipe)
+	// any of these can be overridden from the environment (e.g. LIBGL_ALWAYS_SOFTWARE=1 to force llvmpipe)
+
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "eglfs");
+
+	if (qEnvironmentVariableIsEmpty("QT_QPA_EGLFS_INTEGRATION"))
+		qputenv("QT_QPA_EGLFS_INTEGRATION", "none");
+
+	if (qEnvironmentVariableIsEmpty("QT_QPA_EGLFS_DISABLE_INPUT"))
+		qputenv("QT_QPA_EGLFS_DISABLE_INPUT", "1");
+
+	if (qEnvironmentVariableIsEmpty("QT_QPA_EGLFS_HIDECURSOR"))
+		qputenv("QT_QPA_EGLFS_HIDECURSOR", "1");
+
+	if (qEnvironmentVariableIsEmpty("EGL_PLATFORM"))
+		qputenv("EGL_PLATFORM", "surfaceless");
+
+	isHeadless = true;
+}
+
+bool OffscreenContext::getIsHeadless()
+{
+	return isHeadless;
+}
@@ -0,0 +1,41 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+
+namespace OrientView
+{
+	class Settings;
+
+	// OpenGL context for rendering to framebuffers without a visible window.
+	class OffscreenContext
+	{
+
+	public:
+
+		~OffscreenContext();
+
+		bool initialize(Settings* settings);
+
+		bool makeCurrent();
+		void doneCurrent();
+		void moveToThread(QThread* thread);
+
+		QOffscreenSurface* getSurface() const;
+		QOpenGLContext* getContext() const;
+
+		static bool shouldUseHeadlessPlatform();
+		static void selectHeadlessPlatform();
+		static bool getIsHeadless();
+
+	private:
+
+		QOffscreenSurface* surface = nullptr;
+		QOpenGLContext* context = nullptr;
+
+		static bool isHeadless;
+	};
+}
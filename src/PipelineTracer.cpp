@@ -0,0 +1,176 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <memory>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QTextStream>
+
+#include "PipelineTracer.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// a thread stops recording after this many spans (about 100 MB), so a forgotten trace cannot eat all the memory
+	const size_t MAXIMUM_SPAN_COUNT = 4 * 1024 * 1024;
+	const size_t INITIAL_SPAN_COUNT = 64 * 1024;
+
+	struct TraceSpan
+	{
+		const char* name;
+		qint64 startTime;
+		qint64 endTime;
+	};
+
+	// only the owning thread writes to its buffer, the list of buffers is locked when a thread records its first span
+	struct ThreadBuffer
+	{
+		QString threadName;
+		std::vector<TraceSpan> spans;
+		int droppedSpanCount = 0;
+	};
+
+	QMutex bufferMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+	QElapsedTimer traceTimer;
+	QString outputFilePath;
+	int traceGeneration = 0;
+
+	thread_local ThreadBuffer* currentThreadBuffer = nullptr;
+	thread_local int currentThreadGeneration = -1;
+
+	ThreadBuffer* getThreadBuffer()
+	{
+		if (currentThreadBuffer != nullptr && currentThreadGeneration == traceGeneration)
+			return currentThreadBuffer;
+
+		QMutexLocker locker(&bufferMutex);
+
+		threadBuffers.emplace_back(new ThreadBuffer());
+		currentThreadBuffer = threadBuffers.back().get();
+		currentThreadBuffer->threadName = QString("Thread %1").arg(threadBuffers.size());
+		currentThreadBuffer->spans.reserve(INITIAL_SPAN_COUNT);
+		currentThreadGeneration = traceGeneration;
+
+		return currentThreadBuffer;
+	}
+
+	QString escapeJson(const QString& text)
+	{
+		QString result = text;
+		result.replace("\\", "\\\\");
+		result.replace("\"", "\\\"");
+
+		return result;
+	}
+}
+
+bool PipelineTracer::isEnabled = false;
+
+void PipelineTracer::start(Settings* settings)
+{
+	QMutexLocker locker(&bufferMutex);
+
+	threadBuffers.clear();
+	traceGeneration++;
+	outputFilePath = settings->trace.outputFilePath;
+	isEnabled = settings->trace.enabled;
+
+	if (isEnabled)
+	{
+		qDebug("Tracing the pipeline to %s", qPrintable(outputFilePath));
+		traceTimer.start();
+	}
+}
+
+void PipelineTracer::finish()
+{
+	if (!isEnabled)
+		return;
+
+	isEnabled = false;
+
+	QMutexLocker locker(&bufferMutex);
+
+	QFile file(outputFilePath);
+
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		qWarning("Could not open trace file %s", qPrintable(outputFilePath));
+		threadBuffers.clear();
+		return;
+	}
+
+	QTextStream stream(&file);
+	stream.setRealNumberNotation(QTextStream::FixedNotation);
+	stream.setRealNumberPrecision(3);
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"OrientView\"}}";
+
+	size_t spanCount = 0;
+	int droppedSpanCount = 0;
+
+	for (size_t i = 0; i < threadBuffers.size(); ++i)
+	{
+		const ThreadBuffer& threadBuffer = *threadBuffers[i];
+		size_t threadId = i + 1;
+
+		stream << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId << ",\"args\":{\"name\":\"" << escapeJson(threadBuffer.threadName) << "\"}}";
+
+		// Chrome and Perfetto take microseconds
+		for (const TraceSpan& span : threadBuffer.spans)
+		{
+			stream << ",\n{\"name\":\"" << span.name << "\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+				<< ",\"ts\":" << span.startTime / 1000.0
+				<< ",\"dur\":" << (span.endTime - span.startTime) / 1000.0 << "}";
+		}
+
+		spanCount += threadBuffer.spans.size();
+		droppedSpanCount += threadBuffer.droppedSpanCount;
+	}
+
+	stream << "\n]}\n";
+	stream.flush();
+
+	qDebug("Trace: %d spans from %d threads written to %s (%d dropped)", (int)spanCount, (int)threadBuffers.size(), qPrintable(outputFilePath), droppedSpanCount);
+
+	threadBuffers.clear();
+}
+
+qint64 PipelineTracer::getTime()
+{
+	return traceTimer.nsecsElapsed();
+}
+
+void PipelineTracer::setThreadName(const char* name)
+{
+	if (!isEnabled)
+		return;
+
+	getThreadBuffer()->threadName = QString(name);
+}
+
+void PipelineTracer::addSpan(const char* name, qint64 startTime, qint64 endTime)
+{
+	ThreadBuffer* threadBuffer = getThreadBuffer();
+
+	if (threadBuffer->spans.size() >= MAXIMUM_SPAN_COUNT)
+	{
+		threadBuffer->droppedSpanCount++;
+		return;
+	}
+
+	TraceSpan span;
+	span.name = name;
+	span.startTime = startTime;
+	span.endTime = endTime;
+
+	threadBuffer->spans.push_back(span);
+}
@@ -0,0 +1,63 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QtGlobal>
+
+namespace OrientView
+{
+	class Settings;
+
+	// Record the stage spans of the pipeline threads to per-thread buffers and write them out as a Chrome/Perfetto trace file.
+	class PipelineTracer
+	{
+
+	public:
+
+		// Call before the traced threads are started and after they have all finished.
+		static void start(Settings* settings);
+		static void finish();
+
+		static bool getIsEnabled();
+		static qint64 getTime();
+
+		static void setThreadName(const char* name);
+		static void addSpan(const char* name, qint64 startTime, qint64 endTime);
+
+	private:
+
+		static bool isEnabled;
+	};
+
+	// Trace the lifetime of the scope as one span, the name has to be a string literal.
+	class TraceScope
+	{
+
+	public:
+
+		explicit TraceScope(const char* name);
+		~TraceScope();
+
+	private:
+
+		const char* name;
+		qint64 startTime;
+	};
+
+	// inline, so that a disabled tracer costs only a branch on a constant flag
+	inline bool PipelineTracer::getIsEnabled()
+	{
+		return isEnabled;
+	}
+
+	inline TraceScope::TraceScope(const char* name) : name(name), startTime(PipelineTracer::getIsEnabled() ? PipelineTracer::getTime() : -1)
+	{
+	}
+
+	inline TraceScope::~TraceScope()
+	{
+		if (startTime >= 0)
+			PipelineTracer::addSpan(name, startTime, PipelineTracer::getTime());
+	}
+}
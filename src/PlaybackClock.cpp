@@ -0,0 +1,154 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <QThread>
+
+#include "PlaybackClock.h"
+#include "Settings.h"
+#include "FrameData.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// a frame this far from its scheduled time means a seek or a pause, not a slow frame
+	const int64_t RESYNCHRONIZATION_THRESHOLD = 1000000;
+
+	// the screen is still updated now and then, even if every frame is late
+	const int MAXIMUM_CONSECUTIVE_DROPPED_FRAMES = 8;
+
+	// sleeping can overshoot by the scheduler granularity, so the last part of the wait is done by yielding
+	const int64_t SLEEP_MARGIN = 2000;
+}
+
+void PlaybackClock::initialize(Settings* settings)
+{
+	frameDroppingEnabled = settings->video.enableFrameDropping;
+	catchUpThreshold = (int64_t)(settings->video.catchUpThreshold * 1000.0);
+
+	averageWakeUpError.setAlpha(0.05);
+
+	clock.start();
+	reset();
+}
+
+void PlaybackClock::reset()
+{
+	isSynchronized = false;
+	isCatchingUp = false;
+	consecutiveDroppedFrameCount = 0;
+}
+
+void PlaybackClock::setPlaybackRate(double rate)
+{
+	// continue from the current position, so that the next frames are neither early nor late because of the change
+	if (isSynchronized)
+	{
+		int64_t currentTime = getCurrentTime();
+		presentationTimeOrigin += (int64_t)((currentTime - clockOrigin) * playbackRate);
+		clockOrigin = currentTime;
+	}
+
+	playbackRate = rate;
+}
+
+int64_t PlaybackClock::getTimeUntilPresentation(const FrameData& frameData)
+{
+	int64_t currentTime = getCurrentTime();
+
+	if (isSynchronized && std::abs(getPresentationClockTime(frameData) - currentTime) > RESYNCHRONIZATION_THRESHOLD)
+	{
+		isSynchronized = false;
+		resynchronizationCount++;
+	}
+
+	// the first frame after a reset is shown right away and the following frames are timed relative to it
+	if (!isSynchronized)
+	{
+		clockOrigin = currentTime;
+		presentationTimeOrigin = frameData.presentationTime;
+		isSynchronized = true;
+	}
+
+	int64_t timeUntilPresentation = getPresentationClockTime(frameData) - currentTime;
+
+	// hysteresis, catching up is stopped only when the frames are on time again
+	if (timeUntilPresentation < -catchUpThreshold)
+	{
+		if (!isCatchingUp)
+			catchUpCount++;
+
+		isCatchingUp = true;
+	}
+	else if (timeUntilPresentation >= 0)
+		isCatchingUp = false;
+
+	return timeUntilPresentation;
+}
+
+bool PlaybackClock::shouldDropFrame(int64_t timeUntilPresentation, const FrameData& frameData)
+{
+	if (frameDroppingEnabled && timeUntilPresentation < -(int64_t)(frameData.duration / playbackRate) && consecutiveDroppedFrameCount < MAXIMUM_CONSECUTIVE_DROPPED_FRAMES)
+	{
+		droppedFrameCount++;
+		consecutiveDroppedFrameCount++;
+
+		return true;
+	}
+
+	consecutiveDroppedFrameCount = 0;
+
+	return false;
+}
+
+void PlaybackClock::waitForPresentation(const FrameData& frameData)
+{
+	int64_t presentationClockTime = getPresentationClockTime(frameData);
+	int64_t timeToWait = presentationClockTime - getCurrentTime();
+
+	if (timeToWait <= 0)
+		return;
+
+	if (timeToWait > SLEEP_MARGIN)
+		QThread::usleep((unsigned long)(timeToWait - SLEEP_MARGIN));
+
+	while (getCurrentTime() < presentationClockTime)
+		QThread::yieldCurrentThread();
+
+	double wakeUpError = (getCurrentTime() - presentationClockTime) / 1000.0;
+	averageWakeUpError.addMeasurement(wakeUpError);
+	maximumWakeUpError = std::max(maximumWakeUpError, wakeUpError);
+}
+
+bool PlaybackClock::getIsCatchingUp() const
+{
+	return isCatchingUp;
+}
+
+int PlaybackClock::getDroppedFrameCount() const
+{
+	return droppedFrameCount;
+}
+
+void PlaybackClock::logStatistics()
+{
+	qDebug("Playback clock: %d dropped frames, %d catch-ups, %d resynchronizations, wake-up error %.3f ms average, %.3f ms maximum",
+		droppedFrameCount,
+		catchUpCount,
+		resynchronizationCount,
+		averageWakeUpError.getAverage(),
+		maximumWakeUpError);
+}
+
+int64_t PlaybackClock::getCurrentTime() const
+{
+	return clock.nsecsElapsed() / 1000;
+}
+
+int64_t PlaybackClock::getPresentationClockTime(const FrameData& frameData) const
+{
+	return clockOrigin + (int64_t)((frameData.presentationTime - presentationTimeOrigin) / playbackRate);
+}
@@ -0,0 +1,60 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+
+#include <QElapsedTimer>
+
+#include "MovingAverage.h"
+
+namespace OrientView
+{
+	class Settings;
+	struct FrameData;
+
+	// Schedules the on-screen frames against the wall clock, so that slow frames do not make the video time drift behind.
+	class PlaybackClock
+	{
+
+	public:
+
+		void initialize(Settings* settings);
+		void reset();
+		void setPlaybackRate(double rate);
+
+		int64_t getTimeUntilPresentation(const FrameData& frameData);
+		bool shouldDropFrame(int64_t timeUntilPresentation, const FrameData& frameData);
+		void waitForPresentation(const FrameData& frameData);
+
+		bool getIsCatchingUp() const;
+		int getDroppedFrameCount() const;
+
+		void logStatistics();
+
+	private:
+
+		int64_t getCurrentTime() const;
+		int64_t getPresentationClockTime(const FrameData& frameData) const;
+
+		QElapsedTimer clock;
+
+		bool isSynchronized = false;
+		bool isCatchingUp = false;
+		bool frameDroppingEnabled = false;
+
+		int64_t clockOrigin = 0; // microseconds
+		int64_t presentationTimeOrigin = 0; // microseconds
+		int64_t catchUpThreshold = 0; // microseconds
+		double playbackRate = 1.0;
+
+		int droppedFrameCount = 0;
+		int consecutiveDroppedFrameCount = 0;
+		int catchUpCount = 0;
+		int resynchronizationCount = 0;
+
+		MovingAverage averageWakeUpError;
+		double maximumWakeUpError = 0.0;
+	};
+}
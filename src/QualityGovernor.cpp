@@ -0,0 +1,162 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+
+#include "QualityGovernor.h"
+#include "Renderer.h"
+#include "VideoDecoder.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+namespace
+{
+	// the upgrade delay is doubled every time a raised level turns out to be too slow, up to this limit
+	const int MAXIMUM_UPGRADE_DELAY = 60000;
+}
+
+void QualityGovernor::initialize(Renderer* renderer, VideoDecoder* videoDecoder, Settings* settings)
+{
+	this->renderer = renderer;
+	this->videoDecoder = videoDecoder;
+
+	isEnabled = settings->renderer.enableQualityGovernor;
+	downgradeThreshold = settings->renderer.qualityDowngradeThreshold;
+	upgradeThreshold = std::max(settings->renderer.qualityUpgradeThreshold, downgradeThreshold);
+	downgradeDelay = settings->renderer.qualityDowngradeDelay;
+	upgradeDelay = settings->renderer.qualityUpgradeDelay;
+
+	// time constant of about half a second independent of the frame rate
+	averageSpareTime.setAlpha(0.002);
+
+	levels.clear();
+
+	QualityLevel level;
+	level.name = "full";
+	level.multisamples = settings->window.multisamples;
+	level.frameSizeDivisor = settings->video.frameSizeDivisor;
+	level.grayscaleFrameSizeDivisor = settings->stabilizer.frameSizeDivisor;
+	levels.push_back(level);
+
+	// only the steps that make something cheaper are added, the window surface itself keeps its samples
+	if (settings->renderer.enableDirtyTracking && level.multisamples > 4)
+	{
+		level.name = "msaa 4";
+		level.multisamples = 4;
+		levels.push_back(level);
+	}
+
+	if (settings->renderer.enableDirtyTracking && level.multisamples > 0)
+	{
+		level.name = "msaa off";
+		level.multisamples = 0;
+		levels.push_back(level);
+	}
+
+	if (settings->video.rescaleShader != "default" || settings->map.rescaleShader != "default")
+	{
+		level.name = "bilinear";
+		level.reducedRescale = true;
+		levels.push_back(level);
+	}
+
+	if (settings->stabilizer.enabled && settings->stabilizer.mode == VideoStabilizerMode::RealTime)
+	{
+		level.grayscaleFrameSizeDivisor *= 2;
+		level.name = QString("stabilize 1/%1").arg(level.grayscaleFrameSizeDivisor);
+		levels.push_back(level);
+	}
+
+	level.frameSizeDivisor *= 2;
+	level.name = QString("video 1/%1").arg(level.frameSizeDivisor);
+	levels.push_back(level);
+
+	reset();
+}
+
+void QualityGovernor::update(double spareTime, double frameDuration)
+{
+	if (!isEnabled)
+		return;
+
+	averageSpareTime.addMeasurement(spareTime, std::min(frameDuration, 100.0));
+
+	double average = averageSpareTime.getAverage();
+	qint64 timeSinceLevelChange = levelChangeTimer.elapsed();
+
+	// the thresholds and delays are different in each direction, so the level does not flip back and forth
+	if (average < downgradeThreshold && timeSinceLevelChange >= downgradeDelay && currentLevel < (int)levels.size() - 1)
+	{
+		// the previous upgrade did not hold, so wait longer before trying it again
+		if (lastChangeWasUpgrade && timeSinceLevelChange < currentUpgradeDelay)
+			currentUpgradeDelay = std::min(currentUpgradeDelay * 2, MAXIMUM_UPGRADE_DELAY);
+
+		setLevel(currentLevel + 1);
+		lastChangeWasUpgrade = false;
+		downgradeCount++;
+	}
+	else if (average > upgradeThreshold && timeSinceLevelChange >= currentUpgradeDelay && currentLevel > 0)
+	{
+		setLevel(currentLevel - 1);
+		lastChangeWasUpgrade = true;
+		upgradeCount++;
+	}
+}
+
+void QualityGovernor::reset()
+{
+	currentUpgradeDelay = upgradeDelay;
+	lastChangeWasUpgrade = false;
+	setLevel(0);
+}
+
+bool QualityGovernor::getIsEnabled() const
+{
+	return isEnabled;
+}
+
+int QualityGovernor::getLevel() const
+{
+	return currentLevel;
+}
+
+const QualityLevel& QualityGovernor::getQualityLevel() const
+{
+	return levels.at((size_t)currentLevel);
+}
+
+void QualityGovernor::logStatistics()
+{
+	if (!isEnabled)
+		return;
+
+	qDebug("Quality governor: %d downgrades, %d upgrades, lowest level %d/%d (%s), final level %d (%s)",
+		downgradeCount,
+		upgradeCount,
+		lowestLevel,
+		(int)levels.size() - 1,
+		qPrintable(levels.at((size_t)lowestLevel).name),
+		currentLevel,
+		qPrintable(getQualityLevel().name));
+}
+
+void QualityGovernor::setLevel(int newLevel)
+{
+	currentLevel = std::max(0, std::min(newLevel, (int)levels.size() - 1));
+	lowestLevel = std::max(lowestLevel, currentLevel);
+
+	const QualityLevel& level = getQualityLevel();
+
+	renderer->setMapLayerMultisamples(level.multisamples);
+	renderer->setReducedRescale(level.reducedRescale);
+	renderer->setQualityLevelName(isEnabled ? level.name : QString("-"));
+	videoDecoder->requestFrameSizeDivisors(level.frameSizeDivisor, level.grayscaleFrameSizeDivisor);
+
+	// start from between the thresholds, the new level has to prove itself before the next change
+	averageSpareTime.reset((downgradeThreshold + upgradeThreshold) / 2.0);
+	levelChangeTimer.restart();
+
+	if (isEnabled)
+		qDebug("Quality level %d/%d: %s", currentLevel, (int)levels.size() - 1, qPrintable(level.name));
+}
@@ -0,0 +1,72 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include "MovingAverage.h"
+
+namespace OrientView
+{
+	class Renderer;
+	class VideoDecoder;
+	class Settings;
+
+	// One step of the quality ladder, the first step is what the settings ask for and every later step is cheaper than the previous one.
+	struct QualityLevel
+	{
+		QString name;
+		int multisamples = 0;
+		bool reducedRescale = false;
+		int frameSizeDivisor = 1;
+		int grayscaleFrameSizeDivisor = 1;
+	};
+
+	// Lowers the rendering and decoding quality when the on-screen playback cannot keep up with the video, and raises it again when there is time to spare.
+	class QualityGovernor
+	{
+
+	public:
+
+		void initialize(Renderer* renderer, VideoDecoder* videoDecoder, Settings* settings);
+
+		void update(double spareTime, double frameDuration);
+		void reset();
+
+		bool getIsEnabled() const;
+		int getLevel() const;
+		const QualityLevel& getQualityLevel() const;
+
+		void logStatistics();
+
+	private:
+
+		void setLevel(int newLevel);
+
+		Renderer* renderer = nullptr;
+		VideoDecoder* videoDecoder = nullptr;
+
+		bool isEnabled = false;
+		bool lastChangeWasUpgrade = false;
+
+		std::vector<QualityLevel> levels;
+		int currentLevel = 0;
+
+		double downgradeThreshold = 0.0; // milliseconds
+		double upgradeThreshold = 0.0; // milliseconds
+		int downgradeDelay = 0; // milliseconds
+		int upgradeDelay = 0; // milliseconds
+		int currentUpgradeDelay = 0; // milliseconds
+
+		MovingAverage averageSpareTime;
+		QElapsedTimer levelChangeTimer;
+
+		int downgradeCount = 0;
+		int upgradeCount = 0;
+		int lowestLevel = 0;
+	};
+}
@@ -1,95 +1,169 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <QCoreApplication>
 #include <QElapsedTimer>
 
 #include "RenderOffScreenThread.h"
-#include "MainWindow.h"
-#include "EncodeWindow.h"
+#include "OffscreenContext.h"
 #include "VideoDecoder.h"
 #include "VideoDecoderThread.h"
+#include "FrameStabilizerThread.h"
 #include "VideoStabilizer.h"
 #include "RouteManager.h"
 #include "Renderer.h"
 #include "VideoEncoder.h"
+#include "EncodeCache.h"
 #include "FrameData.h"
+#include "Settings.h"
+#include "PipelineTracer.h"
 
 using namespace OrientView;
 
-void RenderOffScreenThread::initialize(MainWindow* mainWindow, EncodeWindow* encodeWindow, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, VideoEncoder* videoEncoder)
+void RenderOffScreenThread::initialize(OffscreenContext* offscreenContext, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, FrameStabilizerThread* frameStabilizerThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, VideoEncoder* videoEncoder, Settings* settings)
 {
-	this->mainWindow = mainWindow;
-	this->encodeWindow = encodeWindow;
+	this->offscreenContext = offscreenContext;
 	this->videoDecoder = videoDecoder;
 	this->videoDecoderThread = videoDecoderThread;
+	this->frameStabilizerThread = frameStabilizerThread;
 	this->videoStabilizer = videoStabilizer;
 	this->routeManager = routeManager;
 	this->renderer = renderer;
 	this->videoEncoder = videoEncoder;
 
-	frameReadSemaphore = new QSemaphore();
-	frameAvailableSemaphore = new QSemaphore();
+	frameQueue.initialize(settings->encoder.frameQueueDepth);
+
+	for (int i = 0; i < frameQueue.getCapacity(); ++i)
+	{
+		FrameData& frameData = frameQueue.getSlot(i);
+
+		frameData = FrameData();
+		frameData.width = settings->window.width;
+		frameData.height = settings->window.height;
+		frameData.rowLength = (size_t)(frameData.width * 4);
+		frameData.dataLength = frameData.rowLength * frameData.height;
+		frameData.data = new uint8_t[frameData.dataLength];
+	}
 }
 
 RenderOffScreenThread::~RenderOffScreenThread()
 {
-	if (frameAvailableSemaphore != nullptr)
+	for (int i = 0; i < frameQueue.getCapacity(); ++i)
 	{
-		delete frameAvailableSemaphore;
-		frameAvailableSemaphore = nullptr;
-	}
+		FrameData& frameData = frameQueue.getSlot(i);
 
-	if (frameReadSemaphore != nullptr)
-	{
-		delete frameReadSemaphore;
-		frameReadSemaphore = nullptr;
+		if (frameData.data != nullptr)
+		{
+			delete[] frameData.data;
+			frameData.data = nullptr;
+		}
 	}
 }
 
 void RenderOffScreenThread::run()
 {
 	FrameData decodedFrameData;
-	FrameData decodedFrameDataGrayscale;
 
 	double frameDuration = videoDecoder->getFrameDuration();
+	EncodeCache* encodeCache = videoEncoder->getEncodeCache();
+	int64_t frameIndex = 0;
 
-	frameReadSemaphore->release(1);
+	PipelineTracer::setThreadName("Renderer");
 
 	while (!isInterruptionRequested())
 	{
-		if (videoDecoderThread->tryGetNextFrame(decodedFrameData, decodedFrameDataGrayscale, 100))
+		if (frameStabilizerThread->tryGetNextFrame(decodedFrameData, 100))
 		{
-			videoStabilizer->processFrame(decodedFrameDataGrayscale);
-			encodeWindow->getContext()->makeCurrent(encodeWindow->getSurface());
-			renderer->startRendering(videoDecoder->getCurrentTime(), frameDuration, videoDecoder->getDecodeDuration(), videoStabilizer->getProcessDuration(), videoEncoder->getEncodeDuration(), 0.0);
-			renderer->uploadFrameData(decodedFrameData);
-			videoDecoderThread->signalFrameRead();
-			renderer->renderAll();
-			renderer->stopRendering();
-			routeManager->update(videoDecoder->getCurrentTime(), frameDuration);
+			if (decodedFrameData.isEndOfStream)
+			{
+				frameStabilizerThread->signalFrameRead();
+
+				while (!frameQueue.waitForFreeSlot(100) && !isInterruptionRequested()) {}
+
+				if (isInterruptionRequested())
+					break;
+
+				// only the flag is set, the slot keeps its buffer
+				frameQueue.back().isEndOfStream = true;
+				frameQueue.push();
+
+				break;
+			}
+
+			bool isReused = (encodeCache != nullptr && encodeCache->getIsReused(frameIndex, routeManager, frameDuration));
+
+			// the route follows the time of the frame itself, the decoder is already ahead of it by the queued frames
+			routeManager->update(decodedFrameData.time, frameDuration);
+
+			if (encodeCache != nullptr)
+				encodeCache->recordFrame(frameIndex, decodedFrameData.time, routeManager);
 
-			while (!frameReadSemaphore->tryAcquire(1, 100) && !isInterruptionRequested()) {}
+			frameIndex++;
+
+			if (isReused)
+				frameStabilizerThread->signalFrameRead();
+			else
+			{
+				// the software compositor draws straight into the slot, so it has to be free already
+				if (renderer->getIsUsingSoftwareCompositor())
+				{
+					while (!frameQueue.waitForFreeSlot(100) && !isInterruptionRequested()) {}
+
+					if (isInterruptionRequested())
+						break;
+
+					renderer->setRenderTarget(frameQueue.back());
+				}
+
+				if (offscreenContext != nullptr)
+					offscreenContext->makeCurrent();
+
+				TraceScope traceScope("render");
+				renderer->startRendering(decodedFrameData.time, frameDuration, videoDecoder->getDecodeDuration(), videoStabilizer->getProcessDuration(), videoEncoder->getEncodeDuration(), 0.0);
+				renderer->uploadFrameData(decodedFrameData);
+				frameStabilizerThread->signalFrameRead();
+				renderer->renderAll();
+				renderer->stopRendering();
+			}
+
+			while (!frameQueue.waitForFreeSlot(100) && !isInterruptionRequested()) {}
 
 			if (isInterruptionRequested())
 				break;
 
-			renderedFrameData = renderer->getRenderedFrame();
+			FrameData& renderedFrameData = frameQueue.back();
+
+			if (!isReused)
+			{
+				TraceScope traceScope("readback");
+				renderer->getRenderedFrame(renderedFrameData);
+			}
+
 			renderedFrameData.duration = decodedFrameData.duration;
 			renderedFrameData.cumulativeNumber = decodedFrameData.cumulativeNumber;
+			renderedFrameData.isReused = isReused;
+			renderedFrameData.isEndOfStream = false;
 
-			frameAvailableSemaphore->release(1);
+			frameQueue.push();
 		}
 	}
 
-	encodeWindow->getContext()->doneCurrent();
-	encodeWindow->getContext()->moveToThread(mainWindow->thread());
+	renderer->logStatistics();
+	videoDecoderThread->logStatistics();
+	frameStabilizerThread->logStatistics();
+
+	if (offscreenContext != nullptr)
+	{
+		offscreenContext->doneCurrent();
+		offscreenContext->moveToThread(QCoreApplication::instance()->thread());
+	}
 }
 
 bool RenderOffScreenThread::tryGetNextFrame(FrameData& frameData, int timeout)
 {
-	if (frameAvailableSemaphore->tryAcquire(1, timeout))
+	if (frameQueue.waitForItem(timeout))
 	{
-		frameData = renderedFrameData;
+		frameData = frameQueue.front();
 		return true;
 	}
 	else
@@ -98,5 +172,10 @@ bool RenderOffScreenThread::tryGetNextFrame(FrameData& frameData, int timeout)
 
 void RenderOffScreenThread::signalFrameRead()
 {
-	frameReadSemaphore->release(1);
+	frameQueue.pop();
+}
+
+void RenderOffScreenThread::logStatistics()
+{
+	frameQueue.logStatistics("Rendered frame");
 }
@@ -4,20 +4,21 @@
 #pragma once
 
 #include <QThread>
-#include <QSemaphore>
 
 #include "FrameData.h"
+#include "SpscQueue.h"
 
 namespace OrientView
 {
-	class MainWindow;
-	class EncodeWindow;
+	class OffscreenContext;
 	class VideoDecoder;
 	class VideoDecoderThread;
+	class FrameStabilizerThread;
 	class VideoStabilizer;
 	class RouteManager;
 	class Renderer;
 	class VideoEncoder;
+	class Settings;
 
 	// Run renderer on a thread and draw to hidden framebuffers.
 	class RenderOffScreenThread : public QThread
@@ -26,30 +27,30 @@ namespace OrientView
 
 	public:
 
-		void initialize(MainWindow* mainWindow, EncodeWindow* encodeWindow, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, VideoEncoder* videoEncoder);
+		void initialize(OffscreenContext* offscreenContext, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, FrameStabilizerThread* frameStabilizerThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, VideoEncoder* videoEncoder, Settings* settings);
 		~RenderOffScreenThread();
 
 		bool tryGetNextFrame(FrameData& frameData, int timeout);
 		void signalFrameRead();
 
+		void logStatistics();
+
 	protected:
 
 		void run();
 
 	private:
 
-		MainWindow* mainWindow = nullptr;
-		EncodeWindow* encodeWindow = nullptr;
+		OffscreenContext* offscreenContext = nullptr;
 		VideoDecoder* videoDecoder = nullptr;
 		VideoDecoderThread* videoDecoderThread = nullptr;
+		FrameStabilizerThread* frameStabilizerThread = nullptr;
 		VideoStabilizer* videoStabilizer = nullptr;
 		RouteManager* routeManager = nullptr;
 		Renderer* renderer = nullptr;
 		VideoEncoder* videoEncoder = nullptr;
 
-		QSemaphore* frameReadSemaphore = nullptr;
-		QSemaphore* frameAvailableSemaphore = nullptr;
-
-		FrameData renderedFrameData;
+		// each slot owns a window sized buffer, so rendering can continue while the encoder reads the earlier frames
+		SpscQueue<FrameData> frameQueue;
 	};
 }
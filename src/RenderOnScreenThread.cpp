@@ -1,6 +1,8 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <algorithm>
+
 #include <QElapsedTimer>
 
 #include "RenderOnScreenThread.h"
@@ -8,6 +10,7 @@
 #include "VideoWindow.h"
 #include "VideoDecoder.h"
 #include "VideoDecoderThread.h"
+#include "FrameStabilizerThread.h"
 #include "VideoStabilizer.h"
 #include "RouteManager.h"
 #include "Renderer.h"
@@ -16,64 +19,127 @@
 
 using namespace OrientView;
 
-void RenderOnScreenThread::initialize(MainWindow* mainWindow, VideoWindow* videoWindow, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, InputHandler* inputHandler)
+namespace
+{
+	const double MINIMUM_PLAYBACK_RATE = 0.25;
+	const double MAXIMUM_PLAYBACK_RATE = 16.0;
+
+	// above these rates only the reference frames or only the keyframes are decoded
+	const double REFERENCE_ONLY_PLAYBACK_RATE = 2.0;
+	const double KEYFRAME_ONLY_PLAYBACK_RATE = 8.0;
+}
+
+void RenderOnScreenThread::initialize(MainWindow* mainWindow, VideoWindow* videoWindow, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, FrameStabilizerThread* frameStabilizerThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, InputHandler* inputHandler, Settings* settings)
 {
 	this->mainWindow = mainWindow;
 	this->videoWindow = videoWindow;
 	this->videoDecoder = videoDecoder;
 	this->videoDecoderThread = videoDecoderThread;
+	this->frameStabilizerThread = frameStabilizerThread;
 	this->videoStabilizer = videoStabilizer;
 	this->routeManager = routeManager;
 	this->renderer = renderer;
 	this->inputHandler = inputHandler;
+
+	qualityGovernor.initialize(renderer, videoDecoder, settings);
+	playbackClock.initialize(settings);
 }
 
 void RenderOnScreenThread::run()
 {
 	FrameData frameData;
-	FrameData frameDataGrayscale;
 
 	QElapsedTimer frameDurationTimer;
+	QElapsedTimer renderIntervalTimer;
 	double frameDuration = 30.0;
 	double spareTime = 15.0;
 
 	frameDurationTimer.start();
+	renderIntervalTimer.start();
+	playbackClock.reset();
 
 	while (!isInterruptionRequested())
 	{
 		if (!videoWindow->isExposed())
 		{
+			playbackClock.reset();
 			QThread::msleep(100);
 			continue;
 		}
 
 		bool gotFrame = false;
+		bool droppedFrame = false;
 
+		// when paused, a seek keeps asking for a frame until the first one after the seek has arrived
 		if (!isPaused || shouldAdvanceOneFrame)
 		{
-			gotFrame = videoDecoderThread->tryGetNextFrame(frameData, frameDataGrayscale, 0);
-			shouldAdvanceOneFrame = false;
+			gotFrame = frameStabilizerThread->tryGetNextFrame(frameData, 0);
+
+			// the end of the video leaves the last frame on the screen
+			if (gotFrame && frameData.isEndOfStream)
+			{
+				frameStabilizerThread->signalFrameRead();
+				gotFrame = false;
+			}
+
+			if (gotFrame)
+				shouldAdvanceOneFrame = false;
 		}
 
+		// frames stepped through while paused are shown right away, and the clock starts over when playback continues
+		if (isPaused)
+			playbackClock.reset();
+
 		if (gotFrame)
-			videoStabilizer->processFrame(frameDataGrayscale);
+		{
+			int64_t timeUntilPresentation = playbackClock.getTimeUntilPresentation(frameData);
+			spareTime = timeUntilPresentation / 1000.0;
+
+			videoDecoder->setSkipNonReferenceFrames(playbackClock.getIsCatchingUp() || playbackRate > REFERENCE_ONLY_PLAYBACK_RATE);
+
+			// stepping one frame at a time says nothing about keeping up with the video
+			if (!isPaused)
+				qualityGovernor.update(spareTime, frameData.duration / 1000.0);
+
+			if (playbackClock.shouldDropFrame(timeUntilPresentation, frameData))
+			{
+				frameStabilizerThread->signalFrameRead();
+				renderer->setDroppedFrameCount(playbackClock.getDroppedFrameCount());
+
+				gotFrame = false;
+				droppedFrame = true;
+			}
+			else
+				playbackClock.waitForPresentation(frameData);
+		}
 
 		videoWindow->getContext()->makeCurrent(videoWindow);
-		renderer->startRendering(videoDecoder->getCurrentTime(), frameDuration, videoDecoder->getDecodeDuration(), videoStabilizer->getProcessDuration(), 0.0, spareTime);
 
-		videoDecoder->resetDecodeDuration();
-		videoStabilizer->resetProcessDuration();
+		// when paused (or waiting for the decoder) and nothing has moved, the previous frame is left on the screen
+		bool shouldRender = (gotFrame || renderer->hasFrameChanged());
 
-		if (gotFrame)
+		if (shouldRender)
 		{
-			renderer->uploadFrameData(frameData);
-			videoDecoderThread->signalFrameRead();
-		}
+			double renderInterval = renderIntervalTimer.nsecsElapsed() / 1000000.0;
+			renderIntervalTimer.restart();
 
-		renderer->renderAll();
-		renderer->stopRendering();
+			renderer->startRendering(videoDecoder->getCurrentTime(), renderInterval, videoDecoder->getDecodeDuration(), videoStabilizer->getProcessDuration(), 0.0, spareTime);
 
-		routeManager->update(videoDecoder->getCurrentTime(), frameDuration);
+			videoDecoder->resetDecodeDuration();
+			videoStabilizer->resetProcessDuration();
+
+			if (gotFrame)
+			{
+				renderer->uploadFrameData(frameData);
+				frameStabilizerThread->signalFrameRead();
+			}
+
+			renderer->renderAll();
+			renderer->stopRendering();
+		}
+
+		// the route animations follow the video time, not the wall time
+		routeManager->update(videoDecoder->getCurrentTime(), frameDuration * playbackRate);
 		inputHandler->handleInput(frameDuration);
 
 		if (windowHasBeenResized)
@@ -83,35 +149,26 @@ void RenderOnScreenThread::run()
 			windowHasBeenResized = false;
 		}
 
-		videoWindow->getContext()->swapBuffers(videoWindow);
-
-		if (gotFrame)
+		if (shouldRender)
 		{
-			spareTime = (frameData.duration - (frameDurationTimer.nsecsElapsed() / 1000.0)) / 1000.0;
+			videoWindow->getContext()->swapBuffers(videoWindow);
 
-			// use combination of normal and spinning wait to sync the frame rate accurately
-			while (true)
-			{
-				int64_t timeToSleep = frameData.duration - (frameDurationTimer.nsecsElapsed() / 1000);
-
-				if (timeToSleep > 2000)
-				{
-					QThread::msleep(1);
-					continue;
-				}
-				else if (timeToSleep > 0)
-					continue;
-				else
-					break;
-			}
+			if (gotFrame)
+				videoDecoderThread->framePresented();
 		}
-		else
-			spareTime = 0.0;
+		else if (!droppedFrame)
+			QThread::msleep(1);
 
 		frameDuration = frameDurationTimer.nsecsElapsed() / 1000000.0;
 		frameDurationTimer.restart();
 	}
 
+	renderer->logStatistics();
+	qualityGovernor.logStatistics();
+	playbackClock.logStatistics();
+	videoDecoderThread->logStatistics();
+	frameStabilizerThread->logStatistics();
+
 	videoWindow->getContext()->doneCurrent();
 	videoWindow->getContext()->moveToThread(mainWindow->thread());
 }
@@ -132,6 +189,26 @@ void RenderOnScreenThread::advanceOneFrame()
 	shouldAdvanceOneFrame = true;
 }
 
+double RenderOnScreenThread::getPlaybackRate() const
+{
+	return playbackRate;
+}
+
+void RenderOnScreenThread::setPlaybackRate(double rate)
+{
+	playbackRate = std::max(MINIMUM_PLAYBACK_RATE, std::min(rate, MAXIMUM_PLAYBACK_RATE));
+
+	// slow playback needs no decoder changes, the frames are just shown longer and the renderer keeps the last uploaded frame
+	playbackClock.setPlaybackRate(playbackRate);
+	videoDecoder->setSkipNonKeyFrames(playbackRate >= KEYFRAME_ONLY_PLAYBACK_RATE);
+	renderer->setPlaybackRate(playbackRate);
+}
+
+void RenderOnScreenThread::resetPlaybackClock()
+{
+	playbackClock.reset();
+}
+
 void RenderOnScreenThread::windowResized(int newWidth, int newHeight)
 {
 	windowWidth = newWidth;
@@ -5,16 +5,21 @@
 
 #include <QThread>
 
+#include "QualityGovernor.h"
+#include "PlaybackClock.h"
+
 namespace OrientView
 {
 	class MainWindow;
 	class VideoWindow;
 	class VideoDecoder;
 	class VideoDecoderThread;
+	class FrameStabilizerThread;
 	class VideoStabilizer;
 	class RouteManager;
 	class Renderer;
 	class InputHandler;
+	class Settings;
 
 	// Run renderer on a thread and draw to a visible window.
 	class RenderOnScreenThread : public QThread
@@ -23,11 +28,14 @@ namespace OrientView
 
 	public:
 
-		void initialize(MainWindow* mainWindow, VideoWindow* videoWindow, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, InputHandler* inputHandler);
+		void initialize(MainWindow* mainWindow, VideoWindow* videoWindow, VideoDecoder* videoDecoder, VideoDecoderThread* videoDecoderThread, FrameStabilizerThread* frameStabilizerThread, VideoStabilizer* videoStabilizer, RouteManager* routeManager, Renderer* renderer, InputHandler* inputHandler, Settings* settings);
 
 		bool getIsPaused();
 		void togglePaused();
 		void advanceOneFrame();
+		double getPlaybackRate() const;
+		void setPlaybackRate(double rate);
+		void resetPlaybackClock();
 
 		public slots:
 
@@ -43,11 +51,16 @@ namespace OrientView
 		VideoWindow* videoWindow = nullptr;
 		VideoDecoder* videoDecoder = nullptr;
 		VideoDecoderThread* videoDecoderThread = nullptr;
+		FrameStabilizerThread* frameStabilizerThread = nullptr;
 		VideoStabilizer* videoStabilizer = nullptr;
 		RouteManager* routeManager = nullptr;
 		Renderer* renderer = nullptr;
 		InputHandler* inputHandler = nullptr;
 
+		QualityGovernor qualityGovernor;
+		PlaybackClock playbackClock;
+
+		double playbackRate = 1.0;
 		bool isPaused = false;
 		bool shouldAdvanceOneFrame = false;
 		bool windowHasBeenResized = false;
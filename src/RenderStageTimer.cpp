@@ -0,0 +1,185 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include "RenderStageTimer.h"
+
+using namespace OrientView;
+
+bool RenderStageTimer::initialize(int frameDelay)
+{
+	QOpenGLTimerQuery testQuery;
+
+	if (!testQuery.create())
+	{
+		qWarning("Could not create GPU timer query, render stages will not be timed");
+		return false;
+	}
+
+	testQuery.destroy();
+
+	// the results of a frame are read when its queries are about to be reused
+	frames.resize(frameDelay + 1);
+
+	for (int i = 0; i < RenderStageCount; ++i)
+		averageDurations[i].setAlpha(0.05);
+
+	isEnabled = true;
+
+	return true;
+}
+
+RenderStageTimer::~RenderStageTimer()
+{
+	for (FrameQueries& frameQueries : frames)
+	{
+		for (QOpenGLTimerQuery* query : frameQueries.queries)
+			delete query;
+
+		frameQueries.queries.clear();
+	}
+}
+
+void RenderStageTimer::beginFrame()
+{
+	if (!isEnabled)
+		return;
+
+	if (stageIsActive)
+		endStage();
+
+	currentFrameIndex = (currentFrameIndex + 1) % (int)frames.size();
+	collectResults(frames[currentFrameIndex]);
+}
+
+void RenderStageTimer::beginStage(RenderStage stage)
+{
+	if (!isEnabled || stageIsActive)
+		return;
+
+	FrameQueries& frameQueries = frames[currentFrameIndex];
+
+	// a stage can be timed several times per frame, the durations are summed
+	if (frameQueries.usedQueryCount == (int)frameQueries.queries.size())
+	{
+		QOpenGLTimerQuery* query = new QOpenGLTimerQuery();
+
+		if (!query->create())
+		{
+			delete query;
+			return;
+		}
+
+		frameQueries.queries.push_back(query);
+		frameQueries.stages.push_back(stage);
+	}
+
+	frameQueries.stages[frameQueries.usedQueryCount] = stage;
+	frameQueries.queries[frameQueries.usedQueryCount]->begin();
+	frameQueries.usedQueryCount++;
+
+	stageIsActive = true;
+}
+
+void RenderStageTimer::endStage()
+{
+	if (!isEnabled || !stageIsActive)
+		return;
+
+	FrameQueries& frameQueries = frames[currentFrameIndex];
+	frameQueries.queries[frameQueries.usedQueryCount - 1]->end();
+
+	stageIsActive = false;
+}
+
+void RenderStageTimer::collectResults(FrameQueries& frameQueries)
+{
+	if (frameQueries.usedQueryCount == 0)
+		return;
+
+	// waiting for the results would stall the pipeline, so a frame that is not finished yet is just left out
+	for (int i = 0; i < frameQueries.usedQueryCount; ++i)
+	{
+		if (!frameQueries.queries[i]->isResultAvailable())
+		{
+			droppedFrameCount++;
+			frameQueries.usedQueryCount = 0;
+
+			return;
+		}
+	}
+
+	double stageDurations[RenderStageCount] = {};
+	bool stageWasTimed[RenderStageCount] = {};
+
+	for (int i = 0; i < frameQueries.usedQueryCount; ++i)
+	{
+		stageDurations[frameQueries.stages[i]] += frameQueries.queries[i]->waitForResult() / 1000000.0;
+		stageWasTimed[frameQueries.stages[i]] = true;
+	}
+
+	for (int i = 0; i < RenderStageCount; ++i)
+	{
+		if (!stageWasTimed[i])
+			continue;
+
+		if (sampleCounts[i] == 0)
+			averageDurations[i].reset(stageDurations[i]);
+		else
+			averageDurations[i].addMeasurement(stageDurations[i]);
+
+		totalDurations[i] += stageDurations[i];
+		sampleCounts[i]++;
+	}
+
+	collectedFrameCount++;
+	frameQueries.usedQueryCount = 0;
+}
+
+bool RenderStageTimer::getIsEnabled() const
+{
+	return isEnabled;
+}
+
+bool RenderStageTimer::getHasResults(RenderStage stage) const
+{
+	return (sampleCounts[stage] > 0);
+}
+
+double RenderStageTimer::getAverageDuration(RenderStage stage) const
+{
+	return averageDurations[stage].getAverage();
+}
+
+void RenderStageTimer::logStatistics()
+{
+	if (!isEnabled)
+		return;
+
+	qDebug("GPU render stages: %d frames timed, %d frames left out", collectedFrameCount, droppedFrameCount);
+
+	for (int i = 0; i < RenderStageCount; ++i)
+	{
+		if (sampleCounts[i] == 0)
+			continue;
+
+		qDebug("GPU %s: %d samples, %.3f ms average, %.3f ms total",
+			qPrintable(getStageName((RenderStage)i)),
+			sampleCounts[i],
+			totalDurations[i] / sampleCounts[i],
+			totalDurations[i]);
+	}
+}
+
+QString RenderStageTimer::getStageName(RenderStage stage)
+{
+	switch (stage)
+	{
+		case VideoPanelStage: return "video";
+		case MapPanelStage: return "map";
+		case RouteStage: return "route";
+		case InfoPanelStage: return "info";
+		case ResolveStage: return "resolve";
+		case ReadbackStage: return "readback";
+		default: return "unknown";
+	}
+}
@@ -0,0 +1,61 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <vector>
+
+#include <QOpenGLTimerQuery>
+#include <QString>
+
+#include "MovingAverage.h"
+
+namespace OrientView
+{
+	enum RenderStage { VideoPanelStage, MapPanelStage, RouteStage, InfoPanelStage, ResolveStage, ReadbackStage, RenderStageCount };
+
+	// Measures the GPU time of each render stage with timer queries, the results are read a few frames later so that the CPU never waits for the GPU.
+	class RenderStageTimer
+	{
+
+	public:
+
+		bool initialize(int frameDelay);
+		~RenderStageTimer();
+
+		void beginFrame();
+		void beginStage(RenderStage stage);
+		void endStage();
+
+		bool getIsEnabled() const;
+		bool getHasResults(RenderStage stage) const;
+		double getAverageDuration(RenderStage stage) const;
+
+		void logStatistics();
+
+		static QString getStageName(RenderStage stage);
+
+	private:
+
+		struct FrameQueries
+		{
+			std::vector<QOpenGLTimerQuery*> queries;
+			std::vector<RenderStage> stages;
+			int usedQueryCount = 0;
+		};
+
+		void collectResults(FrameQueries& frameQueries);
+
+		bool isEnabled = false;
+		bool stageIsActive = false;
+
+		std::vector<FrameQueries> frames;
+		int currentFrameIndex = 0;
+
+		MovingAverage averageDurations[RenderStageCount];
+		double totalDurations[RenderStageCount] = {};
+		int sampleCounts[RenderStageCount] = {};
+		int collectedFrameCount = 0;
+		int droppedFrameCount = 0;
+	};
+}
@@ -1,7 +1,12 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <algorithm>
+#include <cstring>
+
 #include <QOpenGLPixelTransferOptions>
+#include <QVector2D>
+#include <QVector3D>
 #include <QStandardPaths>
 #include <QDir>
 #include <QString>
@@ -12,24 +17,60 @@
 
 #include "VideoDecoder.h"
 #include "MapImageReader.h"
-#include "VideoStabilizer.h"
 #include "InputHandler.h"
 #include "RouteManager.h"
 #include "Settings.h"
 #include "FrameData.h"
 #include "FileHandler.h"
+#include "SoftwareCompositor.h"
+#include "ShaderLoader.h"
+#include "InterpolationFunctions.h"
 
 using namespace OrientView;
 
-Panel::Panel() : texture(QOpenGLTexture::Target2D)
+namespace
+{
+	const int LATENCY_WINDOW_DURATION = 5000; // milliseconds
+	const int RESAMPLE_PHASE_COUNT = 256;
+}
+
+Panel::Panel() : texture(QOpenGLTexture::Target2D), weightTexture(QOpenGLTexture::Target2D)
+{
+}
+
+bool MapLayerState::operator==(const MapLayerState& other) const
+{
+	return (vertexMatrix == other.vertexMatrix &&
+		area == other.area &&
+		clippingEnabled == other.clippingEnabled &&
+		routePath == other.routePath &&
+		routeRenderMode == other.routeRenderMode &&
+		routeWidth == other.routeWidth &&
+		tailPath == other.tailPath &&
+		tailRenderMode == other.tailRenderMode &&
+		tailWidth == other.tailWidth &&
+		controlPositions == other.controlPositions &&
+		showControls == other.showControls &&
+		runnerPosition == other.runnerPosition &&
+		runnerScale == other.runnerScale &&
+		showRunner == other.showRunner &&
+		routeUserScale == other.routeUserScale);
+}
+
+bool FrameState::operator==(const FrameState& other) const
 {
+	return (videoTextureGeneration == other.videoTextureGeneration &&
+		videoVertexMatrix == other.videoVertexMatrix &&
+		videoArea == other.videoArea &&
+		renderMode == other.renderMode &&
+		showInfoPanel == other.showInfoPanel &&
+		infoPanelUserValues == other.infoPanelUserValues);
 }
 
-bool Renderer::initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageReader, VideoStabilizer* videoStabilizer, InputHandler* inputHandler, RouteManager* routeManager, Settings* settings, bool renderToOffscreen)
+bool Renderer::initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageReader, InputHandler* inputHandler, RouteManager* routeManager, Settings* settings, bool renderToOffscreen)
 {
 	qDebug("Initializing renderer");
 
-	this->videoStabilizer = videoStabilizer;
 	this->inputHandler = inputHandler;
 	this->routeManager = routeManager;
 	this->renderToOffscreen = renderToOffscreen;
@@ -43,6 +84,8 @@ bool Renderer::initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageRe
 	videoPanel.userScale = settings->video.scale;
 	videoPanel.textureWidth = videoDecoder->getFrameWidth();
 	videoPanel.textureHeight = videoDecoder->getFrameHeight();
+	videoPanel.textureDataWidth = videoPanel.textureWidth;
+	videoPanel.textureDataHeight = videoPanel.textureHeight;
 	videoPanel.texelWidth = 1.0 / videoPanel.textureWidth;
 	videoPanel.texelHeight = 1.0 / videoPanel.textureHeight;
 
@@ -53,24 +96,51 @@ bool Renderer::initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageRe
 	mapPanel.userScale = settings->map.scale;
 	mapPanel.textureWidth = mapImageReader->getMapImage().width();
 	mapPanel.textureHeight = mapImageReader->getMapImage().height();
+	mapPanel.textureDataWidth = mapPanel.textureWidth;
+	mapPanel.textureDataHeight = mapPanel.textureHeight;
 	mapPanel.texelWidth = 1.0 / mapPanel.textureWidth;
 	mapPanel.texelHeight = 1.0 / mapPanel.textureHeight;
 	mapPanel.relativeWidth = settings->map.relativeWidth;
 
 	multisamples = settings->window.multisamples;
+	mapLayerMultisamples = multisamples;
 	renderMode = settings->renderer.renderMode;
 	showInfoPanel = settings->renderer.showInfoPanel;
 	infoPanelFontSize = settings->renderer.infoPanelFontSize;
+	infoPanelUpdateInterval = settings->renderer.infoPanelUpdateInterval;
+	infoPanelFont = QFont("DejaVu Sans", infoPanelFontSize, QFont::Bold);
+	infoPanelUpdateTimer.start();
+	dirtyTrackingEnabled = !renderToOffscreen && settings->renderer.enableDirtyTracking;
+
+	// dropped frames are only counted when playing on the screen
+	if (!renderToOffscreen)
+		infoPanelTimingValueCount++;
 
 	const double averagingFactor = 0.005;
 	averageFps.setAlpha(averagingFactor);
-	averageFrameDuration.setAlpha(averagingFactor);
-	averageDecodeDuration.setAlpha(averagingFactor);
-	averageStabilizeDuration.setAlpha(averagingFactor);
-	averageRenderDuration.setAlpha(averagingFactor);
-	averageEncodeDuration.setAlpha(averagingFactor);
 	averageSpareTime.setAlpha(averagingFactor);
 
+	for (int i = 0; i < LatencyStageCount; ++i)
+	{
+		latencyHistograms[i].reset();
+		recentLatencyHistograms[i].reset();
+		previousLatencyHistograms[i].reset();
+	}
+
+	latencyWindowTimer.start();
+
+	if (renderToOffscreen && settings->renderer.backend == RenderBackend::Software)
+	{
+		softwareCompositor = new SoftwareCompositor();
+
+		if (!softwareCompositor->initialize(mapImageReader->getMapImage(), settings->video.rescaleShader, settings->video.rescaleShaderDefines, settings->map.rescaleShader, settings->map.rescaleShaderDefines, settings->renderer.softwareThreadCount))
+			return false;
+
+		painter = new QPainter();
+
+		return windowResized(settings->window.width, settings->window.height);
+	}
+
 	initializeOpenGLFunctions();
 
 	if (!windowResized(settings->window.width, settings->window.height))
@@ -118,15 +188,29 @@ bool Renderer::initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageRe
 	mapPanel.vertexBuffer.allocate(mapPanelBuffer, sizeof(GLfloat) * 20);
 	mapPanel.vertexBuffer.release();
 
-	videoPanel.texture.create();
-	videoPanel.texture.bind();
-	videoPanel.texture.setSize(videoPanel.textureWidth, videoPanel.textureHeight);
-	videoPanel.texture.setFormat(QOpenGLTexture::RGBA8_UNorm);
-	videoPanel.texture.setMinificationFilter(QOpenGLTexture::Linear);
-	videoPanel.texture.setMagnificationFilter(QOpenGLTexture::Linear);
-	videoPanel.texture.setWrapMode(QOpenGLTexture::ClampToEdge);
-	videoPanel.texture.allocateStorage();
-	videoPanel.texture.release();
+	// covers the whole target in normalized device coordinates
+	// 1 2
+	// 4 3
+	GLfloat quadBuffer[] =
+	{
+		-1.0f, 1.0f, // 1
+		1.0f, 1.0f, // 2
+		1.0f, -1.0f, // 3
+		-1.0f, -1.0f, // 4
+
+		0.0f, 1.0f, // 1
+		1.0f, 1.0f, // 2
+		1.0f, 0.0f, // 3
+		0.0f, 0.0f  // 4
+	};
+
+	quadVertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	quadVertexBuffer.create();
+	quadVertexBuffer.bind();
+	quadVertexBuffer.allocate(quadBuffer, sizeof(GLfloat) * 16);
+	quadVertexBuffer.release();
+
+	allocateVideoTexture((int)videoPanel.textureWidth, (int)videoPanel.textureHeight);
 
 	mapPanel.texture.create();
 	mapPanel.texture.bind();
@@ -136,12 +220,52 @@ bool Renderer::initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageRe
 	mapPanel.texture.setWrapMode(QOpenGLTexture::ClampToEdge);
 	mapPanel.texture.release();
 
-	if (!loadRescaleShader(videoPanel, settings->video.rescaleShader))
+	QElapsedTimer shaderLoadTimer;
+	shaderLoadTimer.start();
+
+	GLint maximumTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maximumTextureSize);
+	maximumResampleSize = std::min(settings->renderer.maximumResampleSize, (int)maximumTextureSize);
+
+	bool videoUsesSeparableRescale = (settings->renderer.enableSeparableRescale && settings->video.rescaleShader == "bicubic");
+	bool mapUsesSeparableRescale = (settings->renderer.enableSeparableRescale && settings->map.rescaleShader == "bicubic");
+
+	if ((videoUsesSeparableRescale || mapUsesSeparableRescale) && !loadQuadShader(resampleShaderProgram, resampleVertexArrayObject, "resample_separable"))
+		return false;
+
+	if (videoUsesSeparableRescale)
+	{
+		if (!loadSeparableRescale(videoPanel, settings->video.rescaleShaderDefines))
+			return false;
+	}
+	else if (!loadPanelShader(videoPanel, videoPanel.shaderProgram, videoPanel.vertexArrayObject, QString("rescale_%1").arg(settings->video.rescaleShader), settings->video.rescaleShaderDefines))
+		return false;
+
+	if (mapUsesSeparableRescale)
+	{
+		if (!loadSeparableRescale(mapPanel, settings->map.rescaleShaderDefines))
+			return false;
+	}
+	else if (!loadPanelShader(mapPanel, mapPanel.shaderProgram, mapPanel.vertexArrayObject, QString("rescale_%1").arg(settings->map.rescaleShader), settings->map.rescaleShaderDefines))
+		return false;
+
+	// used for the last step of the separable rescale and when the quality has been reduced during playback
+	if (!loadPanelShader(videoPanel, videoPanel.bilinearShaderProgram, videoPanel.bilinearVertexArrayObject, "rescale_default", QString()))
 		return false;
 
-	if (!loadRescaleShader(mapPanel, settings->map.rescaleShader))
+	if (!loadPanelShader(mapPanel, mapPanel.bilinearShaderProgram, mapPanel.bilinearVertexArrayObject, "rescale_default", QString()))
 		return false;
 
+	if (dirtyTrackingEnabled && !loadQuadShader(layerShaderProgram, layerVertexArrayObject, "layer"))
+		return false;
+
+	// the first run with a new driver or new shader sources compiles (cold), later runs load cached binaries (warm)
+	qDebug("Shaders initialized in %.2f ms", shaderLoadTimer.nsecsElapsed() / 1000000.0);
+
+	// not fatal, the render stages are just not timed if the driver has no timer queries
+	if (settings->renderer.enableGpuTimers && renderStageTimer.initialize(3))
+		infoPanelTimingValueCount += RenderStageCount;
+
 	paintDevice = new QOpenGLPaintDevice(windowWidth, windowHeight);
 	paintDevice->setPaintFlipped(renderToOffscreen);
 	painter = new QPainter();
@@ -156,7 +280,7 @@ bool Renderer::windowResized(int newWidth, int newHeight)
 
 	fullClearRequested = true;
 
-	if (renderToOffscreen)
+	if (renderToOffscreen && softwareCompositor == nullptr)
 	{
 		QOpenGLFramebufferObjectFormat format;
 		format.setSamples(multisamples);
@@ -191,30 +315,48 @@ bool Renderer::windowResized(int newWidth, int newHeight)
 			qWarning("Could not create non multisampled main frame buffer");
 			return false;
 		}
+	}
 
-		if (renderedFrameData.data != nullptr)
-		{
-			delete renderedFrameData.data;
-			renderedFrameData.data = nullptr;
-		}
-
+	if (renderToOffscreen)
+	{
+		// the buffer belongs to the encoder queue, the software compositor is given a slot with setRenderTarget() before each frame
 		renderedFrameData = FrameData();
 		renderedFrameData.dataLength = (size_t)(windowWidth * windowHeight * 4);
 		renderedFrameData.rowLength = (size_t)(windowWidth * 4);
-		renderedFrameData.data = new uint8_t[renderedFrameData.dataLength];
 		renderedFrameData.width = windowWidth;
 		renderedFrameData.height = windowHeight;
+		renderedFrameImage = QImage();
 	}
 
+	if (dirtyTrackingEnabled && !createMapLayerFramebuffers())
+		return false;
+
 	return true;
 }
 
 Renderer::~Renderer()
 {
-	if (renderedFrameData.data != nullptr)
+	if (softwareCompositor != nullptr)
+	{
+		delete softwareCompositor;
+		softwareCompositor = nullptr;
+	}
+
+	renderedFrameImage = QImage();
+
+	deleteResampleFramebuffers(videoPanel);
+	deleteResampleFramebuffers(mapPanel);
+
+	if (mapLayerFramebufferNonMultisample != nullptr)
+	{
+		delete mapLayerFramebufferNonMultisample;
+		mapLayerFramebufferNonMultisample = nullptr;
+	}
+
+	if (mapLayerFramebuffer != nullptr)
 	{
-		delete renderedFrameData.data;
-		renderedFrameData.data = nullptr;
+		delete mapLayerFramebuffer;
+		mapLayerFramebuffer = nullptr;
 	}
 
 	if (offscreenFramebufferNonMultisample != nullptr)
@@ -242,35 +384,144 @@ Renderer::~Renderer()
 	}
 }
 
-bool Renderer::loadRescaleShader(Panel& panel, const QString& shaderName)
+bool Renderer::loadPanelShader(Panel& panel, QOpenGLShaderProgram& program, QOpenGLVertexArrayObject& vertexArrayObject, const QString& shaderName, const QString& shaderDefines)
 {
-	const QString vertexShaderPath = getDataFilePath(QString("shaders/rescale_%1.vert").arg(shaderName));
-	const QString fragmentShaderPath = getDataFilePath(QString("shaders/rescale_%1.frag").arg(shaderName));
-
-	if (!panel.shaderProgram.addShaderFromSourceFile(QOpenGLShader::Vertex, vertexShaderPath))
+	if (!ShaderLoader::loadProgram(program, shaderName, shaderDefines))
 		return false;
 
-	if (!panel.shaderProgram.addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShaderPath))
+	vertexArrayObject.create();
+	vertexArrayObject.bind();
+
+	panel.vertexBuffer.bind();
+	program.enableAttributeArray("vertexPosition");
+	program.enableAttributeArray("vertexTextureCoordinate");
+	program.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3, 0);
+	program.setAttributeBuffer("vertexTextureCoordinate", GL_FLOAT, sizeof(GLfloat) * 12, 2, 0);
+
+	vertexArrayObject.release();
+	panel.vertexBuffer.release();
+
+	return true;
+}
+
+bool Renderer::loadQuadShader(QOpenGLShaderProgram& program, QOpenGLVertexArrayObject& vertexArrayObject, const QString& shaderName)
+{
+	if (!ShaderLoader::loadProgram(program, shaderName))
 		return false;
 
-	if (!panel.shaderProgram.link())
+	vertexArrayObject.create();
+	vertexArrayObject.bind();
+
+	quadVertexBuffer.bind();
+	program.enableAttributeArray("vertexPosition");
+	program.enableAttributeArray("vertexTextureCoordinate");
+	program.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 2, 0);
+	program.setAttributeBuffer("vertexTextureCoordinate", GL_FLOAT, sizeof(GLfloat) * 8, 2, 0);
+
+	vertexArrayObject.release();
+	quadVertexBuffer.release();
+
+	return true;
+}
+
+bool Renderer::loadSeparableRescale(Panel& panel, const QString& shaderDefines)
+{
+	InterpolationFunction function;
+	double lanczosSize;
+	InterpolationFunctions::fromShaderDefines(ShaderLoader::parseDefines(shaderDefines), function, lanczosSize);
+
+	// the kernel is evaluated once on the CPU, the passes only look up the four tap weights
+	std::vector<float> weights = InterpolationFunctions::calculateWeightTable(function, RESAMPLE_PHASE_COUNT, lanczosSize);
+
+	panel.weightTexture.create();
+	panel.weightTexture.bind();
+	panel.weightTexture.setSize(RESAMPLE_PHASE_COUNT, 1);
+	panel.weightTexture.setFormat(QOpenGLTexture::RGBA32F);
+	panel.weightTexture.setMinificationFilter(QOpenGLTexture::Linear);
+	panel.weightTexture.setMagnificationFilter(QOpenGLTexture::Linear);
+	panel.weightTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
+	panel.weightTexture.allocateStorage();
+	panel.weightTexture.setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32, weights.data());
+	panel.weightTexture.release();
+
+	// the resampled image is close to the final size, so hardware bilinear is enough for the last (rotating) step
+	panel.separableRescaleEnabled = true;
+
+	qDebug("Separable rescale: function %d, lanczos size %.1f, maximum weight table error %.6f", (int)function, lanczosSize, InterpolationFunctions::calculateWeightTableError(function, RESAMPLE_PHASE_COUNT, lanczosSize));
+
+	return true;
+}
+
+bool Renderer::createMapLayerFramebuffers()
+{
+	mapLayerIsValid = false;
+
+	// the window is also resized when it is only re-exposed, the old buffers are fine then
+	if (mapLayerFramebuffer != nullptr && mapLayerFramebuffer->size() == QSize(windowWidth, windowHeight) && mapLayerFramebufferMultisamples == mapLayerMultisamples)
+		return true;
+
+	QOpenGLFramebufferObjectFormat format;
+	format.setSamples(mapLayerMultisamples);
+	format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+
+	if (mapLayerFramebuffer != nullptr)
+	{
+		delete mapLayerFramebuffer;
+		mapLayerFramebuffer = nullptr;
+	}
+
+	mapLayerFramebuffer = new QOpenGLFramebufferObject(windowWidth, windowHeight, format);
+
+	if (!mapLayerFramebuffer->isValid())
+	{
+		qWarning("Could not create map layer frame buffer");
 		return false;
+	}
 
-	panel.vertexArrayObject.create();
-	panel.vertexArrayObject.bind();
+	format.setSamples(0);
+	format.setAttachment(QOpenGLFramebufferObject::NoAttachment);
 
-	panel.vertexBuffer.bind();
-	panel.shaderProgram.enableAttributeArray("vertexPosition");
-	panel.shaderProgram.enableAttributeArray("vertexTextureCoordinate");
-	panel.shaderProgram.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3, 0);
-	panel.shaderProgram.setAttributeBuffer("vertexTextureCoordinate", GL_FLOAT, sizeof(GLfloat) * 12, 2, 0);
+	if (mapLayerFramebufferNonMultisample != nullptr)
+	{
+		delete mapLayerFramebufferNonMultisample;
+		mapLayerFramebufferNonMultisample = nullptr;
+	}
 
-	panel.vertexArrayObject.release();
-	panel.vertexBuffer.release();
+	mapLayerFramebufferNonMultisample = new QOpenGLFramebufferObject(windowWidth, windowHeight, format);
+
+	if (!mapLayerFramebufferNonMultisample->isValid())
+	{
+		qWarning("Could not create non multisampled map layer frame buffer");
+		return false;
+	}
+
+	mapLayerFramebufferMultisamples = mapLayerMultisamples;
 
 	return true;
 }
 
+void Renderer::allocateVideoTexture(int width, int height)
+{
+	if (videoPanel.texture.isCreated())
+		videoPanel.texture.destroy();
+
+	videoPanel.texture.create();
+	videoPanel.texture.bind();
+	videoPanel.texture.setSize(width, height);
+	videoPanel.texture.setFormat(QOpenGLTexture::RGBA8_UNorm);
+	videoPanel.texture.setMinificationFilter(QOpenGLTexture::Linear);
+	videoPanel.texture.setMagnificationFilter(QOpenGLTexture::Linear);
+	videoPanel.texture.setWrapMode(QOpenGLTexture::ClampToEdge);
+	videoPanel.texture.allocateStorage();
+	videoPanel.texture.release();
+
+	// the panel keeps its size, only the texture coordinates are in different units
+	videoPanel.textureDataWidth = width;
+	videoPanel.textureDataHeight = height;
+	videoPanel.texelWidth = 1.0 / width;
+	videoPanel.texelHeight = 1.0 / height;
+}
+
 void Renderer::startRendering(double currentTime, double frameDuration, double decodeDuration, double stabilizeDuration, double encodeDuration, double spareTime)
 {
 	renderDurationTimer.restart();
@@ -278,13 +529,36 @@ void Renderer::startRendering(double currentTime, double frameDuration, double d
 	this->currentTime = currentTime;
 
 	averageFps.addMeasurement(1000.0 / frameDuration, frameDuration);
-	averageFrameDuration.addMeasurement(frameDuration, frameDuration);
-	averageDecodeDuration.addMeasurement(decodeDuration, frameDuration);
-	averageStabilizeDuration.addMeasurement(stabilizeDuration, frameDuration);
-	averageRenderDuration.addMeasurement(renderDuration, frameDuration);
-	averageEncodeDuration.addMeasurement(encodeDuration, frameDuration);
 	averageSpareTime.addMeasurement(spareTime, frameDuration);
 
+	if (latencyWindowTimer.elapsed() >= LATENCY_WINDOW_DURATION)
+	{
+		for (int i = 0; i < LatencyStageCount; ++i)
+		{
+			previousLatencyHistograms[i] = recentLatencyHistograms[i];
+			recentLatencyHistograms[i].reset();
+		}
+
+		latencyWindowTimer.restart();
+	}
+
+	double latencies[LatencyStageCount] = { frameDuration, decodeDuration, stabilizeDuration, renderDuration, encodeDuration };
+
+	for (int i = 0; i < LatencyStageCount; ++i)
+	{
+		// nothing is encoded when playing on the screen
+		if (i == EncodeLatency && !renderToOffscreen)
+			continue;
+
+		latencyHistograms[i].record(latencies[i]);
+		recentLatencyHistograms[i].record(latencies[i]);
+	}
+
+	if (softwareCompositor != nullptr)
+		return;
+
+	renderStageTimer.beginFrame();
+
 	paintDevice->setSize(QSize(windowWidth, windowHeight));
 
 	glViewport(0, 0, windowWidth, windowHeight);
@@ -294,8 +568,21 @@ void Renderer::startRendering(double currentTime, double frameDuration, double d
 
 void Renderer::uploadFrameData(const FrameData& frameData)
 {
+	stabilizerX = frameData.stabilizerX;
+	stabilizerY = frameData.stabilizerY;
+	stabilizerAngle = frameData.stabilizerAngle;
+
+	if (softwareCompositor != nullptr)
+	{
+		softwareCompositor->uploadVideoFrame(frameData);
+		return;
+	}
+
 	if (frameData.data != nullptr && frameData.width > 0 && frameData.height > 0)
 	{
+		if (frameData.width != videoPanel.texture.width() || frameData.height != videoPanel.texture.height())
+			allocateVideoTexture(frameData.width, frameData.height);
+
 		QOpenGLPixelTransferOptions options;
 
 		options.setRowLength((int)(frameData.rowLength / 4));
@@ -303,27 +590,108 @@ void Renderer::uploadFrameData(const FrameData& frameData)
 		options.setAlignment(1);
 
 		videoPanel.texture.setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, frameData.data, &options);
+		videoTextureGeneration++;
+	}
+}
+
+bool Renderer::hasFrameChanged()
+{
+	if (!dirtyTrackingEnabled || fullClearRequested)
+		return true;
+
+	if (renderMode == RenderMode::All || renderMode == RenderMode::Video)
+		updateVideoPanel();
+
+	if (renderMode == RenderMode::All || renderMode == RenderMode::Map)
+	{
+		updateMapPanel();
+
+		if (!mapLayerIsValid || !(getMapLayerState() == mapLayerState))
+			return true;
 	}
+
+	return !(getFrameState() == renderedFrameState);
 }
 
 void Renderer::renderAll()
 {
-	if (renderToOffscreen)
+	bool shouldRenderVideo = (renderMode == RenderMode::All || renderMode == RenderMode::Video);
+	bool shouldRenderMap = (renderMode == RenderMode::All || renderMode == RenderMode::Map);
+
+	if (shouldRenderVideo)
+		updateVideoPanel();
+
+	if (shouldRenderMap)
+		updateMapPanel();
+
+	// resampling renders to its own framebuffers, so it has to be done before the main framebuffer is bound
+	if (shouldRenderVideo && videoPanel.separableRescaleEnabled && !videoPanel.reducedRescaleEnabled)
+	{
+		renderStageTimer.beginStage(VideoPanelStage);
+		resamplePanel(videoPanel, videoTextureGeneration);
+		renderStageTimer.endStage();
+	}
+
+	if (shouldRenderMap && mapPanel.separableRescaleEnabled && !mapPanel.reducedRescaleEnabled)
+	{
+		renderStageTimer.beginStage(MapPanelStage);
+		resamplePanel(mapPanel, 0);
+		renderStageTimer.endStage();
+	}
+
+	if (renderToOffscreen && softwareCompositor == nullptr)
 		offscreenFramebuffer->bind();
 
-	if (renderMode == RenderMode::All || renderMode == RenderMode::Video)
+	if (fullClearRequested)
+	{
+		clearArea(QRect(0, 0, (int)windowWidth, (int)windowHeight), shouldRenderVideo ? videoPanel.clearColor : mapPanel.clearColor);
+		fullClearRequested = false;
+	}
+
+	// the back buffer is undefined after a swap, so the video panel is always redrawn
+	// the map and the route are expensive to draw and usually change less often, so they are kept in a layer
+	if (shouldRenderVideo)
+	{
+		renderStageTimer.beginStage(VideoPanelStage);
 		renderVideoPanel();
+		renderStageTimer.endStage();
+	}
 
-	if (renderMode == RenderMode::All || renderMode == RenderMode::Map)
+	if (shouldRenderMap)
 	{
-		renderMapPanel();
-		renderRoute(routeManager->getDefaultRoute());
+		if (dirtyTrackingEnabled)
+		{
+			MapLayerState currentMapLayerState = getMapLayerState();
+
+			if (!mapLayerIsValid || !(currentMapLayerState == mapLayerState))
+			{
+				renderMapLayer();
+
+				mapLayerState = currentMapLayerState;
+				mapLayerIsValid = true;
+				mapLayerRenderCount++;
+			}
+
+			renderStageTimer.beginStage(MapPanelStage);
+			compositeMapLayer();
+			renderStageTimer.endStage();
+		}
+		else
+		{
+			renderStageTimer.beginStage(MapPanelStage);
+			renderMapPanel();
+			renderStageTimer.endStage();
+
+			renderStageTimer.beginStage(RouteStage);
+			renderRoute(routeManager->getDefaultRoute());
+			renderStageTimer.endStage();
+		}
 
 		if (mapPanel.clippingEnabled)
 		{
 			int mapRightBorderX = (int)(mapPanel.relativeWidth * windowWidth + 0.5);
 
-			painter->begin(paintDevice);
+			painter->begin(getPaintDevice());
 			painter->setPen(QColor(0, 0, 0));
 			painter->drawLine(mapRightBorderX, 0, mapRightBorderX, (int)windowHeight);
 			painter->end();
@@ -331,9 +699,20 @@ void Renderer::renderAll()
 	}
 
 	if (showInfoPanel)
+	{
+		updateInfoPanel();
+
+		renderStageTimer.beginStage(InfoPanelStage);
 		renderInfoPanel();
+		renderStageTimer.endStage();
+	}
 
-	if (renderToOffscreen)
+	if (dirtyTrackingEnabled)
+		renderedFrameState = getFrameState();
+
+	renderedFrameCount++;
+
+	if (renderToOffscreen && softwareCompositor == nullptr)
 		offscreenFramebuffer->release();
 }
 
@@ -342,10 +721,33 @@ void Renderer::stopRendering()
 	renderDuration = renderDurationTimer.nsecsElapsed() / 1000000.0;
 }
 
-FrameData Renderer::getRenderedFrame()
+// the software compositor and the painter draw straight into the slot of the encoder queue, so there is nothing to copy afterwards
+void Renderer::setRenderTarget(FrameData& frameData)
 {
-	if (!renderToOffscreen)
-		return FrameData();
+	if (softwareCompositor == nullptr || frameData.data == renderedFrameData.data)
+		return;
+
+	if (frameData.data == nullptr || frameData.dataLength < renderedFrameData.dataLength)
+	{
+		qWarning("Could not use the frame as the render target");
+		return;
+	}
+
+	// the slot still holds the frame from a full queue length ago
+	// without clearing, the video panel leaves a trail behind, and that has to continue from the previous frame
+	if (!videoPanel.clearingEnabled && renderedFrameData.data != nullptr)
+		memcpy(frameData.data, renderedFrameData.data, renderedFrameData.dataLength);
+	else
+		fullClearRequested = true;
+
+	renderedFrameData.data = frameData.data;
+	renderedFrameImage = QImage(renderedFrameData.data, renderedFrameData.width, renderedFrameData.height, (int)renderedFrameData.rowLength, QImage::Format_RGBA8888_Premultiplied);
+}
+
+void Renderer::getRenderedFrame(FrameData& frameData)
+{
+	if (!renderToOffscreen || softwareCompositor != nullptr || frameData.data == nullptr || frameData.dataLength < renderedFrameData.dataLength)
+		return;
 
 	QOpenGLFramebufferObject* sourceFbo = offscreenFramebuffer;
 
@@ -353,27 +755,26 @@ FrameData Renderer::getRenderedFrame()
 	// copy the framebuffer to a non-multisampled framebuffer and continue
 	if (sourceFbo->format().samples() != 0)
 	{
+		renderStageTimer.beginStage(ResolveStage);
+
 		QRect rect(0, 0, windowWidth, windowHeight);
 		QOpenGLFramebufferObject::blitFramebuffer(offscreenFramebufferNonMultisample, rect, sourceFbo, rect);
 		sourceFbo = offscreenFramebufferNonMultisample;
+
+		renderStageTimer.endStage();
 	}
 
+	renderStageTimer.beginStage(ReadbackStage);
+
 	sourceFbo->bind();
-	glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, renderedFrameData.data);
+	glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, frameData.data);
 	sourceFbo->release();
 
-	return renderedFrameData;
+	renderStageTimer.endStage();
 }
 
-void Renderer::renderVideoPanel()
+void Renderer::updateVideoPanel()
 {
-	videoPanel.vertexMatrix.setToIdentity();
-
-	if (!renderToOffscreen)
-		videoPanel.vertexMatrix.ortho(-windowWidth / 2, windowWidth / 2, -windowHeight / 2, windowHeight / 2, 0.0f, 1.0f);
-	else
-		videoPanel.vertexMatrix.ortho(-windowWidth / 2, windowWidth / 2, windowHeight / 2, -windowHeight / 2, 0.0f, 1.0f);
-
 	if (renderMode != RenderMode::Video)
 	{
 		videoPanel.offsetX = (windowWidth / 2.0) - (((1.0 - mapPanel.relativeWidth) * windowWidth) / 2.0);
@@ -388,19 +789,16 @@ void Renderer::renderVideoPanel()
 	if (videoPanel.scale * videoPanel.textureHeight > windowHeight)
 		videoPanel.scale = windowHeight / videoPanel.textureHeight;
 
-	videoPanel.vertexMatrix.translate(videoPanel.offsetX, videoPanel.offsetY); // window coordinate units
-	videoPanel.vertexMatrix.translate( // scaled map pixel units
-		videoPanel.x + videoPanel.userX + videoStabilizer->getX() * videoPanel.textureWidth * videoPanel.scale * videoPanel.userScale,
-		videoPanel.y + videoPanel.userY - videoStabilizer->getY() * videoPanel.textureHeight * videoPanel.scale * videoPanel.userScale);
-	videoPanel.vertexMatrix.rotate(videoPanel.angle + videoPanel.userAngle - videoStabilizer->getAngle(), 0.0f, 0.0f, 1.0f);
-	videoPanel.vertexMatrix.scale(videoPanel.scale * videoPanel.userScale);
+	videoPanel.modelMatrix = QMatrix4x4();
+	videoPanel.modelMatrix.translate(videoPanel.offsetX, videoPanel.offsetY); // window coordinate units
+	videoPanel.modelMatrix.translate( // scaled map pixel units
+		videoPanel.x + videoPanel.userX + stabilizerX * videoPanel.textureWidth * videoPanel.scale * videoPanel.userScale,
+		videoPanel.y + videoPanel.userY - stabilizerY * videoPanel.textureHeight * videoPanel.scale * videoPanel.userScale);
+	videoPanel.modelMatrix.rotate(videoPanel.angle + videoPanel.userAngle - stabilizerAngle, 0.0f, 0.0f, 1.0f);
+	videoPanel.modelMatrix.scale(videoPanel.scale * videoPanel.userScale);
 
-	if (fullClearRequested)
-	{
-		glClearColor(videoPanel.clearColor.redF(), videoPanel.clearColor.greenF(), videoPanel.clearColor.blueF(), 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		fullClearRequested = false;
-	}
+	videoPanel.vertexMatrix = getProjectionMatrix() * videoPanel.modelMatrix;
+	videoPanel.area = QRect(0, 0, (int)windowWidth, (int)windowHeight);
 
 	if (videoPanel.clippingEnabled)
 	{
@@ -409,85 +807,298 @@ void Renderer::renderVideoPanel()
 		double leftMargin = (windowWidth - videoPanelWidth) / 2.0;
 		double bottomMargin = (windowHeight - videoPanelHeight) / 2.0;
 
-		glEnable(GL_SCISSOR_TEST);
-
-		glScissor((int)(leftMargin + videoPanel.x + videoPanel.userX + videoPanel.offsetX + 0.5),
+		videoPanel.area = QRect((int)(leftMargin + videoPanel.x + videoPanel.userX + videoPanel.offsetX + 0.5),
 			(int)(bottomMargin + videoPanel.y + videoPanel.userY + videoPanel.offsetY + 0.5),
 			(int)(videoPanelWidth + 0.5),
 			(int)(videoPanelHeight + 0.5));
 	}
+}
 
+void Renderer::renderVideoPanel()
+{
 	if (videoPanel.clearingEnabled)
+		clearArea(videoPanel.area, videoPanel.clearColor);
+
+	if (softwareCompositor != nullptr)
+	{
+		softwareCompositor->drawVideoPanel(renderedFrameData, videoPanel.area, videoPanel.modelMatrix);
+		return;
+	}
+
+	if (videoPanel.clippingEnabled)
 	{
-		glClearColor(videoPanel.clearColor.redF(), videoPanel.clearColor.greenF(), videoPanel.clearColor.blueF(), 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(videoPanel.area.x(), videoPanel.area.y(), videoPanel.area.width(), videoPanel.area.height());
 	}
 
 	renderPanel(videoPanel);
 	glDisable(GL_SCISSOR_TEST);
 }
 
-void Renderer::renderMapPanel()
+void Renderer::updateMapPanel()
 {
-	mapPanel.vertexMatrix.setToIdentity();
-
-	if (!renderToOffscreen)
-		mapPanel.vertexMatrix.ortho(-windowWidth / 2, windowWidth / 2, -windowHeight / 2, windowHeight / 2, 0.0f, 1.0f);
-	else
-		mapPanel.vertexMatrix.ortho(-windowWidth / 2, windowWidth / 2, windowHeight / 2, -windowHeight / 2, 0.0f, 1.0f);
-
 	if (renderMode != RenderMode::Map)
 		mapPanel.offsetX = -((windowWidth / 2.0) - ((mapPanel.relativeWidth * windowWidth) / 2.0));
 	else
 		mapPanel.offsetX = 0.0;
 
-	mapPanel.vertexMatrix.translate(mapPanel.offsetX, mapPanel.offsetY); // window coordinate units
-	mapPanel.vertexMatrix.rotate(mapPanel.angle + mapPanel.userAngle + routeManager->getAngle(), 0.0f, 0.0f, 1.0f);
-	mapPanel.vertexMatrix.scale(mapPanel.scale * mapPanel.userScale * routeManager->getScale());
-	mapPanel.vertexMatrix.translate(mapPanel.x + mapPanel.userX + routeManager->getX(), mapPanel.y + mapPanel.userY + routeManager->getY()); // map pixel units
+	mapPanel.modelMatrix = QMatrix4x4();
+	mapPanel.modelMatrix.translate(mapPanel.offsetX, mapPanel.offsetY); // window coordinate units
+	mapPanel.modelMatrix.rotate(mapPanel.angle + mapPanel.userAngle + routeManager->getAngle(), 0.0f, 0.0f, 1.0f);
+	mapPanel.modelMatrix.scale(mapPanel.scale * mapPanel.userScale * routeManager->getScale());
+	mapPanel.modelMatrix.translate(mapPanel.x + mapPanel.userX + routeManager->getX(), mapPanel.y + mapPanel.userY + routeManager->getY()); // map pixel units
 
+	mapPanel.vertexMatrix = getProjectionMatrix() * mapPanel.modelMatrix;
 	mapPanel.clippingEnabled = (renderMode == RenderMode::All);
+	mapPanel.area = QRect(0, 0, (int)windowWidth, (int)windowHeight);
 
-	if (fullClearRequested)
+	if (mapPanel.clippingEnabled)
+		mapPanel.area = QRect(0, 0, (int)(mapPanel.relativeWidth * windowWidth + 0.5), (int)windowHeight);
+}
+
+void Renderer::renderMapPanel()
+{
+	if (mapPanel.clearingEnabled)
+		clearArea(mapPanel.area, mapPanel.clearColor);
+
+	if (softwareCompositor != nullptr)
 	{
-		glClearColor(mapPanel.clearColor.redF(), mapPanel.clearColor.greenF(), mapPanel.clearColor.blueF(), 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		fullClearRequested = false;
+		softwareCompositor->drawMapPanel(renderedFrameData, mapPanel.area, mapPanel.modelMatrix);
+		return;
 	}
 
 	if (mapPanel.clippingEnabled)
 	{
 		glEnable(GL_SCISSOR_TEST);
-		glScissor(0, 0, (int)(mapPanel.relativeWidth * windowWidth + 0.5), (int)windowHeight);
-	}
-
-	if (mapPanel.clearingEnabled)
-	{
-		glClearColor(mapPanel.clearColor.redF(), mapPanel.clearColor.greenF(), mapPanel.clearColor.blueF(), 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		glScissor(mapPanel.area.x(), mapPanel.area.y(), mapPanel.area.width(), mapPanel.area.height());
 	}
 
 	renderPanel(mapPanel);
 	glDisable(GL_SCISSOR_TEST);
 }
 
-void Renderer::renderPanel(Panel& panel)
+void Renderer::renderMapLayer()
 {
-	panel.shaderProgram.bind();
+	// the sample count can be changed by the quality governor
+	if (mapLayerFramebufferMultisamples != mapLayerMultisamples)
+		createMapLayerFramebuffers();
 
-	panel.shaderProgram.setUniformValue("vertexMatrix", panel.vertexMatrix);
-	panel.shaderProgram.setUniformValue("textureSampler", 0);
-	panel.shaderProgram.setUniformValue("textureWidth", (float)panel.textureWidth);
-	panel.shaderProgram.setUniformValue("textureHeight", (float)panel.textureHeight);
-	panel.shaderProgram.setUniformValue("texelWidth", (float)panel.texelWidth);
-	panel.shaderProgram.setUniformValue("texelHeight", (float)panel.texelHeight);
+	mapLayerFramebuffer->bind();
 
-	panel.vertexArrayObject.bind();
-	panel.texture.bind();
+	renderStageTimer.beginStage(MapPanelStage);
+	renderMapPanel();
+	renderStageTimer.endStage();
 
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	renderStageTimer.beginStage(RouteStage);
+	renderRoute(routeManager->getDefaultRoute());
+	renderStageTimer.endStage();
 
-	panel.texture.release();
+	mapLayerFramebuffer->release();
+
+	renderStageTimer.beginStage(ResolveStage);
+
+	QRect rect(0, 0, windowWidth, windowHeight);
+	QOpenGLFramebufferObject::blitFramebuffer(mapLayerFramebufferNonMultisample, rect, mapLayerFramebuffer, rect);
+
+	renderStageTimer.endStage();
+}
+
+void Renderer::compositeMapLayer()
+{
+	if (mapPanel.clippingEnabled)
+	{
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(mapPanel.area.x(), mapPanel.area.y(), mapPanel.area.width(), mapPanel.area.height());
+	}
+
+	glDisable(GL_BLEND);
+
+	layerShaderProgram.bind();
+	layerShaderProgram.setUniformValue("textureSampler", 0);
+
+	layerVertexArrayObject.bind();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mapLayerFramebufferNonMultisample->texture());
+
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	layerVertexArrayObject.release();
+	layerShaderProgram.release();
+
+	glDisable(GL_SCISSOR_TEST);
+}
+
+MapLayerState Renderer::getMapLayerState()
+{
+	Route& route = routeManager->getDefaultRoute();
+	MapLayerState state;
+
+	state.vertexMatrix = mapPanel.vertexMatrix;
+	state.area = mapPanel.area;
+	state.clippingEnabled = mapPanel.clippingEnabled;
+	state.routePath = route.routePath;
+	state.routeRenderMode = route.routeRenderMode;
+	state.routeWidth = route.routeWidth;
+	state.tailPath = route.tailPath;
+	state.tailRenderMode = route.tailRenderMode;
+	state.tailWidth = route.tailWidth;
+	state.controlPositions = route.controlPositions;
+	state.showControls = route.showControls;
+	state.runnerPosition = route.runnerPosition;
+	state.runnerScale = route.runnerScale;
+	state.showRunner = route.showRunner;
+	state.routeUserScale = route.userScale;
+
+	return state;
+}
+
+FrameState Renderer::getFrameState()
+{
+	FrameState state;
+
+	state.videoTextureGeneration = videoTextureGeneration;
+	state.videoVertexMatrix = videoPanel.vertexMatrix;
+	state.videoArea = videoPanel.area;
+	state.renderMode = renderMode;
+	state.showInfoPanel = showInfoPanel;
+
+	// the timing values only change when frames are drawn, so they cannot keep the frame changing and are not even formatted here
+	if (showInfoPanel)
+		state.infoPanelUserValues = getInfoPanelUserValues();
+
+	return state;
+}
+
+void Renderer::resamplePanel(Panel& panel, int textureGeneration)
+{
+	// panels are scaled uniformly, so the length of the model x axis is the size of one texel in window pixels
+	double scale = QVector3D(panel.modelMatrix.column(0)).length();
+	int resampledWidth = std::max(1, std::min((int)(panel.textureWidth * scale + 0.5), maximumResampleSize));
+	int resampledHeight = std::max(1, std::min((int)(panel.textureHeight * scale + 0.5), maximumResampleSize));
+	QSize resampledSize(resampledWidth, resampledHeight);
+
+	bool sizeHasChanged = (panel.verticalResampleFramebuffer == nullptr || panel.verticalResampleFramebuffer->size() != resampledSize || panel.horizontalResampleFramebuffer->height() != (int)panel.textureDataHeight);
+
+	if (!sizeHasChanged && textureGeneration == panel.resampledTextureGeneration)
+		return;
+
+	if (sizeHasChanged)
+	{
+		deleteResampleFramebuffers(panel);
+
+		panel.horizontalResampleFramebuffer = new QOpenGLFramebufferObject(resampledWidth, (int)panel.textureDataHeight);
+		panel.verticalResampleFramebuffer = new QOpenGLFramebufferObject(resampledSize);
+
+		// the final step filters the result with hardware bilinear
+		glBindTexture(GL_TEXTURE_2D, panel.verticalResampleFramebuffer->texture());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	glDisable(GL_BLEND);
+	glDisable(GL_SCISSOR_TEST);
+
+	resampleShaderProgram.bind();
+	resampleShaderProgram.setUniformValue("textureSampler", 0);
+	resampleShaderProgram.setUniformValue("weightSampler", 1);
+	resampleShaderProgram.setUniformValue("phaseCount", (float)RESAMPLE_PHASE_COUNT);
+
+	resampleVertexArrayObject.bind();
+	panel.weightTexture.bind(1);
+
+	// horizontal pass, only the width changes
+	panel.horizontalResampleFramebuffer->bind();
+	glViewport(0, 0, resampledWidth, (int)panel.textureDataHeight);
+
+	resampleShaderProgram.setUniformValue("textureSize", QVector2D(panel.textureDataWidth, panel.textureDataHeight));
+	resampleShaderProgram.setUniformValue("direction", QVector2D(1.0f, 0.0f));
+	panel.texture.bind(0);
+
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+	panel.texture.release(0);
+
+	// vertical pass
+	panel.verticalResampleFramebuffer->bind();
+	glViewport(0, 0, resampledWidth, resampledHeight);
+
+	resampleShaderProgram.setUniformValue("textureSize", QVector2D(resampledWidth, panel.textureDataHeight));
+	resampleShaderProgram.setUniformValue("direction", QVector2D(0.0f, 1.0f));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, panel.horizontalResampleFramebuffer->texture());
+
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	panel.verticalResampleFramebuffer->release();
+
+	panel.weightTexture.release(1);
+	glActiveTexture(GL_TEXTURE0);
+	resampleVertexArrayObject.release();
+	resampleShaderProgram.release();
+
+	glViewport(0, 0, windowWidth, windowHeight);
+
+	panel.resampledTextureGeneration = textureGeneration;
+}
+
+void Renderer::deleteResampleFramebuffers(Panel& panel)
+{
+	if (panel.horizontalResampleFramebuffer != nullptr)
+	{
+		delete panel.horizontalResampleFramebuffer;
+		panel.horizontalResampleFramebuffer = nullptr;
+	}
+
+	if (panel.verticalResampleFramebuffer != nullptr)
+	{
+		delete panel.verticalResampleFramebuffer;
+		panel.verticalResampleFramebuffer = nullptr;
+	}
+}
+
+void Renderer::renderPanel(Panel& panel)
+{
+	if (panel.separableRescaleEnabled || panel.reducedRescaleEnabled)
+	{
+		panel.bilinearShaderProgram.bind();
+		panel.bilinearShaderProgram.setUniformValue("vertexMatrix", panel.vertexMatrix);
+		panel.bilinearShaderProgram.setUniformValue("textureSampler", 0);
+
+		panel.bilinearVertexArrayObject.bind();
+		glActiveTexture(GL_TEXTURE0);
+
+		if (panel.reducedRescaleEnabled)
+			glBindTexture(GL_TEXTURE_2D, panel.texture.textureId());
+		else
+			glBindTexture(GL_TEXTURE_2D, panel.verticalResampleFramebuffer->texture());
+
+		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		panel.bilinearVertexArrayObject.release();
+		panel.bilinearShaderProgram.release();
+
+		return;
+	}
+
+	panel.shaderProgram.bind();
+
+	panel.shaderProgram.setUniformValue("vertexMatrix", panel.vertexMatrix);
+	panel.shaderProgram.setUniformValue("textureSampler", 0);
+	panel.shaderProgram.setUniformValue("textureWidth", (float)panel.textureDataWidth);
+	panel.shaderProgram.setUniformValue("textureHeight", (float)panel.textureDataHeight);
+	panel.shaderProgram.setUniformValue("texelWidth", (float)panel.texelWidth);
+	panel.shaderProgram.setUniformValue("texelHeight", (float)panel.texelHeight);
+
+	panel.vertexArrayObject.bind();
+	panel.texture.bind();
+
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+	panel.texture.release();
 	panel.vertexArrayObject.release();
 	panel.shaderProgram.release();
 }
@@ -501,47 +1112,75 @@ void Renderer::renderRoute(Route& route)
 	painterMatrix.scale(mapPanel.scale * mapPanel.userScale * routeManager->getScale(), mapPanel.scale * mapPanel.userScale * routeManager->getScale());
 	painterMatrix.translate(mapPanel.x + mapPanel.userX + routeManager->getX(), -(mapPanel.y + mapPanel.userY + routeManager->getY()));
 
-	painter->begin(paintDevice);
+	QRect clipRect(0, 0, (int)windowWidth, (int)windowHeight);
+
+	if (renderMode != RenderMode::Map)
+		clipRect = QRect(0, 0, (int)(mapPanel.relativeWidth * windowWidth + 0.5), (int)windowHeight);
+
+	painter->begin(getPaintDevice());
 	painter->setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::SmoothPixmapTransform | QPainter::HighQualityAntialiasing);
 
 	if (renderMode != RenderMode::Map)
 	{
 		painter->setClipping(true);
-		painter->setClipRect(0, 0, (int)(mapPanel.relativeWidth * windowWidth + 0.5), (int)windowHeight);
+		painter->setClipRect(clipRect);
 	}
 
-	painter->setWorldMatrix(painterMatrix);
-
-	if (route.routeRenderMode == RouteRenderMode::Discreet || route.routeRenderMode == RouteRenderMode::Highlight)
+	// the software rasterizer is slow with long antialiased paths, so the route is drawn to a cached layer when the map has stopped moving
+	// first frame with a new transformation draws directly, the layer is built only if the next frame still uses the same transformation
+	if (softwareCompositor != nullptr && route.routeRenderMode != RouteRenderMode::None)
 	{
-		QPen routePen;
-		routePen.setWidthF(route.routeWidth * route.userScale);
-		routePen.setJoinStyle(Qt::PenJoinStyle::RoundJoin);
-		routePen.setCapStyle(Qt::PenCapStyle::RoundCap);
-		routePen.setColor(route.routeRenderMode == RouteRenderMode::Discreet ? route.discreetColor : route.highlightColor);
+		QColor routeColor = (route.routeRenderMode == RouteRenderMode::Discreet) ? route.discreetColor : route.highlightColor;
+		double routeWidth = route.routeWidth * route.userScale;
 
-		painter->setPen(routePen);
-		painter->setBrush(Qt::NoBrush);
-		painter->drawPath(route.routePath);
-	}
-
-	if (route.routeRenderMode == RouteRenderMode::Pace)
-	{
-		QPen paceRoutePen;
-		paceRoutePen.setWidthF(route.routeWidth * route.userScale);
-		paceRoutePen.setCapStyle(Qt::PenCapStyle::RoundCap);
+		bool layerIsCurrent = (routeLayerCache.matrix == painterMatrix &&
+			routeLayerCache.routePath == route.routePath &&
+			routeLayerCache.clipRect == clipRect &&
+			routeLayerCache.routeRenderMode == route.routeRenderMode &&
+			routeLayerCache.routeWidth == routeWidth &&
+			routeLayerCache.routeColor == routeColor);
 
-		for (int i = 0; i < (int)routeManager->getDefaultRoute().routePoints.size() - 1; ++i)
+		if (layerIsCurrent)
 		{
-			RoutePoint& rp1 = routeManager->getDefaultRoute().routePoints.at(i);
-			RoutePoint& rp2 = routeManager->getDefaultRoute().routePoints.at(i + 1);
-
-			paceRoutePen.setColor(rp2.color);
-
-			painter->setPen(paceRoutePen);
-			painter->setBrush(Qt::NoBrush);
-			painter->drawLine(rp1.position, rp2.position);
+			if (!routeLayerCache.isValid)
+			{
+				double margin = routeWidth * mapPanel.scale * mapPanel.userScale * routeManager->getScale() / 2.0 + 2.0;
+				QRect layerRect = painterMatrix.mapRect(route.routePath.boundingRect()).adjusted(-margin, -margin, margin, margin).toAlignedRect().intersected(clipRect);
+
+				routeLayerCache.image = QImage(layerRect.size().expandedTo(QSize(1, 1)), QImage::Format_ARGB32_Premultiplied);
+				routeLayerCache.image.fill(Qt::transparent);
+				routeLayerCache.position = layerRect.topLeft();
+
+				QPainter layerPainter(&routeLayerCache.image);
+				layerPainter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform | QPainter::HighQualityAntialiasing);
+				layerPainter.setWorldMatrix(painterMatrix * QMatrix(1.0, 0.0, 0.0, 1.0, -layerRect.x(), -layerRect.y()));
+				renderRoutePath(&layerPainter, route);
+				layerPainter.end();
+
+				routeLayerCache.isValid = true;
+			}
+
+			painter->drawImage(routeLayerCache.position, routeLayerCache.image);
+			painter->setWorldMatrix(painterMatrix);
 		}
+		else
+		{
+			routeLayerCache.matrix = painterMatrix;
+			routeLayerCache.routePath = route.routePath;
+			routeLayerCache.clipRect = clipRect;
+			routeLayerCache.routeRenderMode = route.routeRenderMode;
+			routeLayerCache.routeWidth = routeWidth;
+			routeLayerCache.routeColor = routeColor;
+			routeLayerCache.isValid = false;
+
+			painter->setWorldMatrix(painterMatrix);
+			renderRoutePath(painter, route);
+		}
+	}
+	else
+	{
+		painter->setWorldMatrix(painterMatrix);
+		renderRoutePath(painter, route);
 	}
 
 	if (route.tailRenderMode == RouteRenderMode::Discreet || route.tailRenderMode == RouteRenderMode::Highlight)
@@ -600,119 +1239,362 @@ void Renderer::renderRoute(Route& route)
 	painter->end();
 }
 
+void Renderer::renderRoutePath(QPainter* targetPainter, Route& route)
+{
+	if (route.routeRenderMode == RouteRenderMode::Discreet || route.routeRenderMode == RouteRenderMode::Highlight)
+	{
+		QPen routePen;
+		routePen.setWidthF(route.routeWidth * route.userScale);
+		routePen.setJoinStyle(Qt::PenJoinStyle::RoundJoin);
+		routePen.setCapStyle(Qt::PenCapStyle::RoundCap);
+		routePen.setColor(route.routeRenderMode == RouteRenderMode::Discreet ? route.discreetColor : route.highlightColor);
+
+		targetPainter->setPen(routePen);
+		targetPainter->setBrush(Qt::NoBrush);
+		targetPainter->drawPath(route.routePath);
+	}
+
+	if (route.routeRenderMode == RouteRenderMode::Pace)
+	{
+		QPen paceRoutePen;
+		paceRoutePen.setWidthF(route.routeWidth * route.userScale);
+		paceRoutePen.setCapStyle(Qt::PenCapStyle::RoundCap);
+
+		for (int i = 0; i < (int)route.routePoints.size() - 1; ++i)
+		{
+			RoutePoint& rp1 = route.routePoints.at(i);
+			RoutePoint& rp2 = route.routePoints.at(i + 1);
+
+			paceRoutePen.setColor(rp2.color);
+
+			targetPainter->setPen(paceRoutePen);
+			targetPainter->setBrush(Qt::NoBrush);
+			targetPainter->drawLine(rp1.position, rp2.position);
+		}
+	}
+}
+
+QString Renderer::getLatencyText(LatencyStage stage)
+{
+	panelLatencyHistogram.reset();
+	panelLatencyHistogram.add(previousLatencyHistograms[stage]);
+	panelLatencyHistogram.add(recentLatencyHistograms[stage]);
+
+	std::vector<double> percentiles = panelLatencyHistogram.getPercentiles(std::vector<double> { 50.0, 95.0, 99.0 });
+
+	return QString("%1 / %2 / %3 / %4").arg(
+		QString::number(percentiles[0], 'f', 1),
+		QString::number(percentiles[1], 'f', 1),
+		QString::number(percentiles[2], 'f', 1),
+		QString::number(panelLatencyHistogram.getMaximum(), 'f', 1));
+}
+
+QString Renderer::getInfoPanelTimeText()
+{
+	QTime currentTimeTemp = QTime(0, 0, 0, 0).addMSecs((int)(currentTime * 1000.0 + 0.5));
+
+	return currentTimeTemp.toString("HH:mm:ss.zzz");
+}
+
+// formatted with the displayed precision, so comparing the strings tells if the panel would look any different
+QStringList Renderer::getInfoPanelTimingValues()
+{
+	QStringList values;
+	values << getInfoPanelTimeText();
+	values << QString::number(averageFps.getAverage(), 'f', 2);
+	values << getLatencyText(FrameLatency);
+	values << getLatencyText(DecodeLatency);
+	values << getLatencyText(StabilizeLatency);
+	values << getLatencyText(RenderLatency);
+	values << (renderToOffscreen ? getLatencyText(EncodeLatency) : QString("%1 ms").arg(QString::number(averageSpareTime.getAverage(), 'f', 2)));
+
+	if (!renderToOffscreen)
+		values << QString::number(droppedFrameCount);
+
+	if (renderStageTimer.getIsEnabled())
+	{
+		for (int i = 0; i < RenderStageCount; ++i)
+		{
+			RenderStage stage = (RenderStage)i;
+
+			if (renderStageTimer.getHasResults(stage))
+				values << QString("%1 ms").arg(QString::number(renderStageTimer.getAverageDuration(stage), 'f', 2));
+			else
+				values << QString("-");
+		}
+	}
+
+	return values;
+}
+
+QStringList Renderer::getInfoPanelUserValues()
+{
+	QString scrollText;
+
+	switch (inputHandler->getScrollMode())
+	{
+		case ScrollMode::None: scrollText = "none (seek)"; break;
+		case ScrollMode::Map: scrollText = "map"; break;
+		case ScrollMode::Video: scrollText = "video"; break;
+		default: scrollText = "unknown"; break;
+	}
+
+	QStringList values;
+	values << qualityLevelName;
+	values << QString("%1x").arg(playbackRate);
+	values << scrollText;
+	values << QString::number(videoPanel.userScale, 'f', 2);
+	values << QString::number(mapPanel.userScale, 'f', 2);
+	values << QString::number(routeManager->getDefaultRoute().userScale, 'f', 2);
+	values << QString("%1 s").arg(QString::number(routeManager->getDefaultRoute().controlTimeOffset, 'f', 2));
+	values << QString("%1 s").arg(QString::number(routeManager->getDefaultRoute().runnerTimeOffset, 'f', 2));
+
+	return values;
+}
+
+void Renderer::updateInfoPanel()
+{
+	QElapsedTimer infoPanelTimer;
+	infoPanelTimer.start();
+
+	// values changed by the user are shown immediately
+	QStringList userValues = getInfoPanelUserValues();
+	bool userValuesChanged = infoPanelImage.isNull() || (infoPanelValues.mid(infoPanelTimingValueCount) != userValues);
+
+	// timing values change almost every frame, so they are refreshed at a capped rate and not formatted in between
+	bool timingValuesDue = userValuesChanged || (infoPanelUpdateTimer.elapsed() >= infoPanelUpdateInterval);
+
+	// except the video time burned into an encoded video, which has to follow the frames and not the speed of the encoding
+	QString timeText = renderToOffscreen ? getInfoPanelTimeText() : QString();
+	bool timeChanged = renderToOffscreen && !infoPanelValues.isEmpty() && (infoPanelValues.at(0) != timeText);
+
+	if (timingValuesDue || timeChanged)
+	{
+		QStringList values;
+
+		if (timingValuesDue)
+			values = getInfoPanelTimingValues() + userValues;
+		else
+		{
+			values = infoPanelValues;
+			values[0] = timeText;
+		}
+
+		if (userValuesChanged || values != infoPanelValues)
+		{
+			QElapsedTimer rasterizeTimer;
+			rasterizeTimer.start();
+
+			rasterizeInfoPanel(values);
+
+			infoPanelValues = values;
+
+			if (timingValuesDue)
+				infoPanelUpdateTimer.restart();
+
+			infoPanelRasterizeCount++;
+			totalInfoPanelRasterizeDuration += rasterizeTimer.nsecsElapsed() / 1000000.0;
+		}
+	}
+
+	infoPanelFrameCount++;
+	totalInfoPanelDuration += infoPanelTimer.nsecsElapsed() / 1000000.0;
+}
+
 void Renderer::renderInfoPanel()
 {
-	QFont font = QFont("DejaVu Sans", infoPanelFontSize, QFont::Bold);
-	QFontMetrics metrics(font);
+	QElapsedTimer infoPanelTimer;
+	infoPanelTimer.start();
+
+	painter->begin(getPaintDevice());
+	painter->drawImage(0, 0, infoPanelImage);
+	painter->end();
+
+	totalInfoPanelDuration += infoPanelTimer.nsecsElapsed() / 1000000.0;
+}
+
+void Renderer::rasterizeInfoPanel(const QStringList& values)
+{
+	QFontMetrics metrics(infoPanelFont);
 
 	int textX = 10;
 	int textY = 6;
 	int lineHeight = metrics.height();
 	int lineSpacing = metrics.lineSpacing() + 1;
 	int lineWidth1 = metrics.boundingRect("control offset:").width();
-	int lineWidth2 = metrics.boundingRect("99:99:99.999").width();
+	int lineWidth2 = std::max(metrics.boundingRect("99:99:99.999").width(), metrics.boundingRect("999.9 / 999.9 / 999.9 / 999.9").width());
 	int rightPartMargin = 15;
 	int backgroundRadius = 10;
 	int backgroundWidth = textX + backgroundRadius + lineWidth1 + rightPartMargin + lineWidth2 + 10;
-	int backgroundHeight = lineSpacing * 18 + textY + 3;
+	int lineCount = 21;
+
+	if (!renderToOffscreen)
+		lineCount++;
+
+	if (renderStageTimer.getIsEnabled())
+		lineCount += RenderStageCount + 1;
+
+	int backgroundHeight = lineSpacing * lineCount + textY + 3;
 
 	QColor textColor = QColor(255, 255, 255, 200);
 	QColor textGreenColor = QColor(0, 255, 0, 200);
 	QColor textRedColor = QColor(255, 0, 0, 200);
 
-	painter->begin(paintDevice);
-	painter->setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::SmoothPixmapTransform | QPainter::HighQualityAntialiasing);
+	// the upper left corner of the background is outside the panel, so only the other corners are rounded
+	QSize imageSize(backgroundWidth - backgroundRadius + 1, backgroundHeight - backgroundRadius + 1);
+
+	if (infoPanelImage.size() != imageSize)
+		infoPanelImage = QImage(imageSize, QImage::Format_ARGB32_Premultiplied);
+
+	infoPanelImage.fill(Qt::transparent);
 
-	painter->setPen(QColor(0, 0, 0));
-	painter->setBrush(QBrush(QColor(20, 20, 20, 220)));
-	painter->drawRoundedRect(-backgroundRadius, -backgroundRadius, backgroundWidth, backgroundHeight, backgroundRadius, backgroundRadius);
+	QPainter imagePainter(&infoPanelImage);
+	imagePainter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::SmoothPixmapTransform | QPainter::HighQualityAntialiasing);
 
-	painter->setPen(textColor);
-	painter->setFont(font);
+	imagePainter.setPen(QColor(0, 0, 0));
+	imagePainter.setBrush(QBrush(QColor(20, 20, 20, 220)));
+	imagePainter.drawRoundedRect(-backgroundRadius, -backgroundRadius, backgroundWidth, backgroundHeight, backgroundRadius, backgroundRadius);
 
-	painter->drawText(textX, textY, lineWidth1, lineHeight, 0, "time:");
+	imagePainter.setPen(textColor);
+	imagePainter.setFont(infoPanelFont);
+
+	imagePainter.drawText(textX, textY, lineWidth1, lineHeight, 0, "time:");
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "fps:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "frame:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "decode:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "stabilize:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "render:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "fps:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "latency:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "frame:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "decode:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "stabilize:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "render:");
 
 	if (renderToOffscreen)
-		painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "encode:");
+		imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "encode:");
 	else
-		painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "spare:");
+	{
+		imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "spare:");
+		imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "dropped:");
+	}
+
+	if (renderStageTimer.getIsEnabled())
+	{
+		textY += lineSpacing;
+
+		for (int i = 0; i < RenderStageCount; ++i)
+			imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, QString("gpu %1:").arg(RenderStageTimer::getStageName((RenderStage)i)));
+	}
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "scroll:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "quality:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "speed:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "scroll:");
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "video scale:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "map scale:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "route scale:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "video scale:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "map scale:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "route scale:");
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "control offset:");
-	painter->drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "runner offset:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "control offset:");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth1, lineHeight, 0, "runner offset:");
 
 	textX += lineWidth1 + rightPartMargin;
 	textY = 6;
 
-	QTime currentTimeTemp = QTime(0, 0, 0, 0).addMSecs((int)(currentTime * 1000.0 + 0.5));
-	painter->drawText(textX, textY, lineWidth2, lineHeight, 0, currentTimeTemp.toString("HH:mm:ss.zzz"));
+	imagePainter.drawText(textX, textY, lineWidth2, lineHeight, 0, values.at(0));
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString::number(averageFps.getAverage(), 'f', 2));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 ms").arg(QString::number(averageFrameDuration.getAverage(), 'f', 2)));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 ms").arg(QString::number(averageDecodeDuration.getAverage(), 'f', 2)));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 ms").arg(QString::number(averageStabilizeDuration.getAverage(), 'f', 2)));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 ms").arg(QString::number(averageRenderDuration.getAverage(), 'f', 2)));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(1));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, "p50 / p95 / p99 / max ms");
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(2));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(3));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(4));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(5));
 
-	if (renderToOffscreen)
-		painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 ms").arg(QString::number(averageEncodeDuration.getAverage(), 'f', 2)));
-	else
+	if (!renderToOffscreen)
 	{
 		if (averageSpareTime.getAverage() < 0)
-			painter->setPen(textRedColor);
+			imagePainter.setPen(textRedColor);
 		else if (averageSpareTime.getAverage() > 0)
-			painter->setPen(textGreenColor);
-
-		painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 ms").arg(QString::number(averageSpareTime.getAverage(), 'f', 2)));
-		painter->setPen(textColor);
+			imagePainter.setPen(textGreenColor);
 	}
 
-	QString scrollText;
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(6));
+	imagePainter.setPen(textColor);
 
-	switch (inputHandler->getScrollMode())
+	int stageValueIndex = 7;
+
+	if (!renderToOffscreen)
+		imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(stageValueIndex++));
+
+	if (renderStageTimer.getIsEnabled())
 	{
-		case ScrollMode::None: scrollText = "none (seek)"; break;
-		case ScrollMode::Map: scrollText = "map"; break;
-		case ScrollMode::Video: scrollText = "video"; break;
-		default: scrollText = "unknown"; break;
+		textY += lineSpacing;
+
+		for (int i = 0; i < RenderStageCount; ++i)
+			imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(stageValueIndex + i));
 	}
 
+	int userValueIndex = infoPanelTimingValueCount;
+
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, scrollText);
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 1));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 2));
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString::number(videoPanel.userScale, 'f', 2));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString::number(mapPanel.userScale, 'f', 2));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString::number(routeManager->getDefaultRoute().userScale, 'f', 2));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 3));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 4));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 5));
 
 	textY += lineSpacing;
 
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 s").arg(QString::number(routeManager->getDefaultRoute().controlTimeOffset, 'f', 2)));
-	painter->drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, QString("%1 s").arg(QString::number(routeManager->getDefaultRoute().runnerTimeOffset, 'f', 2)));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 6));
+	imagePainter.drawText(textX, textY += lineSpacing, lineWidth2, lineHeight, 0, values.at(userValueIndex + 7));
 
-	painter->end();
+	imagePainter.end();
+}
+
+QMatrix4x4 Renderer::getProjectionMatrix() const
+{
+	QMatrix4x4 projectionMatrix;
+
+	if (!renderToOffscreen)
+		projectionMatrix.ortho(-windowWidth / 2, windowWidth / 2, -windowHeight / 2, windowHeight / 2, 0.0f, 1.0f);
+	else
+		projectionMatrix.ortho(-windowWidth / 2, windowWidth / 2, windowHeight / 2, -windowHeight / 2, 0.0f, 1.0f);
+
+	return projectionMatrix;
+}
+
+QPaintDevice* Renderer::getPaintDevice()
+{
+	if (softwareCompositor != nullptr)
+		return &renderedFrameImage;
+	else
+		return paintDevice;
+}
+
+void Renderer::clearArea(const QRect& area, const QColor& color)
+{
+	if (softwareCompositor != nullptr)
+	{
+		softwareCompositor->fill(renderedFrameData, area, color);
+		return;
+	}
+
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(area.x(), area.y(), area.width(), area.height());
+	glClearColor(color.redF(), color.greenF(), color.blueF(), 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
 }
 
 Panel& Renderer::getVideoPanel()
@@ -730,11 +1612,54 @@ RenderMode Renderer::getRenderMode() const
 	return renderMode;
 }
 
+bool Renderer::getIsUsingSoftwareCompositor() const
+{
+	return (softwareCompositor != nullptr);
+}
+
 void Renderer::setRenderMode(RenderMode mode)
 {
 	renderMode = mode;
 }
 
+void Renderer::setMapLayerMultisamples(int samples)
+{
+	if (samples == mapLayerMultisamples)
+		return;
+
+	// the framebuffers are recreated the next time the layer is drawn
+	mapLayerMultisamples = samples;
+	mapLayerIsValid = false;
+}
+
+void Renderer::setReducedRescale(bool value)
+{
+	if (value == videoPanel.reducedRescaleEnabled && value == mapPanel.reducedRescaleEnabled)
+		return;
+
+	videoPanel.reducedRescaleEnabled = value;
+	mapPanel.reducedRescaleEnabled = value;
+	videoPanel.resampledTextureGeneration = -1;
+	mapPanel.resampledTextureGeneration = -1;
+	mapLayerIsValid = false;
+	fullClearRequested = true;
+}
+
+void Renderer::setQualityLevelName(const QString& name)
+{
+	qualityLevelName = name;
+}
+
+void Renderer::setDroppedFrameCount(int count)
+{
+	droppedFrameCount = count;
+}
+
+void Renderer::setPlaybackRate(double rate)
+{
+	playbackRate = rate;
+}
+
 void Renderer::toggleShowInfoPanel()
 {
 	showInfoPanel = !showInfoPanel;
@@ -744,3 +1669,32 @@ void Renderer::requestFullClear()
 {
 	fullClearRequested = true;
 }
+
+void Renderer::logStatistics()
+{
+	if (infoPanelFrameCount > 0 && infoPanelRasterizeCount > 0)
+	{
+		qDebug("Info panel: %d frames, %d rasterizations (%.1f %%), %.3f ms per rasterization, %.3f ms per frame",
+			infoPanelFrameCount,
+			infoPanelRasterizeCount,
+			100.0 * infoPanelRasterizeCount / infoPanelFrameCount,
+			totalInfoPanelRasterizeDuration / infoPanelRasterizeCount,
+			totalInfoPanelDuration / infoPanelFrameCount);
+	}
+
+	if (dirtyTrackingEnabled)
+		qDebug("Dirty tracking: %d frames drawn, %d map layer redraws", renderedFrameCount, mapLayerRenderCount);
+
+	renderStageTimer.logStatistics();
+
+	for (int i = 0; i < LatencyStageCount; ++i)
+	{
+		if (latencyHistograms[i].getCount() > 0)
+			qDebug("Latency %s: %s", qPrintable(LatencyHistogram::getStageName((LatencyStage)i)), qPrintable(latencyHistograms[i].getSummary()));
+	}
+}
+
+const LatencyHistogram& Renderer::getLatencyHistogram(LatencyStage stage) const
+{
+	return latencyHistograms[stage];
+}
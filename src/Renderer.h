@@ -12,21 +12,26 @@
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLPaintDevice>
 #include <QPainter>
+#include <QImage>
+#include <QFont>
+#include <QStringList>
 
 #include "MovingAverage.h"
+#include "LatencyHistogram.h"
 #include "FrameData.h"
+#include "RouteManager.h"
+#include "RenderStageTimer.h"
 
 namespace OrientView
 {
 	class VideoDecoder;
 	class MapImageReader;
-	class VideoStabilizer;
 	class InputHandler;
-	class RouteManager;
 	class Settings;
-	struct Route;
+	class SoftwareCompositor;
 
 	enum RenderMode { All, Map, Video };
+	enum RenderBackend { OpenGL, Software };
 
 	struct Panel
 	{
@@ -38,6 +43,17 @@ namespace OrientView
 		QOpenGLTexture texture;
 
 		QMatrix4x4 vertexMatrix;
+		QMatrix4x4 modelMatrix;
+		QRect area;
+
+		bool separableRescaleEnabled = false;
+		bool reducedRescaleEnabled = false;
+		QOpenGLShaderProgram bilinearShaderProgram;
+		QOpenGLVertexArrayObject bilinearVertexArrayObject;
+		QOpenGLTexture weightTexture;
+		QOpenGLFramebufferObject* horizontalResampleFramebuffer = nullptr;
+		QOpenGLFramebufferObject* verticalResampleFramebuffer = nullptr;
+		int resampledTextureGeneration = -1;
 
 		QColor clearColor = QColor(0, 0, 0);
 		bool clippingEnabled = true;
@@ -56,58 +72,153 @@ namespace OrientView
 
 		double textureWidth = 0.0;
 		double textureHeight = 0.0;
+		double textureDataWidth = 0.0; // smaller than the texture size when the video is decoded at a lower resolution
+		double textureDataHeight = 0.0;
 		double texelWidth = 0.0;
 		double texelHeight = 0.0;
 
 		double relativeWidth = 1.0;
 	};
 
-	// Does the actual drawing using OpenGL.
+	// Cached image of the route for the software compositor (only changes when the map moves).
+	struct RouteLayerCache
+	{
+		QImage image;
+		QPoint position;
+		QMatrix matrix;
+		QPainterPath routePath;
+		QRect clipRect;
+		RouteRenderMode routeRenderMode = RouteRenderMode::None;
+		double routeWidth = 0.0;
+		QColor routeColor;
+		bool isValid = false;
+	};
+
+	// Everything the cached map layer depends on, the layer is redrawn only when some of this changes.
+	struct MapLayerState
+	{
+		bool operator==(const MapLayerState& other) const;
+
+		QMatrix4x4 vertexMatrix;
+		QRect area;
+		bool clippingEnabled = false;
+
+		QPainterPath routePath;
+		RouteRenderMode routeRenderMode = RouteRenderMode::None;
+		double routeWidth = 0.0;
+		QPainterPath tailPath;
+		RouteRenderMode tailRenderMode = RouteRenderMode::None;
+		double tailWidth = 0.0;
+		std::vector<QPointF> controlPositions;
+		bool showControls = false;
+		QPointF runnerPosition;
+		double runnerScale = 0.0;
+		bool showRunner = false;
+		double routeUserScale = 0.0;
+	};
+
+	// Everything else visible on the screen, nothing is drawn if this and the map layer have not changed.
+	struct FrameState
+	{
+		bool operator==(const FrameState& other) const;
+
+		int videoTextureGeneration = -1;
+		QMatrix4x4 videoVertexMatrix;
+		QRect videoArea;
+		RenderMode renderMode = RenderMode::All;
+		bool showInfoPanel = false;
+		QStringList infoPanelUserValues;
+	};
+
+	// Does the actual drawing using OpenGL (or the software compositor when encoding without a GPU).
 	class Renderer : protected QOpenGLFunctions
 	{
 
 	public:
 
-		bool initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageReader, VideoStabilizer* videoStabilizer, InputHandler* inputHandler, RouteManager* routeManager, Settings* settings, bool renderToOffscreen);
+		bool initialize(VideoDecoder* videoDecoder, MapImageReader* mapImageReader, InputHandler* inputHandler, RouteManager* routeManager, Settings* settings, bool renderToOffscreen);
 		bool windowResized(int newWidth, int newHeight);
 		~Renderer();
 
 		void startRendering(double currentTime, double frameDuration, double decodeDuration, double stabilizeDuration, double encodeDuration, double spareTime);
 		void uploadFrameData(const FrameData& frameData);
+		bool hasFrameChanged();
 		void renderAll();
 		void stopRendering();
 
-		FrameData getRenderedFrame();
+		void setRenderTarget(FrameData& frameData);
+		void getRenderedFrame(FrameData& frameData);
 		Panel& getVideoPanel();
 		Panel& getMapPanel();
 		RenderMode getRenderMode() const;
+		bool getIsUsingSoftwareCompositor() const;
+
+		// Every sample since the renderer was initialized.
+		const LatencyHistogram& getLatencyHistogram(LatencyStage stage) const;
 
 		void setRenderMode(RenderMode mode);
+		void setMapLayerMultisamples(int samples);
+		void setReducedRescale(bool value);
+		void setQualityLevelName(const QString& name);
+		void setDroppedFrameCount(int count);
+		void setPlaybackRate(double rate);
 		void toggleShowInfoPanel();
 		void requestFullClear();
 
+		void logStatistics();
+
 	private:
 
-		bool loadRescaleShader(Panel& panel, const QString& shaderName);
+		bool loadPanelShader(Panel& panel, QOpenGLShaderProgram& program, QOpenGLVertexArrayObject& vertexArrayObject, const QString& shaderName, const QString& shaderDefines);
+		bool loadQuadShader(QOpenGLShaderProgram& program, QOpenGLVertexArrayObject& vertexArrayObject, const QString& shaderName);
+		bool loadSeparableRescale(Panel& panel, const QString& shaderDefines);
+		bool createMapLayerFramebuffers();
+		void allocateVideoTexture(int width, int height);
+		void updateVideoPanel();
+		void updateMapPanel();
+		void resamplePanel(Panel& panel, int textureGeneration);
+		void deleteResampleFramebuffers(Panel& panel);
 		void renderVideoPanel();
 		void renderMapPanel();
+		void renderMapLayer();
+		void compositeMapLayer();
+		MapLayerState getMapLayerState();
+		FrameState getFrameState();
 		void renderPanel(Panel& panel);
 		void renderRoute(Route& route);
+		void renderRoutePath(QPainter* targetPainter, Route& route);
+		QString getLatencyText(LatencyStage stage);
+		QString getInfoPanelTimeText();
+		QStringList getInfoPanelTimingValues();
+		QStringList getInfoPanelUserValues();
+		void updateInfoPanel();
 		void renderInfoPanel();
+		void rasterizeInfoPanel(const QStringList& values);
+
+		QMatrix4x4 getProjectionMatrix() const;
+		QPaintDevice* getPaintDevice();
+		void clearArea(const QRect& area, const QColor& color);
 
-		VideoStabilizer* videoStabilizer = nullptr;
 		InputHandler* inputHandler = nullptr;
 		RouteManager* routeManager = nullptr;
 
 		bool renderToOffscreen = false;
 		bool showInfoPanel = false;
 		bool fullClearRequested = true;
+		bool dirtyTrackingEnabled = false;
 
 		double windowWidth = 0.0;
 		double windowHeight = 0.0;
 		double currentTime = 0.0;
+		double stabilizerX = 0.0; // computed by the stabilizer thread for the uploaded frame
+		double stabilizerY = 0.0;
+		double stabilizerAngle = 0.0;
 		int multisamples = 0;
+		int mapLayerMultisamples = 0;
+		int mapLayerFramebufferMultisamples = 0;
 		int infoPanelFontSize = 0;
+		int infoPanelUpdateInterval = 0;
+		int infoPanelTimingValueCount = 7;
 
 		Panel videoPanel;
 		Panel mapPanel;
@@ -115,20 +226,56 @@ namespace OrientView
 
 		QElapsedTimer renderDurationTimer;
 		double renderDuration = 0.0;
+		RenderStageTimer renderStageTimer;
 
 		MovingAverage averageFps;
-		MovingAverage averageFrameDuration;
-		MovingAverage averageDecodeDuration;
-		MovingAverage averageStabilizeDuration;
-		MovingAverage averageRenderDuration;
-		MovingAverage averageEncodeDuration;
 		MovingAverage averageSpareTime;
 
+		// the info panel shows the current and the previous window, so that an old stutter drops out eventually
+		LatencyHistogram latencyHistograms[LatencyStageCount];
+		LatencyHistogram recentLatencyHistograms[LatencyStageCount];
+		LatencyHistogram previousLatencyHistograms[LatencyStageCount];
+		LatencyHistogram panelLatencyHistogram;
+		QElapsedTimer latencyWindowTimer;
+
+		QFont infoPanelFont;
+		QImage infoPanelImage;
+		QStringList infoPanelValues;
+		QString qualityLevelName = "full";
+		int droppedFrameCount = 0;
+		double playbackRate = 1.0;
+		QElapsedTimer infoPanelUpdateTimer;
+		int infoPanelFrameCount = 0;
+		int infoPanelRasterizeCount = 0;
+		double totalInfoPanelDuration = 0.0;
+		double totalInfoPanelRasterizeDuration = 0.0;
+
 		QOpenGLPaintDevice* paintDevice = nullptr;
 		QPainter* painter = nullptr;
 
 		QOpenGLFramebufferObject* offscreenFramebuffer = nullptr;
 		QOpenGLFramebufferObject* offscreenFramebufferNonMultisample = nullptr;
 		FrameData renderedFrameData;
+
+		SoftwareCompositor* softwareCompositor = nullptr;
+		QImage renderedFrameImage;
+		RouteLayerCache routeLayerCache;
+
+		QOpenGLBuffer quadVertexBuffer;
+		QOpenGLShaderProgram resampleShaderProgram;
+		QOpenGLVertexArrayObject resampleVertexArrayObject;
+		int maximumResampleSize = 0;
+
+		QOpenGLFramebufferObject* mapLayerFramebuffer = nullptr;
+		QOpenGLFramebufferObject* mapLayerFramebufferNonMultisample = nullptr;
+		QOpenGLShaderProgram layerShaderProgram;
+		QOpenGLVertexArrayObject layerVertexArrayObject;
+		MapLayerState mapLayerState;
+		bool mapLayerIsValid = false;
+
+		FrameState renderedFrameState;
+		int videoTextureGeneration = 0;
+		int renderedFrameCount = 0;
+		int mapLayerRenderCount = 0;
 	};
 }
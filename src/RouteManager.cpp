@@ -98,6 +98,23 @@ void RouteManager::update(double currentTime, double frameTime)
 	calculateCurrentSplitTransformation(routes.at(0), currentTime, frameTime);
 }
 
+void RouteManager::warmUp(double startTime, double frameTime)
+{
+	if (startTime <= 0.0 || frameTime <= 0.0 || routes.empty())
+		return;
+
+	update(0.0, 0.0);
+
+	// the view is stepped from the start of the video, so that the smoothing state at the in-point is the same as after playing all of it
+	// only the view depends on the earlier frames, the runner and the tail are calculated for the first frame anyway
+	int stepCount = (int)(startTime / (frameTime / 1000.0));
+
+	for (int i = 1; i < stepCount; ++i)
+		calculateCurrentSplitTransformation(routes.at(0), i * frameTime / 1000.0, frameTime);
+
+	qDebug("Route view warmed up to %.3f s in %d steps", startTime, stepCount);
+}
+
 void RouteManager::calculateAlignedRoutePoints(Route& route)
 {
 	if (route.routePoints.size() < 2)
@@ -89,6 +89,7 @@ namespace OrientView
 
 		bool initialize(QuickRouteReader* quickRouteReader, SplitsManager* splitsManager, Renderer* renderer, Settings* settings);
 		void update(double currentTime, double frameTime);
+		void warmUp(double startTime, double frameTime);
 
 		void requestFullUpdate();
 		void requestInstantTransition();
@@ -1,6 +1,7 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <QDir>
 #include <QFile>
 #include <QSettings>
 
@@ -24,6 +25,7 @@ void Settings::readFromQSettings(QSettings* settings)
 	map.backgroundColor = settings->value("map/backgroundColor", defaultSettings.map.backgroundColor).value<QColor>();
 	map.headerCrop = settings->value("map/headerCrop", defaultSettings.map.headerCrop).toInt();
 	map.rescaleShader = settings->value("map/rescaleShader", defaultSettings.map.rescaleShader).toString();
+	map.rescaleShaderDefines = settings->value("map/rescaleShaderDefines", defaultSettings.map.rescaleShaderDefines).toString();
 
 	route.quickRouteJpegFilePath = settings->value("route/quickRouteJpegFilePath", defaultSettings.route.quickRouteJpegFilePath).toString();
 	route.discreetColor = settings->value("route/discreetColor", defaultSettings.route.discreetColor).value<QColor>();
@@ -60,12 +62,14 @@ void Settings::readFromQSettings(QSettings* settings)
 
 	video.inputVideoFilePath = settings->value("video/inputVideoFilePath", defaultSettings.video.inputVideoFilePath).toString();
 	video.startTimeOffset = settings->value("video/startTimeOffset", defaultSettings.video.startTimeOffset).toDouble();
+	video.endTimeOffset = settings->value("video/endTimeOffset", defaultSettings.video.endTimeOffset).toDouble();
 	video.x = settings->value("video/x", defaultSettings.video.x).toDouble();
 	video.y = settings->value("video/y", defaultSettings.video.y).toDouble();
 	video.angle = settings->value("video/angle", defaultSettings.video.angle).toDouble();
 	video.scale = settings->value("video/scale", defaultSettings.video.scale).toDouble();
 	video.backgroundColor = settings->value("video/backgroundColor", defaultSettings.video.backgroundColor).value<QColor>();
 	video.rescaleShader = settings->value("video/rescaleShader", defaultSettings.video.rescaleShader).toString();
+	video.rescaleShaderDefines = settings->value("video/rescaleShaderDefines", defaultSettings.video.rescaleShaderDefines).toString();
 	video.enableClipping = settings->value("video/enableClipping", defaultSettings.video.enableClipping).toBool();
 	video.enableClearing = settings->value("video/enableClearing", defaultSettings.video.enableClearing).toBool();
 	video.frameCountDivisor = settings->value("video/frameCountDivisor", defaultSettings.video.frameCountDivisor).toInt();
@@ -73,6 +77,10 @@ void Settings::readFromQSettings(QSettings* settings)
 	video.frameSizeDivisor = settings->value("video/frameSizeDivisor", defaultSettings.video.frameSizeDivisor).toInt();
 	video.enableVerboseLogging = settings->value("video/enableVerboseLogging", defaultSettings.video.enableVerboseLogging).toBool();
 	video.seekToAnyFrame = settings->value("video/seekToAnyFrame", defaultSettings.video.seekToAnyFrame).toBool();
+	video.enableFrameDropping = settings->value("video/enableFrameDropping", defaultSettings.video.enableFrameDropping).toBool();
+	video.catchUpThreshold = settings->value("video/catchUpThreshold", defaultSettings.video.catchUpThreshold).toDouble();
+	video.frameQueueDepth = settings->value("video/frameQueueDepth", defaultSettings.video.frameQueueDepth).toInt();
+	video.decoderThreadCount = settings->value("video/decoderThreadCount", defaultSettings.video.decoderThreadCount).toInt();
 
 	splits.type = (SplitTimeType)settings->value("splits/type", defaultSettings.splits.type).toInt();
 	splits.splitTimes = settings->value("splits/splitTimes", defaultSettings.splits.splitTimes).toString();
@@ -86,6 +94,18 @@ void Settings::readFromQSettings(QSettings* settings)
 	renderer.renderMode = (RenderMode)settings->value("renderer/renderMode", defaultSettings.renderer.renderMode).toInt();
 	renderer.showInfoPanel = settings->value("renderer/showInfoPanel", defaultSettings.renderer.showInfoPanel).toBool();
 	renderer.infoPanelFontSize = settings->value("renderer/infoPanelFontSize", defaultSettings.renderer.infoPanelFontSize).toInt();
+	renderer.infoPanelUpdateInterval = settings->value("renderer/infoPanelUpdateInterval", defaultSettings.renderer.infoPanelUpdateInterval).toInt();
+	renderer.backend = (RenderBackend)settings->value("renderer/backend", defaultSettings.renderer.backend).toInt();
+	renderer.softwareThreadCount = settings->value("renderer/softwareThreadCount", defaultSettings.renderer.softwareThreadCount).toInt();
+	renderer.enableDirtyTracking = settings->value("renderer/enableDirtyTracking", defaultSettings.renderer.enableDirtyTracking).toBool();
+	renderer.enableGpuTimers = settings->value("renderer/enableGpuTimers", defaultSettings.renderer.enableGpuTimers).toBool();
+	renderer.enableSeparableRescale = settings->value("renderer/enableSeparableRescale", defaultSettings.renderer.enableSeparableRescale).toBool();
+	renderer.maximumResampleSize = settings->value("renderer/maximumResampleSize", defaultSettings.renderer.maximumResampleSize).toInt();
+	renderer.enableQualityGovernor = settings->value("renderer/enableQualityGovernor", defaultSettings.renderer.enableQualityGovernor).toBool();
+	renderer.qualityDowngradeThreshold = settings->value("renderer/qualityDowngradeThreshold", defaultSettings.renderer.qualityDowngradeThreshold).toDouble();
+	renderer.qualityUpgradeThreshold = settings->value("renderer/qualityUpgradeThreshold", defaultSettings.renderer.qualityUpgradeThreshold).toDouble();
+	renderer.qualityDowngradeDelay = settings->value("renderer/qualityDowngradeDelay", defaultSettings.renderer.qualityDowngradeDelay).toInt();
+	renderer.qualityUpgradeDelay = settings->value("renderer/qualityUpgradeDelay", defaultSettings.renderer.qualityUpgradeDelay).toInt();
 
 	stabilizer.enabled = settings->value("stabilizer/enabled", defaultSettings.stabilizer.enabled).toBool();
 	stabilizer.mode = (VideoStabilizerMode)settings->value("stabilizer/mode", defaultSettings.stabilizer.mode).toInt();
@@ -99,11 +119,29 @@ void Settings::readFromQSettings(QSettings* settings)
 	stabilizer.passTwoInputFilePath = settings->value("stabilizer/passTwoInputFilePath", defaultSettings.stabilizer.passTwoInputFilePath).toString();
 	stabilizer.passTwoOutputFilePath = settings->value("stabilizer/passTwoOutputFilePath", defaultSettings.stabilizer.passTwoOutputFilePath).toString();
 	stabilizer.smoothingRadius = settings->value("stabilizer/smoothingRadius", defaultSettings.stabilizer.smoothingRadius).toInt();
+	stabilizer.frameQueueDepth = settings->value("stabilizer/frameQueueDepth", defaultSettings.stabilizer.frameQueueDepth).toInt();
+	stabilizer.threadCount = settings->value("stabilizer/threadCount", defaultSettings.stabilizer.threadCount).toInt();
 
 	encoder.outputVideoFilePath = settings->value("encoder/outputVideoFilePath", defaultSettings.encoder.outputVideoFilePath).toString();
+	encoder.backend = settings->value("encoder/backend", defaultSettings.encoder.backend).toString();
+	encoder.codec = settings->value("encoder/codec", defaultSettings.encoder.codec).toString();
+	encoder.codecOptions = settings->value("encoder/codecOptions", defaultSettings.encoder.codecOptions).toString();
+	encoder.outputFormat = settings->value("encoder/outputFormat", defaultSettings.encoder.outputFormat).toString();
 	encoder.preset = settings->value("encoder/preset", defaultSettings.encoder.preset).toString();
 	encoder.profile = settings->value("encoder/profile", defaultSettings.encoder.profile).toString();
+	encoder.tune = settings->value("encoder/tune", defaultSettings.encoder.tune).toString();
 	encoder.constantRateFactor = settings->value("encoder/constantRateFactor", defaultSettings.encoder.constantRateFactor).toInt();
+	encoder.frameQueueDepth = settings->value("encoder/frameQueueDepth", defaultSettings.encoder.frameQueueDepth).toInt();
+	encoder.threadCount = settings->value("encoder/threadCount", defaultSettings.encoder.threadCount).toInt();
+	encoder.conversionThreadCount = settings->value("encoder/conversionThreadCount", defaultSettings.encoder.conversionThreadCount).toInt();
+	encoder.useSwscale = settings->value("encoder/useSwscale", defaultSettings.encoder.useSwscale).toBool();
+	encoder.fragmentDuration = settings->value("encoder/fragmentDuration", defaultSettings.encoder.fragmentDuration).toDouble();
+	encoder.writeBufferSize = settings->value("encoder/writeBufferSize", defaultSettings.encoder.writeBufferSize).toInt();
+	encoder.writeBufferCount = settings->value("encoder/writeBufferCount", defaultSettings.encoder.writeBufferCount).toInt();
+	encoder.enableAudio = settings->value("encoder/enableAudio", defaultSettings.encoder.enableAudio).toBool();
+	encoder.enableCache = settings->value("encoder/enableCache", defaultSettings.encoder.enableCache).toBool();
+	encoder.cacheGopLength = settings->value("encoder/cacheGopLength", defaultSettings.encoder.cacheGopLength).toInt();
+	encoder.enableQualityMetrics = settings->value("encoder/enableQualityMetrics", defaultSettings.encoder.enableQualityMetrics).toBool();
 
 	inputHandler.smallSeekAmount = settings->value("inputHandler/smallSeekAmount", defaultSettings.inputHandler.smallSeekAmount).toDouble();
 	inputHandler.normalSeekAmount = settings->value("inputHandler/normalSeekAmount", defaultSettings.inputHandler.normalSeekAmount).toDouble();
@@ -125,6 +163,9 @@ void Settings::readFromQSettings(QSettings* settings)
 	inputHandler.normalTimeOffset = settings->value("inputHandler/normalTimeOffset", defaultSettings.inputHandler.normalTimeOffset).toDouble();
 	inputHandler.largeTimeOffset = settings->value("inputHandler/largeTimeOffset", defaultSettings.inputHandler.largeTimeOffset).toDouble();
 	inputHandler.veryLargeTimeOffset = settings->value("inputHandler/veryLargeTimeOffset", defaultSettings.inputHandler.veryLargeTimeOffset).toDouble();
+
+	trace.enabled = settings->value("trace/enabled", defaultSettings.trace.enabled).toBool();
+	trace.outputFilePath = settings->value("trace/outputFilePath", defaultSettings.trace.outputFilePath).toString();
 }
 
 void Settings::writeToQSettings(QSettings* settings)
@@ -140,6 +181,7 @@ void Settings::writeToQSettings(QSettings* settings)
 	settings->setValue("map/backgroundColor", map.backgroundColor);
 	settings->setValue("map/headerCrop", map.headerCrop);
 	settings->setValue("map/rescaleShader", map.rescaleShader);
+	settings->setValue("map/rescaleShaderDefines", map.rescaleShaderDefines);
 
 	settings->setValue("route/quickRouteJpegFilePath", route.quickRouteJpegFilePath);
 	settings->setValue("route/discreetColor", route.discreetColor);
@@ -176,12 +218,14 @@ void Settings::writeToQSettings(QSettings* settings)
 
 	settings->setValue("video/inputVideoFilePath", video.inputVideoFilePath);
 	settings->setValue("video/startTimeOffset", video.startTimeOffset);
+	settings->setValue("video/endTimeOffset", video.endTimeOffset);
 	settings->setValue("video/x", video.x);
 	settings->setValue("video/y", video.y);
 	settings->setValue("video/angle", video.angle);
 	settings->setValue("video/scale", video.scale);
 	settings->setValue("video/backgroundColor", video.backgroundColor);
 	settings->setValue("video/rescaleShader", video.rescaleShader);
+	settings->setValue("video/rescaleShaderDefines", video.rescaleShaderDefines);
 	settings->setValue("video/enableClipping", video.enableClipping);
 	settings->setValue("video/enableClearing", video.enableClearing);
 	settings->setValue("video/frameCountDivisor", video.frameCountDivisor);
@@ -189,6 +233,10 @@ void Settings::writeToQSettings(QSettings* settings)
 	settings->setValue("video/frameSizeDivisor", video.frameSizeDivisor);
 	settings->setValue("video/enableVerboseLogging", video.enableVerboseLogging);
 	settings->setValue("video/seekToAnyFrame", video.seekToAnyFrame);
+	settings->setValue("video/enableFrameDropping", video.enableFrameDropping);
+	settings->setValue("video/catchUpThreshold", video.catchUpThreshold);
+	settings->setValue("video/frameQueueDepth", video.frameQueueDepth);
+	settings->setValue("video/decoderThreadCount", video.decoderThreadCount);
 
 	settings->setValue("splits/type", splits.type);
 	settings->setValue("splits/splitTimes", splits.splitTimes);
@@ -202,6 +250,18 @@ void Settings::writeToQSettings(QSettings* settings)
 	settings->setValue("renderer/renderMode", renderer.renderMode);
 	settings->setValue("renderer/showInfoPanel", renderer.showInfoPanel);
 	settings->setValue("renderer/infoPanelFontSize", renderer.infoPanelFontSize);
+	settings->setValue("renderer/infoPanelUpdateInterval", renderer.infoPanelUpdateInterval);
+	settings->setValue("renderer/backend", renderer.backend);
+	settings->setValue("renderer/softwareThreadCount", renderer.softwareThreadCount);
+	settings->setValue("renderer/enableDirtyTracking", renderer.enableDirtyTracking);
+	settings->setValue("renderer/enableGpuTimers", renderer.enableGpuTimers);
+	settings->setValue("renderer/enableSeparableRescale", renderer.enableSeparableRescale);
+	settings->setValue("renderer/maximumResampleSize", renderer.maximumResampleSize);
+	settings->setValue("renderer/enableQualityGovernor", renderer.enableQualityGovernor);
+	settings->setValue("renderer/qualityDowngradeThreshold", renderer.qualityDowngradeThreshold);
+	settings->setValue("renderer/qualityUpgradeThreshold", renderer.qualityUpgradeThreshold);
+	settings->setValue("renderer/qualityDowngradeDelay", renderer.qualityDowngradeDelay);
+	settings->setValue("renderer/qualityUpgradeDelay", renderer.qualityUpgradeDelay);
 
 	settings->setValue("stabilizer/enabled", stabilizer.enabled);
 	settings->setValue("stabilizer/mode", stabilizer.mode);
@@ -215,11 +275,29 @@ void Settings::writeToQSettings(QSettings* settings)
 	settings->setValue("stabilizer/passTwoInputFilePath", stabilizer.passTwoInputFilePath);
 	settings->setValue("stabilizer/passTwoOutputFilePath", stabilizer.passTwoOutputFilePath);
 	settings->setValue("stabilizer/smoothingRadius", stabilizer.smoothingRadius);
+	settings->setValue("stabilizer/frameQueueDepth", stabilizer.frameQueueDepth);
+	settings->setValue("stabilizer/threadCount", stabilizer.threadCount);
 
 	settings->setValue("encoder/outputVideoFilePath", encoder.outputVideoFilePath);
+	settings->setValue("encoder/backend", encoder.backend);
+	settings->setValue("encoder/codec", encoder.codec);
+	settings->setValue("encoder/codecOptions", encoder.codecOptions);
+	settings->setValue("encoder/outputFormat", encoder.outputFormat);
 	settings->setValue("encoder/preset", encoder.preset);
 	settings->setValue("encoder/profile", encoder.profile);
+	settings->setValue("encoder/tune", encoder.tune);
 	settings->setValue("encoder/constantRateFactor", encoder.constantRateFactor);
+	settings->setValue("encoder/frameQueueDepth", encoder.frameQueueDepth);
+	settings->setValue("encoder/threadCount", encoder.threadCount);
+	settings->setValue("encoder/conversionThreadCount", encoder.conversionThreadCount);
+	settings->setValue("encoder/useSwscale", encoder.useSwscale);
+	settings->setValue("encoder/fragmentDuration", encoder.fragmentDuration);
+	settings->setValue("encoder/writeBufferSize", encoder.writeBufferSize);
+	settings->setValue("encoder/writeBufferCount", encoder.writeBufferCount);
+	settings->setValue("encoder/enableAudio", encoder.enableAudio);
+	settings->setValue("encoder/enableCache", encoder.enableCache);
+	settings->setValue("encoder/cacheGopLength", encoder.cacheGopLength);
+	settings->setValue("encoder/enableQualityMetrics", encoder.enableQualityMetrics);
 
 	settings->setValue("inputHandler/smallSeekAmount", inputHandler.smallSeekAmount);
 	settings->setValue("inputHandler/normalSeekAmount", inputHandler.normalSeekAmount);
@@ -241,6 +319,9 @@ void Settings::writeToQSettings(QSettings* settings)
 	settings->setValue("inputHandler/normalTimeOffset", inputHandler.normalTimeOffset);
 	settings->setValue("inputHandler/largeTimeOffset", inputHandler.largeTimeOffset);
 	settings->setValue("inputHandler/veryLargeTimeOffset", inputHandler.veryLargeTimeOffset);
+
+	settings->setValue("trace/enabled", trace.enabled);
+	settings->setValue("trace/outputFilePath", trace.outputFilePath);
 }
 
 void Settings::readFromUI(Ui::MainWindow* ui)
@@ -405,3 +486,25 @@ void Settings::writeToUI(Ui::MainWindow* ui)
 	ui->comboBoxVideoEncoderProfile->setCurrentText(encoder.profile);
 	ui->spinBoxVideoEncoderCrf->setValue(encoder.constantRateFactor);
 }
+
+void Settings::resolveFilePaths(const QString& baseDirectoryPath)
+{
+	QDir baseDirectory(baseDirectoryPath);
+
+	// empty paths stay unset and "-" is the standard output, the other file names get the cache and backup files next to them
+	auto resolve = [&baseDirectory](QString& filePath)
+	{
+		if (!filePath.isEmpty() && filePath != "-")
+			filePath = QDir::cleanPath(baseDirectory.absoluteFilePath(filePath));
+	};
+
+	resolve(map.imageFilePath);
+	resolve(route.quickRouteJpegFilePath);
+	resolve(video.inputVideoFilePath);
+	resolve(stabilizer.inputDataFilePath);
+	resolve(stabilizer.passOneOutputFilePath);
+	resolve(stabilizer.passTwoInputFilePath);
+	resolve(stabilizer.passTwoOutputFilePath);
+	resolve(encoder.outputVideoFilePath);
+	resolve(trace.outputFilePath);
+}
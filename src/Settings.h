@@ -29,6 +29,7 @@ namespace OrientView
 		void writeToQSettings(QSettings* settings);		// Write values to a QSettings instance.
 		void readFromUI(Ui::MainWindow* ui);			// Read values from the UI.
 		void writeToUI(Ui::MainWindow* ui);				// Write values to the UI.
+		void resolveFilePaths(const QString& baseDirectoryPath);	// Make the relative file paths absolute against a directory.
 
 		struct Map
 		{
@@ -41,6 +42,7 @@ namespace OrientView
 			QColor backgroundColor = QColor(255, 255, 255, 255);
 			int headerCrop = 0;
 			QString rescaleShader = "default";
+			QString rescaleShaderDefines = "";
 
 		} map;
 
@@ -89,12 +91,14 @@ namespace OrientView
 		{
 			QString inputVideoFilePath = "";
 			double startTimeOffset = 0.0;
+			double endTimeOffset = 0.0; // 0 plays to the end of the file
 			double x = 0.0;
 			double y = 0.0;
 			double angle = 0.0;
 			double scale = 1.0;
 			QColor backgroundColor = QColor(0, 50, 0, 255);
 			QString rescaleShader = "default";
+			QString rescaleShaderDefines = "";
 			bool enableClipping = false;
 			bool enableClearing = true;
 			int frameCountDivisor = 1;
@@ -102,6 +106,10 @@ namespace OrientView
 			int frameSizeDivisor = 1;
 			bool enableVerboseLogging = false;
 			bool seekToAnyFrame = false;
+			bool enableFrameDropping = true;
+			double catchUpThreshold = 100.0;
+			int frameQueueDepth = 2;
+			int decoderThreadCount = 0; // 0 keeps the FFmpeg default
 
 		} video;
 
@@ -127,6 +135,18 @@ namespace OrientView
 			RenderMode renderMode = RenderMode::All;
 			bool showInfoPanel = false;
 			int infoPanelFontSize = 8;
+			int infoPanelUpdateInterval = 100;
+			RenderBackend backend = RenderBackend::OpenGL;
+			int softwareThreadCount = 0;
+			bool enableDirtyTracking = true;
+			bool enableGpuTimers = true;
+			bool enableSeparableRescale = true;
+			int maximumResampleSize = 4096;
+			bool enableQualityGovernor = true;
+			double qualityDowngradeThreshold = 0.0;
+			double qualityUpgradeThreshold = 5.0;
+			int qualityDowngradeDelay = 1000;
+			int qualityUpgradeDelay = 5000;
 
 		} renderer;
 
@@ -144,15 +164,33 @@ namespace OrientView
 			QString passTwoInputFilePath = "";
 			QString passTwoOutputFilePath = "";
 			int smoothingRadius = 15;
+			int frameQueueDepth = 2;
+			int threadCount = 0; // 0 keeps the OpenCV default
 
 		} stabilizer;
 
 		struct Encoder
 		{
-			QString outputVideoFilePath = "";
+			QString outputVideoFilePath = ""; // "-" streams to the standard output with the libav and y4m backends
+			QString backend = "x264"; // x264 (MP4 with l-smash), libav (any libavcodec encoder and libavformat container) or y4m (raw YUV4MPEG2)
+			QString codec = "libx265"; // libavcodec encoder name for the libav backend
+			QString codecOptions = ""; // comma separated key=value pairs for the libavcodec encoder
+			QString outputFormat = ""; // libavformat container name, empty guesses it from the file name
 			QString preset = "veryfast";
 			QString profile = "high";
+			QString tune = "zerolatency"; // empty enables the lookahead, B-frames and frame threading for offline files
 			int constantRateFactor = 23;
+			int frameQueueDepth = 3;
+			int threadCount = 0; // 0 lets x264 decide
+			int conversionThreadCount = 0; // 0 follows the thread count above, or uses all the cores if that is 0 too
+			bool useSwscale = false; // convert with a single sws_scale call instead of the sliced converter
+			double fragmentDuration = 0.0; // seconds, 0 writes a regular MP4 file with the index at the end
+			int writeBufferSize = 8; // MB
+			int writeBufferCount = 4;
+			bool enableAudio = true; // AAC is copied from the input file, other formats are left out
+			bool enableCache = false;
+			int cacheGopLength = 60; // frames, the unit that is copied from the previous output
+			bool enableQualityMetrics = false;
 
 		} encoder;
 
@@ -184,5 +222,12 @@ namespace OrientView
 			double veryLargeTimeOffset = 20.0;
 
 		} inputHandler;
+
+		struct Trace
+		{
+			bool enabled = false;
+			QString outputFilePath = "orientview_trace.json";
+
+		} trace;
 	};
 }
@@ -0,0 +1,89 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include "ShaderLoader.h"
+#include "FileHandler.h"
+
+using namespace OrientView;
+
+bool ShaderLoader::loadProgram(QOpenGLShaderProgram& program, const QString& shaderName, const QString& defines)
+{
+	QElapsedTimer loadTimer;
+	loadTimer.start();
+
+	QMap<QString, QString> defineMap = parseDefines(defines);
+
+	QByteArray vertexShaderSource = readSource(getDataFilePath(QString("shaders/%1.vert").arg(shaderName)), defineMap);
+	QByteArray fragmentShaderSource = readSource(getDataFilePath(QString("shaders/%1.frag").arg(shaderName)), defineMap);
+
+	if (vertexShaderSource.isEmpty() || fragmentShaderSource.isEmpty())
+		return false;
+
+	// the linked program binary is cached on disk by Qt, keyed by the driver and the final sources (defines included)
+	// later runs load the binary and skip compiling and linking, if the driver supports program binaries
+	if (!program.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource))
+		return false;
+
+	if (!program.addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource))
+		return false;
+
+	if (!program.link())
+	{
+		qWarning("Could not link shader program %s", qPrintable(shaderName));
+		return false;
+	}
+
+	if (defineMap.isEmpty())
+		qDebug("Shader program %s loaded in %.2f ms", qPrintable(shaderName), loadTimer.nsecsElapsed() / 1000000.0);
+	else
+		qDebug("Shader program %s (%s) loaded in %.2f ms", qPrintable(shaderName), qPrintable(defines), loadTimer.nsecsElapsed() / 1000000.0);
+
+	return true;
+}
+
+QMap<QString, QString> ShaderLoader::parseDefines(const QString& defines)
+{
+	QMap<QString, QString> defineMap;
+
+	// NAME=VALUE;NAME=VALUE, a name without a value is defined empty
+	for (const QString& define : defines.split(';', QString::SkipEmptyParts))
+	{
+		int separatorIndex = define.indexOf('=');
+		QString name = define.left(separatorIndex).trimmed();
+		QString value = (separatorIndex >= 0) ? define.mid(separatorIndex + 1).trimmed() : QString();
+
+		if (!name.isEmpty())
+			defineMap[name] = value;
+	}
+
+	return defineMap;
+}
+
+QByteArray ShaderLoader::readSource(const QString& filePath, const QMap<QString, QString>& defines)
+{
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		qWarning("Could not open shader file %s", qPrintable(filePath));
+		return QByteArray();
+	}
+
+	QByteArray source = file.readAll();
+	QByteArray defineLines;
+
+	for (QMap<QString, QString>::const_iterator it = defines.constBegin(); it != defines.constEnd(); ++it)
+		defineLines += QString("#define %1 %2\n").arg(it.key(), it.value()).toLatin1();
+
+	// the version directive has to stay on the first line
+	if (source.startsWith("#version"))
+		source.insert(source.indexOf('\n') + 1, defineLines);
+	else
+		source.prepend(defineLines);
+
+	return source;
+}
@@ -0,0 +1,26 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QByteArray>
+#include <QMap>
+#include <QOpenGLShaderProgram>
+#include <QString>
+
+namespace OrientView
+{
+	// Load shader programs from the data directory, with optional preprocessor defines to select variants.
+	class ShaderLoader
+	{
+
+	public:
+
+		static bool loadProgram(QOpenGLShaderProgram& program, const QString& shaderName, const QString& defines = QString());
+		static QMap<QString, QString> parseDefines(const QString& defines);
+
+	private:
+
+		static QByteArray readSource(const QString& filePath, const QMap<QString, QString>& defines);
+	};
+}
@@ -31,6 +31,11 @@ void SimpleLogger::setMainWindow(MainWindow* mainWindow)
 	this->mainWindow = mainWindow;
 }
 
+void SimpleLogger::setUseStandardError(bool value)
+{
+	useStandardError = value;
+}
+
 void SimpleLogger::handleMessage(QtMsgType type, const QMessageLogContext& context, const QString& message)
 {
 	Q_UNUSED(context);
@@ -55,7 +60,10 @@ void SimpleLogger::handleMessage(QtMsgType type, const QMessageLogContext& conte
 	QString timeString = QTime::currentTime().toString("HH:mm:ss.zzz");
 	QString messageText = QString("%1 [%2] - %3\n").arg(timeString, typeString, message);
 
-	std::cout << messageText.toStdString();
+	if (useStandardError)
+		std::cerr << messageText.toStdString();
+	else
+		std::cout << messageText.toStdString();
 
 	if (logFile.isOpen())
 	{
@@ -19,11 +19,13 @@ namespace OrientView
 
 		void initialize(const QString& fileName);
 		void setMainWindow(MainWindow* mainWindow);
+		void setUseStandardError(bool value);
 		void handleMessage(QtMsgType type, const QMessageLogContext& context, const QString& message);
 
 	private:
 
 		QFile logFile;
 		MainWindow* mainWindow = nullptr;
+		bool useStandardError = false; // keeps the standard output free for the command line progress
 	};
 }
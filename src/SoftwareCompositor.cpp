@@ -0,0 +1,392 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#include <QRunnable>
+#include <QThread>
+
+#include "SoftwareCompositor.h"
+#include "InterpolationFunctions.h"
+#include "ShaderLoader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ORIENTVIEW_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace OrientView;
+
+namespace
+{
+	const int WEIGHT_TABLE_PHASE_COUNT = 256;
+	const int MINIMUM_BAND_HEIGHT = 16;
+
+	// one RGBA texel in floating point, all four channels are processed at once
+#ifdef ORIENTVIEW_USE_SSE2
+	struct Texel
+	{
+		__m128 value;
+	};
+
+	inline Texel loadTexel(const uint8_t* source)
+	{
+		int32_t packed;
+		memcpy(&packed, source, 4);
+
+		__m128i pixel = _mm_cvtsi32_si128(packed);
+		pixel = _mm_unpacklo_epi8(pixel, _mm_setzero_si128());
+		pixel = _mm_unpacklo_epi16(pixel, _mm_setzero_si128());
+
+		return Texel { _mm_cvtepi32_ps(pixel) };
+	}
+
+	inline void storeTexel(uint8_t* target, const Texel& texel)
+	{
+		__m128i pixel = _mm_cvtps_epi32(texel.value);
+		pixel = _mm_packs_epi32(pixel, pixel);
+		pixel = _mm_packus_epi16(pixel, pixel);
+
+		int32_t packed = _mm_cvtsi128_si32(pixel);
+		memcpy(target, &packed, 4);
+	}
+
+	inline Texel operator+(const Texel& a, const Texel& b) { return Texel { _mm_add_ps(a.value, b.value) }; }
+	inline Texel operator-(const Texel& a, const Texel& b) { return Texel { _mm_sub_ps(a.value, b.value) }; }
+	inline Texel operator*(const Texel& a, float b) { return Texel { _mm_mul_ps(a.value, _mm_set1_ps(b)) }; }
+	inline Texel zeroTexel() { return Texel { _mm_setzero_ps() }; }
+#else
+	struct Texel
+	{
+		float value[4];
+	};
+
+	inline Texel loadTexel(const uint8_t* source)
+	{
+		return Texel { { (float)source[0], (float)source[1], (float)source[2], (float)source[3] } };
+	}
+
+	inline void storeTexel(uint8_t* target, const Texel& texel)
+	{
+		for (int i = 0; i < 4; ++i)
+			target[i] = (uint8_t)std::min(std::max(texel.value[i] + 0.5f, 0.0f), 255.0f);
+	}
+
+	inline Texel operator+(const Texel& a, const Texel& b) { return Texel { { a.value[0] + b.value[0], a.value[1] + b.value[1], a.value[2] + b.value[2], a.value[3] + b.value[3] } }; }
+	inline Texel operator-(const Texel& a, const Texel& b) { return Texel { { a.value[0] - b.value[0], a.value[1] - b.value[1], a.value[2] - b.value[2], a.value[3] - b.value[3] } }; }
+	inline Texel operator*(const Texel& a, float b) { return Texel { { a.value[0] * b, a.value[1] * b, a.value[2] * b, a.value[3] * b } }; }
+	inline Texel zeroTexel() { return Texel { { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+#endif
+
+	inline int clampIndex(int index, int size)
+	{
+		return (index < 0) ? 0 : ((index >= size) ? size - 1 : index);
+	}
+
+	inline const uint8_t* texelAddress(const SoftwareTexture& texture, int x, int y)
+	{
+		return texture.data.data() + y * texture.rowLength + x * 4;
+	}
+
+	// same as the rescale shaders: round up to the nearest texel center, and remap the fraction 0.5 1.0 0.5 -> 0.0 0.5 1.0
+	// the taps start from the texel of that center, which is one texel further than with GL_LINEAR
+	inline void snapToTexelCenter(float t, int& index, float& alpha)
+	{
+		index = (int)ceilf(t + 0.5f) - 1;
+		alpha = t - floorf(t);
+		alpha += (alpha > 0.5f) ? -0.5f : 0.5f;
+	}
+
+	// same as GL_LINEAR with GL_CLAMP_TO_EDGE
+	inline Texel sampleLinear(const SoftwareTexture& texture, float tx, float ty)
+	{
+		float x = tx - 0.5f;
+		float y = ty - 0.5f;
+		float fx0 = floorf(x);
+		float fy0 = floorf(y);
+		float alphaX = x - fx0;
+		float alphaY = y - fy0;
+
+		int x0 = clampIndex((int)fx0, texture.width);
+		int x1 = clampIndex((int)fx0 + 1, texture.width);
+		int y0 = clampIndex((int)fy0, texture.height);
+		int y1 = clampIndex((int)fy0 + 1, texture.height);
+
+		Texel c00 = loadTexel(texelAddress(texture, x0, y0));
+		Texel c10 = loadTexel(texelAddress(texture, x1, y0));
+		Texel c01 = loadTexel(texelAddress(texture, x0, y1));
+		Texel c11 = loadTexel(texelAddress(texture, x1, y1));
+
+		Texel top = c00 + (c10 - c00) * alphaX;
+		Texel bottom = c01 + (c11 - c01) * alphaX;
+
+		return top + (bottom - top) * alphaY;
+	}
+
+	// same as rescale_bilinear.frag, the weights are eased with smoothstep for smoother gradients at the edges
+	inline Texel sampleBilinear(const SoftwareTexture& texture, float tx, float ty)
+	{
+		int ix, iy;
+		float alphaX, alphaY;
+		snapToTexelCenter(tx, ix, alphaX);
+		snapToTexelCenter(ty, iy, alphaY);
+
+		alphaX = alphaX * alphaX * (3.0f - 2.0f * alphaX);
+		alphaY = alphaY * alphaY * (3.0f - 2.0f * alphaY);
+
+		int x0 = clampIndex(ix, texture.width);
+		int x1 = clampIndex(ix + 1, texture.width);
+		int y0 = clampIndex(iy, texture.height);
+		int y1 = clampIndex(iy + 1, texture.height);
+
+		Texel c00 = loadTexel(texelAddress(texture, x0, y0));
+		Texel c10 = loadTexel(texelAddress(texture, x1, y0));
+		Texel c01 = loadTexel(texelAddress(texture, x0, y1));
+		Texel c11 = loadTexel(texelAddress(texture, x1, y1));
+
+		Texel top = c00 + (c10 - c00) * alphaX;
+		Texel bottom = c01 + (c11 - c01) * alphaX;
+
+		return top + (bottom - top) * alphaY;
+	}
+
+	// 4x4 taps with normalized weights from the table (same functions and snapping as rescale_bicubic.frag)
+	inline Texel sampleBicubic(const SoftwareTexture& texture, float tx, float ty)
+	{
+		int ix, iy;
+		float alphaX, alphaY;
+		snapToTexelCenter(tx, ix, alphaX);
+		snapToTexelCenter(ty, iy, alphaY);
+
+		int phaseX = (int)(alphaX * WEIGHT_TABLE_PHASE_COUNT + 0.5f);
+		int phaseY = (int)(alphaY * WEIGHT_TABLE_PHASE_COUNT + 0.5f);
+
+		if (phaseX == WEIGHT_TABLE_PHASE_COUNT)
+		{
+			phaseX = 0;
+			ix++;
+		}
+
+		if (phaseY == WEIGHT_TABLE_PHASE_COUNT)
+		{
+			phaseY = 0;
+			iy++;
+		}
+
+		const float* weightsX = &texture.weightTable[phaseX * 4];
+		const float* weightsY = &texture.weightTable[phaseY * 4];
+
+		int columns[4];
+
+		for (int i = 0; i < 4; ++i)
+			columns[i] = clampIndex(ix - 1 + i, texture.width) * 4;
+
+		Texel result = zeroTexel();
+
+		for (int j = 0; j < 4; ++j)
+		{
+			const uint8_t* row = texture.data.data() + clampIndex(iy - 1 + j, texture.height) * texture.rowLength;
+
+			Texel rowResult = loadTexel(row + columns[0]) * weightsX[0];
+			rowResult = rowResult + loadTexel(row + columns[1]) * weightsX[1];
+			rowResult = rowResult + loadTexel(row + columns[2]) * weightsX[2];
+			rowResult = rowResult + loadTexel(row + columns[3]) * weightsX[3];
+
+			result = result + rowResult * weightsY[j];
+		}
+
+		return result;
+	}
+
+	class CompositorTask : public QRunnable
+	{
+
+	public:
+
+		explicit CompositorTask(const std::function<void()>& function) : function(function) {}
+		void run() { function(); }
+
+	private:
+
+		std::function<void()> function;
+	};
+}
+
+bool SoftwareCompositor::initialize(const QImage& mapImage, const QString& videoRescaleShader, const QString& videoRescaleShaderDefines, const QString& mapRescaleShader, const QString& mapRescaleShaderDefines, int threadCount)
+{
+	qDebug("Initializing software compositor");
+
+	if (threadCount <= 0)
+		threadCount = QThread::idealThreadCount();
+
+	if (threadCount <= 0)
+		threadCount = 1;
+
+	// the calling thread renders one band itself
+	threadPool.setMaxThreadCount(std::max(1, threadCount - 1));
+	bandCount = threadCount;
+
+	setFilter(videoTexture, videoRescaleShader, videoRescaleShaderDefines);
+	setFilter(mapTexture, mapRescaleShader, mapRescaleShaderDefines);
+
+	if (!mapImage.isNull())
+	{
+		QImage convertedMapImage = mapImage.convertToFormat(QImage::Format_RGBA8888);
+
+		mapTexture.width = convertedMapImage.width();
+		mapTexture.height = convertedMapImage.height();
+		mapTexture.rowLength = (size_t)mapTexture.width * 4;
+		mapTexture.data.resize(mapTexture.rowLength * mapTexture.height);
+
+		for (int y = 0; y < mapTexture.height; ++y)
+			memcpy(&mapTexture.data[y * mapTexture.rowLength], convertedMapImage.constScanLine(y), mapTexture.rowLength);
+	}
+
+	const char* filterNames[] = { "default", "bilinear", "bicubic" };
+	qDebug("Software compositor: %d threads, video %s, map %s", threadCount, filterNames[videoTexture.filter], filterNames[mapTexture.filter]);
+
+	return true;
+}
+
+void SoftwareCompositor::setFilter(SoftwareTexture& texture, const QString& shaderName, const QString& shaderDefines)
+{
+	if (shaderName == "bicubic")
+	{
+		InterpolationFunction function;
+		double lanczosSize;
+		InterpolationFunctions::fromShaderDefines(ShaderLoader::parseDefines(shaderDefines), function, lanczosSize);
+
+		texture.filter = SoftwareFilter::Bicubic;
+		texture.weightTable = InterpolationFunctions::calculateWeightTable(function, WEIGHT_TABLE_PHASE_COUNT, lanczosSize);
+	}
+	else if (shaderName == "bilinear")
+		texture.filter = SoftwareFilter::Bilinear;
+	else
+		texture.filter = SoftwareFilter::Linear;
+}
+
+void SoftwareCompositor::uploadVideoFrame(const FrameData& frameData)
+{
+	if (frameData.data == nullptr || frameData.width <= 0 || frameData.height <= 0)
+		return;
+
+	// the decoder reuses its buffer as soon as the frame has been read, so a copy is needed (same as a texture upload)
+	videoTexture.width = frameData.width;
+	videoTexture.height = frameData.height;
+	videoTexture.rowLength = (size_t)frameData.width * 4;
+	videoTexture.data.resize(videoTexture.rowLength * videoTexture.height);
+
+	if (frameData.rowLength == videoTexture.rowLength)
+		memcpy(videoTexture.data.data(), frameData.data, videoTexture.data.size());
+	else
+	{
+		for (int y = 0; y < videoTexture.height; ++y)
+			memcpy(&videoTexture.data[y * videoTexture.rowLength], frameData.data + y * frameData.rowLength, videoTexture.rowLength);
+	}
+}
+
+void SoftwareCompositor::fill(FrameData& target, const QRect& area, const QColor& color)
+{
+	QRect clippedArea = area.intersected(QRect(0, 0, target.width, target.height));
+
+	if (clippedArea.isEmpty())
+		return;
+
+	uint8_t pixel[4] = { (uint8_t)color.red(), (uint8_t)color.green(), (uint8_t)color.blue(), 255 };
+	uint32_t packedPixel;
+	memcpy(&packedPixel, pixel, 4);
+
+	for (int y = clippedArea.top(); y <= clippedArea.bottom(); ++y)
+	{
+		uint32_t* row = (uint32_t*)(target.data + y * target.rowLength);
+		std::fill(row + clippedArea.left(), row + clippedArea.right() + 1, packedPixel);
+	}
+}
+
+void SoftwareCompositor::drawVideoPanel(FrameData& target, const QRect& clipArea, const QMatrix4x4& modelMatrix)
+{
+	drawTexture(target, clipArea, modelMatrix, videoTexture);
+}
+
+void SoftwareCompositor::drawMapPanel(FrameData& target, const QRect& clipArea, const QMatrix4x4& modelMatrix)
+{
+	drawTexture(target, clipArea, modelMatrix, mapTexture);
+}
+
+void SoftwareCompositor::drawTexture(FrameData& target, const QRect& clipArea, const QMatrix4x4& modelMatrix, const SoftwareTexture& texture)
+{
+	if (texture.data.empty())
+		return;
+
+	QRect clippedArea = clipArea.intersected(QRect(0, 0, target.width, target.height));
+
+	if (clippedArea.isEmpty())
+		return;
+
+	bool isInvertible = false;
+	QMatrix4x4 inverseMatrix = modelMatrix.inverted(&isInvertible);
+
+	if (!isInvertible)
+		return;
+
+	// target row r (top to bottom) is at world y = height / 2 - (r + 0.5), same mapping as the flipped projection of the offscreen renderer
+	// panel quad is centered at the origin, texture coordinate (0, 0) being the upper left corner
+	const double m00 = inverseMatrix(0, 0);
+	const double m01 = inverseMatrix(0, 1);
+	const double m03 = inverseMatrix(0, 3);
+	const double m10 = inverseMatrix(1, 0);
+	const double m11 = inverseMatrix(1, 1);
+	const double m13 = inverseMatrix(1, 3);
+	const double halfTargetWidth = target.width / 2.0;
+	const double halfTargetHeight = target.height / 2.0;
+	const double halfTextureWidth = texture.width / 2.0;
+	const double halfTextureHeight = texture.height / 2.0;
+	const float textureWidth = (float)texture.width;
+	const float textureHeight = (float)texture.height;
+	const SoftwareFilter filter = texture.filter;
+
+	auto drawRows = [&](int firstRow, int lastRow)
+	{
+		for (int y = firstRow; y <= lastRow; ++y)
+		{
+			double worldX = clippedArea.left() + 0.5 - halfTargetWidth;
+			double worldY = halfTargetHeight - (y + 0.5);
+			double tx = m00 * worldX + m01 * worldY + m03 + halfTextureWidth;
+			double ty = halfTextureHeight - (m10 * worldX + m11 * worldY + m13);
+
+			uint8_t* pixel = target.data + y * target.rowLength + clippedArea.left() * 4;
+
+			for (int x = clippedArea.left(); x <= clippedArea.right(); ++x, pixel += 4, tx += m00, ty -= m10)
+			{
+				if (tx < 0.0 || ty < 0.0 || tx >= textureWidth || ty >= textureHeight)
+					continue;
+
+				if (filter == SoftwareFilter::Bicubic)
+					storeTexel(pixel, sampleBicubic(texture, (float)tx, (float)ty));
+				else if (filter == SoftwareFilter::Bilinear)
+					storeTexel(pixel, sampleBilinear(texture, (float)tx, (float)ty));
+				else
+					storeTexel(pixel, sampleLinear(texture, (float)tx, (float)ty));
+			}
+		}
+	};
+
+	int rowCount = clippedArea.height();
+	int usedBandCount = std::max(1, std::min(bandCount, rowCount / MINIMUM_BAND_HEIGHT));
+	int bandHeight = (rowCount + usedBandCount - 1) / usedBandCount;
+
+	for (int band = 1; band < usedBandCount; ++band)
+	{
+		int firstRow = clippedArea.top() + band * bandHeight;
+		int lastRow = std::min(firstRow + bandHeight - 1, clippedArea.bottom());
+
+		if (firstRow <= lastRow)
+			threadPool.start(new CompositorTask([=]() { drawRows(firstRow, lastRow); }));
+	}
+
+	drawRows(clippedArea.top(), std::min(clippedArea.top() + bandHeight - 1, clippedArea.bottom()));
+	threadPool.waitForDone();
+}
@@ -0,0 +1,57 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QRect>
+#include <QColor>
+#include <QThreadPool>
+
+#include "FrameData.h"
+
+namespace OrientView
+{
+	// Linear is GL_LINEAR like rescale_default, the others follow rescale_bilinear and rescale_bicubic.
+	enum SoftwareFilter { Linear, Bilinear, Bicubic };
+
+	struct SoftwareTexture
+	{
+		std::vector<uint8_t> data;
+		size_t rowLength = 0;
+		int width = 0;
+		int height = 0;
+
+		SoftwareFilter filter = SoftwareFilter::Linear;
+		std::vector<float> weightTable;
+	};
+
+	// Draw the panels with the CPU directly into RGBA frames.
+	class SoftwareCompositor
+	{
+
+	public:
+
+		bool initialize(const QImage& mapImage, const QString& videoRescaleShader, const QString& videoRescaleShaderDefines, const QString& mapRescaleShader, const QString& mapRescaleShaderDefines, int threadCount);
+
+		void uploadVideoFrame(const FrameData& frameData);
+		void fill(FrameData& target, const QRect& area, const QColor& color);
+		void drawVideoPanel(FrameData& target, const QRect& clipArea, const QMatrix4x4& modelMatrix);
+		void drawMapPanel(FrameData& target, const QRect& clipArea, const QMatrix4x4& modelMatrix);
+
+	private:
+
+		void setFilter(SoftwareTexture& texture, const QString& shaderName, const QString& shaderDefines);
+		void drawTexture(FrameData& target, const QRect& clipArea, const QMatrix4x4& modelMatrix, const SoftwareTexture& texture);
+
+		SoftwareTexture videoTexture;
+		SoftwareTexture mapTexture;
+
+		QThreadPool threadPool;
+		int bandCount = 1;
+	};
+}
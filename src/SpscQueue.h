@@ -0,0 +1,278 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+#include "PipelineTracer.h"
+
+namespace OrientView
+{
+	// Fixed size lock-free queue between one producer thread and one consumer thread, the mutex is only touched when one side has to sleep.
+	template <typename T>
+	class SpscQueue
+	{
+
+	public:
+
+		void initialize(int capacity);
+
+		int getCapacity() const;
+		T& getSlot(int index);
+
+		// Producer side: wait for a free slot, fill back() and push it.
+		bool waitForFreeSlot(int timeout);
+		T& back();
+		void push();
+
+		// Consumer side: wait for an item, read front() and pop it when done with it, so that its buffers are not reused too early.
+		bool waitForItem(int timeout);
+		T& front();
+		void pop();
+
+		void logStatistics(const char* name);
+
+	private:
+
+		static const size_t CACHE_LINE_SIZE = 64;
+
+		struct WaitStatistics
+		{
+			int operationCount = 0;
+			int waitCount = 0;
+			int timeoutCount = 0;
+			int notifyCount = 0;
+			double totalWaitDuration = 0.0;
+			double maximumWaitDuration = 0.0;
+		};
+
+		void notify(std::atomic<bool>& isWaiting, QWaitCondition& condition, WaitStatistics& statistics);
+		bool wait(std::atomic<bool>& isWaiting, QWaitCondition& condition, WaitStatistics& statistics, int timeout, bool forFreeSlot);
+
+		std::vector<T> slots;
+		size_t capacity = 0;
+
+		// the indices grow without wrapping, the producer and the consumer each write only their own and keep a stale copy of the other's
+		// the padding keeps them on separate cache lines wherever the queue itself happens to be allocated
+		char padding0[CACHE_LINE_SIZE];
+		std::atomic<size_t> head{ 0 }; // written by the consumer
+		size_t cachedTail = 0;
+		char padding1[CACHE_LINE_SIZE];
+		std::atomic<size_t> tail{ 0 }; // written by the producer
+		size_t cachedHead = 0;
+		char padding2[CACHE_LINE_SIZE];
+
+		std::atomic<bool> producerIsWaiting{ false };
+		std::atomic<bool> consumerIsWaiting{ false };
+		QMutex waitMutex;
+		QWaitCondition slotFreed;
+		QWaitCondition itemPushed;
+
+		WaitStatistics producerStatistics;
+		WaitStatistics consumerStatistics;
+		size_t maximumSize = 0;
+	};
+
+	template <typename T>
+	void SpscQueue<T>::initialize(int capacity)
+	{
+		this->capacity = (size_t)std::max(1, capacity);
+
+		slots.clear();
+		slots.resize(this->capacity);
+
+		head = 0;
+		tail = 0;
+		cachedHead = 0;
+		cachedTail = 0;
+		producerIsWaiting = false;
+		consumerIsWaiting = false;
+
+		producerStatistics = WaitStatistics();
+		consumerStatistics = WaitStatistics();
+		maximumSize = 0;
+	}
+
+	template <typename T>
+	int SpscQueue<T>::getCapacity() const
+	{
+		return (int)capacity;
+	}
+
+	template <typename T>
+	T& SpscQueue<T>::getSlot(int index)
+	{
+		return slots[(size_t)index];
+	}
+
+	template <typename T>
+	bool SpscQueue<T>::waitForFreeSlot(int timeout)
+	{
+		size_t currentTail = tail.load(std::memory_order_relaxed);
+
+		if (currentTail - cachedHead < capacity)
+			return true;
+
+		cachedHead = head.load(std::memory_order_acquire);
+
+		if (currentTail - cachedHead < capacity)
+			return true;
+
+		if (timeout <= 0)
+			return false;
+
+		TraceScope traceScope("wait for free slot");
+		return wait(producerIsWaiting, slotFreed, producerStatistics, timeout, true);
+	}
+
+	template <typename T>
+	T& SpscQueue<T>::back()
+	{
+		return slots[tail.load(std::memory_order_relaxed) % capacity];
+	}
+
+	template <typename T>
+	void SpscQueue<T>::push()
+	{
+		size_t newTail = tail.load(std::memory_order_relaxed) + 1;
+
+		// sequentially consistent, so that either this store is seen by a consumer going to sleep or its waiting flag is seen here
+		tail.store(newTail);
+
+		producerStatistics.operationCount++;
+		maximumSize = std::max(maximumSize, newTail - cachedHead);
+
+		notify(consumerIsWaiting, itemPushed, consumerStatistics);
+	}
+
+	template <typename T>
+	bool SpscQueue<T>::waitForItem(int timeout)
+	{
+		size_t currentHead = head.load(std::memory_order_relaxed);
+
+		if (cachedTail != currentHead)
+			return true;
+
+		cachedTail = tail.load(std::memory_order_acquire);
+
+		if (cachedTail != currentHead)
+			return true;
+
+		if (timeout <= 0)
+			return false;
+
+		TraceScope traceScope("wait for item");
+		return wait(consumerIsWaiting, itemPushed, consumerStatistics, timeout, false);
+	}
+
+	template <typename T>
+	T& SpscQueue<T>::front()
+	{
+		return slots[head.load(std::memory_order_relaxed) % capacity];
+	}
+
+	template <typename T>
+	void SpscQueue<T>::pop()
+	{
+		head.store(head.load(std::memory_order_relaxed) + 1);
+
+		consumerStatistics.operationCount++;
+
+		notify(producerIsWaiting, slotFreed, producerStatistics);
+	}
+
+	template <typename T>
+	void SpscQueue<T>::notify(std::atomic<bool>& isWaiting, QWaitCondition& condition, WaitStatistics& statistics)
+	{
+		if (!isWaiting.load())
+			return;
+
+		// the sleeper holds the mutex until it is inside the wait, so the wake-up cannot be lost
+		QMutexLocker locker(&waitMutex);
+		condition.wakeOne();
+		statistics.notifyCount++;
+	}
+
+	template <typename T>
+	bool SpscQueue<T>::wait(std::atomic<bool>& isWaiting, QWaitCondition& condition, WaitStatistics& statistics, int timeout, bool forFreeSlot)
+	{
+		QElapsedTimer waitTimer;
+		waitTimer.start();
+
+		QMutexLocker locker(&waitMutex);
+		isWaiting.store(true);
+
+		bool isReady = false;
+
+		while (true)
+		{
+			if (forFreeSlot)
+			{
+				cachedHead = head.load();
+				isReady = (tail.load(std::memory_order_relaxed) - cachedHead < capacity);
+			}
+			else
+			{
+				cachedTail = tail.load();
+				isReady = (cachedTail != head.load(std::memory_order_relaxed));
+			}
+
+			qint64 remainingTime = timeout - waitTimer.elapsed();
+
+			if (isReady || remainingTime <= 0)
+				break;
+
+			condition.wait(&waitMutex, (unsigned long)remainingTime);
+		}
+
+		isWaiting.store(false);
+
+		double waitDuration = waitTimer.nsecsElapsed() / 1000000.0;
+
+		statistics.waitCount++;
+		statistics.totalWaitDuration += waitDuration;
+		statistics.maximumWaitDuration = std::max(statistics.maximumWaitDuration, waitDuration);
+
+		if (!isReady)
+			statistics.timeoutCount++;
+
+		return isReady;
+	}
+
+	template <typename T>
+	void SpscQueue<T>::logStatistics(const char* name)
+	{
+		if (producerStatistics.operationCount == 0)
+			return;
+
+		qDebug("%s queue: %d frames, depth %d, at most %d queued",
+			name,
+			producerStatistics.operationCount,
+			(int)capacity,
+			(int)maximumSize);
+
+		qDebug("%s queue producer: waited %d times (%d timed out), %.2f ms total, %.2f ms maximum, woken %d times",
+			name,
+			producerStatistics.waitCount,
+			producerStatistics.timeoutCount,
+			producerStatistics.totalWaitDuration,
+			producerStatistics.maximumWaitDuration,
+			producerStatistics.notifyCount);
+
+		qDebug("%s queue consumer: waited %d times (%d timed out), %.2f ms total, %.2f ms maximum, woken %d times",
+			name,
+			consumerStatistics.waitCount,
+			consumerStatistics.timeoutCount,
+			consumerStatistics.totalWaitDuration,
+			consumerStatistics.maximumWaitDuration,
+			consumerStatistics.notifyCount);
+	}
+}
@@ -1,6 +1,8 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <algorithm>
+
 #include <QtGlobal>
 
 extern "C"
@@ -34,7 +36,7 @@ namespace
 			qDebug("%s", lineClipped);
 	}
 
-	bool openCodecContext(int* streamIndex, AVFormatContext* formatContext, AVMediaType mediaType, AVCodecContext** codecContext)
+	bool openCodecContext(int* streamIndex, AVFormatContext* formatContext, AVMediaType mediaType, AVCodecContext** codecContext, int threadCount)
 	{
 		*streamIndex = av_find_best_stream(formatContext, mediaType, -1, -1, nullptr, 0);
 
@@ -68,6 +70,9 @@ namespace
 				return false;
 			}
 
+			if (threadCount > 0)
+				(*codecContext)->thread_count = threadCount;
+
 			AVDictionary* opts = nullptr;
 
 			if (avcodec_open2(*codecContext, codec, &opts) < 0)
@@ -105,7 +110,7 @@ bool VideoDecoder::initialize(Settings* settings)
 		return false;
 	}
 
-	if (!openCodecContext(&videoStreamIndex, formatContext, AVMEDIA_TYPE_VIDEO, &videoCodecContext))
+	if (!openCodecContext(&videoStreamIndex, formatContext, AVMEDIA_TYPE_VIDEO, &videoCodecContext, settings->video.decoderThreadCount))
 	{
 		qWarning("Could not open video codec context");
 		return false;
@@ -127,78 +132,67 @@ bool VideoDecoder::initialize(Settings* settings)
 	videoStream = formatContext->streams[(size_t)videoStreamIndex];
 	// videoCodecContext is now set by openCodecContext
 
-	frameWidth = videoCodecContext->width / settings->video.frameSizeDivisor;
-	frameHeight = videoCodecContext->height / settings->video.frameSizeDivisor;
+	// the audio is never decoded here, so only the stream is looked up
+	audioStreamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, videoStreamIndex, nullptr, 0);
 
-	swsContext = sws_getContext(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt, frameWidth, frameHeight, AV_PIX_FMT_RGBA, SWS_BILINEAR, nullptr, nullptr, nullptr);
+	if (audioStreamIndex >= 0)
+		audioStream = formatContext->streams[(size_t)audioStreamIndex];
 
-	if (!swsContext)
-	{
-		qWarning("Could not get sws context");
+	if (!createConverters(settings->video.frameSizeDivisor, settings->stabilizer.frameSizeDivisor))
 		return false;
-	}
 
-	convertedPicture = av_frame_alloc();
-	if (!convertedPicture)
-	{
-		qWarning("Could not allocate conversion frame");
-		return false;
-	}
+	requestedFrameSizeDivisor = frameSizeDivisor;
+	requestedGrayscaleFrameSizeDivisor = grayscaleFrameSizeDivisor;
 
-	convertedPicture->format = AV_PIX_FMT_RGBA;
-	convertedPicture->width = frameWidth;
-	convertedPicture->height = frameHeight;
+	frameCountDivisor = settings->video.frameCountDivisor;
+	frameDurationDivisor = settings->video.frameDurationDivisor;
 
-	if (av_frame_get_buffer(convertedPicture, 0) < 0)
-	{
-		qWarning("Could not allocate conversion frame buffer");
-		return false;
-	}
+	totalFrameCount = videoStream->nb_frames / frameCountDivisor;
 
-	grayscaleFrameWidth = videoCodecContext->width / settings->stabilizer.frameSizeDivisor;
-	grayscaleFrameHeight = videoCodecContext->height / settings->stabilizer.frameSizeDivisor;
+	frameRateNum = (int64_t)videoStream->r_frame_rate.num / frameCountDivisor * frameDurationDivisor;
+	frameRateDen = (int64_t)videoStream->r_frame_rate.den;
+	frameDuration = frameRateDen * 1000000 / frameRateNum;
 
-	swsContextGrayscale = sws_getContext(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt, grayscaleFrameWidth, grayscaleFrameHeight, AV_PIX_FMT_GRAY8, SWS_BILINEAR, nullptr, nullptr, nullptr);
+	totalDurationInSeconds = ((double)videoStream->time_base.num / videoStream->time_base.den) * videoStream->duration;
 
-	if (!swsContextGrayscale)
-	{
-		qWarning("Could not get sws grayscale context");
-		return false;
-	}
+	// only the frames between the in-point and the out-point are decoded
+	double rangeStartTime = std::max(0.0, settings->video.startTimeOffset);
+	double rangeEndTime = (settings->video.endTimeOffset > 0.0) ? std::min(settings->video.endTimeOffset, totalDurationInSeconds) : totalDurationInSeconds;
 
-	convertedPictureGrayscale = av_frame_alloc();
-	if (!convertedPictureGrayscale)
+	// an empty range would stop at the first frame and leave an empty output behind
+	if (settings->video.endTimeOffset > 0.0 && settings->video.endTimeOffset <= rangeStartTime)
 	{
-		qWarning("Could not allocate grayscale conversion frame");
+		qWarning("Could not decode the range %.3f - %.3f s, the end time offset has to be after the start time offset", rangeStartTime, settings->video.endTimeOffset);
 		return false;
 	}
 
-	convertedPictureGrayscale->format = AV_PIX_FMT_GRAY8;
-	convertedPictureGrayscale->width = grayscaleFrameWidth;
-	convertedPictureGrayscale->height = grayscaleFrameHeight;
-
-	if (av_frame_get_buffer(convertedPictureGrayscale, 0) < 0)
+	if (totalDurationInSeconds > 0.0 && rangeStartTime >= totalDurationInSeconds)
 	{
-		qWarning("Could not allocate grayscale conversion frame buffer");
+		qWarning("Could not decode from %.3f s, the video is only %.3f s long", rangeStartTime, totalDurationInSeconds);
 		return false;
 	}
 
-	frameCountDivisor = settings->video.frameCountDivisor;
-	frameDurationDivisor = settings->video.frameDurationDivisor;
+	if (settings->video.endTimeOffset > 0.0)
+	{
+		endTimestamp = (int64_t)(((double)videoStream->time_base.den / videoStream->time_base.num) * rangeEndTime + 0.5);
 
-	totalFrameCount = videoStream->nb_frames / frameCountDivisor;
+		if (audioStream != nullptr)
+			audioEndTimestamp = av_rescale_q(endTimestamp, videoStream->time_base, audioStream->time_base);
+	}
 
-	frameRateNum = (int64_t)videoStream->r_frame_rate.num / frameCountDivisor * frameDurationDivisor;
-	frameRateDen = (int64_t)videoStream->r_frame_rate.den;
-	frameDuration = frameRateDen * 1000000 / frameRateNum;
+	if (rangeStartTime > 0.0 || settings->video.endTimeOffset > 0.0)
+	{
+		double rangeFrameCount = (rangeEndTime - rangeStartTime) * videoStream->r_frame_rate.num / videoStream->r_frame_rate.den / frameCountDivisor;
+		totalFrameCount = std::max((int64_t)0, (int64_t)(rangeFrameCount + 0.5));
 
-	totalDurationInSeconds = ((double)videoStream->time_base.num / videoStream->time_base.den) * videoStream->duration;
+		qDebug("Decoding the range %.3f - %.3f s (%lld frames)", rangeStartTime, rangeEndTime, (long long)totalFrameCount);
+	}
 
 	isInitialized = true;
 	isFinished = false;
 
-	if (settings->video.startTimeOffset > 0.0)
-		seekRelative(settings->video.startTimeOffset);
+	if (rangeStartTime > 0.0)
+		seekAccurate(rangeStartTime);
 
 	return true;
 }
@@ -223,16 +217,61 @@ VideoDecoder::~VideoDecoder()
 		frame = nullptr;
 	}
 
-	if (swsContextGrayscale != nullptr)
+	deleteConverters();
+
+	for (AVPacket*& audioPacket : audioPackets)
+		av_packet_free(&audioPacket);
+
+	audioPackets.clear();
+
+	for (AVFrame*& picture : convertedPictures)
+		av_frame_free(&picture);
+
+	for (AVFrame*& picture : convertedPicturesGrayscale)
+		av_frame_free(&picture);
+
+	convertedPictures.clear();
+	convertedPicturesGrayscale.clear();
+}
+
+bool VideoDecoder::createConverters(int frameSizeDivisor, int grayscaleFrameSizeDivisor)
+{
+	deleteConverters();
+
+	this->frameSizeDivisor = frameSizeDivisor;
+	this->grayscaleFrameSizeDivisor = grayscaleFrameSizeDivisor;
+
+	frameWidth = videoCodecContext->width / frameSizeDivisor;
+	frameHeight = videoCodecContext->height / frameSizeDivisor;
+
+	swsContext = sws_getContext(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt, frameWidth, frameHeight, AV_PIX_FMT_RGBA, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+	if (!swsContext)
 	{
-		sws_freeContext(swsContextGrayscale);
-		swsContextGrayscale = nullptr;
+		qWarning("Could not get sws context");
+		return false;
 	}
 
-	if (convertedPictureGrayscale != nullptr)
+	grayscaleFrameWidth = videoCodecContext->width / grayscaleFrameSizeDivisor;
+	grayscaleFrameHeight = videoCodecContext->height / grayscaleFrameSizeDivisor;
+
+	swsContextGrayscale = sws_getContext(videoCodecContext->width, videoCodecContext->height, videoCodecContext->pix_fmt, grayscaleFrameWidth, grayscaleFrameHeight, AV_PIX_FMT_GRAY8, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+	if (!swsContextGrayscale)
 	{
-		av_frame_free(&convertedPictureGrayscale);
-		convertedPictureGrayscale = nullptr;
+		qWarning("Could not get sws grayscale context");
+		return false;
+	}
+
+	return true;
+}
+
+void VideoDecoder::deleteConverters()
+{
+	if (swsContextGrayscale != nullptr)
+	{
+		sws_freeContext(swsContextGrayscale);
+		swsContextGrayscale = nullptr;
 	}
 
 	if (swsContext != nullptr)
@@ -240,15 +279,45 @@ VideoDecoder::~VideoDecoder()
 		sws_freeContext(swsContext);
 		swsContext = nullptr;
 	}
+}
+
+AVFrame* VideoDecoder::getConvertedPicture(std::vector<AVFrame*>& pictures, int pictureIndex, AVPixelFormat format, int width, int height)
+{
+	if ((size_t)pictureIndex >= pictures.size())
+		pictures.resize((size_t)pictureIndex + 1, nullptr);
+
+	AVFrame*& picture = pictures[(size_t)pictureIndex];
 
-	if (convertedPicture != nullptr)
+	// allocated on first use, and again after the decoding size has changed
+	if (picture != nullptr && (picture->width != width || picture->height != height))
+		av_frame_free(&picture);
+
+	if (picture == nullptr)
 	{
-		av_frame_free(&convertedPicture);
-		convertedPicture = nullptr;
+		picture = av_frame_alloc();
+
+		if (!picture)
+		{
+			qWarning("Could not allocate conversion frame");
+			return nullptr;
+		}
+
+		picture->format = format;
+		picture->width = width;
+		picture->height = height;
+
+		if (av_frame_get_buffer(picture, 0) < 0)
+		{
+			qWarning("Could not allocate conversion frame buffer");
+			av_frame_free(&picture);
+			return nullptr;
+		}
 	}
+
+	return picture;
 }
 
-bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGrayscale)
+bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGrayscale, int pictureIndex)
 {
 	QMutexLocker locker(&decoderMutex);
 
@@ -257,6 +326,33 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 
 	decodeDurationTimer.restart();
 
+	// only the conversion contexts change here, frames still waiting to be read keep their own pictures
+	if (requestedFrameSizeDivisor != frameSizeDivisor || requestedGrayscaleFrameSizeDivisor != grayscaleFrameSizeDivisor)
+	{
+		if (!createConverters(requestedFrameSizeDivisor, requestedGrayscaleFrameSizeDivisor))
+		{
+			isInitialized = false;
+			return false;
+		}
+
+		qDebug("Decoding at %dx%d (stabilizer %dx%d)", frameWidth, frameHeight, grayscaleFrameWidth, grayscaleFrameHeight);
+	}
+
+	// when playback has fallen behind (or is fast), frames that no other frame depends on are not decoded at all
+	// at the highest playback rates only the keyframes are decoded
+	AVDiscard requestedSkipFrame = AVDISCARD_DEFAULT;
+
+	if (requestedSkipNonKeyFrames != 0)
+		requestedSkipFrame = AVDISCARD_NONKEY;
+	else if (requestedSkipNonReferenceFrames != 0)
+		requestedSkipFrame = AVDISCARD_NONREF;
+
+	if (requestedSkipFrame != skipFrame)
+	{
+		skipFrame = requestedSkipFrame;
+		videoCodecContext->skip_frame = skipFrame;
+	}
+
 	int framesRead = 0;
 	int readResult = 0;
 
@@ -290,6 +386,29 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 					return false;
 				}
 
+				// decoding starts from the keyframe before the in-point, the frames up to it are only needed as references
+				if (skipUntilTimestamp >= 0)
+				{
+					if (frame->best_effort_timestamp < skipUntilTimestamp)
+					{
+						previousFrameTimestamp = frame->best_effort_timestamp;
+						av_packet_unref(&packet);
+						continue;
+					}
+
+					skipUntilTimestamp = -1;
+				}
+
+				// the out-point ends the video just like the end of the file
+				if (endTimestamp >= 0 && frame->best_effort_timestamp >= endTimestamp)
+				{
+					av_packet_unref(&packet);
+					decodeDuration = decodeDurationTimer.nsecsElapsed() / 1000000.0;
+					isFinished = true;
+
+					return false;
+				}
+
 				if (++framesRead < frameCountDivisor)
 				{
 					av_packet_unref(&packet);
@@ -299,6 +418,30 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 				framesRead = 0;
 				cumulativeFrameNumber++;
 
+				if (cumulativeFrameNumber == 1 && audioStream != nullptr)
+				{
+					QMutexLocker audioLocker(&audioMutex);
+					startTimestamp = av_rescale_q(frame->best_effort_timestamp, videoStream->time_base, audioStream->time_base);
+				}
+
+				double totalDurationInSeconds = ((double)videoStream->time_base.num / videoStream->time_base.den) * videoStream->duration;
+				double frameTimeInSeconds = ((double)frame->best_effort_timestamp / videoStream->duration) * totalDurationInSeconds;
+
+				AVFrame* convertedPicture = nullptr;
+				AVFrame* convertedPictureGrayscale = nullptr;
+
+				if (frameData != nullptr)
+					convertedPicture = getConvertedPicture(convertedPictures, pictureIndex, AV_PIX_FMT_RGBA, frameWidth, frameHeight);
+
+				if (frameDataGrayscale != nullptr)
+					convertedPictureGrayscale = getConvertedPicture(convertedPicturesGrayscale, pictureIndex, AV_PIX_FMT_GRAY8, grayscaleFrameWidth, grayscaleFrameHeight);
+
+				if ((frameData != nullptr && convertedPicture == nullptr) || (frameDataGrayscale != nullptr && convertedPictureGrayscale == nullptr))
+				{
+					av_packet_unref(&packet);
+					return false;
+				}
+
 				// We have a valid frame
 				if (frameData != nullptr)
 				{
@@ -311,6 +454,8 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 					frameData->height = frameHeight;
 					frameData->duration = av_rescale((frame->best_effort_timestamp - previousFrameTimestamp) * 1000000 / frameDurationDivisor, videoStream->time_base.num, videoStream->time_base.den);
 					frameData->timeStamp = frame->best_effort_timestamp;
+					frameData->presentationTime = av_rescale(frame->best_effort_timestamp * 1000000 / frameDurationDivisor, videoStream->time_base.num, videoStream->time_base.den);
+					frameData->time = frameTimeInSeconds;
 					frameData->cumulativeNumber = cumulativeFrameNumber;
 
 					if (frameData->duration <= 0 || frameData->duration > 1000000)
@@ -328,14 +473,15 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 					frameDataGrayscale->height = grayscaleFrameHeight;
 					frameDataGrayscale->duration = (int)av_rescale((frame->best_effort_timestamp - previousFrameTimestamp) * 1000000 / frameDurationDivisor, videoStream->time_base.num, videoStream->time_base.den);
 					frameDataGrayscale->timeStamp = frame->best_effort_timestamp;
+					frameDataGrayscale->presentationTime = av_rescale(frame->best_effort_timestamp * 1000000 / frameDurationDivisor, videoStream->time_base.num, videoStream->time_base.den);
+					frameDataGrayscale->time = frameTimeInSeconds;
 					frameDataGrayscale->cumulativeNumber = cumulativeFrameNumber;
 
 					if (frameDataGrayscale->duration <= 0 || frameDataGrayscale->duration > 1000000)
 						frameDataGrayscale->duration = frameDuration;
 				}
 
-				double totalDurationInSeconds = ((double)videoStream->time_base.num / videoStream->time_base.den) * videoStream->duration;
-				currentTimeInSeconds = ((double)frame->best_effort_timestamp / videoStream->duration) * totalDurationInSeconds;
+				currentTimeInSeconds = frameTimeInSeconds;
 				previousFrameTimestamp = frame->best_effort_timestamp;
 				decodeDuration = decodeDurationTimer.nsecsElapsed() / 1000000.0;
 				isFinished = false;
@@ -343,6 +489,19 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 				av_packet_unref(&packet);
 				return true;
 			}
+			else if (packet.stream_index == audioStreamIndex && isAudioPassthroughEnabled)
+			{
+				if (audioEndTimestamp < 0 || packet.pts == AV_NOPTS_VALUE || packet.pts < audioEndTimestamp)
+				{
+					AVPacket* audioPacket = av_packet_clone(&packet);
+
+					if (audioPacket != nullptr)
+					{
+						QMutexLocker audioLocker(&audioMutex);
+						audioPackets.push_back(audioPacket);
+					}
+				}
+			}
 
 			av_packet_unref(&packet);
 		}
@@ -359,6 +518,45 @@ bool VideoDecoder::getNextFrame(FrameData* frameData, FrameData* frameDataGraysc
 	}
 }
 
+void VideoDecoder::setAudioPassthrough(bool value)
+{
+	QMutexLocker locker(&decoderMutex);
+
+	isAudioPassthroughEnabled = value && (audioStream != nullptr);
+}
+
+// hands over the audio packets read so far, the caller frees them
+// the start timestamp maps them to the output timeline, and the packets are held back until the first video frame has given it
+bool VideoDecoder::takeAudioPackets(std::vector<AVPacket*>& packets, int64_t& startTimestamp)
+{
+	QMutexLocker locker(&audioMutex);
+
+	if (this->startTimestamp < 0)
+		return false;
+
+	packets.insert(packets.end(), audioPackets.begin(), audioPackets.end());
+	audioPackets.clear();
+	startTimestamp = this->startTimestamp;
+
+	return true;
+}
+
+void VideoDecoder::requestFrameSizeDivisors(int frameSizeDivisor, int grayscaleFrameSizeDivisor)
+{
+	requestedFrameSizeDivisor = std::max(1, frameSizeDivisor);
+	requestedGrayscaleFrameSizeDivisor = std::max(1, grayscaleFrameSizeDivisor);
+}
+
+void VideoDecoder::setSkipNonReferenceFrames(bool value)
+{
+	requestedSkipNonReferenceFrames = value ? 1 : 0;
+}
+
+void VideoDecoder::setSkipNonKeyFrames(bool value)
+{
+	requestedSkipNonKeyFrames = value ? 1 : 0;
+}
+
 void VideoDecoder::seekRelative(double seconds)
 {
 	QMutexLocker locker(&decoderMutex);
@@ -366,6 +564,8 @@ void VideoDecoder::seekRelative(double seconds)
 	if (!isInitialized)
 		return;
 
+	skipUntilTimestamp = -1;
+
 	int64_t targetTimeStamp = previousFrameTimestamp + (int64_t)(((double)videoStream->time_base.den / videoStream->time_base.num) * seconds + 0.5);
 	targetTimeStamp = std::max((int64_t)0, std::min(targetTimeStamp, videoStream->duration));
 
@@ -429,6 +629,22 @@ void VideoDecoder::seekRelative(double seconds)
 		qWarning("Could not seek video");
 }
 
+void VideoDecoder::seekAccurate(double seconds)
+{
+	int64_t targetTimestamp = (int64_t)(((double)videoStream->time_base.den / videoStream->time_base.num) * seconds + 0.5);
+	targetTimestamp = std::max((int64_t)0, std::min(targetTimestamp, videoStream->duration));
+
+	// unlike the interactive seeks, the frames between the keyframe and the target are decoded and dropped by getNextFrame
+	if (avformat_seek_file(formatContext, (int)videoStreamIndex, 0, targetTimestamp, targetTimestamp, 0) >= 0)
+	{
+		avcodec_flush_buffers(videoCodecContext);
+		skipUntilTimestamp = targetTimestamp;
+		previousFrameTimestamp = targetTimestamp;
+	}
+	else
+		qWarning("Could not seek video");
+}
+
 bool VideoDecoder::getIsFinished()
 {
 	QMutexLocker locker(&decoderMutex);
@@ -491,3 +707,13 @@ double VideoDecoder::getTotalDuration() const
 {
 	return totalDurationInSeconds;
 }
+
+AVStream* VideoDecoder::getAudioStream() const
+{
+	return audioStream;
+}
+
+int VideoDecoder::getFrameDurationDivisor() const
+{
+	return frameDurationDivisor;
+}
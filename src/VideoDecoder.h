@@ -3,7 +3,10 @@
 
 #pragma once
 
+#include <vector>
+
 #include <QMutex>
+#include <QAtomicInt>
 #include <QElapsedTimer>
 #include <QPicture>
 
@@ -29,8 +32,13 @@ namespace OrientView
 		bool initialize(Settings* settings);
 		~VideoDecoder();
 
-		bool getNextFrame(FrameData* frameData, FrameData* frameDataGrayscale);
+		bool getNextFrame(FrameData* frameData, FrameData* frameDataGrayscale, int pictureIndex = 0);
+		void setAudioPassthrough(bool value);
+		bool takeAudioPackets(std::vector<AVPacket*>& packets, int64_t& startTimestamp);
 		void seekRelative(double seconds);
+		void requestFrameSizeDivisors(int frameSizeDivisor, int grayscaleFrameSizeDivisor);
+		void setSkipNonReferenceFrames(bool value);
+		void setSkipNonKeyFrames(bool value);
 
 		bool getIsFinished();
 		double getCurrentTime();
@@ -44,9 +52,16 @@ namespace OrientView
 		int64_t getFrameRateDen() const;
 		double getFrameDuration() const;
 		double getTotalDuration() const;
+		AVStream* getAudioStream() const;
+		int getFrameDurationDivisor() const;
 
 	private:
 
+		void seekAccurate(double seconds);
+		bool createConverters(int frameSizeDivisor, int grayscaleFrameSizeDivisor);
+		void deleteConverters();
+		AVFrame* getConvertedPicture(std::vector<AVFrame*>& pictures, int pictureIndex, AVPixelFormat format, int width, int height);
+
 		QMutex decoderMutex;
 
 		AVFormatContext* formatContext = nullptr;
@@ -58,13 +73,24 @@ namespace OrientView
 
 		SwsContext* swsContext = nullptr;
 		SwsContext* swsContextGrayscale = nullptr;
- 		AVFrame* convertedPicture = nullptr;
- 		AVFrame* convertedPictureGrayscale = nullptr;
+
+		// one picture per queued frame, a picture is only written when the frame that used it has been read
+		std::vector<AVFrame*> convertedPictures;
+		std::vector<AVFrame*> convertedPicturesGrayscale;
 
 		int frameWidth = 0;
 		int frameHeight = 0;
 		int grayscaleFrameWidth = 0;
 		int grayscaleFrameHeight = 0;
+		int frameSizeDivisor = 1;
+		int grayscaleFrameSizeDivisor = 1;
+
+		// set from the rendering thread, taken into use before the next frame is decoded
+		QAtomicInt requestedFrameSizeDivisor;
+		QAtomicInt requestedGrayscaleFrameSizeDivisor;
+		QAtomicInt requestedSkipNonReferenceFrames;
+		QAtomicInt requestedSkipNonKeyFrames;
+		AVDiscard skipFrame = AVDISCARD_DEFAULT;
 
 		int frameCountDivisor = 0;
 		int frameDurationDivisor = 0;
@@ -76,6 +102,8 @@ namespace OrientView
 		int64_t frameRateDen = 0; // no unit
 		int64_t frameDuration = 0.0; // microseconds
 		int64_t previousFrameTimestamp = 0; // video stream time base units
+		int64_t skipUntilTimestamp = -1; // video stream time base units, frames before the in-point are decoded but not returned
+		int64_t endTimestamp = -1; // video stream time base units, the out-point
 
 		double currentTimeInSeconds = 0.0;
 		double totalDurationInSeconds = 0.0;
@@ -86,5 +114,14 @@ namespace OrientView
 
 		QElapsedTimer decodeDurationTimer;
 		double decodeDuration = 0.0;
+
+		// the audio packets are passed through as they are, they are only collected when the encoder asks for them
+		QMutex audioMutex;
+		AVStream* audioStream = nullptr;
+		int audioStreamIndex = -1;
+		bool isAudioPassthroughEnabled = false;
+		std::vector<AVPacket*> audioPackets;
+		int64_t audioEndTimestamp = -1; // audio stream time base units, the out-point
+		int64_t startTimestamp = -1; // audio stream time base units, the time of the first returned video frame
 	};
 }
@@ -1,68 +1,195 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <algorithm>
+
 #include "VideoDecoderThread.h"
 #include "VideoDecoder.h"
+#include "Settings.h"
+#include "PipelineTracer.h"
 
 using namespace OrientView;
 
-void VideoDecoderThread::initialize(VideoDecoder* videoDecoder)
+void VideoDecoderThread::initialize(VideoDecoder* videoDecoder, Settings* settings)
 {
 	this->videoDecoder = videoDecoder;
 
-	frameReadSemaphore = new QSemaphore();
-	frameAvailableSemaphore = new QSemaphore();
-	decodedFrameData = FrameData();
-	decodedFrameDataGrayscale = FrameData();
-}
+	frameQueue.initialize(settings->video.frameQueueDepth);
+	pictureCount = frameQueue.getCapacity() + std::max(1, settings->stabilizer.frameQueueDepth);
+	nextPictureIndex = 0;
+	isEndOfStreamSent = false;
 
-VideoDecoderThread::~VideoDecoderThread()
-{
-	if (frameAvailableSemaphore != nullptr)
-	{
-		delete frameAvailableSemaphore;
-		frameAvailableSemaphore = nullptr;
-	}
-
-	if (frameReadSemaphore != nullptr)
-	{
-		delete frameReadSemaphore;
-		frameReadSemaphore = nullptr;
-	}
+	seekLatencyTimer.start();
 }
 
 void VideoDecoderThread::run()
 {
-	frameReadSemaphore->release(1);
+	PipelineTracer::setThreadName("Decoder");
 
 	while (!isInterruptionRequested())
 	{
-		while (!frameReadSemaphore->tryAcquire(1, 100) && !isInterruptionRequested()) {}
+		if (!frameQueue.waitForFreeSlot(100))
+			continue;
+
+		double seekAmount = 0.0;
+		int generation = 0;
+		qint64 requestTime = -1;
+
+		if (takePendingSeek(seekAmount, generation, requestTime))
+		{
+			TraceScope traceScope("seek");
+			videoDecoder->seekRelative(seekAmount);
+			performedSeekCount++;
+			isEndOfStreamSent = false;
+		}
+
+		DecodedFrame& decodedFrame = frameQueue.back();
+		bool gotFrame = false;
 
-		if (isInterruptionRequested())
-			break;
+		{
+			TraceScope traceScope("decode");
+			gotFrame = videoDecoder->getNextFrame(&decodedFrame.frameData, &decodedFrame.frameDataGrayscale, nextPictureIndex);
+		}
 
-		if (videoDecoder->getNextFrame(&decodedFrameData, &decodedFrameDataGrayscale))
-			frameAvailableSemaphore->release(1);
+		if (gotFrame)
+		{
+			nextPictureIndex = (nextPictureIndex + 1) % pictureCount;
+			decodedFrame.frameData.isEndOfStream = false;
+			decodedFrame.generation = generation;
+			decodedFrame.seekRequestTime = requestTime;
+			frameQueue.push();
+			isEndOfStreamSent = false;
+		}
 		else
-			QThread::msleep(100);
+		{
+			// the marker goes through every stage after the frames still queued, so the encoder knows when it has seen all of them
+			if (!isEndOfStreamSent && videoDecoder->getIsFinished())
+			{
+				decodedFrame.frameData = FrameData();
+				decodedFrame.frameData.isEndOfStream = true;
+				decodedFrame.frameDataGrayscale = FrameData();
+				decodedFrame.generation = generation;
+				decodedFrame.seekRequestTime = -1;
+				frameQueue.push();
+				isEndOfStreamSent = true;
+			}
+
+			// at the end of the video the slot stays free, so that seeking backwards works again
+			for (int i = 0; i < 10 && !getHasPendingSeek() && !isInterruptionRequested(); ++i)
+				QThread::msleep(10);
+		}
 	}
 }
 
-bool VideoDecoderThread::tryGetNextFrame(FrameData& frameData, FrameData& frameDataGrayscale, int timeout)
+bool VideoDecoderThread::tryGetNextFrame(FrameData& frameData, FrameData& frameDataGrayscale, int timeout, int* generation)
 {
-	if (frameAvailableSemaphore->tryAcquire(1, timeout))
+	if (!frameQueue.waitForItem(timeout))
+		return false;
+
+	int currentGeneration = getSeekGeneration();
+
+	// decoded before the latest seek, the previous frame stays on the screen until the right one arrives
+	while (frameQueue.front().generation != currentGeneration)
 	{
-		frameData = decodedFrameData;
-		frameDataGrayscale = decodedFrameDataGrayscale;
+		discardedFrameCount++;
+		frameQueue.pop();
 
-		return true;
+		if (!frameQueue.waitForItem(0))
+			return false;
 	}
-	else
-		return false;
+
+	DecodedFrame& decodedFrame = frameQueue.front();
+
+	frameData = decodedFrame.frameData;
+	frameDataGrayscale = decodedFrame.frameDataGrayscale;
+
+	if (generation != nullptr)
+		*generation = decodedFrame.generation;
+
+	if (decodedFrame.seekRequestTime >= 0)
+		presentedSeekRequestTime = decodedFrame.seekRequestTime;
+
+	return true;
 }
 
 void VideoDecoderThread::signalFrameRead()
 {
-	frameReadSemaphore->release(1);
+	frameQueue.pop();
+}
+
+void VideoDecoderThread::requestSeek(double seconds)
+{
+	QMutexLocker locker(&seekMutex);
+
+	if (!hasPendingSeek)
+		seekRequestTime = seekLatencyTimer.nsecsElapsed();
+
+	pendingSeekAmount += seconds;
+	hasPendingSeek = true;
+	seekGeneration++;
+	requestedSeekCount++;
+}
+
+void VideoDecoderThread::framePresented()
+{
+	// set by whichever stage reads the frames from the decoder
+	qint64 requestTime = presentedSeekRequestTime.exchange(-1);
+
+	if (requestTime < 0)
+		return;
+
+	double seekLatency = (seekLatencyTimer.nsecsElapsed() - requestTime) / 1000000.0;
+
+	measuredSeekCount++;
+	totalSeekLatency += seekLatency;
+	maximumSeekLatency = std::max(maximumSeekLatency, seekLatency);
+
+	qDebug("Seek latency %.2f ms", seekLatency);
+}
+
+void VideoDecoderThread::logStatistics()
+{
+	frameQueue.logStatistics("Decoded frame");
+
+	QMutexLocker locker(&seekMutex);
+
+	if (requestedSeekCount == 0)
+		return;
+
+	qDebug("Seeks: %d requested, %d performed, %d discarded frames, latency %.2f ms average, %.2f ms maximum",
+		requestedSeekCount,
+		performedSeekCount,
+		discardedFrameCount,
+		(measuredSeekCount > 0) ? totalSeekLatency / measuredSeekCount : 0.0,
+		maximumSeekLatency);
+}
+
+bool VideoDecoderThread::getHasPendingSeek()
+{
+	QMutexLocker locker(&seekMutex);
+	return hasPendingSeek;
+}
+
+bool VideoDecoderThread::takePendingSeek(double& seconds, int& generation, qint64& requestTime)
+{
+	QMutexLocker locker(&seekMutex);
+
+	generation = seekGeneration;
+
+	if (!hasPendingSeek)
+		return false;
+
+	seconds = pendingSeekAmount;
+	requestTime = seekRequestTime;
+	pendingSeekAmount = 0.0;
+	hasPendingSeek = false;
+	seekRequestTime = -1;
+
+	return true;
+}
+
+int VideoDecoderThread::getSeekGeneration()
+{
+	QMutexLocker locker(&seekMutex);
+	return seekGeneration;
 }
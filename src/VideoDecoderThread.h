@@ -3,14 +3,19 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <QThread>
-#include <QSemaphore>
+#include <QMutex>
+#include <QElapsedTimer>
 
 #include "FrameData.h"
+#include "SpscQueue.h"
 
 namespace OrientView
 {
 	class VideoDecoder;
+	class Settings;
 
 	// Run video decoder on a thread.
 	class VideoDecoderThread : public QThread
@@ -19,11 +24,15 @@ namespace OrientView
 
 	public:
 
-		void initialize(VideoDecoder* videoDecoder);
-		~VideoDecoderThread();
+		void initialize(VideoDecoder* videoDecoder, Settings* settings);
 
-		bool tryGetNextFrame(FrameData& frameData, FrameData& frameDataGrayscale, int timeout);
+		bool tryGetNextFrame(FrameData& frameData, FrameData& frameDataGrayscale, int timeout, int* generation = nullptr);
 		void signalFrameRead();
+		void requestSeek(double seconds);
+		int getSeekGeneration();
+		void framePresented();
+
+		void logStatistics();
 
 	protected:
 
@@ -31,12 +40,41 @@ namespace OrientView
 
 	private:
 
+		struct DecodedFrame
+		{
+			FrameData frameData;
+			FrameData frameDataGrayscale;
+			int generation = 0;
+			qint64 seekRequestTime = -1;
+		};
+
+		bool getHasPendingSeek();
+		bool takePendingSeek(double& seconds, int& generation, qint64& requestTime);
+
 		VideoDecoder* videoDecoder = nullptr;
 
-		QSemaphore* frameReadSemaphore = nullptr;
-		QSemaphore* frameAvailableSemaphore = nullptr;
+		// the frames stay in the queue until they have been read, each uses its own decoder picture
+		// the stabilizer stage passes the color pictures on without copying, so there are enough pictures for its queue too
+		SpscQueue<DecodedFrame> frameQueue;
+		int pictureCount = 0;
+		int nextPictureIndex = 0;
+		bool isEndOfStreamSent = false;
+
+		// seeks requested while the previous one is still pending are added together
+		QMutex seekMutex;
+		double pendingSeekAmount = 0.0;
+		bool hasPendingSeek = false;
+		int seekGeneration = 0;
+		qint64 seekRequestTime = -1; // nanoseconds
 
-		FrameData decodedFrameData;
-		FrameData decodedFrameDataGrayscale;
+		// from the first key press of a seek to the swap of the first frame after it
+		QElapsedTimer seekLatencyTimer;
+		std::atomic<qint64> presentedSeekRequestTime{ -1 };
+		int requestedSeekCount = 0;
+		int performedSeekCount = 0;
+		int discardedFrameCount = 0;
+		int measuredSeekCount = 0;
+		double totalSeekLatency = 0.0;
+		double maximumSeekLatency = 0.0;
 	};
 }
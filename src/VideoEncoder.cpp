@@ -1,163 +1,397 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <QRunnable>
+
 #include "VideoEncoder.h"
 #include "VideoDecoder.h"
 #include "Settings.h"
 #include "FrameData.h"
-#include "Mp4File.h"
+#include "EncoderBackend.h"
+#include "EncodeCache.h"
 
 using namespace OrientView;
 
+namespace
+{
+	class EncoderTask : public QRunnable
+	{
+
+	public:
+
+		explicit EncoderTask(const std::function<void()>& function) : function(function) {}
+		void run() { function(); }
+
+	private:
+
+		std::function<void()> function;
+	};
+}
+
 bool VideoEncoder::initialize(VideoDecoder* videoDecoder, Settings* settings)
 {
 	qDebug("Initializing video encoder (%s)", qPrintable(settings->encoder.outputVideoFilePath));
 
-	x264_param_t param;
+	backendName = settings->encoder.backend;
+	backend = EncoderBackend::create(backendName);
 
-	if (x264_param_default_preset(&param, qPrintable(settings->encoder.preset), "zerolatency") < 0)
-	{
-		qWarning("Could not apply presets");
+	if (backend == nullptr)
 		return false;
+
+	if (settings->encoder.enableCache)
+	{
+		// the info panel shows the route offsets, which are left out of the cache hashes
+		if (settings->renderer.showInfoPanel)
+			qWarning("Encode cache is not used when the info panel is shown");
+		else if (backendName != "x264")
+			qWarning("Encode cache is not used with the %s backend, it copies from MP4 files written by x264", qPrintable(backendName));
+		else
+		{
+			encodeCache = new EncodeCache();
+
+			if (!encodeCache->initialize(settings))
+				return false;
+		}
 	}
 
-	param.i_width = settings->window.width;
-	param.i_height = settings->window.height;
-	param.i_fps_num = videoDecoder->getFrameRateNum();
-	param.i_fps_den = videoDecoder->getFrameRateDen();
-	param.i_timebase_num = param.i_fps_den;
-	param.i_timebase_den = param.i_fps_num;
-	param.i_csp = X264_CSP_I420;
-	param.rc.i_rc_method = X264_RC_CRF;
-	param.rc.f_rf_constant = settings->encoder.constantRateFactor;
-	param.i_log_level = X264_LOG_NONE;
+	if (!backend->initialize(videoDecoder, settings, (encodeCache != nullptr) ? encodeCache->getGopLength() : 0))
+		return false;
 
-	x264_param_apply_fastfirstpass(&param);
+	for (AVFrame*& convertedPicture : convertedPictures)
+	{
+		convertedPicture = av_frame_alloc();
+
+		if (convertedPicture == nullptr)
+		{
+			qWarning("Could not allocate encoder picture");
+			return false;
+		}
+
+		convertedPicture->format = AV_PIX_FMT_YUV420P;
+		convertedPicture->width = settings->window.width;
+		convertedPicture->height = settings->window.height;
+
+		if (av_frame_get_buffer(convertedPicture, 0) < 0)
+		{
+			qWarning("Could not allocate encoder picture buffer");
+			return false;
+		}
+	}
 
-	if (x264_param_apply_profile(&param, qPrintable(settings->encoder.profile)) < 0)
+	if (settings->encoder.useSwscale)
 	{
-		qWarning("Could not apply profile");
-		return false;
+		swsContext = sws_getContext(settings->window.width, settings->window.height, AV_PIX_FMT_RGBA, settings->window.width, settings->window.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+		if (!swsContext)
+		{
+			qWarning("Could not get sws context");
+			return false;
+		}
 	}
 
-	// these need to set to zero for MP4 files
-	param.b_annexb = 0;
-	param.b_repeat_headers = 0;
+	int conversionThreadCount = settings->encoder.conversionThreadCount;
 
-	encoder = x264_encoder_open(&param);
+	if (conversionThreadCount <= 0)
+		conversionThreadCount = settings->encoder.threadCount;
 
-	if (!encoder)
-	{
-		qWarning("Could not open encoder");
+	// the encoder thread converts one band itself
+	yuvConverter.initialize(conversionThreadCount);
+	encodeThreadPool.setMaxThreadCount(1);
+
+	// the encode goes on without sound if the audio can't be passed through
+	this->videoDecoder = videoDecoder;
+
+	if (settings->encoder.enableAudio)
+		hasAudio = initializeAudio(videoDecoder);
+
+	if (!backend->writeHeaders())
 		return false;
-	}
 
-	x264_encoder_parameters(encoder, &param);
+	return true;
+}
 
-	convertedPicture = new x264_picture_t();
+VideoEncoder::~VideoEncoder()
+{
+	encodeThreadPool.waitForDone();
 
-	if (x264_picture_alloc(convertedPicture, X264_CSP_I420, settings->window.width, settings->window.height) < 0)
+	if (backend != nullptr)
 	{
-		qWarning("Could not allocate encoder picture");
-		return false;
+		delete backend;
+		backend = nullptr;
 	}
 
-	swsContext = sws_getContext(settings->window.width, settings->window.height, AV_PIX_FMT_RGBA, settings->window.width, settings->window.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+	if (encodeCache != nullptr)
+	{
+		delete encodeCache;
+		encodeCache = nullptr;
+	}
 
-	if (!swsContext)
+	if (swsContext != nullptr)
 	{
-		qWarning("Could not get sws context");
-		return false;
+		sws_freeContext(swsContext);
+		swsContext = nullptr;
 	}
 
-	mp4File = new Mp4File();
+	for (AVFrame*& convertedPicture : convertedPictures)
+		av_frame_free(&convertedPicture);
+}
 
-	if (!mp4File->open(settings->encoder.outputVideoFilePath))
-		return false;
+void VideoEncoder::readFrameData(const FrameData& frameData)
+{
+	if (!encodeTimer.isValid())
+		encodeTimer.start();
 
-	if (!mp4File->setParameters(&param))
-		return false;
+	encodeDurationTimer.restart();
 
-	x264_nal_t* nal;
-	int nalCount;
+	// the other picture may still be in the backend, and an encoder that kept a reference to this one gets to keep its buffer
+	AVFrame* convertedPicture = convertedPictures[pictureIndex];
 
-	if (x264_encoder_headers(encoder, &nal, &nalCount) < 0)
+	if (av_frame_make_writable(convertedPicture) < 0)
 	{
-		qWarning("Could not get encoder headers");
-		return false;
+		qWarning("Could not make encoder picture writable");
+		setFailed();
 	}
 
-	if (!mp4File->writeHeaders(nal))
-		return false;
+	if (swsContext != nullptr)
+		sws_scale(swsContext, &frameData.data, (int*)(&frameData.rowLength), 0, frameData.height, convertedPicture->data, convertedPicture->linesize);
+	else
+		yuvConverter.convert(frameData, convertedPicture);
 
-	return true;
+	conversionDurationSum += encodeDurationTimer.nsecsElapsed() / 1000000.0;
+	conversionCount++;
 }
 
-VideoEncoder::~VideoEncoder()
+// returns the size of the previous frame, this one is still being encoded
+int VideoEncoder::encodeFrame()
+{
+	int frameSize = waitForEncode();
+
+	AVFrame* convertedPicture = convertedPictures[pictureIndex];
+	pictureIndex = 1 - pictureIndex;
+
+	int64_t pts = frameNumber++;
+	bool forceKeyframe = (encodeCache != nullptr && (pts % encodeCache->getGopLength() == 0 || isPreviousFrameCopied));
+
+	isPreviousFrameCopied = false;
+
+	double conversionDuration = encodeDurationTimer.nsecsElapsed() / 1000000.0;
+	encodeThreadPool.start(new EncoderTask([=]() { encodePicture(convertedPicture, pts, forceKeyframe, conversionDuration); }));
+
+	return frameSize;
+}
+
+int VideoEncoder::copyFrame()
 {
-	if (mp4File != nullptr)
+	if (!encodeTimer.isValid())
+		encodeTimer.start();
+
+	encodeDurationTimer.restart();
+
+	// the samples have to go to the file in order
+	int previousFrameSize = waitForEncode();
+	double previousStallDuration = backend->getWriteStallDuration();
+
+	writeAudioPackets();
+
+	QByteArray data;
+	bool isKeyframe = false;
+	int frameSize = 0;
+
+	if (encodeCache != nullptr && encodeCache->readPreviousFrame(frameNumber, data, isKeyframe) && backend->writeCopiedFrame((const uint8_t*)data.constData(), (size_t)data.size(), frameNumber, isKeyframe))
+		frameSize = data.size();
+	else
 	{
-		delete mp4File;
-		mp4File = nullptr;
+		qWarning("Could not copy frame");
+		setFailed();
 	}
 
-	if (swsContext != nullptr)
+	// x264 never saw this frame, so the next one it encodes can't refer back to its own previous frame
+	frameNumber++;
+	isPreviousFrameCopied = true;
+
+	QMutexLocker locker(&encoderMutex);
+
+	double stallDuration = backend->getWriteStallDuration() - previousStallDuration;
+	writeStallDuration += stallDuration;
+	encodeDuration = encodeDurationTimer.nsecsElapsed() / 1000000.0 - stallDuration;
+
+	return previousFrameSize + frameSize;
+}
+
+// returns false if any frame could not be encoded or written, or if the output could not be finished
+bool VideoEncoder::close(bool isComplete)
+{
+	waitForEncode();
+
+	// the frames still held back for the lookahead or the B-frames
+	if (backend->flush() < 0)
+		setFailed();
+
+	writeAudioPackets();
+
+	if (!backend->close(frameNumber))
+		setFailed();
+
+	bool isSuccessful = false;
+
 	{
-		sws_freeContext(swsContext);
-		swsContext = nullptr;
+		QMutexLocker locker(&encoderMutex);
+		isSuccessful = !isFailed;
 	}
 
-	if (convertedPicture != nullptr)
+	// a file with missing frames is no good for copying from either
+	if (encodeCache != nullptr)
+		encodeCache->close(isComplete && isSuccessful);
+
+	logStatistics();
+
+	if (!isSuccessful)
+		qWarning("Could not encode or write all of the output");
+
+	return isSuccessful;
+}
+
+double VideoEncoder::getEncodeDuration()
+{
+	QMutexLocker locker(&encoderMutex);
+
+	return encodeDuration;
+}
+
+// the time the encoder waited for the output, when the file system or the program reading it could not keep up
+double VideoEncoder::getWriteStallDuration()
+{
+	QMutexLocker locker(&encoderMutex);
+
+	return writeStallDuration;
+}
+
+EncodeCache* VideoEncoder::getEncodeCache() const
+{
+	return encodeCache;
+}
+
+bool VideoEncoder::initializeAudio(VideoDecoder* videoDecoder)
+{
+	AVStream* audioStream = videoDecoder->getAudioStream();
+
+	if (audioStream == nullptr)
 	{
-		x264_picture_clean(convertedPicture);
-		delete convertedPicture;
-		convertedPicture = nullptr;
+		qDebug("No audio in the input file");
+		return false;
 	}
 
-	if (encoder != nullptr)
+	// the packets keep their duration, so the audio would drift away from video that plays at another rate
+	if (videoDecoder->getFrameDurationDivisor() != 1)
 	{
-		x264_encoder_close(encoder);
-		encoder = nullptr;
+		qWarning("Could not pass through audio, the frame duration divisor changes the playback rate");
+		return false;
 	}
+
+	if (!backend->initializeAudio(audioStream))
+		return false;
+
+	videoDecoder->setAudioPassthrough(true);
+
+	qDebug("Passing through %s audio (%d Hz, %d channels)", avcodec_get_name(audioStream->codecpar->codec_id), audioStream->codecpar->sample_rate, audioStream->codecpar->ch_layout.nb_channels);
+
+	return true;
 }
 
-void VideoEncoder::readFrameData(const FrameData& frameData)
+void VideoEncoder::writeAudioPackets()
 {
-	encodeDurationTimer.restart();
+	if (!hasAudio)
+		return;
+
+	std::vector<AVPacket*> audioPackets;
+	int64_t startTimestamp = 0;
 
-	sws_scale(swsContext, &frameData.data, (int*)(&frameData.rowLength), 0, frameData.height, convertedPicture->img.plane, convertedPicture->img.i_stride);
+	if (!videoDecoder->takeAudioPackets(audioPackets, startTimestamp))
+		return;
+
+	for (AVPacket*& audioPacket : audioPackets)
+	{
+		int64_t timestamp = (audioPacket->pts != AV_NOPTS_VALUE) ? audioPacket->pts : audioPacket->dts;
+
+		// the output starts at the first video frame, the packets before it were read on the way to the in-point
+		if (timestamp != AV_NOPTS_VALUE && timestamp >= startTimestamp)
+		{
+			if (backend->writeAudioPacket(audioPacket, timestamp - startTimestamp))
+				audioPacketCount++;
+			else
+				setFailed();
+		}
+
+		av_packet_free(&audioPacket);
+	}
 }
 
-int VideoEncoder::encodeFrame()
+// runs on the encode thread pool, one frame at a time
+void VideoEncoder::encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe, double conversionDuration)
 {
-	x264_picture_t encodedPicture;
-	x264_nal_t* nal;
-	int nalCount;
+	QElapsedTimer backendTimer;
+	backendTimer.start();
 
-	convertedPicture->i_pts = frameNumber++;
+	double previousStallDuration = backend->getWriteStallDuration();
 
-	int frameSize = x264_encoder_encode(encoder, &nal, &nalCount, convertedPicture, &encodedPicture);
+	// the backends are only used from one thread at a time, so the audio goes in with the video
+	writeAudioPackets();
 
-	if (frameSize > 0)
-		mp4File->writeFrame(nal[0].p_payload, (size_t)frameSize, &encodedPicture);
-	else
-		qWarning("Could not encode frame");
+	// the backend may hold frames back and return them during later calls
+	int frameSize = backend->encodePicture(picture, pts, forceKeyframe);
+
+	if (frameSize < 0)
+		setFailed();
+
+	pendingFrameSize = std::max(0, frameSize);
 
 	QMutexLocker locker(&encoderMutex);
 
-	encodeDuration = encodeDurationTimer.nsecsElapsed() / 1000000.0;
+	double stallDuration = backend->getWriteStallDuration() - previousStallDuration;
+	writeStallDuration += stallDuration;
+	encodeDuration = conversionDuration + backendTimer.nsecsElapsed() / 1000000.0 - stallDuration;
+}
 
-	return frameSize;
+void VideoEncoder::setFailed()
+{
+	QMutexLocker locker(&encoderMutex);
+
+	isFailed = true;
 }
 
-void VideoEncoder::close()
+int VideoEncoder::waitForEncode()
 {
-	mp4File->close(frameNumber);
+	encodeThreadPool.waitForDone();
+
+	int frameSize = pendingFrameSize;
+	pendingFrameSize = 0;
+
+	return frameSize;
 }
 
-double VideoEncoder::getEncodeDuration()
+void VideoEncoder::logStatistics()
 {
-	QMutexLocker locker(&encoderMutex);
+	double elapsedSeconds = encodeTimer.isValid() ? encodeTimer.nsecsElapsed() / 1000000000.0 : 0.0;
+	double framesPerSecond = (elapsedSeconds > 0.0) ? frameNumber / elapsedSeconds : 0.0;
 
-	return encodeDuration;
+	qDebug("Encoder: %lld frames in %.1f s (%.2f fps), %s backend", (long long)frameNumber, elapsedSeconds, framesPerSecond, qPrintable(backendName));
+
+	backend->logStatistics();
+
+	if (conversionCount > 0)
+	{
+		if (swsContext != nullptr)
+			qDebug("Encoder: color conversion %.3f ms per frame (swscale)", conversionDurationSum / conversionCount);
+		else
+			qDebug("Encoder: color conversion %.3f ms per frame (%d bands)", conversionDurationSum / conversionCount, yuvConverter.getBandCount());
+	}
+
+	qDebug("Encoder: waited %.1f ms for the output, not counted in the encode time", writeStallDuration);
+
+	if (hasAudio)
+		qDebug("Encoder: passed through %lld audio packets", (long long)audioPacketCount);
 }
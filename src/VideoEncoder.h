@@ -5,12 +5,16 @@
 
 #include <QMutex>
 #include <QElapsedTimer>
+#include <QString>
+#include <QThreadPool>
+
+#include "YuvConverter.h"
 
 extern "C"
 {
 #include <stdint.h>
-#include "x264.h"
 #include "libswscale/swscale.h"
+#include "libavutil/frame.h"
 }
 
 namespace OrientView
@@ -18,9 +22,10 @@ namespace OrientView
 	class VideoDecoder;
 	class Settings;
 	struct FrameData;
-	class Mp4File;
+	class EncoderBackend;
+	class EncodeCache;
 
-	// Encapsulate the x264 library for encoding video frames.
+	// Encode the rendered frames with one of the encoder backends. The frame is converted to YUV in parallel bands, and the backend runs on its own thread while the next frame is converted. The audio of the input file is passed through.
 	class VideoEncoder
 	{
 
@@ -31,21 +36,46 @@ namespace OrientView
 
 		void readFrameData(const FrameData& frameData);
 		int encodeFrame();
-		void close();
+		int copyFrame();
+		bool close(bool isComplete);
 
 		double getEncodeDuration();
+		double getWriteStallDuration();
+		EncodeCache* getEncodeCache() const;
 
 	private:
 
+		bool initializeAudio(VideoDecoder* videoDecoder);
+		void writeAudioPackets();
+		void encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe, double conversionDuration);
+		void setFailed();
+		int waitForEncode();
+		void logStatistics();
+
 		QMutex encoderMutex;
 
-		x264_t* encoder = nullptr;
-		x264_picture_t* convertedPicture = nullptr;
+		EncoderBackend* backend = nullptr;
+		QString backendName;
+		AVFrame* convertedPictures[2] = { nullptr, nullptr }; // one is converted to while the other is encoded
+		int pictureIndex = 0;
 		SwsContext* swsContext = nullptr;
-		Mp4File* mp4File = nullptr;
+		YuvConverter yuvConverter;
+		QThreadPool encodeThreadPool;
+		int pendingFrameSize = 0;
+		VideoDecoder* videoDecoder = nullptr;
+		bool hasAudio = false;
+		int64_t audioPacketCount = 0;
+		EncodeCache* encodeCache = nullptr;
 		int64_t frameNumber = 0;
+		bool isPreviousFrameCopied = false;
+		bool isFailed = false; // stays set after any frame could not be encoded or written
 
 		QElapsedTimer encodeDurationTimer;
 		double encodeDuration = 0.0;
+		double writeStallDuration = 0.0; // not included in the encode duration
+
+		QElapsedTimer encodeTimer;
+		double conversionDurationSum = 0.0;
+		int64_t conversionCount = 0;
 	};
 }
@@ -6,6 +6,7 @@
 #include "VideoEncoder.h"
 #include "RenderOffScreenThread.h"
 #include "FrameData.h"
+#include "PipelineTracer.h"
 
 using namespace OrientView;
 
@@ -26,10 +27,25 @@ bool VideoEncoderThread::getIsPaused() const
 	return isPaused;
 }
 
+bool VideoEncoderThread::getIsStreamComplete() const
+{
+	return isStreamComplete;
+}
+
+bool VideoEncoderThread::getIsOutputWritten() const
+{
+	return isOutputWritten;
+}
+
 void VideoEncoderThread::run()
 {
 	FrameData renderedFrameData;
 
+	PipelineTracer::setThreadName("Encoder");
+
+	isStreamComplete = false;
+	isOutputWritten = false;
+
 	while (!isInterruptionRequested())
 	{
 		if (isPaused)
@@ -38,18 +54,44 @@ void VideoEncoderThread::run()
 			continue;
 		}
 
+		// the decoder can finish long before the frames queued in the later stages have come through, so only the marker ends the encoding
 		if (renderOffScreenThread->tryGetNextFrame(renderedFrameData, 100))
 		{
-			videoEncoder->readFrameData(renderedFrameData);
-			renderOffScreenThread->signalFrameRead();
-			int frameSize = videoEncoder->encodeFrame();
+			if (renderedFrameData.isEndOfStream)
+			{
+				renderOffScreenThread->signalFrameRead();
+				isStreamComplete = true;
+				break;
+			}
+
+			int frameSize = 0;
+
+			if (renderedFrameData.isReused)
+			{
+				TraceScope traceScope("copy");
+				renderOffScreenThread->signalFrameRead();
+				frameSize = videoEncoder->copyFrame();
+			}
+			else
+			{
+				{
+					TraceScope traceScope("convert");
+					videoEncoder->readFrameData(renderedFrameData);
+					renderOffScreenThread->signalFrameRead();
+				}
+
+				{
+					TraceScope traceScope("encode");
+					frameSize = videoEncoder->encodeFrame();
+				}
+			}
 
 			emit frameProcessed(renderedFrameData.cumulativeNumber, frameSize, videoDecoder->getCurrentTime());
 		}
-		else if (videoDecoder->getIsFinished())
-			break;
 	}
 
-	videoEncoder->close();
+	renderOffScreenThread->logStatistics();
+
+	isOutputWritten = videoEncoder->close(isStreamComplete);
 	emit encodingFinished();
 }
@@ -22,6 +22,8 @@ namespace OrientView
 
 		void togglePaused();
 		bool getIsPaused() const;
+		bool getIsStreamComplete() const;
+		bool getIsOutputWritten() const;
 
 	signals:
 
@@ -39,5 +41,7 @@ namespace OrientView
 		RenderOffScreenThread* renderOffScreenThread = nullptr;
 
 		bool isPaused = false;
+		bool isStreamComplete = false; // the end of stream marker has come through all the stages
+		bool isOutputWritten = false; // every frame was encoded and written, and the output was finished
 	};
 }
@@ -19,6 +19,7 @@ bool VideoStabilizer::initialize(Settings* settings, bool isPreprocessing)
 {
 	mode = settings->stabilizer.mode;
 	isEnabled = settings->stabilizer.enabled;
+	requestedIsEnabled = isEnabled ? 1 : 0;
 	cumulativeXAverage.setAlpha(settings->stabilizer.averagingFactor);
 	cumulativeYAverage.setAlpha(settings->stabilizer.averagingFactor);
 	cumulativeAngleAverage.setAlpha(settings->stabilizer.averagingFactor);
@@ -26,6 +27,10 @@ bool VideoStabilizer::initialize(Settings* settings, bool isPreprocessing)
 	maxDisplacementFactor = settings->stabilizer.maxDisplacementFactor;
 	maxAngle = settings->stabilizer.maxAngle;
 
+	// the thread count of OpenCV is global, but each batch job runs in its own process
+	if (settings->stabilizer.threadCount > 0)
+		cv::setNumThreads(settings->stabilizer.threadCount);
+
 	reset();
 
 	if (!isPreprocessing && mode == VideoStabilizerMode::Preprocessed)
@@ -48,6 +53,14 @@ void VideoStabilizer::preProcessFrame(const FrameData& frameDataGrayscale, QFile
 
 void VideoStabilizer::processFrame(const FrameData& frameDataGrayscale)
 {
+	bool shouldBeEnabled = (requestedIsEnabled != 0);
+
+	if (shouldBeEnabled != isEnabled)
+	{
+		isEnabled = shouldBeEnabled;
+		reset();
+	}
+
 	if (!isEnabled)
 		return;
 
@@ -83,7 +96,8 @@ FramePosition VideoStabilizer::calculateCumulativeFramePosition(const FrameData&
 {
 	cv::Mat currentImage(frameDataGrayscale.height, frameDataGrayscale.width, CV_8UC1, frameDataGrayscale.data);
 
-	if (isFirstImage)
+	// the decoder can change the frame size during playback, the motion is then tracked again from the new size
+	if (isFirstImage || previousImage.cols != frameDataGrayscale.width || previousImage.rows != frameDataGrayscale.height)
 	{
 		previousImage = cv::Mat(frameDataGrayscale.height, frameDataGrayscale.width, CV_8UC1);
 		currentImage.copyTo(previousImage);
@@ -275,8 +289,7 @@ bool VideoStabilizer::readNormalizedFramePositions(const QString& fileName)
 
 void VideoStabilizer::toggleEnabled()
 {
-	isEnabled = !isEnabled;
-	reset();
+	requestedIsEnabled = (requestedIsEnabled != 0) ? 0 : 1;
 }
 
 void VideoStabilizer::reset()
@@ -7,6 +7,7 @@
 
 #include <QFile>
 #include <QElapsedTimer>
+#include <QAtomicInt>
 
 #include "opencv2/opencv.hpp"
 
@@ -61,6 +62,9 @@ namespace OrientView
 		bool isFirstImage = true;
 		bool isEnabled = true;
 
+		// set from the input handler, taken into use before the next frame is processed
+		QAtomicInt requestedIsEnabled;
+
 		double dampingFactor = 0.0;
 		double maxDisplacementFactor = 0.0;
 		double maxAngle = 5.0;
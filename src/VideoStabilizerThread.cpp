@@ -1,11 +1,14 @@
 // Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
 // License: GPLv3, see the LICENSE file.
 
+#include <QElapsedTimer>
+
 #include "VideoStabilizerThread.h"
 #include "VideoDecoder.h"
 #include "VideoStabilizer.h"
 #include "Settings.h"
 #include "FrameData.h"
+#include "PipelineTracer.h"
 
 using namespace OrientView;
 
@@ -36,9 +39,20 @@ bool VideoStabilizerThread::getIsPaused() const
 	return isPaused;
 }
 
+const LatencyHistogram& VideoStabilizerThread::getLatencyHistogram(LatencyStage stage) const
+{
+	return latencyHistograms[stage];
+}
+
 void VideoStabilizerThread::run()
 {
 	FrameData frameDataGrayscale;
+	QElapsedTimer stageTimer;
+
+	PipelineTracer::setThreadName("Stabilizer");
+
+	for (LatencyHistogram& latencyHistogram : latencyHistograms)
+		latencyHistogram.reset();
 
 	while (!isInterruptionRequested())
 	{
@@ -48,9 +62,25 @@ void VideoStabilizerThread::run()
 			continue;
 		}
 
-		if (videoDecoder->getNextFrame(nullptr, &frameDataGrayscale))
+		bool gotFrame = false;
+
 		{
-			videoStabilizer->preProcessFrame(frameDataGrayscale, outputFile);
+			TraceScope traceScope("decode");
+			stageTimer.start();
+			gotFrame = videoDecoder->getNextFrame(nullptr, &frameDataGrayscale);
+		}
+
+		if (gotFrame)
+		{
+			latencyHistograms[DecodeLatency].record(stageTimer.nsecsElapsed() / 1000000.0);
+
+			{
+				TraceScope traceScope("stabilize");
+				stageTimer.start();
+				videoStabilizer->preProcessFrame(frameDataGrayscale, outputFile);
+				latencyHistograms[StabilizeLatency].record(stageTimer.nsecsElapsed() / 1000000.0);
+			}
+
 			emit frameProcessed(frameDataGrayscale.cumulativeNumber, videoDecoder->getCurrentTime());
 		}
 		else if (videoDecoder->getIsFinished())
@@ -60,5 +90,8 @@ void VideoStabilizerThread::run()
 	if (outputFile.isOpen())
 		outputFile.close();
 
+	qDebug("Latency decode: %s", qPrintable(latencyHistograms[DecodeLatency].getSummary()));
+	qDebug("Latency stabilize: %s", qPrintable(latencyHistograms[StabilizeLatency].getSummary()));
+
 	emit processingFinished();
 }
@@ -6,6 +6,8 @@
 #include <QThread>
 #include <QFile>
 
+#include "LatencyHistogram.h"
+
 namespace OrientView
 {
 	class VideoDecoder;
@@ -22,6 +24,7 @@ namespace OrientView
 
 		void togglePaused();
 		bool getIsPaused() const;
+		const LatencyHistogram& getLatencyHistogram(LatencyStage stage) const;
 
 	signals:
 
@@ -39,6 +42,9 @@ namespace OrientView
 
 		QFile outputFile;
 
+		// only the decode and stabilize stages are used
+		LatencyHistogram latencyHistograms[LatencyStageCount];
+
 		bool isPaused = false;
 	};
 }
@@ -103,6 +103,9 @@ bool VideoWindow::event(QEvent* event)
 		emit resizing(re->size().width(), re->size().height());
 	}
 
+	if (event->type() == QEvent::Expose && isExposed())
+		emit resizing(width(), height());
+
 	if (event->type() == QEvent::FocusIn)
 	{
 		emit resizing(width(), height());
@@ -0,0 +1,281 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+
+#include <QtGlobal>
+
+#include "X264Backend.h"
+#include "VideoDecoder.h"
+#include "Settings.h"
+#include "Mp4File.h"
+
+using namespace OrientView;
+
+X264Backend::~X264Backend()
+{
+	if (mp4File != nullptr)
+	{
+		delete mp4File;
+		mp4File = nullptr;
+	}
+
+	if (encoder != nullptr)
+	{
+		x264_encoder_close(encoder);
+		encoder = nullptr;
+	}
+}
+
+bool X264Backend::initialize(VideoDecoder* videoDecoder, Settings* settings, int cacheGopLength)
+{
+	x264_param_t param;
+
+	// the MP4 file is written out of order and its index is rewritten at the end, so it can't be streamed
+	if (settings->encoder.outputVideoFilePath == "-")
+	{
+		qWarning("Could not stream to the standard output with the x264 backend, use the libav or y4m backend instead");
+		return false;
+	}
+
+	tune = settings->encoder.tune;
+
+	// copied GOPs are spliced in as soon as they come up, so every frame has to leave x264 right after it went in
+	if (cacheGopLength > 0 && !tune.contains("zerolatency"))
+	{
+		qWarning("Encode cache needs the zerolatency tune, using it instead of \"%s\"", qPrintable(tune));
+		tune = "zerolatency";
+	}
+
+	if (x264_param_default_preset(&param, qPrintable(settings->encoder.preset), tune.isEmpty() ? nullptr : qPrintable(tune)) < 0)
+	{
+		qWarning("Could not apply presets");
+		return false;
+	}
+
+	param.i_width = settings->window.width;
+	param.i_height = settings->window.height;
+	param.i_fps_num = videoDecoder->getFrameRateNum();
+	param.i_fps_den = videoDecoder->getFrameRateDen();
+	param.i_timebase_num = param.i_fps_den;
+	param.i_timebase_den = param.i_fps_num;
+	param.i_csp = X264_CSP_I420;
+	param.rc.i_rc_method = X264_RC_CRF;
+	param.rc.f_rf_constant = settings->encoder.constantRateFactor;
+	param.i_log_level = X264_LOG_NONE;
+
+	if (settings->encoder.threadCount > 0)
+		param.i_threads = settings->encoder.threadCount;
+
+	enableQualityMetrics = settings->encoder.enableQualityMetrics;
+
+	if (enableQualityMetrics)
+	{
+		param.analyse.b_psnr = 1;
+		param.analyse.b_ssim = 1;
+	}
+
+	if (cacheGopLength > 0)
+	{
+		// every GOP starts with an IDR and has the same length, so any of them can be copied in place
+		param.i_keyint_max = cacheGopLength;
+		param.i_scenecut_threshold = 0;
+		param.b_open_gop = 0;
+		isForcingKeyframes = true;
+	}
+	else if (settings->encoder.fragmentDuration > 0.0)
+	{
+		// fragments can only start on a keyframe
+		int fragmentFrameCount = std::max(1, (int)(settings->encoder.fragmentDuration * param.i_fps_num / param.i_fps_den + 0.5));
+		param.i_keyint_max = std::min(param.i_keyint_max, fragmentFrameCount);
+	}
+
+	x264_param_apply_fastfirstpass(&param);
+
+	if (x264_param_apply_profile(&param, qPrintable(settings->encoder.profile)) < 0)
+	{
+		qWarning("Could not apply profile");
+		return false;
+	}
+
+	// these need to set to zero for MP4 files
+	param.b_annexb = 0;
+	param.b_repeat_headers = 0;
+
+	encoder = x264_encoder_open(&param);
+
+	if (!encoder)
+	{
+		qWarning("Could not open encoder");
+		return false;
+	}
+
+	x264_encoder_parameters(encoder, &param);
+
+	mp4File = new Mp4File();
+
+	if (!mp4File->open(settings->encoder.outputVideoFilePath, std::max(1, settings->encoder.writeBufferSize) * 1024 * 1024, settings->encoder.writeBufferCount))
+		return false;
+
+	if (!mp4File->setParameters(&param, settings->encoder.fragmentDuration))
+		return false;
+
+	return true;
+}
+
+// AAC only, l-smash needs to know the format of the samples
+bool X264Backend::initializeAudio(AVStream* audioStream)
+{
+	AVCodecParameters* codecParameters = audioStream->codecpar;
+
+	if (codecParameters->codec_id != AV_CODEC_ID_AAC || codecParameters->extradata == nullptr || codecParameters->extradata_size <= 0)
+	{
+		qWarning("Could not pass through %s audio, only AAC with a decoder configuration is supported", avcodec_get_name(codecParameters->codec_id));
+		return false;
+	}
+
+	int frameLength = (codecParameters->frame_size > 0) ? codecParameters->frame_size : 1024;
+
+	if (!mp4File->addAudioTrack(codecParameters->sample_rate, codecParameters->ch_layout.nb_channels, frameLength, codecParameters->extradata, (size_t)codecParameters->extradata_size))
+	{
+		qWarning("Could not add audio track");
+		return false;
+	}
+
+	audioTimeBase = audioStream->time_base;
+	audioSampleRate = codecParameters->sample_rate;
+
+	return true;
+}
+
+bool X264Backend::writeHeaders()
+{
+	x264_nal_t* nal;
+	int nalCount;
+
+	if (x264_encoder_headers(encoder, &nal, &nalCount) < 0)
+	{
+		qWarning("Could not get encoder headers");
+		return false;
+	}
+
+	return mp4File->writeHeaders(nal);
+}
+
+int X264Backend::encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe)
+{
+	// x264 copies the picture in, so it only points to the planes of the frame
+	x264_picture_t inputPicture;
+	x264_picture_init(&inputPicture);
+
+	inputPicture.img.i_csp = X264_CSP_I420;
+	inputPicture.img.i_plane = 3;
+	inputPicture.i_pts = pts;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		inputPicture.img.plane[i] = picture->data[i];
+		inputPicture.img.i_stride[i] = picture->linesize[i];
+	}
+
+	if (isForcingKeyframes)
+		inputPicture.i_type = forceKeyframe ? X264_TYPE_IDR : X264_TYPE_AUTO;
+
+	x264_picture_t encodedPicture;
+	x264_nal_t* nal;
+	int nalCount;
+
+	int frameSize = x264_encoder_encode(encoder, &nal, &nalCount, &inputPicture, &encodedPicture);
+
+	if (frameSize < 0)
+	{
+		qWarning("Could not encode frame");
+		return -1;
+	}
+
+	// without zerolatency x264 holds frames back for the lookahead and the B-frames, and returns them during later calls
+	if (frameSize > 0 && !writeEncodedFrame(nal, frameSize, &encodedPicture))
+		return -1;
+
+	return frameSize;
+}
+
+int X264Backend::flush()
+{
+	x264_picture_t encodedPicture;
+	x264_nal_t* nal;
+	int nalCount;
+	int totalSize = 0;
+
+	// drain the frames that are still waiting in the lookahead or for their B-frame decisions
+	while (x264_encoder_delayed_frames(encoder) > 0)
+	{
+		int frameSize = x264_encoder_encode(encoder, &nal, &nalCount, nullptr, &encodedPicture);
+
+		if (frameSize < 0)
+		{
+			qWarning("Could not flush encoder");
+			return -1;
+		}
+
+		if (frameSize > 0)
+		{
+			if (!writeEncodedFrame(nal, frameSize, &encodedPicture))
+				return -1;
+
+			totalSize += frameSize;
+		}
+	}
+
+	return totalSize;
+}
+
+bool X264Backend::writeCopiedFrame(const uint8_t* data, size_t size, int64_t pts, bool isKeyframe)
+{
+	return mp4File->writeCopiedFrame(data, size, pts, isKeyframe);
+}
+
+bool X264Backend::writeAudioPacket(AVPacket* packet, int64_t timestamp)
+{
+	int64_t dts = av_rescale_q(timestamp, audioTimeBase, AVRational { 1, audioSampleRate });
+
+	return mp4File->writeAudioSample(packet->data, (size_t)packet->size, dts);
+}
+
+bool X264Backend::close(int64_t frameCount)
+{
+	return mp4File->close(frameCount);
+}
+
+double X264Backend::getWriteStallDuration() const
+{
+	return (mp4File != nullptr) ? mp4File->getWriteStallDuration() : 0.0;
+}
+
+void X264Backend::logStatistics()
+{
+	qDebug("Encoder: x264, tune \"%s\"", qPrintable(tune));
+
+	if (enableQualityMetrics && encodedFrameCount > 0)
+		qDebug("Encoder: mean PSNR %.3f dB, mean SSIM %.5f over %lld frames", psnrSum / encodedFrameCount, ssimSum / encodedFrameCount, (long long)encodedFrameCount);
+}
+
+bool X264Backend::writeEncodedFrame(x264_nal_t* nal, int frameSize, x264_picture_t* encodedPicture)
+{
+	// the payloads of all the NAL units of a frame are back to back, so the first one covers the whole frame
+	if (!mp4File->writeFrame(nal[0].p_payload, (size_t)frameSize, encodedPicture))
+	{
+		qWarning("Could not write frame");
+		return false;
+	}
+
+	encodedFrameCount++;
+
+	if (enableQualityMetrics)
+	{
+		psnrSum += encodedPicture->prop.f_psnr_avg;
+		ssimSum += encodedPicture->prop.f_ssim;
+	}
+
+	return true;
+}
@@ -0,0 +1,59 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QString>
+
+extern "C"
+{
+#include <stdint.h>
+#include "x264.h"
+}
+
+#include "EncoderBackend.h"
+
+namespace OrientView
+{
+	class Mp4File;
+
+	// Encode H.264 with the x264 library and write it to an MP4 file with l-smash. The only backend that supports the encode cache and the fragmented MP4 files of its own.
+	class X264Backend : public EncoderBackend
+	{
+
+	public:
+
+		~X264Backend();
+
+		bool initialize(VideoDecoder* videoDecoder, Settings* settings, int cacheGopLength);
+		bool initializeAudio(AVStream* audioStream);
+		bool writeHeaders();
+
+		int encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe);
+		int flush();
+
+		bool writeCopiedFrame(const uint8_t* data, size_t size, int64_t pts, bool isKeyframe);
+		bool writeAudioPacket(AVPacket* packet, int64_t timestamp);
+		bool close(int64_t frameCount);
+
+		double getWriteStallDuration() const;
+		void logStatistics();
+
+	private:
+
+		bool writeEncodedFrame(x264_nal_t* nal, int frameSize, x264_picture_t* encodedPicture);
+
+		x264_t* encoder = nullptr;
+		Mp4File* mp4File = nullptr;
+		bool isForcingKeyframes = false;
+
+		AVRational audioTimeBase = { 1, 1 };
+		int audioSampleRate = 0;
+
+		QString tune;
+		bool enableQualityMetrics = false;
+		int64_t encodedFrameCount = 0;
+		double psnrSum = 0.0;
+		double ssimSum = 0.0;
+	};
+}
@@ -0,0 +1,140 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtGlobal>
+
+#include "Y4mBackend.h"
+#include "VideoDecoder.h"
+#include "Settings.h"
+
+using namespace OrientView;
+
+Y4mBackend::~Y4mBackend()
+{
+	if (file != nullptr && !isStandardOutput)
+		fclose(file);
+
+	file = nullptr;
+}
+
+bool Y4mBackend::initialize(VideoDecoder* videoDecoder, Settings* settings, int)
+{
+	width = settings->window.width;
+	height = settings->window.height;
+	frameRateNum = videoDecoder->getFrameRateNum();
+	frameRateDen = videoDecoder->getFrameRateDen();
+
+	QString outputFilePath = settings->encoder.outputVideoFilePath;
+
+	if (outputFilePath == "-")
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		file = stdout;
+		isStandardOutput = true;
+	}
+	else
+		file = fopen(QFile::encodeName(outputFilePath).constData(), "wb");
+
+	if (file == nullptr)
+	{
+		qWarning("Could not open output file %s", qPrintable(outputFilePath));
+		return false;
+	}
+
+	return true;
+}
+
+bool Y4mBackend::writeHeaders()
+{
+	// the chroma is the average of each 2x2 block, so it sits in the middle of them like in JPEG
+	if (fprintf(file, "YUV4MPEG2 W%d H%d F%lld:%lld Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, (long long)frameRateNum, (long long)frameRateDen) < 0)
+	{
+		qWarning("Could not write output header");
+		return false;
+	}
+
+	return true;
+}
+
+// the keyframes are up to the program that reads the stream
+int Y4mBackend::encodePicture(AVFrame* picture, int64_t, bool)
+{
+	// the frame is gathered into one block, so that it goes out with a single write instead of one per row
+	size_t frameSize = 6 + (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+	frameBuffer.resize(frameSize);
+
+	uint8_t* destination = frameBuffer.data();
+	memcpy(destination, "FRAME\n", 6);
+	destination += 6;
+
+	for (int plane = 0; plane < 3; ++plane)
+	{
+		int planeWidth = (plane == 0) ? width : (width + 1) / 2;
+		int planeHeight = (plane == 0) ? height : (height + 1) / 2;
+
+		for (int y = 0; y < planeHeight; ++y)
+		{
+			memcpy(destination, picture->data[plane] + y * picture->linesize[plane], (size_t)planeWidth);
+			destination += planeWidth;
+		}
+	}
+
+	QElapsedTimer writeTimer;
+	writeTimer.start();
+
+	bool isWritten = (fwrite(frameBuffer.data(), 1, frameSize, file) == frameSize);
+
+	writeDuration += writeTimer.nsecsElapsed() / 1000000.0;
+
+	if (!isWritten)
+	{
+		qWarning("Could not write frame");
+		return -1;
+	}
+
+	writtenFrameCount++;
+	writtenByteCount += (int64_t)frameSize;
+
+	return (int)frameSize;
+}
+
+int Y4mBackend::flush()
+{
+	return (fflush(file) == 0) ? 0 : -1;
+}
+
+bool Y4mBackend::close(int64_t)
+{
+	if (file == nullptr)
+		return false;
+
+	bool isSuccessful = isStandardOutput ? (fflush(file) == 0) : (fclose(file) == 0);
+
+	if (!isSuccessful)
+		qWarning("Could not write output file");
+
+	file = nullptr;
+
+	return isSuccessful;
+}
+
+double Y4mBackend::getWriteStallDuration() const
+{
+	return writeDuration;
+}
+
+void Y4mBackend::logStatistics()
+{
+	qDebug("Encoder: YUV4MPEG2 stream, %lld frames, %.1f MB, %.1f ms writing", (long long)writtenFrameCount, writtenByteCount / 1000000.0, writeDuration);
+}
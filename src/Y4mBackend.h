@@ -0,0 +1,47 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "EncoderBackend.h"
+
+namespace OrientView
+{
+	// Write the raw pictures as a YUV4MPEG2 stream, to a file or a named pipe, or to the standard output with "-", so that another program can encode them.
+	class Y4mBackend : public EncoderBackend
+	{
+
+	public:
+
+		~Y4mBackend();
+
+		bool initialize(VideoDecoder* videoDecoder, Settings* settings, int cacheGopLength);
+		bool writeHeaders();
+
+		int encodePicture(AVFrame* picture, int64_t pts, bool forceKeyframe);
+		int flush();
+		bool close(int64_t frameCount);
+
+		double getWriteStallDuration() const;
+		void logStatistics();
+
+	private:
+
+		FILE* file = nullptr;
+		bool isStandardOutput = false;
+		std::vector<uint8_t> frameBuffer;
+
+		int width = 0;
+		int height = 0;
+		int64_t frameRateNum = 0;
+		int64_t frameRateDen = 0;
+
+		int64_t writtenFrameCount = 0;
+		int64_t writtenByteCount = 0;
+		double writeDuration = 0.0; // milliseconds, mostly waiting for the reading program
+	};
+}
@@ -0,0 +1,113 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <functional>
+
+#include <QRunnable>
+#include <QThread>
+
+#include "YuvConverter.h"
+#include "FrameData.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const int MINIMUM_BAND_HEIGHT = 16;
+
+	class ConverterTask : public QRunnable
+	{
+
+	public:
+
+		explicit ConverterTask(const std::function<void()>& function) : function(function) {}
+		void run() { function(); }
+
+	private:
+
+		std::function<void()> function;
+	};
+
+	inline uint8_t getLuma(const uint8_t* pixel)
+	{
+		return (uint8_t)(((66 * pixel[0] + 129 * pixel[1] + 25 * pixel[2] + 128) >> 8) + 16);
+	}
+
+	// the chroma is the average of each 2x2 block, firstRow has to be even
+	void convertRows(const FrameData& frameData, AVFrame* picture, int firstRow, int lastRow)
+	{
+		int width = frameData.width;
+
+		for (int y = firstRow; y <= lastRow; y += 2)
+		{
+			// an odd last row is paired with itself
+			bool hasSecondRow = (y + 1 < frameData.height);
+
+			const uint8_t* sourceRow0 = frameData.data + y * frameData.rowLength;
+			const uint8_t* sourceRow1 = hasSecondRow ? sourceRow0 + frameData.rowLength : sourceRow0;
+			uint8_t* lumaRow0 = picture->data[0] + y * picture->linesize[0];
+			uint8_t* lumaRow1 = hasSecondRow ? lumaRow0 + picture->linesize[0] : lumaRow0;
+			uint8_t* chromaRowU = picture->data[1] + (y / 2) * picture->linesize[1];
+			uint8_t* chromaRowV = picture->data[2] + (y / 2) * picture->linesize[2];
+
+			for (int x = 0; x < width; x += 2)
+			{
+				// an odd last column is paired with itself
+				int x1 = (x + 1 < width) ? x + 1 : x;
+
+				const uint8_t* pixel00 = sourceRow0 + x * 4;
+				const uint8_t* pixel01 = sourceRow0 + x1 * 4;
+				const uint8_t* pixel10 = sourceRow1 + x * 4;
+				const uint8_t* pixel11 = sourceRow1 + x1 * 4;
+
+				lumaRow0[x] = getLuma(pixel00);
+				lumaRow0[x1] = getLuma(pixel01);
+				lumaRow1[x] = getLuma(pixel10);
+				lumaRow1[x1] = getLuma(pixel11);
+
+				int r = pixel00[0] + pixel01[0] + pixel10[0] + pixel11[0];
+				int g = pixel00[1] + pixel01[1] + pixel10[1] + pixel11[1];
+				int b = pixel00[2] + pixel01[2] + pixel10[2] + pixel11[2];
+
+				chromaRowU[x / 2] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+				chromaRowV[x / 2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+			}
+		}
+	}
+}
+
+void YuvConverter::initialize(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = QThread::idealThreadCount();
+
+	// the calling thread converts one band itself
+	bandCount = std::max(1, threadCount);
+	threadPool.setMaxThreadCount(std::max(1, bandCount - 1));
+}
+
+void YuvConverter::convert(const FrameData& frameData, AVFrame* picture)
+{
+	int usedBandCount = std::max(1, std::min(bandCount, frameData.height / MINIMUM_BAND_HEIGHT));
+
+	// the bands start on even rows, so that every chroma row belongs to one band only
+	int bandHeight = ((frameData.height + usedBandCount - 1) / usedBandCount + 1) & ~1;
+
+	for (int band = 1; band < usedBandCount; ++band)
+	{
+		int firstRow = band * bandHeight;
+		int lastRow = std::min(firstRow + bandHeight - 1, frameData.height - 1);
+
+		if (firstRow <= lastRow)
+			threadPool.start(new ConverterTask([=]() { convertRows(frameData, picture, firstRow, lastRow); }));
+	}
+
+	convertRows(frameData, picture, 0, std::min(bandHeight - 1, frameData.height - 1));
+	threadPool.waitForDone();
+}
+
+int YuvConverter::getBandCount() const
+{
+	return bandCount;
+}
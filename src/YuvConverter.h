@@ -0,0 +1,33 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#pragma once
+
+#include <QThreadPool>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+namespace OrientView
+{
+	struct FrameData;
+
+	// Convert the rendered RGBA frames to YUV 4:2:0 (BT.601 limited range, the same as swscale) in parallel bands of rows.
+	class YuvConverter
+	{
+
+	public:
+
+		void initialize(int threadCount);
+		void convert(const FrameData& frameData, AVFrame* picture);
+
+		int getBandCount() const;
+
+	private:
+
+		QThreadPool threadPool;
+		int bandCount = 1;
+	};
+}
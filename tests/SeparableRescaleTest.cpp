@@ -0,0 +1,490 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLTimerQuery>
+#include <QOpenGLVertexArrayObject>
+#include <QString>
+#include <QVector2D>
+
+#include "InterpolationFunctions.h"
+#include "OffscreenContext.h"
+#include "Settings.h"
+#include "ShaderLoader.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const int TARGET_WIDTH = 1920;
+	const int TARGET_HEIGHT = 1080;
+	const int TEXTURE_WIDTH = 1280;
+	const int TEXTURE_HEIGHT = 720;
+	const int PHASE_COUNT = 256; // same as RESAMPLE_PHASE_COUNT in the renderer
+	const int TIMED_DRAW_COUNT = 20;
+	const double PI = 3.14159265358979;
+
+	struct FunctionCase
+	{
+		const char* shaderDefines;
+		int maximumError; // largest difference of any color channel, in 8-bit steps
+		double meanError; // average difference over all the color channels
+	};
+
+	void PrintTo(const FunctionCase& functionCase, std::ostream* stream)
+	{
+		*stream << functionCase.shaderDefines;
+	}
+
+	// the passes store 8-bit intermediate images and the last step is hardware bilinear, so a couple of steps are expected
+	const FunctionCase FUNCTION_CASES[] =
+	{
+		{ "INTERPOLATION_FUNCTION=triangle", 4, 0.5 },
+		{ "INTERPOLATION_FUNCTION=bell", 4, 0.5 },
+		{ "INTERPOLATION_FUNCTION=bspline", 4, 0.5 },
+		{ "INTERPOLATION_FUNCTION=catmullrom", 4, 0.5 },
+		{ "INTERPOLATION_FUNCTION=lanczos", 4, 0.5 }
+	};
+
+	// a 720p video frame with smooth detail, so that any difference comes from the filters and not from where a hard edge happens to fall
+	QImage createPanelImage()
+	{
+		QImage image(TEXTURE_WIDTH, TEXTURE_HEIGHT, QImage::Format_RGBA8888);
+
+		for (int y = 0; y < TEXTURE_HEIGHT; ++y)
+		{
+			for (int x = 0; x < TEXTURE_WIDTH; ++x)
+			{
+				int red = (int)(128.0 + 100.0 * sin(x * 2.0 * PI / 48.0) * cos(y * 2.0 * PI / 40.0) + 0.5);
+				int green = (int)(128.0 + 100.0 * cos(y * 2.0 * PI / 40.0) + 0.5);
+				int blue = (x / 5 + y / 3) / 2;
+
+				image.setPixel(x, y, qRgba(red, green, blue, 255));
+			}
+		}
+
+		return image;
+	}
+
+	// slightly rotated and magnified like a stabilized video panel, and large enough to cover the whole target, so that no panel edge is compared
+	QMatrix4x4 createModelMatrix()
+	{
+		QMatrix4x4 modelMatrix;
+		modelMatrix.rotate(2.0f, 0.0f, 0.0f, 1.0f);
+		modelMatrix.scale(1.65f);
+
+		return modelMatrix;
+	}
+
+	QMatrix4x4 createProjectionMatrix()
+	{
+		QMatrix4x4 projectionMatrix;
+		projectionMatrix.ortho(-TARGET_WIDTH / 2, TARGET_WIDTH / 2, TARGET_HEIGHT / 2, -TARGET_HEIGHT / 2, 0.0f, 1.0f);
+
+		return projectionMatrix;
+	}
+
+	void createPanelTexture(QOpenGLTexture& texture, const QImage& image)
+	{
+		texture.create();
+		texture.bind();
+		texture.setData(image);
+		texture.setMinificationFilter(QOpenGLTexture::Linear);
+		texture.setMagnificationFilter(QOpenGLTexture::Linear);
+		texture.setWrapMode(QOpenGLTexture::ClampToEdge);
+		texture.release();
+	}
+
+	// the same panel quad as the renderer, in texels around the origin
+	void createPanelVertices(QOpenGLShaderProgram& program, QOpenGLBuffer& vertexBuffer, QOpenGLVertexArrayObject& vertexArrayObject)
+	{
+		// 1 2
+		// 4 3
+		GLfloat panelBuffer[] =
+		{
+			-(float)TEXTURE_WIDTH / 2, (float)TEXTURE_HEIGHT / 2, 0.0f, // 1
+			(float)TEXTURE_WIDTH / 2, (float)TEXTURE_HEIGHT / 2, 0.0f, // 2
+			(float)TEXTURE_WIDTH / 2, -(float)TEXTURE_HEIGHT / 2, 0.0f, // 3
+			-(float)TEXTURE_WIDTH / 2, -(float)TEXTURE_HEIGHT / 2, 0.0f, // 4
+
+			0.0f, 0.0f, // 1
+			1.0f, 0.0f, // 2
+			1.0f, 1.0f, // 3
+			0.0f, 1.0f  // 4
+		};
+
+		vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+		vertexBuffer.create();
+		vertexBuffer.bind();
+		vertexBuffer.allocate(panelBuffer, sizeof(GLfloat) * 20);
+
+		vertexArrayObject.create();
+		vertexArrayObject.bind();
+
+		program.enableAttributeArray("vertexPosition");
+		program.enableAttributeArray("vertexTextureCoordinate");
+		program.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3, 0);
+		program.setAttributeBuffer("vertexTextureCoordinate", GL_FLOAT, sizeof(GLfloat) * 12, 2, 0);
+
+		vertexArrayObject.release();
+		vertexBuffer.release();
+	}
+
+	// the same full screen quad as the renderer uses for the resample passes
+	void createQuadVertices(QOpenGLShaderProgram& program, QOpenGLBuffer& vertexBuffer, QOpenGLVertexArrayObject& vertexArrayObject)
+	{
+		// 1 2
+		// 4 3
+		GLfloat quadBuffer[] =
+		{
+			-1.0f, 1.0f, // 1
+			1.0f, 1.0f, // 2
+			1.0f, -1.0f, // 3
+			-1.0f, -1.0f, // 4
+
+			0.0f, 1.0f, // 1
+			1.0f, 1.0f, // 2
+			1.0f, 0.0f, // 3
+			0.0f, 0.0f  // 4
+		};
+
+		vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+		vertexBuffer.create();
+		vertexBuffer.bind();
+		vertexBuffer.allocate(quadBuffer, sizeof(GLfloat) * 16);
+
+		vertexArrayObject.create();
+		vertexArrayObject.bind();
+
+		program.enableAttributeArray("vertexPosition");
+		program.enableAttributeArray("vertexTextureCoordinate");
+		program.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 2, 0);
+		program.setAttributeBuffer("vertexTextureCoordinate", GL_FLOAT, sizeof(GLfloat) * 8, 2, 0);
+
+		vertexArrayObject.release();
+		vertexBuffer.release();
+	}
+
+	// milliseconds per draw, or a negative value if the driver has no timer queries
+	double measureGpuTime(const std::function<void()>& draw)
+	{
+		QOpenGLTimerQuery query;
+
+		if (!query.create())
+			return -1.0;
+
+		// one untimed draw, so that the first use of the shaders and the textures is not counted
+		draw();
+
+		query.begin();
+
+		for (int i = 0; i < TIMED_DRAW_COUNT; ++i)
+			draw();
+
+		query.end();
+
+		return query.waitForResult() / 1000000.0 / TIMED_DRAW_COUNT;
+	}
+
+	void readTarget(QOpenGLFramebufferObject& framebuffer, std::vector<uint8_t>& pixels)
+	{
+		QOpenGLFunctions* functions = QOpenGLContext::currentContext()->functions();
+
+		pixels.resize((size_t)TARGET_WIDTH * TARGET_HEIGHT * 4);
+
+		framebuffer.bind();
+		functions->glReadPixels(0, 0, TARGET_WIDTH, TARGET_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		framebuffer.release();
+	}
+
+	// the single pass rescale, as drawn by the renderer when the separable rescale is disabled
+	bool renderWithBicubic(const QImage& image, const FunctionCase& functionCase, std::vector<uint8_t>& pixels, double& gpuTime)
+	{
+		QOpenGLFunctions* functions = QOpenGLContext::currentContext()->functions();
+
+		QOpenGLFramebufferObject framebuffer(TARGET_WIDTH, TARGET_HEIGHT);
+
+		if (!framebuffer.isValid())
+			return false;
+
+		QOpenGLShaderProgram program;
+
+		if (!ShaderLoader::loadProgram(program, "rescale_bicubic", functionCase.shaderDefines))
+			return false;
+
+		QOpenGLBuffer vertexBuffer;
+		QOpenGLVertexArrayObject vertexArrayObject;
+		createPanelVertices(program, vertexBuffer, vertexArrayObject);
+
+		QOpenGLTexture texture(QOpenGLTexture::Target2D);
+		createPanelTexture(texture, image);
+
+		QMatrix4x4 vertexMatrix = createProjectionMatrix() * createModelMatrix();
+
+		auto draw = [&]()
+		{
+			framebuffer.bind();
+			functions->glViewport(0, 0, TARGET_WIDTH, TARGET_HEIGHT);
+
+			program.bind();
+			program.setUniformValue("vertexMatrix", vertexMatrix);
+			program.setUniformValue("textureSampler", 0);
+			program.setUniformValue("textureWidth", (float)TEXTURE_WIDTH);
+			program.setUniformValue("textureHeight", (float)TEXTURE_HEIGHT);
+			program.setUniformValue("texelWidth", (float)(1.0 / TEXTURE_WIDTH));
+			program.setUniformValue("texelHeight", (float)(1.0 / TEXTURE_HEIGHT));
+
+			vertexArrayObject.bind();
+			texture.bind();
+
+			functions->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+			texture.release();
+			vertexArrayObject.release();
+			program.release();
+			framebuffer.release();
+		};
+
+		gpuTime = measureGpuTime(draw);
+
+		draw();
+		readTarget(framebuffer, pixels);
+
+		return (functions->glGetError() == GL_NO_ERROR);
+	}
+
+	// the horizontal and the vertical pass to the final size and the rotating bilinear step, as in Renderer::resamplePanel and Renderer::renderPanel
+	bool renderWithSeparable(const QImage& image, const FunctionCase& functionCase, std::vector<uint8_t>& pixels, double& gpuTime, double& finalStepGpuTime)
+	{
+		QOpenGLFunctions* functions = QOpenGLContext::currentContext()->functions();
+
+		QMatrix4x4 modelMatrix = createModelMatrix();
+		QMatrix4x4 vertexMatrix = createProjectionMatrix() * modelMatrix;
+
+		double scale = modelMatrix.column(0).toVector3D().length();
+		int resampledWidth = (int)(TEXTURE_WIDTH * scale + 0.5);
+		int resampledHeight = (int)(TEXTURE_HEIGHT * scale + 0.5);
+
+		QOpenGLFramebufferObject framebuffer(TARGET_WIDTH, TARGET_HEIGHT);
+		QOpenGLFramebufferObject horizontalFramebuffer(resampledWidth, TEXTURE_HEIGHT);
+		QOpenGLFramebufferObject verticalFramebuffer(resampledWidth, resampledHeight);
+
+		if (!framebuffer.isValid() || !horizontalFramebuffer.isValid() || !verticalFramebuffer.isValid())
+			return false;
+
+		functions->glBindTexture(GL_TEXTURE_2D, verticalFramebuffer.texture());
+		functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		functions->glBindTexture(GL_TEXTURE_2D, 0);
+
+		QOpenGLShaderProgram resampleProgram;
+		QOpenGLShaderProgram bilinearProgram;
+
+		if (!ShaderLoader::loadProgram(resampleProgram, "resample_separable"))
+			return false;
+
+		if (!ShaderLoader::loadProgram(bilinearProgram, "rescale_default"))
+			return false;
+
+		QOpenGLBuffer quadVertexBuffer;
+		QOpenGLVertexArrayObject quadVertexArrayObject;
+		createQuadVertices(resampleProgram, quadVertexBuffer, quadVertexArrayObject);
+
+		QOpenGLBuffer panelVertexBuffer;
+		QOpenGLVertexArrayObject panelVertexArrayObject;
+		createPanelVertices(bilinearProgram, panelVertexBuffer, panelVertexArrayObject);
+
+		QOpenGLTexture texture(QOpenGLTexture::Target2D);
+		createPanelTexture(texture, image);
+
+		InterpolationFunction function;
+		double lanczosSize;
+		InterpolationFunctions::fromShaderDefines(ShaderLoader::parseDefines(functionCase.shaderDefines), function, lanczosSize);
+
+		std::vector<float> weights = InterpolationFunctions::calculateWeightTable(function, PHASE_COUNT, lanczosSize);
+
+		QOpenGLTexture weightTexture(QOpenGLTexture::Target2D);
+		weightTexture.create();
+		weightTexture.bind();
+		weightTexture.setSize(PHASE_COUNT, 1);
+		weightTexture.setFormat(QOpenGLTexture::RGBA32F);
+		weightTexture.setMinificationFilter(QOpenGLTexture::Linear);
+		weightTexture.setMagnificationFilter(QOpenGLTexture::Linear);
+		weightTexture.setWrapMode(QOpenGLTexture::ClampToEdge);
+		weightTexture.allocateStorage();
+		weightTexture.setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32, weights.data());
+		weightTexture.release();
+
+		auto drawPasses = [&]()
+		{
+			resampleProgram.bind();
+			resampleProgram.setUniformValue("textureSampler", 0);
+			resampleProgram.setUniformValue("weightSampler", 1);
+			resampleProgram.setUniformValue("phaseCount", (float)PHASE_COUNT);
+
+			quadVertexArrayObject.bind();
+			weightTexture.bind(1);
+
+			horizontalFramebuffer.bind();
+			functions->glViewport(0, 0, resampledWidth, TEXTURE_HEIGHT);
+
+			resampleProgram.setUniformValue("textureSize", QVector2D(TEXTURE_WIDTH, TEXTURE_HEIGHT));
+			resampleProgram.setUniformValue("direction", QVector2D(1.0f, 0.0f));
+			texture.bind(0);
+
+			functions->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+			texture.release(0);
+
+			verticalFramebuffer.bind();
+			functions->glViewport(0, 0, resampledWidth, resampledHeight);
+
+			resampleProgram.setUniformValue("textureSize", QVector2D(resampledWidth, TEXTURE_HEIGHT));
+			resampleProgram.setUniformValue("direction", QVector2D(0.0f, 1.0f));
+			functions->glActiveTexture(GL_TEXTURE0);
+			functions->glBindTexture(GL_TEXTURE_2D, horizontalFramebuffer.texture());
+
+			functions->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+			functions->glBindTexture(GL_TEXTURE_2D, 0);
+			verticalFramebuffer.release();
+
+			weightTexture.release(1);
+			functions->glActiveTexture(GL_TEXTURE0);
+			quadVertexArrayObject.release();
+			resampleProgram.release();
+		};
+
+		auto drawFinalStep = [&]()
+		{
+			framebuffer.bind();
+			functions->glViewport(0, 0, TARGET_WIDTH, TARGET_HEIGHT);
+
+			bilinearProgram.bind();
+			bilinearProgram.setUniformValue("vertexMatrix", vertexMatrix);
+			bilinearProgram.setUniformValue("textureSampler", 0);
+
+			panelVertexArrayObject.bind();
+			functions->glActiveTexture(GL_TEXTURE0);
+			functions->glBindTexture(GL_TEXTURE_2D, verticalFramebuffer.texture());
+
+			functions->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+			functions->glBindTexture(GL_TEXTURE_2D, 0);
+			panelVertexArrayObject.release();
+			bilinearProgram.release();
+			framebuffer.release();
+		};
+
+		// a video panel runs both passes every frame, a map panel only the final step until its scale changes
+		gpuTime = measureGpuTime([&]() { drawPasses(); drawFinalStep(); });
+		finalStepGpuTime = measureGpuTime(drawFinalStep);
+
+		drawPasses();
+		drawFinalStep();
+		readTarget(framebuffer, pixels);
+
+		return (functions->glGetError() == GL_NO_ERROR);
+	}
+}
+
+class SeparableRescaleTest : public ::testing::TestWithParam<FunctionCase>
+{
+
+protected:
+
+	static void SetUpTestSuite()
+	{
+		offscreenContext.reset(new OffscreenContext());
+
+		Settings settings;
+		settings.window.multisamples = 0;
+
+		if (!offscreenContext->initialize(&settings))
+			offscreenContext.reset();
+	}
+
+	static void TearDownTestSuite()
+	{
+		offscreenContext.reset();
+	}
+
+	static std::unique_ptr<OffscreenContext> offscreenContext;
+};
+
+std::unique_ptr<OffscreenContext> SeparableRescaleTest::offscreenContext;
+
+TEST_P(SeparableRescaleTest, MatchesBicubicWithinTolerance)
+{
+	if (offscreenContext == nullptr)
+		GTEST_SKIP() << "No OpenGL context available";
+
+	const FunctionCase& functionCase = GetParam();
+	QImage image = createPanelImage();
+
+	std::vector<uint8_t> bicubicPixels;
+	std::vector<uint8_t> separablePixels;
+	double bicubicGpuTime = 0.0;
+	double separableGpuTime = 0.0;
+	double finalStepGpuTime = 0.0;
+
+	ASSERT_TRUE(renderWithBicubic(image, functionCase, bicubicPixels, bicubicGpuTime));
+	ASSERT_TRUE(renderWithSeparable(image, functionCase, separablePixels, separableGpuTime, finalStepGpuTime));
+
+	int maximumError = 0;
+	double totalError = 0.0;
+	size_t sampleCount = 0;
+
+	// the alpha is left out, the rescale shaders write only the color
+	for (size_t i = 0; i < bicubicPixels.size(); i += 4)
+	{
+		for (size_t channel = 0; channel < 3; ++channel)
+		{
+			int error = std::abs((int)bicubicPixels[i + channel] - (int)separablePixels[i + channel]);
+
+			maximumError = std::max(maximumError, error);
+			totalError += error;
+			sampleCount++;
+		}
+	}
+
+	double meanError = totalError / sampleCount;
+
+	EXPECT_LE(maximumError, functionCase.maximumError);
+	EXPECT_LE(meanError, functionCase.meanError);
+
+	RecordProperty("MaximumError", maximumError);
+	RecordProperty("MeanError", QString::number(meanError, 'f', 3).toStdString());
+
+	// the times are only reported, they depend too much on the driver to be checked
+	if (bicubicGpuTime >= 0.0 && separableGpuTime >= 0.0)
+	{
+		RecordProperty("BicubicGpuTime", QString::number(bicubicGpuTime, 'f', 3).toStdString());
+		RecordProperty("SeparableGpuTime", QString::number(separableGpuTime, 'f', 3).toStdString());
+		RecordProperty("SeparableFinalStepGpuTime", QString::number(finalStepGpuTime, 'f', 3).toStdString());
+
+		printf("%s: error max %d mean %.3f, GPU time bicubic %.3f ms, separable %.3f ms (final step %.3f ms)\n", functionCase.shaderDefines, maximumError, meanError, bicubicGpuTime, separableGpuTime, finalStepGpuTime);
+	}
+	else
+		printf("%s: error max %d mean %.3f, no GPU timer queries\n", functionCase.shaderDefines, maximumError, meanError);
+}
+
+INSTANTIATE_TEST_SUITE_P(InterpolationFunctions, SeparableRescaleTest, ::testing::ValuesIn(FUNCTION_CASES));
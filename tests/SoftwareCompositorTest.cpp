@@ -0,0 +1,278 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <QColor>
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <QRect>
+#include <QString>
+
+#include "FrameData.h"
+#include "OffscreenContext.h"
+#include "Settings.h"
+#include "ShaderLoader.h"
+#include "SoftwareCompositor.h"
+
+using namespace OrientView;
+
+namespace
+{
+	const int TARGET_WIDTH = 320;
+	const int TARGET_HEIGHT = 240;
+	const int TEXTURE_SIZE = 256;
+	const double PI = 3.14159265358979;
+
+	struct FilterCase
+	{
+		const char* shaderName;
+		const char* shaderDefines;
+		int maximumError; // largest difference of any color channel, in 8-bit steps
+		double meanError; // average difference over all the color channels
+	};
+
+	void PrintTo(const FilterCase& filterCase, std::ostream* stream)
+	{
+		*stream << filterCase.shaderName << " (" << filterCase.shaderDefines << ")";
+	}
+
+	// the software filters follow the snapping and the weights of each shader, so they all get the same room
+	const FilterCase FILTER_CASES[] =
+	{
+		{ "default", "", 3, 0.5 },
+		{ "bilinear", "", 3, 0.5 },
+		{ "bicubic", "", 3, 0.5 },
+		{ "bicubic", "INTERPOLATION_FUNCTION=catmullrom", 3, 0.5 },
+		{ "bicubic", "INTERPOLATION_FUNCTION=bspline", 3, 0.5 }
+	};
+
+	// smooth enough that any difference comes from the filters, and not from where a hard edge happens to fall
+	QImage createPanelImage()
+	{
+		QImage image(TEXTURE_SIZE, TEXTURE_SIZE, QImage::Format_RGBA8888);
+
+		for (int y = 0; y < TEXTURE_SIZE; ++y)
+		{
+			for (int x = 0; x < TEXTURE_SIZE; ++x)
+			{
+				int red = (int)(128.0 + 100.0 * sin(x * 2.0 * PI / 48.0) + 0.5);
+				int green = (int)(128.0 + 100.0 * cos(y * 2.0 * PI / 40.0) + 0.5);
+				int blue = (x + y) / 2;
+
+				image.setPixel(x, y, qRgba(red, green, blue, 255));
+			}
+		}
+
+		return image;
+	}
+
+	// rotated and magnified like a map panel, and large enough to cover the whole target, so that no panel edge is compared
+	QMatrix4x4 createModelMatrix()
+	{
+		QMatrix4x4 modelMatrix;
+		modelMatrix.rotate(10.0f, 0.0f, 0.0f, 1.0f);
+		modelMatrix.scale(1.7f);
+
+		return modelMatrix;
+	}
+
+	// the same quad, textures and uniforms as the single pass rescale of the renderer, drawn with the flipped projection of the offscreen renderer
+	bool renderWithOpenGL(const QImage& image, const QMatrix4x4& modelMatrix, const FilterCase& filterCase, std::vector<uint8_t>& pixels)
+	{
+		QOpenGLFunctions* functions = QOpenGLContext::currentContext()->functions();
+
+		QOpenGLFramebufferObject framebuffer(TARGET_WIDTH, TARGET_HEIGHT);
+
+		if (!framebuffer.isValid())
+			return false;
+
+		QOpenGLShaderProgram program;
+
+		if (!ShaderLoader::loadProgram(program, QString("rescale_%1").arg(filterCase.shaderName), filterCase.shaderDefines))
+			return false;
+
+		// 1 2
+		// 4 3
+		GLfloat panelBuffer[] =
+		{
+			-(float)image.width() / 2, (float)image.height() / 2, 0.0f, // 1
+			(float)image.width() / 2, (float)image.height() / 2, 0.0f, // 2
+			(float)image.width() / 2, -(float)image.height() / 2, 0.0f, // 3
+			-(float)image.width() / 2, -(float)image.height() / 2, 0.0f, // 4
+
+			0.0f, 0.0f, // 1
+			1.0f, 0.0f, // 2
+			1.0f, 1.0f, // 3
+			0.0f, 1.0f  // 4
+		};
+
+		QOpenGLBuffer vertexBuffer;
+		vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+		vertexBuffer.create();
+		vertexBuffer.bind();
+		vertexBuffer.allocate(panelBuffer, sizeof(GLfloat) * 20);
+
+		QOpenGLVertexArrayObject vertexArrayObject;
+		vertexArrayObject.create();
+		vertexArrayObject.bind();
+
+		program.enableAttributeArray("vertexPosition");
+		program.enableAttributeArray("vertexTextureCoordinate");
+		program.setAttributeBuffer("vertexPosition", GL_FLOAT, 0, 3, 0);
+		program.setAttributeBuffer("vertexTextureCoordinate", GL_FLOAT, sizeof(GLfloat) * 12, 2, 0);
+
+		vertexArrayObject.release();
+		vertexBuffer.release();
+
+		QOpenGLTexture texture(QOpenGLTexture::Target2D);
+		texture.create();
+		texture.bind();
+		texture.setData(image);
+		texture.setMinificationFilter(QOpenGLTexture::Linear);
+		texture.setMagnificationFilter(QOpenGLTexture::Linear);
+		texture.setWrapMode(QOpenGLTexture::ClampToEdge);
+		texture.release();
+
+		QMatrix4x4 projectionMatrix;
+		projectionMatrix.ortho(-TARGET_WIDTH / 2, TARGET_WIDTH / 2, TARGET_HEIGHT / 2, -TARGET_HEIGHT / 2, 0.0f, 1.0f);
+
+		framebuffer.bind();
+
+		functions->glViewport(0, 0, TARGET_WIDTH, TARGET_HEIGHT);
+		functions->glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		functions->glClear(GL_COLOR_BUFFER_BIT);
+
+		program.bind();
+		program.setUniformValue("vertexMatrix", projectionMatrix * modelMatrix);
+		program.setUniformValue("textureSampler", 0);
+		program.setUniformValue("textureWidth", (float)image.width());
+		program.setUniformValue("textureHeight", (float)image.height());
+		program.setUniformValue("texelWidth", (float)(1.0 / image.width()));
+		program.setUniformValue("texelHeight", (float)(1.0 / image.height()));
+
+		vertexArrayObject.bind();
+		texture.bind();
+
+		functions->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+		texture.release();
+		vertexArrayObject.release();
+		program.release();
+
+		// the flipped projection puts the top row first, the same as the software compositor
+		pixels.resize((size_t)TARGET_WIDTH * TARGET_HEIGHT * 4);
+		functions->glReadPixels(0, 0, TARGET_WIDTH, TARGET_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+		framebuffer.release();
+
+		return (functions->glGetError() == GL_NO_ERROR);
+	}
+
+	bool renderWithSoftwareCompositor(const QImage& image, const QMatrix4x4& modelMatrix, const FilterCase& filterCase, std::vector<uint8_t>& pixels)
+	{
+		SoftwareCompositor softwareCompositor;
+
+		if (!softwareCompositor.initialize(image, "default", QString(), filterCase.shaderName, filterCase.shaderDefines, 0))
+			return false;
+
+		pixels.resize((size_t)TARGET_WIDTH * TARGET_HEIGHT * 4);
+
+		FrameData target;
+		target.data = pixels.data();
+		target.width = TARGET_WIDTH;
+		target.height = TARGET_HEIGHT;
+		target.rowLength = (size_t)TARGET_WIDTH * 4;
+		target.dataLength = pixels.size();
+
+		QRect targetArea(0, 0, TARGET_WIDTH, TARGET_HEIGHT);
+
+		softwareCompositor.fill(target, targetArea, QColor(0, 0, 0));
+		softwareCompositor.drawMapPanel(target, targetArea, modelMatrix);
+
+		return true;
+	}
+}
+
+class SoftwareCompositorTest : public ::testing::TestWithParam<FilterCase>
+{
+
+protected:
+
+	static void SetUpTestSuite()
+	{
+		offscreenContext.reset(new OffscreenContext());
+
+		Settings settings;
+		settings.window.multisamples = 0;
+
+		if (!offscreenContext->initialize(&settings))
+			offscreenContext.reset();
+	}
+
+	static void TearDownTestSuite()
+	{
+		offscreenContext.reset();
+	}
+
+	static std::unique_ptr<OffscreenContext> offscreenContext;
+};
+
+std::unique_ptr<OffscreenContext> SoftwareCompositorTest::offscreenContext;
+
+TEST_P(SoftwareCompositorTest, MatchesOpenGLWithinTolerance)
+{
+	if (offscreenContext == nullptr)
+		GTEST_SKIP() << "No OpenGL context available";
+
+	const FilterCase& filterCase = GetParam();
+	QImage image = createPanelImage();
+	QMatrix4x4 modelMatrix = createModelMatrix();
+
+	std::vector<uint8_t> openGLPixels;
+	std::vector<uint8_t> softwarePixels;
+
+	ASSERT_TRUE(renderWithOpenGL(image, modelMatrix, filterCase, openGLPixels));
+	ASSERT_TRUE(renderWithSoftwareCompositor(image, modelMatrix, filterCase, softwarePixels));
+
+	int maximumError = 0;
+	double totalError = 0.0;
+	size_t sampleCount = 0;
+
+	// the alpha is left out, the rescale shaders write only the color
+	for (size_t i = 0; i < openGLPixels.size(); i += 4)
+	{
+		for (size_t channel = 0; channel < 3; ++channel)
+		{
+			int error = std::abs((int)openGLPixels[i + channel] - (int)softwarePixels[i + channel]);
+
+			maximumError = std::max(maximumError, error);
+			totalError += error;
+			sampleCount++;
+		}
+	}
+
+	double meanError = totalError / sampleCount;
+
+	EXPECT_LE(maximumError, filterCase.maximumError);
+	EXPECT_LE(meanError, filterCase.meanError);
+
+	RecordProperty("MaximumError", maximumError);
+	RecordProperty("MeanError", QString::number(meanError, 'f', 3).toStdString());
+}
+
+INSTANTIATE_TEST_SUITE_P(RescaleShaders, SoftwareCompositorTest, ::testing::ValuesIn(FILTER_CASES));
@@ -0,0 +1,23 @@
+// Copyright © 2014 Mikko Ronkainen <firstname@mikkoronkainen.com>
+// License: GPLv3, see the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include <QGuiApplication>
+
+#include "OffscreenContext.h"
+
+using namespace OrientView;
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+
+	// same platform selection as the headless encoder, so that the test runs without a display
+	if (OffscreenContext::shouldUseHeadlessPlatform())
+		OffscreenContext::selectHeadlessPlatform();
+
+	QGuiApplication application(argc, argv);
+
+	return RUN_ALL_TESTS();
+}